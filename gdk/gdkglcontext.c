@@ -93,6 +93,7 @@
 #include "gdk-private.h"
 
 #include <epoxy/gl.h>
+#include <string.h>
 
 typedef struct {
   GdkGLContext *shared_context;
@@ -142,7 +143,7 @@ gdk_gl_context_clear_old_updated_area (GdkGLContext *context)
 {
   int i;
 
-  for (i = 0; i < 2; i++)
+  for (i = 0; i < GDK_GL_MAX_TRACKED_BUFFERS; i++)
     {
       g_clear_pointer (&context->old_updated_area[i], cairo_region_destroy);
     }
@@ -292,6 +293,45 @@ gdk_gl_context_real_get_damage (GdkGLContext *context)
                                         });
 }
 
+/*< private >
+ * gdk_gl_context_get_damage_for_buffer_age:
+ * @context: a #GdkGLContext
+ * @buffer_age: the age of the back buffer, as reported by
+ *   GLX_EXT_buffer_age or EGL_EXT_buffer_age
+ *
+ * Computes the area of the back buffer that is out of date, from the
+ * areas updated in the last frames.
+ *
+ * Returns: (nullable): the damaged area, or %NULL if it is unknown
+ *   and the whole surface needs to be redrawn
+ */
+cairo_region_t *
+gdk_gl_context_get_damage_for_buffer_age (GdkGLContext *context,
+                                          int           buffer_age)
+{
+  cairo_region_t *damage;
+  int i;
+
+  /* 0 means the contents are undefined */
+  if (buffer_age < 1 || buffer_age > GDK_GL_MAX_TRACKED_BUFFERS + 1)
+    return NULL;
+
+  damage = cairo_region_create ();
+
+  for (i = 0; i < buffer_age - 1; i++)
+    {
+      if (context->old_updated_area[i] == NULL)
+        {
+          cairo_region_destroy (damage);
+          return NULL;
+        }
+
+      cairo_region_union (damage, context->old_updated_area[i]);
+    }
+
+  return damage;
+}
+
 static void
 gdk_gl_context_real_begin_frame (GdkDrawContext *draw_context,
                                  cairo_region_t *region)
@@ -311,9 +351,10 @@ gdk_gl_context_real_begin_frame (GdkDrawContext *draw_context,
 
   damage = GDK_GL_CONTEXT_GET_CLASS (context)->get_damage (context);
 
-  if (context->old_updated_area[1])
-    cairo_region_destroy (context->old_updated_area[1]);
-  context->old_updated_area[1] = context->old_updated_area[0];
+  if (context->old_updated_area[GDK_GL_MAX_TRACKED_BUFFERS - 1])
+    cairo_region_destroy (context->old_updated_area[GDK_GL_MAX_TRACKED_BUFFERS - 1]);
+  memmove (&context->old_updated_area[1], &context->old_updated_area[0],
+           sizeof (cairo_region_t *) * (GDK_GL_MAX_TRACKED_BUFFERS - 1));
   context->old_updated_area[0] = cairo_region_copy (region);
 
   cairo_region_union (region, damage);
@@ -32,12 +32,16 @@ G_BEGIN_DECLS
 
 typedef struct _GdkGLContextClass       GdkGLContextClass;
 
+/* Drivers with triple buffering and a compositor holding on to one
+ * more buffer give us buffers of up to this age + 1 */
+#define GDK_GL_MAX_TRACKED_BUFFERS 4
+
 struct _GdkGLContext
 {
   GdkDrawContext parent_instance;
 
   /* We store the old drawn areas to support buffer-age optimizations */
-  cairo_region_t *old_updated_area[2];
+  cairo_region_t *old_updated_area[GDK_GL_MAX_TRACKED_BUFFERS];
 };
 
 struct _GdkGLContextClass
@@ -76,6 +80,8 @@ typedef struct {
   guint use_es : 1;
 } GdkGLContextPaintData;
 
+cairo_region_t *        gdk_gl_context_get_damage_for_buffer_age (GdkGLContext   *context,
+                                                                  int             buffer_age);
 void                    gdk_gl_context_set_is_legacy            (GdkGLContext    *context,
                                                                  gboolean         is_legacy);
 
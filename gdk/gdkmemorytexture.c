@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include "gdkmemorytextureprivate.h"
+#include "gdkparalleltaskprivate.h"
 
 struct _GdkMemoryTexture
 {
@@ -172,7 +173,175 @@ convert_memcpy (guchar       *dest_data,
     memcpy (dest_data + y * dest_stride, src_data + y * src_stride, 4 * width);
 }
 
+/* The converters below first handle as many pixels as possible with
+ * the row functions here, and do the rest byte by byte.
+ *
+ * The 4-byte formats are handled 8 pixels at a time with the GCC/Clang
+ * vector extensions, so the compiler emits SSE2 or NEON instructions.
+ * On x86-64 Linux, the converters are also built for AVX2 and the best
+ * version is selected when the library is loaded. The 3-byte formats
+ * are read 4 pixels at a time as 3 words on little-endian machines.
+ *
+ * All of them give exactly the same result as the byte loops.
+ */
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define BYTE_SHIFT(i) (8 * (i))
+#else
+#define BYTE_SHIFT(i) (24 - 8 * (i))
+#endif
+
+#define CHANNEL(p, i) (((p) >> BYTE_SHIFT (i)) & 0xFF)
+
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 9)
+#define HAVE_VECTOR_CONVERT 1
+#define CONVERT_INLINE inline __attribute__ ((always_inline))
+#else
+#define CONVERT_INLINE inline
+#endif
+
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__) && !defined(__clang__)
+#define CONVERT_TARGET_CLONES __attribute__ ((target_clones ("avx2", "default")))
+#else
+#define CONVERT_TARGET_CLONES
+#endif
+
+#ifdef HAVE_VECTOR_CONVERT
+#define CONVERT_PIXELS 8
+
+typedef guint32 PixelVector __attribute__ ((vector_size (4 * CONVERT_PIXELS)));
+
+static CONVERT_INLINE gsize
+swizzle_row (guchar       *dest,
+             const guchar *src,
+             gsize         width,
+             int           A,
+             int           R,
+             int           G,
+             int           B)
+{
+  PixelVector p, d;
+  gsize x;
+
+  for (x = 0; x + CONVERT_PIXELS <= width; x += CONVERT_PIXELS)
+    {
+      memcpy (&p, src + 4 * x, sizeof (p));
+      d = CHANNEL (p, 0) << BYTE_SHIFT (A) |
+          CHANNEL (p, 1) << BYTE_SHIFT (R) |
+          CHANNEL (p, 2) << BYTE_SHIFT (G) |
+          CHANNEL (p, 3) << BYTE_SHIFT (B);
+      memcpy (dest + 4 * x, &d, sizeof (d));
+    }
+
+  return x;
+}
+
+/* Red and blue are premultiplied together in the two halves of
+ * one word, with the same rounding as PREMULTIPLY() */
+static CONVERT_INLINE gsize
+swizzle_premultiply_row (guchar       *dest,
+                         const guchar *src,
+                         gsize         width,
+                         int           A,
+                         int           R,
+                         int           G,
+                         int           B,
+                         int           A2,
+                         int           R2,
+                         int           G2,
+                         int           B2)
+{
+  PixelVector p, a, rb, g;
+  gsize x;
+
+  for (x = 0; x + CONVERT_PIXELS <= width; x += CONVERT_PIXELS)
+    {
+      memcpy (&p, src + 4 * x, sizeof (p));
+
+      a = CHANNEL (p, A2);
+      rb = (CHANNEL (p, R2) | CHANNEL (p, B2) << 16) * a + 0x00800080;
+      rb = ((((rb >> 8) & 0x00FF00FF) + rb) >> 8) & 0x00FF00FF;
+      g = CHANNEL (p, G2) * a + 0x80;
+      g = ((g >> 8) + g) >> 8;
+
+      p = a << BYTE_SHIFT (A) |
+          (rb & 0xFF) << BYTE_SHIFT (R) |
+          g << BYTE_SHIFT (G) |
+          (rb >> 16) << BYTE_SHIFT (B);
+      memcpy (dest + 4 * x, &p, sizeof (p));
+    }
+
+  return x;
+}
+#else
+static CONVERT_INLINE gsize
+swizzle_row (guchar       *dest,
+             const guchar *src,
+             gsize         width,
+             int           A,
+             int           R,
+             int           G,
+             int           B)
+{
+  return 0;
+}
+
+static CONVERT_INLINE gsize
+swizzle_premultiply_row (guchar       *dest,
+                         const guchar *src,
+                         gsize         width,
+                         int           A,
+                         int           R,
+                         int           G,
+                         int           B,
+                         int           A2,
+                         int           R2,
+                         int           G2,
+                         int           B2)
+{
+  return 0;
+}
+#endif
+
+static CONVERT_INLINE gsize
+swizzle_opaque_row (guchar       *dest,
+                    const guchar *src,
+                    gsize         width,
+                    int           A,
+                    int           R,
+                    int           G,
+                    int           B)
+{
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  guint32 w[3], p[4];
+  gsize x;
+  int i;
+
+  for (x = 0; x + 4 <= width; x += 4)
+    {
+      memcpy (w, src + 3 * x, sizeof (w));
+
+      p[0] = w[0];
+      p[1] = w[0] >> 24 | w[1] << 8;
+      p[2] = w[1] >> 16 | w[2] << 16;
+      p[3] = w[2] >> 8;
+
+      for (i = 0; i < 4; i++)
+        p[i] = 0xFFu << BYTE_SHIFT (A) |
+               CHANNEL (p[i], 0) << BYTE_SHIFT (R) |
+               CHANNEL (p[i], 1) << BYTE_SHIFT (G) |
+               CHANNEL (p[i], 2) << BYTE_SHIFT (B);
+
+      memcpy (dest + 4 * x, p, sizeof (p));
+    }
+
+  return x;
+#else
+  return 0;
+#endif
+}
+
 #define SWIZZLE(A,R,G,B) \
+CONVERT_TARGET_CLONES \
 static void \
 convert_swizzle ## A ## R ## G ## B (guchar       *dest_data, \
                                      gsize         dest_stride, \
@@ -185,7 +354,7 @@ convert_swizzle ## A ## R ## G ## B (guchar       *dest_data, \
 \
   for (y = 0; y < height; y++) \
     { \
-      for (x = 0; x < width; x++) \
+      for (x = swizzle_row (dest_data, src_data, width, A, R, G, B); x < width; x++) \
         { \
           dest_data[4 * x + A] = src_data[4 * x + 0]; \
           dest_data[4 * x + R] = src_data[4 * x + 1]; \
@@ -201,6 +370,7 @@ convert_swizzle ## A ## R ## G ## B (guchar       *dest_data, \
 SWIZZLE(3,2,1,0)
 
 #define SWIZZLE_OPAQUE(A,R,G,B) \
+CONVERT_TARGET_CLONES \
 static void \
 convert_swizzle_opaque_## A ## R ## G ## B (guchar       *dest_data, \
                                             gsize         dest_stride, \
@@ -213,7 +383,7 @@ convert_swizzle_opaque_## A ## R ## G ## B (guchar       *dest_data, \
 \
   for (y = 0; y < height; y++) \
     { \
-      for (x = 0; x < width; x++) \
+      for (x = swizzle_opaque_row (dest_data, src_data, width, A, R, G, B); x < width; x++) \
         { \
           dest_data[4 * x + A] = 0xFF; \
           dest_data[4 * x + R] = src_data[3 * x + 0]; \
@@ -233,6 +403,7 @@ SWIZZLE_OPAQUE(0,3,2,1)
 
 #define PREMULTIPLY(d,c,a) G_STMT_START { guint t = c * a + 0x80; d = ((t >> 8) + t) >> 8; } G_STMT_END
 #define SWIZZLE_PREMULTIPLY(A,R,G,B, A2,R2,G2,B2) \
+CONVERT_TARGET_CLONES \
 static void \
 convert_swizzle_premultiply_ ## A ## R ## G ## B ## _ ## A2 ## R2 ## G2 ## B2 \
                                     (guchar       *dest_data, \
@@ -246,7 +417,8 @@ convert_swizzle_premultiply_ ## A ## R ## G ## B ## _ ## A2 ## R2 ## G2 ## B2 \
 \
   for (y = 0; y < height; y++) \
     { \
-      for (x = 0; x < width; x++) \
+      for (x = swizzle_premultiply_row (dest_data, src_data, width, A, R, G, B, A2, R2, G2, B2); \
+           x < width; x++) \
         { \
           dest_data[4 * x + A] = src_data[4 * x + A2]; \
           PREMULTIPLY(dest_data[4 * x + R], src_data[4 * x + R2], src_data[4 * x + A2]); \
@@ -287,6 +459,35 @@ static ConversionFunc converters[GDK_MEMORY_N_FORMATS][2] =
   { convert_swizzle_opaque_3012, convert_swizzle_opaque_0321 }
 };
 
+/* Images with more pixels than this are converted by several
+ * threads, each taking a range of rows */
+#define PARALLEL_CONVERT_PIXELS (512 * 512)
+
+typedef struct
+{
+  ConversionFunc func;
+  guchar *dest_data;
+  gsize dest_stride;
+  const guchar *src_data;
+  gsize src_stride;
+  gsize width;
+  gsize height;
+  gsize rows;
+} ConvertJob;
+
+static void
+convert_task (gpointer data,
+              guint    index,
+              guint    n_tasks)
+{
+  ConvertJob *job = data;
+  gsize y = index * job->rows;
+
+  job->func (job->dest_data + y * job->dest_stride, job->dest_stride,
+             job->src_data + y * job->src_stride, job->src_stride,
+             job->width, MIN (job->rows, job->height - y));
+}
+
 void
 gdk_memory_convert (guchar          *dest_data,
                     gsize            dest_stride,
@@ -297,8 +498,33 @@ gdk_memory_convert (guchar          *dest_data,
                     gsize            width,
                     gsize            height)
 {
+  ConversionFunc func;
+  ConvertJob job;
+  guint n_tasks;
+
   g_assert (dest_format < 2);
   g_assert (src_format < GDK_MEMORY_N_FORMATS);
 
-  converters[src_format][dest_format] (dest_data, dest_stride, src_data, src_stride, width, height);
+  func = converters[src_format][dest_format];
+
+  n_tasks = 1;
+  if (width * height >= PARALLEL_CONVERT_PIXELS)
+    n_tasks = MIN (gdk_parallel_task_get_max_tasks (), height);
+
+  if (n_tasks < 2)
+    {
+      func (dest_data, dest_stride, src_data, src_stride, width, height);
+      return;
+    }
+
+  job = (ConvertJob) {
+    func,
+    dest_data, dest_stride,
+    src_data, src_stride,
+    width, height,
+    (height + n_tasks - 1) / n_tasks
+  };
+  n_tasks = (height + job.rows - 1) / job.rows;
+
+  gdk_parallel_task_run (convert_task, &job, n_tasks);
 }
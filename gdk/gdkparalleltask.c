@@ -0,0 +1,148 @@
+/* GDK - The GIMP Drawing Kit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gdkparalleltaskprivate.h"
+
+typedef struct
+{
+  GdkTaskFunc func;
+  gpointer data;
+  guint n_tasks;
+
+  GMutex lock;
+  GCond cond;
+  guint pending;
+} GdkParallelJob;
+
+typedef struct
+{
+  GdkParallelJob *job;
+  guint index;
+} GdkParallelTask;
+
+static void
+gdk_parallel_task_thread (gpointer data,
+                          gpointer user_data)
+{
+  GdkParallelTask *task = data;
+  GdkParallelJob *job = task->job;
+
+  job->func (job->data, task->index, job->n_tasks);
+
+  g_mutex_lock (&job->lock);
+  job->pending--;
+  if (job->pending == 0)
+    g_cond_signal (&job->cond);
+  g_mutex_unlock (&job->lock);
+}
+
+static GThreadPool *
+get_pool (void)
+{
+  static GThreadPool *pool;
+
+  if (g_once_init_enter (&pool))
+    {
+      GThreadPool *new_pool = NULL;
+
+      if (g_get_num_processors () > 1)
+        new_pool = g_thread_pool_new (gdk_parallel_task_thread, NULL,
+                                      g_get_num_processors (), FALSE,
+                                      NULL);
+
+      g_once_init_leave (&pool, new_pool ? new_pool : GINT_TO_POINTER (1));
+    }
+
+  return pool == GINT_TO_POINTER (1) ? NULL : pool;
+}
+
+/*< private >
+ * gdk_parallel_task_get_max_tasks:
+ *
+ * Gets the number of tasks that gdk_parallel_task_run() can run at
+ * the same time. Callers should split their work into at most this
+ * many tasks.
+ *
+ * Returns: the number of tasks, 1 if there is only one processor
+ */
+guint
+gdk_parallel_task_get_max_tasks (void)
+{
+  if (get_pool () == NULL)
+    return 1;
+
+  return g_get_num_processors ();
+}
+
+/*< private >
+ * gdk_parallel_task_run:
+ * @task_func: the function to run
+ * @task_data: data to pass to @task_func
+ * @n_tasks: the number of tasks
+ *
+ * Calls @task_func once for every index from 0 to @n_tasks - 1, on
+ * the threads of a pool shared by all users, and waits until all
+ * calls have returned. The calling thread runs one of the tasks
+ * itself.
+ *
+ * @task_func must not call gdk_parallel_task_run() again.
+ */
+void
+gdk_parallel_task_run (GdkTaskFunc task_func,
+                       gpointer    task_data,
+                       guint       n_tasks)
+{
+  GThreadPool *pool;
+  GdkParallelTask *tasks;
+  GdkParallelJob job;
+  guint i;
+
+  pool = get_pool ();
+
+  if (pool == NULL || n_tasks < 2)
+    {
+      for (i = 0; i < n_tasks; i++)
+        task_func (task_data, i, n_tasks);
+      return;
+    }
+
+  job.func = task_func;
+  job.data = task_data;
+  job.n_tasks = n_tasks;
+  g_mutex_init (&job.lock);
+  g_cond_init (&job.cond);
+  job.pending = n_tasks - 1;
+
+  tasks = g_new (GdkParallelTask, n_tasks - 1);
+  for (i = 1; i < n_tasks; i++)
+    {
+      tasks[i - 1] = (GdkParallelTask) { &job, i };
+      g_thread_pool_push (pool, &tasks[i - 1], NULL);
+    }
+
+  task_func (task_data, 0, n_tasks);
+
+  g_mutex_lock (&job.lock);
+  while (job.pending > 0)
+    g_cond_wait (&job.cond, &job.lock);
+  g_mutex_unlock (&job.lock);
+
+  g_mutex_clear (&job.lock);
+  g_cond_clear (&job.cond);
+  g_free (tasks);
+}
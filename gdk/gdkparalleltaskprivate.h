@@ -0,0 +1,37 @@
+/* GDK - The GIMP Drawing Kit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GDK_PARALLEL_TASK_PRIVATE_H__
+#define __GDK_PARALLEL_TASK_PRIVATE_H__
+
+#include <gdk/gdk.h>
+
+G_BEGIN_DECLS
+
+typedef void (* GdkTaskFunc) (gpointer task_data,
+                              guint    index,
+                              guint    n_tasks);
+
+GDK_AVAILABLE_IN_ALL
+guint           gdk_parallel_task_get_max_tasks (void);
+GDK_AVAILABLE_IN_ALL
+void            gdk_parallel_task_run           (GdkTaskFunc  task_func,
+                                                 gpointer     task_data,
+                                                 guint        n_tasks);
+
+G_END_DECLS
+
+#endif /* __GDK_PARALLEL_TASK_PRIVATE_H__ */
@@ -170,6 +170,7 @@ gdk_wayland_gl_context_get_damage (GdkGLContext *context)
   EGLSurface egl_surface;
   GdkSurface *surface = gdk_draw_context_get_surface (GDK_DRAW_CONTEXT (context));
   int buffer_age = 0;
+  cairo_region_t *damage;
 
   if (display_wayland->have_egl_buffer_age)
     {
@@ -187,30 +188,9 @@ gdk_wayland_gl_context_get_damage (GdkGLContext *context)
       eglQuerySurface (display_wayland->egl_display, egl_surface,
                        EGL_BUFFER_AGE_EXT, &buffer_age);
 
-      switch (buffer_age)
-        {
-          case 1:
-            return cairo_region_create ();
-            break;
-
-          case 2:
-            if (context->old_updated_area[0])
-              return cairo_region_copy (context->old_updated_area[0]);
-            break;
-
-          case 3:
-            if (context->old_updated_area[0] &&
-                context->old_updated_area[1])
-              {
-                cairo_region_t *damage = cairo_region_copy (context->old_updated_area[0]);
-                cairo_region_union (damage, context->old_updated_area[1]);
-                return damage;
-              }
-            break;
-
-          default:
-            ;
-        }
+      damage = gdk_gl_context_get_damage_for_buffer_age (context, buffer_age);
+      if (damage != NULL)
+        return damage;
     }
 
   return GDK_GL_CONTEXT_CLASS (gdk_wayland_gl_context_parent_class)->get_damage (context);
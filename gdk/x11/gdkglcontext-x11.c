@@ -196,6 +196,7 @@ gdk_x11_gl_context_get_damage (GdkGLContext *context)
   GdkX11Display *display_x11 = GDK_X11_DISPLAY (display);
   Display *dpy = gdk_x11_display_get_xdisplay (display);
   unsigned int buffer_age = 0;
+  cairo_region_t *damage;
 
   if (display_x11->has_glx_buffer_age)
     {
@@ -211,30 +212,9 @@ gdk_x11_gl_context_get_damage (GdkGLContext *context)
       glXQueryDrawable (dpy, shared_x11->attached_drawable,
                         GLX_BACK_BUFFER_AGE_EXT, &buffer_age);
 
-      switch (buffer_age)
-        {
-          case 1:
-            return cairo_region_create ();
-            break;
-
-          case 2:
-            if (context->old_updated_area[0])
-              return cairo_region_copy (context->old_updated_area[0]);
-            break;
-
-          case 3:
-            if (context->old_updated_area[0] &&
-                context->old_updated_area[1])
-              {
-                cairo_region_t *damage = cairo_region_copy (context->old_updated_area[0]);
-                cairo_region_union (damage, context->old_updated_area[1]);
-                return damage;
-              }
-            break;
-
-          default:
-            ;
-        }
+      damage = gdk_gl_context_get_damage_for_buffer_age (context, buffer_age);
+      if (damage != NULL)
+        return damage;
 
     }
 
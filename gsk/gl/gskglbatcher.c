@@ -0,0 +1,477 @@
+#include "config.h"
+
+#include "gskglbatcherprivate.h"
+
+#include <string.h>
+
+/* How many batches we look at when trying to move a draw up to
+ * an earlier one using the same program and texture. */
+#define MAX_LOOKBACK 128
+
+/* A single OP_DRAW or OP_DRAW_INSTANCED, along with the state changes
+ * for its program that happened since the last draw using that program. */
+typedef struct
+{
+  const Program *program;
+  int texture_id; /* 0 if the program doesn't sample a source texture */
+  guint first_op; /* Into batch_ops */
+  guint n_ops;
+  OpKind draw_kind;
+  gsize offset; /* In vertices or instances, depending on draw_kind */
+  gsize size;
+  graphene_rect_t bounds;
+} Batch;
+
+typedef struct
+{
+  guint op;
+  const Program *program;
+} PendingOp;
+
+typedef struct
+{
+  const OpBuffer *ops;
+  const GArray *vertices;
+  const GArray *instances;
+} Source;
+
+typedef struct
+{
+  const Program *program;
+  int texture_id;
+} Output;
+
+static inline gconstpointer
+source_get_op (const Source *source,
+               guint         i,
+               OpKind       *kind)
+{
+  const OpBufferEntry *entry = &g_array_index (source->ops->index, OpBufferEntry, i);
+
+  *kind = entry->kind;
+  return &source->ops->buf[entry->pos];
+}
+
+static int
+compare_pending_ops (gconstpointer a,
+                     gconstpointer b)
+{
+  const PendingOp *pa = a;
+  const PendingOp *pb = b;
+
+  return (int) pa->op - (int) pb->op;
+}
+
+void
+gsk_gl_batcher_init (GskGLBatcher *self)
+{
+  guint i;
+
+  memset (self, 0, sizeof (*self));
+
+  op_buffer_init (&self->ops);
+  self->vertices = g_array_new (FALSE, TRUE, sizeof (GskQuadVertex));
+  self->instances = g_array_new (FALSE, TRUE, sizeof (GskGLInstance));
+  self->batches = g_array_new (FALSE, FALSE, sizeof (Batch));
+  self->batch_ops = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->order = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->flush = g_array_new (FALSE, FALSE, sizeof (PendingOp));
+
+  for (i = 0; i < GL_N_PROGRAMS; i ++)
+    self->pending[i] = g_array_new (FALSE, FALSE, sizeof (PendingOp));
+}
+
+void
+gsk_gl_batcher_free (GskGLBatcher *self)
+{
+  guint i;
+
+  op_buffer_destroy (&self->ops);
+  g_array_unref (self->vertices);
+  g_array_unref (self->instances);
+  g_array_unref (self->batches);
+  g_array_unref (self->batch_ops);
+  g_array_unref (self->order);
+  g_array_unref (self->flush);
+
+  for (i = 0; i < GL_N_PROGRAMS; i ++)
+    g_array_unref (self->pending[i]);
+}
+
+/* The program state is only sent when it changes, so remember what
+ * every program's modelview is before we start adding ops. */
+void
+gsk_gl_batcher_begin_frame (GskGLBatcher                *self,
+                            const GskGLRendererPrograms *programs)
+{
+  guint i;
+
+  for (i = 0; i < GL_N_PROGRAMS; i ++)
+    {
+      if (programs->state[i].modelview != NULL)
+        gsk_transform_to_matrix (programs->state[i].modelview, &self->modelviews[i]);
+      else
+        graphene_matrix_init_identity (&self->modelviews[i]);
+    }
+}
+
+static inline void
+emit_program (GskGLBatcher  *self,
+              Output        *out,
+              const Program *program)
+{
+  OpProgram *op;
+
+  if (out->program == program)
+    return;
+
+  op = op_buffer_add (&self->ops, OP_CHANGE_PROGRAM);
+  op->program = program;
+  out->program = program;
+}
+
+static inline void
+emit_draw (GskGLBatcher *self,
+           const Source *source,
+           gsize         vao_offset,
+           gsize         vao_size)
+{
+  OpDraw *op;
+
+  if ((op = op_buffer_peek_tail_checked (&self->ops, OP_DRAW)))
+    {
+      op->vao_size += vao_size;
+    }
+  else
+    {
+      op = op_buffer_add (&self->ops, OP_DRAW);
+      op->vao_offset = self->vertices->len;
+      op->vao_size = vao_size;
+      self->n_draws_after ++;
+    }
+
+  g_array_append_vals (self->vertices,
+                       &g_array_index (source->vertices, GskQuadVertex, vao_offset),
+                       vao_size);
+}
+
+static inline void
+emit_draw_instanced (GskGLBatcher *self,
+                     const Source *source,
+                     gsize         instance_offset,
+                     gsize         n_instances)
+{
+  OpDrawInstanced *op;
+
+  if ((op = op_buffer_peek_tail_checked (&self->ops, OP_DRAW_INSTANCED)))
+    {
+      op->n_instances += n_instances;
+    }
+  else
+    {
+      op = op_buffer_add (&self->ops, OP_DRAW_INSTANCED);
+      op->instance_offset = self->instances->len;
+      op->n_instances = n_instances;
+      self->n_draws_after ++;
+    }
+
+  g_array_append_vals (self->instances,
+                       &g_array_index (source->instances, GskGLInstance, instance_offset),
+                       n_instances);
+}
+
+static void
+compute_bounds (const GskQuadVertex     *vertices,
+                gsize                    n_vertices,
+                const graphene_matrix_t *modelview,
+                graphene_rect_t         *out_bounds)
+{
+  float min_x = vertices[0].position[0];
+  float min_y = vertices[0].position[1];
+  float max_x = min_x;
+  float max_y = min_y;
+  gsize i;
+
+  for (i = 1; i < n_vertices; i ++)
+    {
+      min_x = MIN (min_x, vertices[i].position[0]);
+      min_y = MIN (min_y, vertices[i].position[1]);
+      max_x = MAX (max_x, vertices[i].position[0]);
+      max_y = MAX (max_y, vertices[i].position[1]);
+    }
+
+  graphene_matrix_transform_bounds (modelview,
+                                    &GRAPHENE_RECT_INIT (min_x, min_y, max_x - min_x, max_y - min_y),
+                                    out_bounds);
+}
+
+static void
+compute_instance_bounds (const GskGLInstance     *instances,
+                         gsize                    n_instances,
+                         const graphene_matrix_t *modelview,
+                         graphene_rect_t         *out_bounds)
+{
+  graphene_rect_t bounds;
+  gsize i;
+
+  graphene_rect_init (&bounds, instances[0].rect[0], instances[0].rect[1],
+                      instances[0].rect[2], instances[0].rect[3]);
+
+  for (i = 1; i < n_instances; i ++)
+    graphene_rect_union (&bounds,
+                         &GRAPHENE_RECT_INIT (instances[i].rect[0], instances[i].rect[1],
+                                              instances[i].rect[2], instances[i].rect[3]),
+                         &bounds);
+
+  graphene_matrix_transform_bounds (modelview, &bounds, out_bounds);
+}
+
+/* Move the batch up to the last one with the same program, if it uses
+ * the same texture and doesn't overlap anything it would jump over.
+ * Batches with the same program are never reordered among each other,
+ * so the uniform changes of every program stay in order. */
+static void
+insert_batch (GskGLBatcher *self,
+              guint         batch_index)
+{
+  const Batch *batch = &g_array_index (self->batches, Batch, batch_index);
+  const guint n = self->order->len;
+  const guint limit = n > MAX_LOOKBACK ? n - MAX_LOOKBACK : 0;
+  guint i;
+
+  for (i = n; i > limit; i --)
+    {
+      const guint other_index = g_array_index (self->order, guint, i - 1);
+      const Batch *other = &g_array_index (self->batches, Batch, other_index);
+
+      if (other->program == batch->program)
+        {
+          if (other->texture_id == batch->texture_id)
+            {
+              g_array_insert_val (self->order, i, batch_index);
+              return;
+            }
+
+          break;
+        }
+
+      if (graphene_rect_intersection (&other->bounds, &batch->bounds, NULL))
+        break;
+    }
+
+  g_array_append_val (self->order, batch_index);
+}
+
+static void
+add_batch (GskGLBatcher  *self,
+           const Source  *source,
+           OpKind         kind,
+           gconstpointer  op,
+           const Program *program,
+           int            texture_id)
+{
+  GArray *pending = self->pending[program->index];
+  Batch *batch;
+  guint i;
+
+  g_array_set_size (self->batches, self->batches->len + 1);
+  batch = &g_array_index (self->batches, Batch, self->batches->len - 1);
+
+  batch->program = program;
+  batch->texture_id = program->source_location == -1 ? 0 : texture_id;
+  batch->first_op = self->batch_ops->len;
+  batch->n_ops = pending->len;
+  batch->draw_kind = kind;
+
+  for (i = 0; i < pending->len; i ++)
+    g_array_append_val (self->batch_ops, g_array_index (pending, PendingOp, i).op);
+  g_array_set_size (pending, 0);
+
+  if (kind == OP_DRAW_INSTANCED)
+    {
+      const OpDrawInstanced *draw = op;
+
+      batch->offset = draw->instance_offset;
+      batch->size = draw->n_instances;
+      compute_instance_bounds (&g_array_index (source->instances, GskGLInstance, batch->offset),
+                               batch->size,
+                               &self->modelviews[program->index],
+                               &batch->bounds);
+    }
+  else
+    {
+      const OpDraw *draw = op;
+
+      batch->offset = draw->vao_offset;
+      batch->size = draw->vao_size;
+      compute_bounds (&g_array_index (source->vertices, GskQuadVertex, batch->offset),
+                      batch->size,
+                      &self->modelviews[program->index],
+                      &batch->bounds);
+    }
+
+  insert_batch (self, self->batches->len - 1);
+}
+
+static void
+flush_segment (GskGLBatcher *self,
+               const Source *source,
+               Output       *out)
+{
+  OpKind kind;
+  guint i, j;
+
+  for (i = 0; i < self->order->len; i ++)
+    {
+      const Batch *batch = &g_array_index (self->batches, Batch,
+                                           g_array_index (self->order, guint, i));
+
+      emit_program (self, out, batch->program);
+
+      if (batch->texture_id != 0 && batch->texture_id != out->texture_id)
+        {
+          OpTexture *op = op_buffer_add (&self->ops, OP_CHANGE_SOURCE_TEXTURE);
+
+          op->texture_id = batch->texture_id;
+          out->texture_id = batch->texture_id;
+        }
+
+      for (j = 0; j < batch->n_ops; j ++)
+        {
+          const guint op_index = g_array_index (self->batch_ops, guint, batch->first_op + j);
+          gconstpointer ptr = source_get_op (source, op_index, &kind);
+
+          op_buffer_add_copy (&self->ops, kind, ptr);
+        }
+
+      if (batch->draw_kind == OP_DRAW_INSTANCED)
+        emit_draw_instanced (self, source, batch->offset, batch->size);
+      else
+        emit_draw (self, source, batch->offset, batch->size);
+    }
+
+  g_array_set_size (self->order, 0);
+  g_array_set_size (self->batches, 0);
+  g_array_set_size (self->batch_ops, 0);
+
+  /* State changes that were not followed by a draw of their program
+   * still need to be applied, in their original order. */
+  for (i = 0; i < GL_N_PROGRAMS; i ++)
+    {
+      g_array_append_vals (self->flush, self->pending[i]->data, self->pending[i]->len);
+      g_array_set_size (self->pending[i], 0);
+    }
+
+  g_array_sort (self->flush, compare_pending_ops);
+
+  for (i = 0; i < self->flush->len; i ++)
+    {
+      const PendingOp *pending = &g_array_index (self->flush, PendingOp, i);
+      gconstpointer ptr = source_get_op (source, pending->op, &kind);
+
+      emit_program (self, out, pending->program);
+      op_buffer_add_copy (&self->ops, kind, ptr);
+    }
+
+  g_array_set_size (self->flush, 0);
+}
+
+void
+gsk_gl_batcher_process (GskGLBatcher    *self,
+                        RenderOpBuilder *builder)
+{
+  const Source source = { &builder->render_ops, builder->vertices, builder->instances };
+  const Program *program = NULL;
+  Output out = { NULL, 0 };
+  int texture_id = 0;
+  guint i;
+
+  op_buffer_clear (&self->ops);
+  g_array_set_size (self->vertices, 0);
+  g_array_set_size (self->instances, 0);
+  self->n_draws_before = 0;
+  self->n_draws_after = 0;
+
+  for (i = 1; i < builder->render_ops.index->len; i ++)
+    {
+      OpKind kind;
+      gconstpointer ptr = source_get_op (&source, i, &kind);
+
+      switch (kind)
+        {
+        case OP_NONE:
+          break;
+
+        case OP_CHANGE_PROGRAM:
+          program = ((const OpProgram *) ptr)->program;
+          break;
+
+        case OP_CHANGE_SOURCE_TEXTURE:
+          texture_id = ((const OpTexture *) ptr)->texture_id;
+          break;
+
+        case OP_CHANGE_RENDER_TARGET:
+        case OP_CHANGE_SCISSOR:
+        case OP_CHANGE_STENCIL:
+        case OP_CLEAR:
+        case OP_DUMP_FRAMEBUFFER:
+        case OP_PUSH_DEBUG_GROUP:
+        case OP_POP_DEBUG_GROUP:
+          flush_segment (self, &source, &out);
+          op_buffer_add_copy (&self->ops, kind, ptr);
+          break;
+
+        case OP_CHANGE_VIEWPORT:
+          /* This also changes the global glViewport, so nothing can
+           * be moved across it. */
+          if (program == NULL)
+            break;
+
+          flush_segment (self, &source, &out);
+          emit_program (self, &out, program);
+          op_buffer_add_copy (&self->ops, kind, ptr);
+          break;
+
+        case OP_DRAW:
+        case OP_DRAW_INSTANCED:
+          if (program == NULL)
+            break;
+
+          self->n_draws_before ++;
+          add_batch (self, &source, kind, ptr, program, texture_id);
+          break;
+
+        case OP_LAST:
+          g_assert_not_reached ();
+
+        default:
+          /* Everything else only changes uniforms of the current program */
+          if (program == NULL)
+            break;
+
+          if (kind == OP_CHANGE_MODELVIEW)
+            self->modelviews[program->index] = ((const OpMatrix *) ptr)->matrix;
+
+          g_array_append_val (self->pending[program->index],
+                              ((PendingOp) { i, program }));
+          break;
+        }
+    }
+
+  flush_segment (self, &source, &out);
+
+  /* Hand the reordered ops to the builder and keep the old buffers
+   * around for the next frame. */
+  {
+    OpBuffer tmp_ops = builder->render_ops;
+    GArray *tmp_vertices = builder->vertices;
+    GArray *tmp_instances = builder->instances;
+
+    builder->render_ops = self->ops;
+    builder->vertices = self->vertices;
+    builder->instances = self->instances;
+    self->ops = tmp_ops;
+    self->vertices = tmp_vertices;
+    self->instances = tmp_instances;
+  }
+}
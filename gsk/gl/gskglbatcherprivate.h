@@ -0,0 +1,40 @@
+#ifndef __GSK_GL_BATCHER_PRIVATE_H__
+#define __GSK_GL_BATCHER_PRIVATE_H__
+
+#include <glib.h>
+#include <graphene.h>
+
+#include "gskglrenderopsprivate.h"
+#include "opbuffer.h"
+
+/* Reorders and merges the draws recorded in a RenderOpBuilder so that
+ * draws using the same program and source texture end up next to each
+ * other, as long as that doesn't change the result. */
+typedef struct
+{
+  /* Output, swapped with the builder's buffers after processing */
+  OpBuffer ops;
+  GArray *vertices;
+  GArray *instances;
+
+  GArray *batches;
+  GArray *batch_ops;
+  GArray *order;
+  GArray *pending[GL_N_PROGRAMS];
+  GArray *flush;
+
+  /* Modelview of every program when building the ops started */
+  graphene_matrix_t modelviews[GL_N_PROGRAMS];
+
+  guint n_draws_before;
+  guint n_draws_after;
+} GskGLBatcher;
+
+void gsk_gl_batcher_init        (GskGLBatcher                *self);
+void gsk_gl_batcher_free        (GskGLBatcher                *self);
+void gsk_gl_batcher_begin_frame (GskGLBatcher                *self,
+                                 const GskGLRendererPrograms *programs);
+void gsk_gl_batcher_process     (GskGLBatcher                *self,
+                                 RenderOpBuilder             *builder);
+
+#endif
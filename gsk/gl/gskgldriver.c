@@ -47,7 +47,6 @@ struct _GskGLDriver
   Fbo default_fbo;
 
   GHashTable *textures;         /* texture_id -> Texture */
-  GHashTable *pointer_textures; /* pointer -> texture_id */
 
   const Texture *bound_source_texture;
 
@@ -120,7 +119,6 @@ gsk_gl_driver_finalize (GObject *gobject)
   gdk_gl_context_make_current (self->gl_context);
 
   g_clear_pointer (&self->textures, g_hash_table_unref);
-  g_clear_pointer (&self->pointer_textures, g_hash_table_unref);
   g_clear_object (&self->profiler);
 
   if (self->gl_context == gdk_gl_context_get_current ())
@@ -266,29 +264,11 @@ gsk_gl_driver_collect_textures (GskGLDriver *self)
             {
               fbo_clear (&t->fbo);
               t->fbo.fbo_id = 0;
+              t->fbo.depth_stencil_id = 0;
             }
         }
       else
         {
-          /* Remove from self->pointer_textures. */
-          /* TODO: Is there a better way for this? */
-          if (self->pointer_textures)
-            {
-              GHashTableIter pointer_iter;
-              gpointer value;
-              gpointer p;
-
-              g_hash_table_iter_init (&pointer_iter, self->pointer_textures);
-              while (g_hash_table_iter_next (&pointer_iter, &p, &value))
-                {
-                  if (GPOINTER_TO_INT (value) == t->texture_id)
-                    {
-                      g_hash_table_iter_remove (&pointer_iter);
-                      break;
-                    }
-                }
-            }
-
           g_hash_table_iter_remove (&iter);
         }
     }
@@ -541,41 +521,6 @@ gsk_gl_driver_get_texture_for_texture (GskGLDriver *self,
   return t->texture_id;
 }
 
-int
-gsk_gl_driver_get_texture_for_pointer (GskGLDriver *self,
-                                       gpointer     pointer)
-{
-  int id = 0;
-
-  if (G_UNLIKELY (self->pointer_textures == NULL))
-    self->pointer_textures = g_hash_table_new (NULL, NULL);
-
-  id = GPOINTER_TO_INT (g_hash_table_lookup (self->pointer_textures, pointer));
-
-  if (id != 0)
-    {
-      Texture *t;
-
-      t = g_hash_table_lookup (self->textures, GINT_TO_POINTER (id));
-
-      if (t != NULL)
-        t->in_use = TRUE;
-    }
-
-  return id;
-}
-
-void
-gsk_gl_driver_set_texture_for_pointer (GskGLDriver *self,
-                                       gpointer     pointer,
-                                       int          texture_id)
-{
-  if (G_UNLIKELY (self->pointer_textures == NULL))
-    self->pointer_textures = g_hash_table_new (NULL, NULL);
-
-  g_hash_table_insert (self->pointer_textures, pointer, GINT_TO_POINTER (texture_id));
-}
-
 int
 gsk_gl_driver_create_texture (GskGLDriver *self,
                               float        width,
@@ -650,6 +595,66 @@ gsk_gl_driver_create_render_target (GskGLDriver *self,
   *out_render_target_id = fbo_id;
 }
 
+/* Attaches a stencil buffer to a render target created with
+ * gsk_gl_driver_create_render_target(), if it doesn't have one yet.
+ * Returns FALSE if @render_target_id is not one of ours or the
+ * stencil buffer can't be used with it. */
+gboolean
+gsk_gl_driver_ensure_stencil_buffer (GskGLDriver *self,
+                                     int          render_target_id)
+{
+  GHashTableIter iter;
+  gpointer value_p = NULL;
+  Texture *t = NULL;
+  GLenum status;
+
+  g_return_val_if_fail (GSK_IS_GL_DRIVER (self), FALSE);
+  g_return_val_if_fail (self->in_frame, FALSE);
+
+  if (render_target_id == 0)
+    return FALSE;
+
+  g_hash_table_iter_init (&iter, self->textures);
+  while (g_hash_table_iter_next (&iter, NULL, &value_p))
+    {
+      if (((Texture *) value_p)->fbo.fbo_id == render_target_id)
+        {
+          t = value_p;
+          break;
+        }
+    }
+
+  if (t == NULL)
+    return FALSE;
+
+  if (t->fbo.depth_stencil_id != 0)
+    return TRUE;
+
+  glGenRenderbuffers (1, &t->fbo.depth_stencil_id);
+  gdk_gl_context_label_object_printf (self->gl_context, GL_RENDERBUFFER, t->fbo.depth_stencil_id,
+                                      "Stencil buffer for %d", t->texture_id);
+  glBindRenderbuffer (GL_RENDERBUFFER, t->fbo.depth_stencil_id);
+  glRenderbufferStorage (GL_RENDERBUFFER, GL_STENCIL_INDEX8, t->width, t->height);
+
+  glBindFramebuffer (GL_FRAMEBUFFER, t->fbo.fbo_id);
+  glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT,
+                             GL_RENDERBUFFER, t->fbo.depth_stencil_id);
+  status = glCheckFramebufferStatus (GL_FRAMEBUFFER);
+
+  if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+      /* Some implementations only support packed depth/stencil */
+      glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, 0);
+      glDeleteRenderbuffers (1, &t->fbo.depth_stencil_id);
+      t->fbo.depth_stencil_id = 0;
+    }
+
+  glBindRenderbuffer (GL_RENDERBUFFER, 0);
+  glBindFramebuffer (GL_FRAMEBUFFER, self->default_fbo.fbo_id);
+
+  return t->fbo.depth_stencil_id != 0;
+}
+
 /* Mark the texture permanent, meaning it won'e be reused by the GLDriver.
  * E.g. to store it in some other cache. */
 void
@@ -34,11 +34,6 @@ int             gsk_gl_driver_get_texture_for_texture   (GskGLDriver     *driver
                                                          GdkTexture      *texture,
                                                          int              min_filter,
                                                          int              mag_filter);
-int             gsk_gl_driver_get_texture_for_pointer   (GskGLDriver     *driver,
-                                                         gpointer         pointer);
-void            gsk_gl_driver_set_texture_for_pointer   (GskGLDriver     *driver,
-                                                         gpointer         pointer,
-                                                         int              texture_id);
 int             gsk_gl_driver_create_texture            (GskGLDriver     *driver,
                                                          float            width,
                                                          float            height);
@@ -47,6 +42,8 @@ void            gsk_gl_driver_create_render_target      (GskGLDriver     *driver
                                                          int              height,
                                                          int             *out_texture_id,
                                                          int             *out_render_target_id);
+gboolean        gsk_gl_driver_ensure_stencil_buffer     (GskGLDriver     *self,
+                                                         int              render_target_id);
 void            gsk_gl_driver_mark_texture_permanent    (GskGLDriver     *self,
                                                          int              texture_id);
 void            gsk_gl_driver_bind_source_texture       (GskGLDriver     *driver,
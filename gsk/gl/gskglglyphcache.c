@@ -7,11 +7,14 @@
 #include "gskgltextureatlasprivate.h"
 
 #include "gdk/gdkglcontextprivate.h"
+#include "gdk/gdkprofilerprivate.h"
+#include "gdk/gdkparalleltaskprivate.h"
 
 #include <graphene.h>
 #include <cairo.h>
 #include <epoxy/gl.h>
 #include <string.h>
+#include <math.h>
 
 /* Cache eviction strategy
  *
@@ -21,13 +24,26 @@
  *
  * We keep count of the pixels of each atlas that are
  * taken up by old data. When the fraction of old pixels
- * gets too high, we drop the atlas and all the items it
- * contained.
+ * gets too high, we move the items that are still in use
+ * to other atlases and drop the old ones along with the
+ * atlas.
+ *
+ * Glyphs that are not from color fonts only need their
+ * alpha channel, so they go into single channel atlases.
  *
  * Big glyphs are not stored in the atlas, they get their
  * own texture, but they are still cached.
  */
 
+/* Rasterization
+ *
+ * Glyphs that are not in the cache yet get their place in an
+ * atlas right away, but they are only rasterized when the renderer
+ * uploads them in one go before it draws the frame. That happens on
+ * the threads of gdk_parallel_task_run(), so a frame full of new
+ * glyphs costs about as much as the slowest thread.
+ */
+
 #define MAX_FRAME_AGE (60)
 #define MAX_GLYPH_SIZE 128 /* Will get its own texture if bigger */
 
@@ -50,6 +66,7 @@ gsk_gl_glyph_cache_new (GdkDisplay *display,
                                                    glyph_cache_key_free, glyph_cache_value_free);
 
   glyph_cache->atlases = gsk_gl_texture_atlases_ref (atlases);
+  glyph_cache->pending = g_ptr_array_new ();
 
   glyph_cache->ref_count = 1;
 
@@ -71,6 +88,16 @@ gsk_gl_glyph_cache_unref (GskGLGlyphCache *self)
 
   if (self->ref_count == 1)
     {
+      guint i;
+
+      for (i = 0; i < self->pending->len; i++)
+        {
+          RenderJob *job = g_ptr_array_index (self->pending, i);
+
+          cairo_scaled_font_destroy (job->scaled_font);
+          g_free (job);
+        }
+      g_ptr_array_unref (self->pending);
       gsk_gl_texture_atlases_unref (self->atlases);
       g_hash_table_unref (self->hash_table);
       g_free (self);
@@ -109,19 +136,110 @@ glyph_cache_value_free (gpointer v)
   g_free (v);
 }
 
+/* A glyph that is rasterized in a worker thread by
+ * gsk_gl_glyph_cache_upload_pending(). */
+typedef struct
+{
+  GskGLCachedGlyph *value;
+  cairo_scaled_font_t *scaled_font;
+  PangoGlyph glyph;
+  guint xshift;
+  guint scale;
+
+  GskImageRegion region;
+} RenderJob;
+
+static cairo_t *
+create_glyph_context (const GskGLCachedGlyph *value,
+                      cairo_scaled_font_t    *scaled_font,
+                      guint                   scale,
+                      GskImageRegion         *region)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  cairo_format_t format;
+
+  region->width = value->draw_width * scale / 1024;
+  region->height = value->draw_height * scale / 1024;
+
+  if (value->atlas && value->atlas->format == GSK_GL_TEXTURE_ATLAS_FORMAT_ALPHA)
+    format = CAIRO_FORMAT_A8;
+  else
+    format = CAIRO_FORMAT_ARGB32;
+
+  region->stride = cairo_format_stride_for_width (format, region->width);
+  region->data = g_malloc0 (region->stride * region->height);
+
+  if (value->atlas)
+    {
+      region->x = (gsize)(value->tx * value->atlas->width);
+      region->y = (gsize)(value->ty * value->atlas->height);
+    }
+  else
+    {
+      region->x = 0;
+      region->y = 0;
+    }
+
+  surface = cairo_image_surface_create_for_data (region->data, format,
+                                                 region->width, region->height,
+                                                 region->stride);
+  cairo_surface_set_device_scale (surface, scale / 1024.0, scale / 1024.0);
+
+  cr = cairo_create (surface);
+  cairo_surface_destroy (surface);
+
+  cairo_set_scaled_font (cr, scaled_font);
+  cairo_set_source_rgba (cr, 1, 1, 1, 1);
+
+  return cr;
+}
+
+static void
+finish_glyph_context (cairo_t *cr)
+{
+  cairo_surface_flush (cairo_get_target (cr));
+  cairo_destroy (cr);
+}
+
+/* Runs in a worker thread, so it must not use Pango.
+ * Renders every @n_tasks'th job of @data. */
+static void
+render_jobs (gpointer data,
+             guint    index,
+             guint    n_tasks)
+{
+  GPtrArray *jobs = data;
+  guint i;
+
+  for (i = index; i < jobs->len; i += n_tasks)
+    {
+      RenderJob *job = g_ptr_array_index (jobs, i);
+      cairo_glyph_t glyph;
+      cairo_t *cr;
+
+      cr = create_glyph_context (job->value, job->scaled_font, job->scale, &job->region);
+
+      glyph.index = job->glyph;
+      glyph.x = job->xshift / 4.0 - job->value->draw_x;
+      glyph.y = - job->value->draw_y;
+      cairo_show_glyphs (cr, &glyph, 1);
+
+      finish_glyph_context (cr);
+    }
+}
+
+/* Used for glyphs that Pango has to draw itself, like the hex boxes
+ * of unknown glyphs */
 static gboolean
 render_glyph (GlyphCacheKey    *key,
               GskGLCachedGlyph *value,
               GskImageRegion   *region)
 {
-  cairo_surface_t *surface;
   cairo_t *cr;
   cairo_scaled_font_t *scaled_font;
   PangoGlyphString glyph_string;
   PangoGlyphInfo glyph_info;
-  int surface_width, surface_height;
-  int stride;
-  unsigned char *data;
 
   scaled_font = pango_cairo_font_get_scaled_font ((PangoCairoFont *)key->data.font);
   if (G_UNLIKELY (!scaled_font || cairo_scaled_font_status (scaled_font) != CAIRO_STATUS_SUCCESS))
@@ -130,55 +248,55 @@ render_glyph (GlyphCacheKey    *key,
       return FALSE;
     }
 
-  surface_width = value->draw_width * key->data.scale / 1024;
-  surface_height = value->draw_height * key->data.scale / 1024;
-
-  stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, surface_width);
-  data = g_malloc0 (stride * surface_height);
-  surface = cairo_image_surface_create_for_data (data, CAIRO_FORMAT_ARGB32,
-                                                 surface_width, surface_height,
-                                                 stride);
-  cairo_surface_set_device_scale (surface, key->data.scale / 1024.0, key->data.scale / 1024.0);
-
-  cr = cairo_create (surface);
-
-  cairo_set_scaled_font (cr, scaled_font);
-  cairo_set_source_rgba (cr, 1, 1, 1, 1);
+  cr = create_glyph_context (value, scaled_font, key->data.scale, region);
 
   glyph_info.glyph = key->data.glyph;
   glyph_info.geometry.width = value->draw_width * 1024;
   if (glyph_info.glyph & PANGO_GLYPH_UNKNOWN_FLAG)
-    glyph_info.geometry.x_offset = 0;
+    glyph_info.geometry.x_offset = key->data.xshift * 256;
   else
-    glyph_info.geometry.x_offset = - value->draw_x * 1024;
+    glyph_info.geometry.x_offset = key->data.xshift * 256 - value->draw_x * 1024;
   glyph_info.geometry.y_offset = - value->draw_y * 1024;
 
   glyph_string.num_glyphs = 1;
   glyph_string.glyphs = &glyph_info;
 
   pango_cairo_show_glyph_string (cr, key->data.font, &glyph_string);
-  cairo_destroy (cr);
 
-  cairo_surface_flush (surface);
+  finish_glyph_context (cr);
 
-  region->width = cairo_image_surface_get_width (surface);
-  region->height = cairo_image_surface_get_height (surface);
-  region->stride = cairo_image_surface_get_stride (surface);
-  region->data = data;
-  if (value->atlas)
+  return TRUE;
+}
+
+static void
+upload_region (GskGLCachedGlyph *value,
+               GskImageRegion   *r)
+{
+  glBindTexture (GL_TEXTURE_2D, value->texture_id);
+
+  if (value->atlas && value->atlas->format == GSK_GL_TEXTURE_ATLAS_FORMAT_ALPHA)
     {
-      region->x = (gsize)(value->tx * value->atlas->width);
-      region->y = (gsize)(value->ty * value->atlas->height);
+      glPixelStorei (GL_UNPACK_ROW_LENGTH, r->stride);
+      glTexSubImage2D (GL_TEXTURE_2D, 0, r->x, r->y, r->width, r->height,
+                       GL_RED, GL_UNSIGNED_BYTE,
+                       r->data);
     }
   else
     {
-      region->x = 0;
-      region->y = 0;
-    }
+      glPixelStorei (GL_UNPACK_ROW_LENGTH, r->stride / 4);
 
-  cairo_surface_destroy (surface);
+      if (gdk_gl_context_get_use_es (gdk_gl_context_get_current ()))
+        glTexSubImage2D (GL_TEXTURE_2D, 0, r->x, r->y, r->width, r->height,
+                         GL_RGBA, GL_UNSIGNED_BYTE,
+                         r->data);
+      else
+        glTexSubImage2D (GL_TEXTURE_2D, 0, r->x, r->y, r->width, r->height,
+                         GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
+                         r->data);
+    }
 
-  return TRUE;
+  glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+  g_free (r->data);
 }
 
 static void
@@ -192,23 +310,88 @@ upload_glyph (GlyphCacheKey    *key,
                                           key->data.glyph);
 
   if (render_glyph (key, value, &r))
+    upload_region (value, &r);
+
+  gdk_gl_context_pop_debug_group (gdk_gl_context_get_current ());
+}
+
+/* Queues the glyph for the worker threads. It gets rasterized and
+ * uploaded in gsk_gl_glyph_cache_upload_pending(), before the frame
+ * is drawn. */
+static void
+queue_glyph (GskGLGlyphCache  *self,
+             GlyphCacheKey    *key,
+             GskGLCachedGlyph *value)
+{
+  cairo_scaled_font_t *scaled_font;
+  RenderJob *job;
+
+  if (key->data.glyph & PANGO_GLYPH_UNKNOWN_FLAG)
     {
-      glPixelStorei (GL_UNPACK_ROW_LENGTH, r.stride / 4);
-      glBindTexture (GL_TEXTURE_2D, value->texture_id);
+      upload_glyph (key, value);
+      return;
+    }
 
-      if (gdk_gl_context_get_use_es (gdk_gl_context_get_current ()))
-        glTexSubImage2D (GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height,
-                         GL_RGBA, GL_UNSIGNED_BYTE,
-                         r.data);
-      else
-        glTexSubImage2D (GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height,
-                         GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
-                         r.data);
-      glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
-      g_free (r.data);
+  scaled_font = pango_cairo_font_get_scaled_font ((PangoCairoFont *)key->data.font);
+  if (G_UNLIKELY (!scaled_font || cairo_scaled_font_status (scaled_font) != CAIRO_STATUS_SUCCESS))
+    {
+      g_warning ("Failed to get a font");
+      return;
     }
 
-  gdk_gl_context_pop_debug_group (gdk_gl_context_get_current ());
+  job = g_new (RenderJob, 1);
+  job->value = value;
+  job->scaled_font = cairo_scaled_font_reference (scaled_font);
+  job->glyph = key->data.glyph;
+  job->xshift = key->data.xshift;
+  job->scale = key->data.scale;
+
+  g_ptr_array_add (self->pending, job);
+}
+
+static inline void
+get_atlas_position (const GskGLCachedGlyph *value,
+                    int                    *x,
+                    int                    *y)
+{
+  /* Undo the 1px padding around the glyph */
+  *x = (int) roundf (value->tx * value->atlas->width) - 1;
+  *y = (int) roundf (value->ty * value->atlas->height) - 1;
+}
+
+static inline void
+set_atlas_position (GskGLCachedGlyph  *value,
+                    GskGLTextureAtlas *atlas,
+                    int                x,
+                    int                y,
+                    int                width,
+                    int                height)
+{
+  value->tx = (float)(x + 1) / atlas->width;
+  value->ty = (float)(y + 1) / atlas->height;
+  value->tw = (float)width / atlas->width;
+  value->th = (float)height / atlas->height;
+
+  value->atlas = atlas;
+  value->texture_id = atlas->texture_id;
+}
+
+/* The atlas accounts for glyphs with the scaled size and
+ * padding they were packed with */
+static inline void
+mark_glyph_used (const GlyphCacheKey *key,
+                 GskGLCachedGlyph    *value,
+                 gboolean             used)
+{
+  const int width = value->draw_width * key->data.scale / 1024 + 2;
+  const int height = value->draw_height * key->data.scale / 1024 + 2;
+
+  if (used)
+    gsk_gl_texture_atlas_mark_used (value->atlas, width, height);
+  else
+    gsk_gl_texture_atlas_mark_unused (value->atlas, width, height);
+
+  value->used = used;
 }
 
 static void
@@ -226,16 +409,16 @@ add_to_cache (GskGLGlyphCache  *self,
       int packed_x = 0;
       int packed_y = 0;
 
-      gsk_gl_texture_atlases_pack (self->atlases, width + 2, height + 2, &atlas, &packed_x, &packed_y);
+      gsk_gl_texture_atlases_pack (self->atlases,
+                                   key->data.color ? GSK_GL_TEXTURE_ATLAS_FORMAT_RGBA
+                                                   : GSK_GL_TEXTURE_ATLAS_FORMAT_ALPHA,
+                                   width + 2, height + 2,
+                                   &atlas, &packed_x, &packed_y);
 
-      value->tx = (float)(packed_x + 1) / atlas->width;
-      value->ty = (float)(packed_y + 1) / atlas->height;
-      value->tw = (float)width / atlas->width;
-      value->th = (float)height / atlas->height;
+      set_atlas_position (value, atlas, packed_x, packed_y, width, height);
       value->used = TRUE;
 
-      value->atlas = atlas;
-      value->texture_id = atlas->texture_id;
+      self->atlases->n_uploaded++;
     }
   else
     {
@@ -252,7 +435,7 @@ add_to_cache (GskGLGlyphCache  *self,
       value->th = 1.0f;
     }
 
-  upload_glyph (key, value);
+  queue_glyph (self, key, value);
 }
 
 void
@@ -269,8 +452,7 @@ gsk_gl_glyph_cache_lookup_or_add (GskGLGlyphCache         *cache,
     {
       if (value->atlas && !value->used)
         {
-          gsk_gl_texture_atlas_mark_used (value->atlas, value->draw_width, value->draw_height);
-          value->used = TRUE;
+          mark_glyph_used (lookup, value, TRUE);
         }
       value->accessed = TRUE;
 
@@ -284,10 +466,9 @@ gsk_gl_glyph_cache_lookup_or_add (GskGLGlyphCache         *cache,
 
     pango_font_get_glyph_extents (lookup->data.font, lookup->data.glyph, &ink_rect, NULL);
     pango_extents_to_pixels (&ink_rect, NULL);
+    /* The shifted glyph can reach into the next pixel */
     if (lookup->data.xshift != 0)
       ink_rect.width += 1;
-    if (lookup->data.yshift != 0)
-      ink_rect.height += 1;
 
     value = g_new0 (GskGLCachedGlyph, 1);
 
@@ -303,7 +484,7 @@ gsk_gl_glyph_cache_lookup_or_add (GskGLGlyphCache         *cache,
     key->data.font = g_object_ref (lookup->data.font);
     key->data.glyph = lookup->data.glyph;
     key->data.xshift = lookup->data.xshift;
-    key->data.yshift = lookup->data.yshift;
+    key->data.color = lookup->data.color;
     key->data.scale = lookup->data.scale;
     key->hash = lookup->hash;
 
@@ -317,6 +498,44 @@ gsk_gl_glyph_cache_lookup_or_add (GskGLGlyphCache         *cache,
   }
 }
 
+/* Rasterizes the glyphs added since the last call and uploads them
+ * all at once. Must be called before drawing any of them. */
+void
+gsk_gl_glyph_cache_upload_pending (GskGLGlyphCache *self)
+{
+  gint64 before;
+  guint n_uploaded, i;
+
+  if (self->pending->len == 0)
+    return;
+
+  before = g_get_monotonic_time ();
+  n_uploaded = self->pending->len;
+
+  gdk_parallel_task_run (render_jobs,
+                         self->pending,
+                         MIN (gdk_parallel_task_get_max_tasks (), n_uploaded));
+
+  gdk_gl_context_push_debug_group_printf (gdk_gl_context_get_current (),
+                                          "Uploading %u glyphs", n_uploaded);
+
+  for (i = 0; i < n_uploaded; i++)
+    {
+      RenderJob *job = g_ptr_array_index (self->pending, i);
+
+      upload_region (job->value, &job->region);
+
+      cairo_scaled_font_destroy (job->scaled_font);
+      g_free (job);
+    }
+  g_ptr_array_set_size (self->pending, 0);
+
+  gdk_gl_context_pop_debug_group (gdk_gl_context_get_current ());
+
+  if (GDK_PROFILER_IS_RUNNING)
+    gdk_profiler_end_markf (before, "glyph upload", "%u glyphs", n_uploaded);
+}
+
 void
 gsk_gl_glyph_cache_begin_frame (GskGLGlyphCache *self,
                                 GskGLDriver     *driver,
@@ -334,9 +553,30 @@ gsk_gl_glyph_cache_begin_frame (GskGLGlyphCache *self,
       g_hash_table_iter_init (&iter, self->hash_table);
       while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&value))
         {
-          if (g_ptr_array_find (removed_atlases, value->atlas, NULL))
+          GskGLTextureAtlas *atlas;
+          int width, height;
+          int x, y;
+
+          if (value->atlas == NULL ||
+              !g_ptr_array_find (removed_atlases, value->atlas, NULL))
+            continue;
+
+          width = value->draw_width * key->data.scale / 1024;
+          height = value->draw_height * key->data.scale / 1024;
+          get_atlas_position (value, &x, &y);
+
+          /* Glyphs that are still in use are kept, only old ones are dropped */
+          if (value->used &&
+              gsk_gl_texture_atlases_move (self->atlases, value->atlas,
+                                           x, y, width + 2, height + 2,
+                                           &atlas, &x, &y))
+            {
+              set_atlas_position (value, atlas, x, y, width, height);
+            }
+          else
             {
               g_hash_table_iter_remove (&iter);
+              self->atlases->n_evicted++;
               dropped++;
             }
         }
@@ -353,8 +593,7 @@ gsk_gl_glyph_cache_begin_frame (GskGLGlyphCache *self,
                 {
                   if (value->used)
                     {
-                      gsk_gl_texture_atlas_mark_unused (value->atlas, value->draw_width, value->draw_height);
-                      value->used = FALSE;
+                      mark_glyph_used (key, value, FALSE);
                     }
                 }
               else
@@ -15,6 +15,8 @@ typedef struct
   GHashTable *hash_table;
   GskGLTextureAtlases *atlases;
 
+  GPtrArray *pending; /* Queued, but not rasterized and uploaded yet */
+
   int timestamp;
 } GskGLGlyphCache;
 
@@ -22,9 +24,9 @@ struct _CacheKeyData
 {
   PangoFont *font;
   PangoGlyph glyph;
-  guint xshift : 3;
-  guint yshift : 3;
-  guint scale  : 26; /* times 1024 */
+  guint xshift : 2; /* Subpixel position, in quarter pixels */
+  guint color  : 1; /* Needs an RGBA atlas */
+  guint scale  : 29; /* times 1024 */
 };
 
 typedef struct _CacheKeyData CacheKeyData;
@@ -37,21 +39,21 @@ struct _GlyphCacheKey
 
 typedef struct _GlyphCacheKey GlyphCacheKey;
 
+/* Glyphs are only positioned with subpixel precision horizontally.
+ * Vertical positions get rounded to whole pixels, so there are at
+ * most 4 entries per glyph and scale. */
 #define PHASE(x) ((int)(floor (4 * (x + 0.125)) - 4 * floor (x + 0.125)))
 
 static inline void
 glyph_cache_key_set_glyph_and_shift (GlyphCacheKey *key,
                                      PangoGlyph glyph,
-                                     float x,
-                                     float y)
+                                     float x)
 {
   key->data.glyph = glyph;
   key->data.xshift = PHASE (x);
-  key->data.yshift = PHASE (y);
   key->hash = GPOINTER_TO_UINT (key->data.font) ^
               key->data.glyph ^
               (key->data.xshift << 24) ^
-              (key->data.yshift << 26) ^
               key->data.scale;
 }
 
@@ -88,5 +90,6 @@ void                     gsk_gl_glyph_cache_lookup_or_add   (GskGLGlyphCache
                                                              GlyphCacheKey          *lookup,
                                                              GskGLDriver            *driver,
                                                              const GskGLCachedGlyph **cached_glyph_out);
+void                     gsk_gl_glyph_cache_upload_pending  (GskGLGlyphCache        *self);
 
 #endif
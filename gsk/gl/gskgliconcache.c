@@ -4,6 +4,7 @@
 #include "gdk/gdkglcontextprivate.h"
 
 #include <epoxy/gl.h>
+#include <math.h>
 
 #define MAX_FRAME_AGE 60
 
@@ -54,6 +55,23 @@ gsk_gl_icon_cache_unref (GskGLIconCache *self)
   self->ref_count--;
 }
 
+static inline void
+set_atlas_position (IconData          *icon_data,
+                    GskGLTextureAtlas *atlas,
+                    int                x,
+                    int                y)
+{
+  const int width = icon_data->source_texture->width;
+  const int height = icon_data->source_texture->height;
+
+  icon_data->atlas = atlas;
+  icon_data->texture_id = atlas->texture_id;
+  icon_data->x = (float)(x + 1) / atlas->width;
+  icon_data->y = (float)(y + 1) / atlas->height;
+  icon_data->x2 = icon_data->x + (float)width / atlas->width;
+  icon_data->y2 = icon_data->y + (float)height / atlas->height;
+}
+
 void
 gsk_gl_icon_cache_begin_frame (GskGLIconCache *self,
                                GPtrArray      *removed_atlases)
@@ -64,7 +82,7 @@ gsk_gl_icon_cache_begin_frame (GskGLIconCache *self,
 
   self->timestamp++;
 
-  /* Drop icons on removed atlases */
+  /* Move icons that are still in use off removed atlases, drop the rest */
   if (removed_atlases->len > 0)
     {
       guint dropped = 0;
@@ -72,9 +90,27 @@ gsk_gl_icon_cache_begin_frame (GskGLIconCache *self,
       g_hash_table_iter_init (&iter, self->icons);
       while (g_hash_table_iter_next (&iter, (gpointer *)&texture, (gpointer *)&icon_data))
         {
-          if (g_ptr_array_find (removed_atlases, icon_data->atlas, NULL))
+          GskGLTextureAtlas *atlas;
+          int x, y;
+
+          if (!g_ptr_array_find (removed_atlases, icon_data->atlas, NULL))
+            continue;
+
+          x = (int) roundf (icon_data->x * icon_data->atlas->width) - 1;
+          y = (int) roundf (icon_data->y * icon_data->atlas->height) - 1;
+
+          if (icon_data->used &&
+              gsk_gl_texture_atlases_move (self->atlases, icon_data->atlas,
+                                           x, y,
+                                           texture->width + 2, texture->height + 2,
+                                           &atlas, &x, &y))
+            {
+              set_atlas_position (icon_data, atlas, x, y);
+            }
+          else
             {
               g_hash_table_iter_remove (&iter);
+              self->atlases->n_evicted++;
               dropped++;
             }
         }
@@ -136,18 +172,16 @@ gsk_gl_icon_cache_lookup_or_add (GskGLIconCache  *self,
     unsigned char *surface_data;
     guint gl_format;
 
-    gsk_gl_texture_atlases_pack (self->atlases, width + 2, height + 2, &atlas, &packed_x, &packed_y);
+    gsk_gl_texture_atlases_pack (self->atlases, GSK_GL_TEXTURE_ATLAS_FORMAT_RGBA,
+                                 width + 2, height + 2, &atlas, &packed_x, &packed_y);
 
     icon_data = g_new0 (IconData, 1);
-    icon_data->atlas = atlas;
     icon_data->accessed = TRUE;
     icon_data->used = TRUE;
-    icon_data->texture_id = atlas->texture_id;
     icon_data->source_texture = g_object_ref (texture);
-    icon_data->x = (float)(packed_x + 1) / atlas->width;
-    icon_data->y = (float)(packed_y + 1) / atlas->width;
-    icon_data->x2 = icon_data->x + (float)width / atlas->width;
-    icon_data->y2 = icon_data->y + (float)height / atlas->height;
+    set_atlas_position (icon_data, atlas, packed_x, packed_y);
+
+    self->atlases->n_uploaded++;
 
     g_hash_table_insert (self->icons, texture, icon_data);
 
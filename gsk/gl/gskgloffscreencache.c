@@ -0,0 +1,225 @@
+#include "config.h"
+
+#include "gskgloffscreencacheprivate.h"
+
+#include "gskdebugprivate.h"
+
+#include <string.h>
+
+#define MAX_UNUSED_FRAMES (16 * 5)
+
+/* Enough for a few dozen window-sized blurs and shadows */
+#define MAX_CACHE_SIZE (64 * 1024 * 1024)
+
+typedef struct
+{
+  GskGLOffscreenCacheKey key;
+
+  int texture_id;
+  gsize size;
+  guint64 last_used;
+} CacheItem;
+
+static guint
+key_hash (gconstpointer v)
+{
+  const GskGLOffscreenCacheKey *key = v;
+
+  return g_direct_hash (key->node) ^
+         (guint) (key->scale * 1024) ^
+         ((guint) key->bounds.size.width << 8) ^
+         ((guint) key->bounds.size.height << 16) ^
+         key->flags;
+}
+
+static gboolean
+key_equal (gconstpointer v1,
+           gconstpointer v2)
+{
+  const GskGLOffscreenCacheKey *a = v1;
+  const GskGLOffscreenCacheKey *b = v2;
+
+  return a->node == b->node &&
+         a->scale == b->scale &&
+         a->opacity == b->opacity &&
+         a->flags == b->flags &&
+         graphene_rect_equal (&a->bounds, &b->bounds) &&
+         graphene_rect_equal (&a->clip.bounds, &b->clip.bounds) &&
+         graphene_size_equal (&a->clip.corner[0], &b->clip.corner[0]) &&
+         graphene_size_equal (&a->clip.corner[1], &b->clip.corner[1]) &&
+         graphene_size_equal (&a->clip.corner[2], &b->clip.corner[2]) &&
+         graphene_size_equal (&a->clip.corner[3], &b->clip.corner[3]);
+}
+
+static void
+remove_item (GskGLOffscreenCache *self,
+             GskGLDriver         *gl_driver,
+             CacheItem           *item)
+{
+  self->size -= item->size;
+  gsk_gl_driver_destroy_texture (gl_driver, item->texture_id);
+  /* Frees the item */
+  g_hash_table_remove (self->items, &item->key);
+}
+
+static void
+cache_item_free (gpointer data)
+{
+  CacheItem *item = data;
+
+  gsk_render_node_unref (item->key.node);
+  g_slice_free (CacheItem, item);
+}
+
+static int
+compare_last_used (gconstpointer a,
+                   gconstpointer b)
+{
+  const CacheItem *item_a = *(const CacheItem **) a;
+  const CacheItem *item_b = *(const CacheItem **) b;
+
+  if (item_a->last_used < item_b->last_used)
+    return -1;
+  else if (item_a->last_used > item_b->last_used)
+    return 1;
+
+  return 0;
+}
+
+void
+gsk_gl_offscreen_cache_init (GskGLOffscreenCache *self)
+{
+  memset (self, 0, sizeof (*self));
+
+  /* The key is embedded in the item */
+  self->items = g_hash_table_new_full (key_hash, key_equal, NULL, cache_item_free);
+  self->max_size = MAX_CACHE_SIZE;
+}
+
+void
+gsk_gl_offscreen_cache_free (GskGLOffscreenCache *self,
+                             GskGLDriver         *gl_driver)
+{
+  GHashTableIter iter;
+  CacheItem *item;
+
+  g_hash_table_iter_init (&iter, self->items);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &item))
+    gsk_gl_driver_destroy_texture (gl_driver, item->texture_id);
+
+  g_clear_pointer (&self->items, g_hash_table_unref);
+  self->size = 0;
+}
+
+/* Drops textures that have not been used for a while, and the least
+ * recently used ones if we are above our budget. Textures can only go
+ * away here, since the ops of the current frame might still use them. */
+void
+gsk_gl_offscreen_cache_begin_frame (GskGLOffscreenCache *self,
+                                    GskGLDriver         *gl_driver)
+{
+  GHashTableIter iter;
+  CacheItem *item;
+  guint n_dropped = 0;
+
+  self->frame ++;
+  self->n_hits = 0;
+  self->n_misses = 0;
+
+  g_hash_table_iter_init (&iter, self->items);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &item))
+    {
+      if (self->frame - item->last_used > MAX_UNUSED_FRAMES)
+        {
+          self->size -= item->size;
+          gsk_gl_driver_destroy_texture (gl_driver, item->texture_id);
+          g_hash_table_iter_remove (&iter);
+          n_dropped ++;
+        }
+    }
+
+  if (self->size > self->max_size)
+    {
+      GPtrArray *lru = g_ptr_array_sized_new (g_hash_table_size (self->items));
+      guint i;
+
+      g_hash_table_iter_init (&iter, self->items);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &item))
+        g_ptr_array_add (lru, item);
+
+      g_ptr_array_sort (lru, compare_last_used);
+
+      for (i = 0; i < lru->len && self->size > self->max_size; i ++)
+        {
+          remove_item (self, gl_driver, g_ptr_array_index (lru, i));
+          n_dropped ++;
+        }
+
+      g_ptr_array_unref (lru);
+    }
+
+  if (n_dropped > 0)
+    GSK_NOTE (OPENGL, g_message ("Dropped %u offscreen textures, %u left using %" G_GSIZE_FORMAT " kB",
+                                 n_dropped, g_hash_table_size (self->items), self->size / 1024));
+}
+
+int
+gsk_gl_offscreen_cache_lookup (GskGLOffscreenCache          *self,
+                               const GskGLOffscreenCacheKey *key)
+{
+  CacheItem *item;
+
+  g_assert (self != NULL);
+  g_assert (key->node != NULL);
+
+  item = g_hash_table_lookup (self->items, key);
+  if (item == NULL)
+    {
+      self->n_misses ++;
+      return 0;
+    }
+
+  self->n_hits ++;
+  item->last_used = self->frame;
+
+  g_assert (item->texture_id != 0);
+
+  return item->texture_id;
+}
+
+/* Takes ownership of @texture_id, which must not be used for anything
+ * but drawing @key->node afterwards. */
+void
+gsk_gl_offscreen_cache_commit (GskGLOffscreenCache          *self,
+                               GskGLDriver                  *gl_driver,
+                               const GskGLOffscreenCacheKey *key,
+                               int                           texture_id,
+                               int                           width,
+                               int                           height)
+{
+  const gsize size = (gsize) width * height * 4;
+  CacheItem *item;
+
+  g_assert (self != NULL);
+  g_assert (texture_id > 0);
+
+  /* Would only push out everything else */
+  if (size > self->max_size / 2)
+    return;
+
+  if (g_hash_table_contains (self->items, key))
+    return;
+
+  item = g_slice_new (CacheItem);
+  item->key = *key;
+  gsk_render_node_ref (item->key.node);
+  item->texture_id = texture_id;
+  item->size = size;
+  item->last_used = self->frame;
+
+  /* Don't let the driver reuse the texture for something else */
+  gsk_gl_driver_mark_texture_permanent (gl_driver, texture_id);
+
+  g_hash_table_insert (self->items, &item->key, item);
+  self->size += size;
+}
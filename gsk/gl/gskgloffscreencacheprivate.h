@@ -0,0 +1,53 @@
+#ifndef __GSK_GL_OFFSCREEN_CACHE_PRIVATE_H__
+#define __GSK_GL_OFFSCREEN_CACHE_PRIVATE_H__
+
+#include <glib.h>
+#include "gskgldriverprivate.h"
+#include "gskrendernodeprivate.h"
+#include "gskroundedrect.h"
+
+/* Everything that influences the contents of an offscreen rendering of
+ * a node, besides the node itself. State that is reset for the offscreen
+ * rendering (clip, opacity) should be left zeroed. */
+typedef struct
+{
+  GskRenderNode *node;
+  graphene_rect_t bounds;
+  GskRoundedRect clip;
+  float scale;
+  float opacity;
+  guint flags;
+} GskGLOffscreenCacheKey;
+
+/* Keeps the offscreen textures of nodes around for as long as the nodes
+ * keep being drawn, so unchanged subtrees don't get rendered again. */
+typedef struct
+{
+  GHashTable *items; /* GskGLOffscreenCacheKey -> CacheItem */
+
+  /* In bytes */
+  gsize size;
+  gsize max_size;
+
+  guint64 frame;
+
+  /* Statistics of the current frame */
+  guint n_hits;
+  guint n_misses;
+} GskGLOffscreenCache;
+
+void gsk_gl_offscreen_cache_init        (GskGLOffscreenCache          *self);
+void gsk_gl_offscreen_cache_free        (GskGLOffscreenCache          *self,
+                                         GskGLDriver                  *gl_driver);
+void gsk_gl_offscreen_cache_begin_frame (GskGLOffscreenCache          *self,
+                                         GskGLDriver                  *gl_driver);
+int  gsk_gl_offscreen_cache_lookup      (GskGLOffscreenCache          *self,
+                                         const GskGLOffscreenCacheKey *key);
+void gsk_gl_offscreen_cache_commit      (GskGLOffscreenCache          *self,
+                                         GskGLDriver                  *gl_driver,
+                                         const GskGLOffscreenCacheKey *key,
+                                         int                           texture_id,
+                                         int                           width,
+                                         int                           height);
+
+#endif
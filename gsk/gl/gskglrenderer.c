@@ -16,7 +16,10 @@
 #include "gskglrenderopsprivate.h"
 #include "gskcairoblurprivate.h"
 #include "gskglshadowcacheprivate.h"
+#include "gskgloffscreencacheprivate.h"
 #include "gskglnodesampleprivate.h"
+#include "gskglvertexbufferprivate.h"
+#include "gskglbatcherprivate.h"
 #include "gsktransform.h"
 
 #include "gskprivate.h"
@@ -67,6 +70,9 @@ typedef enum
   DUMP_FRAMEBUFFER = 1 << 3,
   CENTER_CHILD     = 1 << 4,
   NO_CACHE_PLZ     = 1 << 5,
+  /* Only used in offscreen cache keys, for the texture a node is
+   * finally drawn with rather than an offscreen rendering of it */
+  FINAL_TEXTURE    = 1 << 6,
 } OffscreenFlags;
 
 typedef struct
@@ -434,6 +440,8 @@ struct _GskGLRenderer
   GskRenderer parent_instance;
 
   int scale_factor;
+  /* Of the default framebuffer, queried at realize time */
+  int stencil_bits;
 
   GdkGLContext *gl_context;
   GskGLDriver *gl_driver;
@@ -442,15 +450,37 @@ struct _GskGLRenderer
   GskGLRendererPrograms *programs;
 
   RenderOpBuilder op_builder;
+  GskGLVertexBuffer vertex_buffer;
+  GskGLVertexBuffer instance_buffer; /* Only with an instanced program */
+  GskGLBatcher batcher;
 
   GskGLTextureAtlases *atlases;
   GskGLGlyphCache *glyph_cache;
   GskGLIconCache *icon_cache;
   GskGLShadowCache shadow_cache;
+  GskGLOffscreenCache offscreen_cache;
 
 #ifdef G_ENABLE_DEBUG
+  /* Regions drawn from the offscreen cache in the current frame,
+   * in framebuffer coordinates */
+  GArray *cached_regions;
+  int root_render_target;
+
+  guint n_drawn_nodes;
+  guint n_culled_nodes;
+
   struct {
     GQuark frames;
+    GQuark nodes_drawn;
+    GQuark nodes_culled;
+    GQuark vertex_bytes;
+    GQuark vertex_stalls;
+    GQuark atlas_occupancy;
+    GQuark atlas_moves;
+    GQuark atlas_evictions;
+    GQuark atlas_uploads;
+    GQuark offscreen_hits;
+    GQuark offscreen_misses;
   } profile_counters;
   struct {
     GQuark cpu_time;
@@ -458,7 +488,10 @@ struct _GskGLRenderer
   } profile_timers;
 #endif
 
+  /* The rectangles of the surface we render to in this frame, one
+   * pass each, or NULL for the whole surface */
   cairo_region_t *render_region;
+  int render_pass;
 };
 
 struct _GskGLRendererClass
@@ -490,28 +523,30 @@ add_rect_ops (RenderOpBuilder       *builder,
 
 static GdkRGBA BLACK = {0, 0, 0, 1};
 
-static void G_GNUC_UNUSED
-add_rect_outline_ops (GskGLRenderer         *self,
-                      RenderOpBuilder       *builder,
-                      const graphene_rect_t *rect)
+#ifdef G_ENABLE_DEBUG
+/* Tints everything that was drawn from the offscreen cache this frame */
+static void
+add_cached_region_ops (GskGLRenderer   *self,
+                       RenderOpBuilder *builder)
 {
+  guint i;
+
+  if (self->cached_regions->len == 0)
+    return;
+
+  /* The regions are already transformed */
+  ops_set_modelview (builder, NULL);
   ops_set_program (builder, &self->programs->color_program);
-  ops_set_color (builder, &BLACK);
+  ops_set_color (builder, &(GdkRGBA) { 0, 0.3, 0.6, 0.3 });
+
+  for (i = 0; i < self->cached_regions->len; i ++)
+    add_rect_ops (builder, &g_array_index (self->cached_regions, graphene_rect_t, i));
 
-  add_rect_ops (builder,
-                &GRAPHENE_RECT_INIT (rect->origin.x, rect->origin.y,
-                                     1, rect->size.height));
-  add_rect_ops (builder,
-                &GRAPHENE_RECT_INIT (rect->origin.x, rect->origin.y,
-                                     rect->size.width, 1));
-  add_rect_ops (builder,
-                &GRAPHENE_RECT_INIT (rect->origin.x + rect->size.width - 1, rect->origin.y,
-                                     1, rect->size.height));
+  ops_pop_modelview (builder);
 
-  add_rect_ops (builder,
-                &GRAPHENE_RECT_INIT (rect->origin.x, rect->origin.y + rect->size.height - 1,
-                                     rect->size.width, 1));
+  g_array_set_size (self->cached_regions, 0);
 }
+#endif
 
 static inline GskRoundedRect
 transform_rect (GskGLRenderer        *self,
@@ -532,6 +567,135 @@ transform_rect (GskGLRenderer        *self,
   return r;
 }
 
+static inline gboolean
+use_instancing (GskGLRenderer *self)
+{
+  return self->programs->instanced_program.id > 0;
+}
+
+/* Draws @bounds in @color with the instanced program, cut down to the
+ * area between @outline and its shrunk and offset version if given. */
+static inline void
+add_instance (GskGLRenderer         *self,
+              RenderOpBuilder       *builder,
+              const graphene_rect_t *bounds,
+              const GdkRGBA         *color,
+              const GskRoundedRect  *outline,
+              float                  spread,
+              float                  dx,
+              float                  dy)
+{
+  const float alpha = color->alpha * builder->current_opacity;
+  GskGLInstance *instance;
+
+  ops_set_program (builder, &self->programs->instanced_program);
+  instance = ops_draw_instance (builder);
+
+  instance->rect[0] = builder->dx + bounds->origin.x;
+  instance->rect[1] = builder->dy + bounds->origin.y;
+  instance->rect[2] = bounds->size.width;
+  instance->rect[3] = bounds->size.height;
+
+  instance->color[0] = color->red * alpha;
+  instance->color[1] = color->green * alpha;
+  instance->color[2] = color->blue * alpha;
+  instance->color[3] = alpha;
+
+  if (outline != NULL)
+    {
+      const GskRoundedRect r = transform_rect (self, builder, outline);
+
+      memcpy (instance->outline, &r, sizeof (instance->outline));
+    }
+  else
+    {
+      memset (instance->outline, 0, sizeof (instance->outline));
+    }
+
+  instance->params[0] = spread;
+  instance->params[1] = dx;
+  instance->params[2] = dy;
+  instance->params[3] = outline != NULL ? 1.0 : 0.0;
+
+  memcpy (instance->clip, builder->current_clip, sizeof (instance->clip));
+}
+
+static void G_GNUC_UNUSED
+add_rect_outline_ops (GskGLRenderer         *self,
+                      RenderOpBuilder       *builder,
+                      const graphene_rect_t *rect)
+{
+  const graphene_rect_t edges[4] = {
+    GRAPHENE_RECT_INIT (rect->origin.x, rect->origin.y,
+                        1, rect->size.height),
+    GRAPHENE_RECT_INIT (rect->origin.x, rect->origin.y,
+                        rect->size.width, 1),
+    GRAPHENE_RECT_INIT (rect->origin.x + rect->size.width - 1, rect->origin.y,
+                        1, rect->size.height),
+    GRAPHENE_RECT_INIT (rect->origin.x, rect->origin.y + rect->size.height - 1,
+                        rect->size.width, 1),
+  };
+  guint i;
+
+  if (use_instancing (self))
+    {
+      for (i = 0; i < G_N_ELEMENTS (edges); i++)
+        add_instance (self, builder, &edges[i], &BLACK, NULL, 0, 0, 0);
+      return;
+    }
+
+  ops_set_program (builder, &self->programs->color_program);
+  ops_set_color (builder, &BLACK);
+
+  for (i = 0; i < G_N_ELEMENTS (edges); i++)
+    add_rect_ops (builder, &edges[i]);
+}
+
+static inline void
+init_offscreen_cache_key (GskGLOffscreenCacheKey *key,
+                          RenderOpBuilder        *builder,
+                          GskRenderNode          *node,
+                          const graphene_rect_t  *bounds,
+                          guint                   flags)
+{
+  memset (key, 0, sizeof (*key));
+
+  key->node = node;
+  key->bounds = *bounds;
+  key->scale = ops_get_scale (builder);
+  key->flags = flags & (RESET_CLIP | RESET_OPACITY | CENTER_CHILD | FINAL_TEXTURE);
+
+  /* Final textures don't depend on the state we draw them with */
+  if ((flags & (RESET_CLIP | FINAL_TEXTURE)) == 0)
+    key->clip = *builder->current_clip;
+  if ((flags & (RESET_OPACITY | FINAL_TEXTURE)) == 0)
+    key->opacity = builder->current_opacity;
+}
+
+static int
+lookup_offscreen (GskGLRenderer                *self,
+                  RenderOpBuilder              *builder,
+                  const GskGLOffscreenCacheKey *key)
+{
+  int texture_id;
+
+  texture_id = gsk_gl_offscreen_cache_lookup (&self->offscreen_cache, key);
+
+#ifdef G_ENABLE_DEBUG
+  if (texture_id != 0 &&
+      GSK_RENDERER_DEBUG_CHECK (GSK_RENDERER (self), OFFSCREEN_CACHE) &&
+      builder->current_render_target == self->root_render_target)
+    {
+      graphene_rect_t region;
+
+      ops_transform_bounds_modelview (builder, &key->bounds, &region);
+      g_array_append_val (self->cached_regions, region);
+    }
+#endif
+
+  return texture_id;
+}
+
 static inline void
 render_fallback_node (GskGLRenderer   *self,
                       GskRenderNode   *node,
@@ -542,6 +706,7 @@ render_fallback_node (GskGLRenderer   *self,
   const int surface_height = ceilf (node->bounds.size.height) * scale;
   cairo_surface_t *surface;
   cairo_surface_t *rendered_surface;
+  GskGLOffscreenCacheKey key;
   cairo_t *cr;
   int cached_id;
   int texture_id;
@@ -550,7 +715,8 @@ render_fallback_node (GskGLRenderer   *self,
       surface_height <= 0)
     return;
 
-  cached_id = gsk_gl_driver_get_texture_for_pointer (self->gl_driver, node);
+  init_offscreen_cache_key (&key, builder, node, &node->bounds, FINAL_TEXTURE);
+  cached_id = lookup_offscreen (self, builder, &key);
 
   if (cached_id != 0)
     {
@@ -628,7 +794,8 @@ render_fallback_node (GskGLRenderer   *self,
   cairo_surface_destroy (surface);
   cairo_surface_destroy (rendered_surface);
 
-  gsk_gl_driver_set_texture_for_pointer (self->gl_driver, node, texture_id);
+  gsk_gl_offscreen_cache_commit (&self->offscreen_cache, self->gl_driver, &key,
+                                 texture_id, surface_width, surface_height);
 
   ops_set_program (builder, &self->programs->blit_program);
   ops_set_texture (builder, texture_id);
@@ -666,6 +833,7 @@ render_text_node (GskGLRenderer   *self,
 
   memset (&lookup, 0, sizeof (CacheKeyData));
   lookup.data.font = (PangoFont *)font;
+  lookup.data.color = gsk_text_node_has_color_glyphs (node);
   lookup.data.scale = (guint) (text_scale * 1024);
 
   /* We use one quad per character, unlike the other nodes which
@@ -685,7 +853,7 @@ render_text_node (GskGLRenderer   *self,
       cx = (float)(x_position + gi->geometry.x_offset) / PANGO_SCALE;
       cy = (float)(gi->geometry.y_offset) / PANGO_SCALE;
 
-      glyph_cache_key_set_glyph_and_shift (&lookup, gi->glyph, x + cx, y + cy);
+      glyph_cache_key_set_glyph_and_shift (&lookup, gi->glyph, x + cx);
 
       gsk_gl_glyph_cache_lookup_or_add (self->glyph_cache,
                                         &lookup,
@@ -702,8 +870,9 @@ render_text_node (GskGLRenderer   *self,
       tx2 = tx + glyph->tw;
       ty2 = ty + glyph->th;
 
+      /* The glyph contains the subpixel offset, see PHASE() */
       glyph_x = floor (x + cx + 0.125) + glyph->draw_x;
-      glyph_y = floor (y + cy + 0.125) + glyph->draw_y;
+      glyph_y = floor (y + cy + 0.5) + glyph->draw_y;
       glyph_x2 = glyph_x + glyph->draw_width;
       glyph_y2 = glyph_y + glyph->draw_height;
 
@@ -745,6 +914,13 @@ render_border_node (GskGLRenderer   *self,
     {
       OpShadow *op;
 
+      if (use_instancing (self))
+        {
+          add_instance (self, builder, &node->bounds, &colors[0],
+                        rounded_outline, widths[0], 0, 0);
+          return;
+        }
+
       ops_set_program (builder, &self->programs->inset_shadow_program);
       op = ops_begin (builder, OP_CHANGE_INSET_SHADOW);
       op->color = &colors[0];
@@ -878,6 +1054,13 @@ render_color_node (GskGLRenderer   *self,
                    GskRenderNode   *node,
                    RenderOpBuilder *builder)
 {
+  if (use_instancing (self))
+    {
+      add_instance (self, builder, &node->bounds,
+                    gsk_color_node_peek_color (node), NULL, 0, 0, 0);
+      return;
+    }
+
   ops_set_program (builder, &self->programs->color_program);
   ops_set_color (builder, gsk_color_node_peek_color (node));
   load_vertex_data (ops_draw (builder, NULL), node, builder);
@@ -1123,6 +1306,28 @@ render_linear_gradient_node (GskGLRenderer   *self,
   load_vertex_data (ops_draw (builder, NULL), node, builder);
 }
 
+/* Whether clips can be transformed to rectangles in framebuffer space,
+ * which is what glScissor() and the stencil clips need. */
+static inline gboolean
+modelview_is_axis_aligned (RenderOpBuilder *builder)
+{
+  return gsk_transform_get_category (builder->current_modelview) >= GSK_TRANSFORM_CATEGORY_2D_AFFINE;
+}
+
+static gboolean
+ensure_stencil_buffer (GskGLRenderer   *self,
+                       RenderOpBuilder *builder)
+{
+  /* Levels are counted in the stencil buffer, so 8 bits give us 255 */
+  if (ops_get_stencil_level (builder) >= 255)
+    return FALSE;
+
+  if (builder->current_render_target == 0)
+    return self->stencil_bits >= 8;
+
+  return gsk_gl_driver_ensure_stencil_buffer (self->gl_driver, builder->current_render_target);
+}
+
 static inline void
 render_clipped_child (GskGLRenderer         *self,
                       RenderOpBuilder       *builder,
@@ -1135,6 +1340,17 @@ render_clipped_child (GskGLRenderer         *self,
 
   ops_transform_bounds_modelview (builder, clip, &transformed_clip);
 
+  /* Intersecting with the bounds would lose the rounded corners of
+   * the current clip, so keep that and scissor the rectangle. */
+  if (!gsk_rounded_rect_is_rectilinear (builder->current_clip) &&
+      modelview_is_axis_aligned (builder))
+    {
+      ops_push_scissor (builder, &transformed_clip);
+      gsk_gl_renderer_add_render_ops (self, child, builder);
+      ops_pop_scissor (builder);
+      return;
+    }
+
   graphene_rect_intersection (&transformed_clip,
                               &builder->current_clip->bounds,
                               &intersection);
@@ -1174,6 +1390,12 @@ render_rounded_clip_node (GskGLRenderer       *self,
 
   ops_transform_bounds_modelview (builder, &clip->bounds, &transformed_clip.bounds);
 
+  for (i = 0; i < 4; i ++)
+    {
+      transformed_clip.corner[i].width = clip->corner[i].width * scale;
+      transformed_clip.corner[i].height = clip->corner[i].height * scale;
+    }
+
   if (!ops_has_clip (builder))
     need_offscreen = FALSE;
   else if (graphene_rect_contains_rect (&builder->current_clip->bounds,
@@ -1186,16 +1408,31 @@ render_rounded_clip_node (GskGLRenderer       *self,
     {
       /* If they don't intersect at all, we can simply set
        * the new clip and add the render ops */
-      for (i = 0; i < 4; i ++)
-        {
-          transformed_clip.corner[i].width = clip->corner[i].width * scale;
-          transformed_clip.corner[i].height = clip->corner[i].height * scale;
-        }
-
       ops_push_clip (builder, &transformed_clip);
       gsk_gl_renderer_add_render_ops (self, child, builder);
       ops_pop_clip (builder);
     }
+  else if (modelview_is_axis_aligned (builder) &&
+           gsk_rounded_rect_is_rectilinear (builder->current_clip))
+    {
+      /* The current clip is a plain rectangle, so scissor that
+       * and let the shaders do the rounded one. */
+      ops_push_scissor (builder, &builder->current_clip->bounds);
+      ops_push_clip (builder, &transformed_clip);
+      gsk_gl_renderer_add_render_ops (self, child, builder);
+      ops_pop_clip (builder);
+      ops_pop_scissor (builder);
+    }
+  else if (modelview_is_axis_aligned (builder) &&
+           ensure_stencil_buffer (self, builder))
+    {
+      /* Both are rounded, move the current one to the stencil buffer */
+      ops_push_stencil_clip (builder);
+      ops_push_clip (builder, &transformed_clip);
+      gsk_gl_renderer_add_render_ops (self, child, builder);
+      ops_pop_clip (builder);
+      ops_pop_stencil_clip (builder);
+    }
   else
     {
       GskRoundedRect scaled_clip;
@@ -1427,6 +1664,7 @@ render_blur_node (GskGLRenderer   *self,
 {
   const float blur_radius = gsk_blur_node_get_radius (node);
   GskRenderNode *child = gsk_blur_node_get_child (node);
+  GskGLOffscreenCacheKey key;
   TextureRegion blurred_region;
 
   if (node_is_invisible (child))
@@ -1438,9 +1676,19 @@ render_blur_node (GskGLRenderer   *self,
       return;
     }
 
-  blurred_region.texture_id = gsk_gl_driver_get_texture_for_pointer (self->gl_driver, node);
+  init_offscreen_cache_key (&key, builder, node, &node->bounds, FINAL_TEXTURE);
+  blurred_region.texture_id = lookup_offscreen (self, builder, &key);
   if (blurred_region.texture_id == 0)
-    blur_node (self, child, builder, blur_radius, 0, &blurred_region, NULL);
+    {
+      const float scale = ops_get_scale (builder);
+      const float blur_extra = blur_radius * 3.0 / 2.0;
+
+      blur_node (self, child, builder, blur_radius, 0, &blurred_region, NULL);
+      gsk_gl_offscreen_cache_commit (&self->offscreen_cache, self->gl_driver, &key,
+                                     blurred_region.texture_id,
+                                     ceilf (child->bounds.size.width + blur_extra * 2) * scale,
+                                     ceilf (child->bounds.size.height + blur_extra * 2) * scale);
+    }
 
   g_assert (blurred_region.texture_id != 0);
 
@@ -1448,9 +1696,6 @@ render_blur_node (GskGLRenderer   *self,
   ops_set_program (builder, &self->programs->blit_program);
   ops_set_texture (builder, blurred_region.texture_id);
   load_offscreen_vertex_data (ops_draw (builder, NULL), node, builder); /* Render result to screen */
-
-  /* Add to cache for the blur node */
-  gsk_gl_driver_set_texture_for_pointer (self->gl_driver, node, blurred_region.texture_id);
 }
 
 static inline void
@@ -1466,6 +1711,15 @@ render_unblurred_inset_shadow_node (GskGLRenderer   *self,
 
   g_assert (blur_radius == 0);
 
+  if (use_instancing (self))
+    {
+      add_instance (self, builder, &node->bounds,
+                    gsk_inset_shadow_node_peek_color (node),
+                    gsk_inset_shadow_node_peek_outline (node),
+                    spread, dx, dy);
+      return;
+    }
+
   ops_set_program (builder, &self->programs->inset_shadow_program);
   op = ops_begin (builder, OP_CHANGE_INSET_SHADOW);
   op->color = gsk_inset_shadow_node_peek_color (node);
@@ -1490,6 +1744,7 @@ render_inset_shadow_node (GskGLRenderer   *self,
   const GskRoundedRect *node_outline = gsk_inset_shadow_node_peek_outline (node);
   float texture_width;
   float texture_height;
+  GskGLOffscreenCacheKey key;
   OpShadow *op;
   int blurred_texture_id;
 
@@ -1498,7 +1753,8 @@ render_inset_shadow_node (GskGLRenderer   *self,
   texture_width = ceilf ((node_outline->bounds.size.width + blur_extra) * scale);
   texture_height = ceilf ((node_outline->bounds.size.height + blur_extra) * scale);
 
-  blurred_texture_id = gsk_gl_driver_get_texture_for_pointer (self->gl_driver, node);
+  init_offscreen_cache_key (&key, builder, node, &node->bounds, FINAL_TEXTURE);
+  blurred_texture_id = lookup_offscreen (self, builder, &key);
   if (blurred_texture_id == 0)
     {
       const float spread = gsk_inset_shadow_node_get_spread (node) + (blur_extra / 2.0);
@@ -1582,6 +1838,8 @@ render_inset_shadow_node (GskGLRenderer   *self,
                                          texture_width,
                                          texture_height,
                                          blur_radius * scale);
+      gsk_gl_offscreen_cache_commit (&self->offscreen_cache, self->gl_driver, &key,
+                                     blurred_texture_id, texture_width, texture_height);
     }
 
   g_assert (blurred_texture_id != 0);
@@ -1595,8 +1853,6 @@ render_inset_shadow_node (GskGLRenderer   *self,
     const float ty1 = blur_extra / 2.0 * scale / texture_height;
     const float ty2 = 1.0 - ty1;
 
-    gsk_gl_driver_set_texture_for_pointer (self->gl_driver, node, blurred_texture_id);
-
     if (needs_clip)
       {
         const GskRoundedRect node_clip = transform_rect (self, builder, node_outline);
@@ -2336,12 +2592,70 @@ apply_render_target_op (GskGLRenderer        *self,
 
   glBindFramebuffer (GL_FRAMEBUFFER, op->render_target_id);
 
+  /* The builder sets up the stencil and scissor clips of the new
+   * render target again, if it has any */
+  glDisable (GL_STENCIL_TEST);
+  glColorMask (GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
   if (op->render_target_id != 0)
     glDisable (GL_SCISSOR_TEST);
   else
     gsk_gl_renderer_setup_render_mode (self); /* Reset glScissor etc. */
 }
 
+static inline void
+apply_scissor_op (GskGLRenderer   *self,
+                  const OpScissor *op)
+{
+  if (!op->enabled)
+    {
+      OP_PRINT (" -> Scissor: none");
+
+      if (op->render_target_id != 0)
+        glDisable (GL_SCISSOR_TEST);
+      else
+        gsk_gl_renderer_setup_render_mode (self);
+
+      return;
+    }
+
+  OP_PRINT (" -> Scissor: %d, %d, %d, %d", op->x, op->y, op->width, op->height);
+  glEnable (GL_SCISSOR_TEST);
+  glScissor (op->x, op->y, op->width, op->height);
+}
+
+static inline void
+apply_stencil_op (const OpStencil *op)
+{
+  OP_PRINT (" -> Stencil: %d at level %u", op->mode, op->level);
+
+  switch (op->mode)
+    {
+    case STENCIL_OFF:
+      glDisable (GL_STENCIL_TEST);
+      glColorMask (GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+      break;
+
+    case STENCIL_TEST:
+      glEnable (GL_STENCIL_TEST);
+      glColorMask (GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+      glStencilFunc (GL_EQUAL, op->level, 0xff);
+      glStencilOp (GL_KEEP, GL_KEEP, GL_KEEP);
+      break;
+
+    case STENCIL_INCREMENT:
+    case STENCIL_DECREMENT:
+      glEnable (GL_STENCIL_TEST);
+      glColorMask (GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+      glStencilFunc (GL_EQUAL, op->level, 0xff);
+      glStencilOp (GL_KEEP, GL_KEEP, op->mode == STENCIL_INCREMENT ? GL_INCR : GL_DECR);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
 static inline void
 apply_color_op (const Program *program,
                 const OpColor *op)
@@ -2530,6 +2844,10 @@ gsk_gl_renderer_dispose (GObject *gobject)
   GskGLRenderer *self = GSK_GL_RENDERER (gobject);
 
   ops_free (&self->op_builder);
+  gsk_gl_batcher_free (&self->batcher);
+#ifdef G_ENABLE_DEBUG
+  g_clear_pointer (&self->cached_regions, g_array_unref);
+#endif
 
   G_OBJECT_CLASS (gsk_gl_renderer_parent_class)->dispose (gobject);
 }
@@ -2581,6 +2899,7 @@ gsk_gl_renderer_create_programs (GskGLRenderer  *self,
 {
   GskGLShaderBuilder shader_builder;
   GskGLRendererPrograms *programs = NULL;
+  gboolean has_instanced_arrays = FALSE;
   int i;
   static const struct {
     const char *resource_path;
@@ -2595,9 +2914,11 @@ gsk_gl_renderer_create_programs (GskGLRenderer  *self,
     { "/org/gtk/libgsk/glsl/coloring.glsl",                  "coloring" },
     { "/org/gtk/libgsk/glsl/cross_fade.glsl",                "cross fade" },
     { "/org/gtk/libgsk/glsl/inset_shadow.glsl",              "inset shadow" },
+    { "/org/gtk/libgsk/glsl/instanced.glsl",                 "instanced" },
     { "/org/gtk/libgsk/glsl/linear_gradient.glsl",           "linear gradient" },
     { "/org/gtk/libgsk/glsl/outset_shadow.glsl",             "outset shadow" },
     { "/org/gtk/libgsk/glsl/repeat.glsl",                    "repeat" },
+    { "/org/gtk/libgsk/glsl/stencil.glsl",                   "stencil" },
     { "/org/gtk/libgsk/glsl/unblurred_outset_shadow.glsl",   "unblurred_outset shadow" },
   };
 
@@ -2638,6 +2959,18 @@ gsk_gl_renderer_create_programs (GskGLRenderer  *self,
       shader_builder.gl3 = TRUE;
     }
 
+  gsk_gl_shader_builder_enable_binary_cache (&shader_builder, self->gl_context);
+
+  /* GDK can create 3.2 core contexts, glVertexAttribDivisor() is 3.3 */
+  if (shader_builder.gl3)
+    {
+      int maj, min;
+
+      gdk_gl_context_get_version (self->gl_context, &maj, &min);
+      has_instanced_arrays = maj > 3 || (maj == 3 && min >= 3) ||
+                             epoxy_has_gl_extension ("GL_ARB_instanced_arrays");
+    }
+
   programs = gsk_gl_renderer_programs_new ();
 
   for (i = 0; i < GL_N_PROGRAMS; i ++)
@@ -2645,6 +2978,12 @@ gsk_gl_renderer_create_programs (GskGLRenderer  *self,
       Program *prog = &programs->programs[i];
 
       prog->index = i;
+
+      /* Needs gl_VertexID and instanced arrays. Without it, the nodes
+       * it would draw use their own programs instead. */
+      if (prog == &programs->instanced_program && !has_instanced_arrays)
+        continue;
+
       prog->id = gsk_gl_shader_builder_create_program (&shader_builder,
                                                        program_definitions[i].resource_path,
                                                        error);
@@ -2688,6 +3027,9 @@ gsk_gl_renderer_create_programs (GskGLRenderer  *self,
   INIT_PROGRAM_UNIFORM_LOCATION (inset_shadow, offset);
   INIT_PROGRAM_UNIFORM_LOCATION (inset_shadow, outline_rect);
 
+  /* instanced */
+  programs->instanced_program.instanced = TRUE;
+
   /* outset shadow */
   INIT_PROGRAM_UNIFORM_LOCATION (outset_shadow, color);
   INIT_PROGRAM_UNIFORM_LOCATION (outset_shadow, outline_rect);
@@ -2721,10 +3063,19 @@ gsk_gl_renderer_create_programs (GskGLRenderer  *self,
    * work in gles. */
   for (i = 0; i < GL_N_PROGRAMS; i++)
     {
+      if (programs->programs[i].id == 0)
+        continue;
+
       glUseProgram(programs->programs[i].id);
       glUniform1f (programs->programs[i].alpha_location, 1.0);
     }
 
+  if (shader_builder.cache_dir != NULL)
+    GSK_RENDERER_NOTE (GSK_RENDERER (self), SHADERS,
+                       g_message ("Loaded %u programs from %s, compiled %u",
+                                  shader_builder.n_cache_hits, shader_builder.cache_dir,
+                                  shader_builder.n_cache_misses));
+
 out:
   gsk_gl_shader_builder_finish (&shader_builder);
 
@@ -2819,6 +3170,69 @@ get_icon_cache_for_display (GdkDisplay *display,
   return gsk_gl_icon_cache_ref (icon_cache);
 }
 
+static void
+setup_quad_attributes (gsize offset)
+{
+  glEnableVertexAttribArray (GSK_GL_ATTRIB_POSITION);
+  glVertexAttribPointer (GSK_GL_ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE,
+                         sizeof (GskQuadVertex),
+                         (void *) (offset + G_STRUCT_OFFSET (GskQuadVertex, position)));
+  glEnableVertexAttribArray (GSK_GL_ATTRIB_UV);
+  glVertexAttribPointer (GSK_GL_ATTRIB_UV, 2, GL_FLOAT, GL_FALSE,
+                         sizeof (GskQuadVertex),
+                         (void *) (offset + G_STRUCT_OFFSET (GskQuadVertex, uv)));
+}
+
+static void
+setup_instance_attribute (guint location,
+                          gsize offset)
+{
+  glEnableVertexAttribArray (location);
+  glVertexAttribPointer (location, 4, GL_FLOAT, GL_FALSE,
+                         sizeof (GskGLInstance), (void *) offset);
+  glVertexAttribDivisor (location, 1);
+}
+
+static void
+setup_instance_attributes (gsize offset)
+{
+  setup_instance_attribute (GSK_GL_ATTRIB_RECT, offset + G_STRUCT_OFFSET (GskGLInstance, rect));
+  setup_instance_attribute (GSK_GL_ATTRIB_COLOR, offset + G_STRUCT_OFFSET (GskGLInstance, color));
+  setup_instance_attribute (GSK_GL_ATTRIB_OUTLINE + 0, offset + G_STRUCT_OFFSET (GskGLInstance, outline[0]));
+  setup_instance_attribute (GSK_GL_ATTRIB_OUTLINE + 1, offset + G_STRUCT_OFFSET (GskGLInstance, outline[4]));
+  setup_instance_attribute (GSK_GL_ATTRIB_OUTLINE + 2, offset + G_STRUCT_OFFSET (GskGLInstance, outline[8]));
+  setup_instance_attribute (GSK_GL_ATTRIB_PARAMS, offset + G_STRUCT_OFFSET (GskGLInstance, params));
+  setup_instance_attribute (GSK_GL_ATTRIB_CLIP + 0, offset + G_STRUCT_OFFSET (GskGLInstance, clip[0]));
+  setup_instance_attribute (GSK_GL_ATTRIB_CLIP + 1, offset + G_STRUCT_OFFSET (GskGLInstance, clip[4]));
+  setup_instance_attribute (GSK_GL_ATTRIB_CLIP + 2, offset + G_STRUCT_OFFSET (GskGLInstance, clip[8]));
+}
+
+/* The stencil size can only be queried like this for the default
+ * framebuffer, which is what we clip in for the root render target. */
+static void
+query_stencil_bits (GskGLRenderer *self)
+{
+  int prev_fbo;
+
+  self->stencil_bits = 0;
+
+  glGetIntegerv (GL_FRAMEBUFFER_BINDING, &prev_fbo);
+  glBindFramebuffer (GL_FRAMEBUFFER, 0);
+
+  if (gdk_gl_context_get_use_es (self->gl_context) ||
+      gdk_gl_context_is_legacy (self->gl_context))
+    glGetIntegerv (GL_STENCIL_BITS, &self->stencil_bits);
+  else
+    glGetFramebufferAttachmentParameteriv (GL_FRAMEBUFFER, GL_STENCIL,
+                                           GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE,
+                                           &self->stencil_bits);
+
+  glBindFramebuffer (GL_FRAMEBUFFER, prev_fbo);
+
+  GSK_RENDERER_NOTE (GSK_RENDERER (self), OPENGL,
+                     g_message ("Framebuffer stencil bits: %d", self->stencil_bits));
+}
+
 static gboolean
 gsk_gl_renderer_realize (GskRenderer  *renderer,
                          GdkSurface    *surface,
@@ -2845,6 +3259,8 @@ gsk_gl_renderer_realize (GskRenderer  *renderer,
   g_assert (self->gl_driver == NULL);
   self->gl_profiler = gsk_gl_profiler_new (self->gl_context);
   self->gl_driver = gsk_gl_driver_new (self->gl_context);
+  gsk_gl_vertex_buffer_init (&self->vertex_buffer, self->gl_context, setup_quad_attributes);
+  query_stencil_bits (self);
 
   GSK_RENDERER_NOTE (renderer, OPENGL, g_message ("Creating buffers and programs"));
   self->programs = get_programs_for_display (self, gdk_surface_get_display (surface), error);
@@ -2852,10 +3268,14 @@ gsk_gl_renderer_realize (GskRenderer  *renderer,
     return FALSE;
   self->op_builder.programs = self->programs;
 
+  if (use_instancing (self))
+    gsk_gl_vertex_buffer_init (&self->instance_buffer, self->gl_context, setup_instance_attributes);
+
   self->atlases = get_texture_atlases_for_display (gdk_surface_get_display (surface));
   self->glyph_cache = get_glyph_cache_for_display (gdk_surface_get_display (surface), self->atlases);
   self->icon_cache = get_icon_cache_for_display (gdk_surface_get_display (surface), self->atlases);
   gsk_gl_shadow_cache_init (&self->shadow_cache);
+  gsk_gl_offscreen_cache_init (&self->offscreen_cache);
 
   if (GDK_PROFILER_IS_RUNNING)
     gdk_profiler_end_mark (before, "gl renderer realize", NULL);
@@ -2884,6 +3304,10 @@ gsk_gl_renderer_unrealize (GskRenderer *renderer)
   g_clear_pointer (&self->icon_cache, gsk_gl_icon_cache_unref);
   g_clear_pointer (&self->atlases, gsk_gl_texture_atlases_unref);
   gsk_gl_shadow_cache_free (&self->shadow_cache, self->gl_driver);
+  gsk_gl_offscreen_cache_free (&self->offscreen_cache, self->gl_driver);
+  gsk_gl_vertex_buffer_free (&self->vertex_buffer);
+  if (self->instance_buffer.vao_id != 0)
+    gsk_gl_vertex_buffer_free (&self->instance_buffer);
 
   g_clear_object (&self->gl_profiler);
   g_clear_object (&self->gl_driver);
@@ -2933,10 +3357,8 @@ gsk_gl_renderer_setup_render_mode (GskGLRenderer *self)
       cairo_rectangle_int_t extents;
       int surface_height;
 
-      g_assert (cairo_region_num_rectangles (self->render_region) == 1);
-
       surface_height = gdk_surface_get_height (surface) * self->scale_factor;
-      cairo_region_get_rectangle (self->render_region, 0, &extents);
+      cairo_region_get_rectangle (self->render_region, self->render_pass, &extents);
 
       glEnable (GL_SCISSOR_TEST);
       glScissor (extents.x * self->scale_factor,
@@ -2967,9 +3389,18 @@ gsk_gl_renderer_add_render_ops (GskGLRenderer   *self,
 
     if (!graphene_rect_intersection (&builder->current_clip->bounds,
                                      &transformed_node_bounds, NULL))
-      return;
+      {
+#ifdef G_ENABLE_DEBUG
+        self->n_culled_nodes ++;
+#endif
+        return;
+      }
   }
 
+#ifdef G_ENABLE_DEBUG
+  self->n_drawn_nodes ++;
+#endif
+
   switch (gsk_render_node_get_node_type (node))
     {
     case GSK_NOT_A_RENDER_NODE:
@@ -3103,6 +3534,7 @@ add_offscreen_ops (GskGLRenderer         *self,
   graphene_rect_t prev_viewport;
   graphene_matrix_t item_proj;
   float prev_opacity = 1.0;
+  GskGLOffscreenCacheKey key;
   int texture_id = 0;
   int max_texture_size;
 
@@ -3127,17 +3559,21 @@ add_offscreen_ops (GskGLRenderer         *self,
     }
 
   /* Check if we've already cached the drawn texture. */
-  {
-    const int cached_id = gsk_gl_driver_get_texture_for_pointer (self->gl_driver, child_node);
+  if ((flags & NO_CACHE_PLZ) == 0)
+    {
+      int cached_id;
 
-    if (cached_id != 0)
-      {
-        init_full_texture_region (texture_region_out, cached_id);
-        /* We didn't render it offscreen, but hand out an offscreen texture id */
-        *is_offscreen = TRUE;
-        return TRUE;
-      }
-  }
+      init_offscreen_cache_key (&key, builder, child_node, bounds, flags);
+      cached_id = lookup_offscreen (self, builder, &key);
+
+      if (cached_id != 0)
+        {
+          init_full_texture_region (texture_region_out, cached_id);
+          /* We didn't render it offscreen, but hand out an offscreen texture id */
+          *is_offscreen = TRUE;
+          return TRUE;
+        }
+    }
 
   scale = ops_get_scale (builder);
   width = bounds->size.width;
@@ -3235,7 +3671,8 @@ add_offscreen_ops (GskGLRenderer         *self,
   init_full_texture_region (texture_region_out, texture_id);
 
   if ((flags & NO_CACHE_PLZ) == 0)
-    gsk_gl_driver_set_texture_for_pointer (self->gl_driver, child_node, texture_id);
+    gsk_gl_offscreen_cache_commit (&self->offscreen_cache, self->gl_driver, &key,
+                                   texture_id, width, height);
 
   return TRUE;
 }
@@ -3244,35 +3681,51 @@ static void
 gsk_gl_renderer_render_ops (GskGLRenderer *self)
 {
   const Program *program = NULL;
-  const gsize vertex_data_size = self->op_builder.vertices->len * sizeof (GskQuadVertex);
-  const float *vertex_data = (float *)self->op_builder.vertices->data;
   OpBufferIter iter;
   OpKind kind;
   gpointer ptr;
-  GLuint buffer_id, vao_id;
+  gsize base_vertex;
+  gsize instance_base = 0;
+  gboolean instanced = FALSE;
 
 #if DEBUG_OPS
   g_print ("============================================\n");
 #endif
 
-  glGenVertexArrays (1, &vao_id);
-  glBindVertexArray (vao_id);
+  if (self->op_builder.instances->len > 0)
+    instance_base = gsk_gl_vertex_buffer_upload (&self->instance_buffer,
+                                                 self->op_builder.instances->data,
+                                                 self->op_builder.instances->len * sizeof (GskGLInstance));
+
+  /* Leaves the quad VAO bound */
+  base_vertex = gsk_gl_vertex_buffer_upload (&self->vertex_buffer,
+                                             self->op_builder.vertices->data,
+                                             self->op_builder.vertices->len * sizeof (GskQuadVertex));
+  base_vertex /= sizeof (GskQuadVertex);
+
+#ifdef G_ENABLE_DEBUG
+  {
+    GskProfiler *profiler = gsk_renderer_get_profiler (GSK_RENDERER (self));
+    gsize uploaded_bytes = self->vertex_buffer.uploaded_bytes;
+    guint n_stalls = self->vertex_buffer.n_stalls;
 
-  glGenBuffers (1, &buffer_id);
-  glBindBuffer (GL_ARRAY_BUFFER, buffer_id);
+    if (self->op_builder.instances->len > 0)
+      {
+        uploaded_bytes += self->instance_buffer.uploaded_bytes;
+        n_stalls += self->instance_buffer.n_stalls;
+      }
 
-  glBufferData (GL_ARRAY_BUFFER, vertex_data_size, vertex_data, GL_STATIC_DRAW);
+    gsk_profiler_counter_set (profiler, self->profile_counters.vertex_bytes, uploaded_bytes);
+    gsk_profiler_counter_set (profiler, self->profile_counters.vertex_stalls, n_stalls);
+  }
+#endif
 
-  /* 0 = position location */
-  glEnableVertexAttribArray (0);
-  glVertexAttribPointer (0, 2, GL_FLOAT, GL_FALSE,
-                         sizeof (GskQuadVertex),
-                         (void *) G_STRUCT_OFFSET (GskQuadVertex, position));
-  /* 1 = texture coord location */
-  glEnableVertexAttribArray (1);
-  glVertexAttribPointer (1, 2, GL_FLOAT, GL_FALSE,
-                         sizeof (GskQuadVertex),
-                         (void *) G_STRUCT_OFFSET (GskQuadVertex, uv));
+  /* Stencil clips on the default framebuffer start at level 0 */
+  if (self->stencil_bits > 0)
+    {
+      glClearStencil (0);
+      glClear (GL_STENCIL_BUFFER_BIT);
+    }
 
   op_buffer_iter_init (&iter, ops_get_buffer (&self->op_builder));
   while ((ptr = op_buffer_iter_next (&iter, &kind)))
@@ -3285,6 +3738,8 @@ gsk_gl_renderer_render_ops (GskGLRenderer *self)
           kind != OP_POP_DEBUG_GROUP &&
           kind != OP_CHANGE_PROGRAM &&
           kind != OP_CHANGE_RENDER_TARGET &&
+          kind != OP_CHANGE_SCISSOR &&
+          kind != OP_CHANGE_STENCIL &&
           kind != OP_CLEAR)
         continue;
 
@@ -3312,6 +3767,14 @@ gsk_gl_renderer_render_ops (GskGLRenderer *self)
           apply_render_target_op (self, program, ptr);
           break;
 
+        case OP_CHANGE_SCISSOR:
+          apply_scissor_op (self, ptr);
+          break;
+
+        case OP_CHANGE_STENCIL:
+          apply_stencil_op (ptr);
+          break;
+
         case OP_CLEAR:
           glClearColor (0, 0, 0, 0);
           glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -3395,7 +3858,32 @@ gsk_gl_renderer_render_ops (GskGLRenderer *self)
 
             OP_PRINT (" -> draw %ld, size %ld and program %d\n",
                       op->vao_offset, op->vao_size, program->index);
-            glDrawArrays (GL_TRIANGLES, op->vao_offset, op->vao_size);
+
+            if (instanced)
+              {
+                glBindVertexArray (self->vertex_buffer.vao_id);
+                instanced = FALSE;
+              }
+
+            glDrawArrays (GL_TRIANGLES, base_vertex + op->vao_offset, op->vao_size);
+            break;
+          }
+
+        case OP_DRAW_INSTANCED:
+          {
+            const OpDrawInstanced *op = ptr;
+
+            OP_PRINT (" -> draw %ld instances from %ld with program %d\n",
+                      op->n_instances, op->instance_offset, program->index);
+
+            /* Instance attributes have no base instance before GL 4.2,
+             * so point them at the first instance of the draw instead. */
+            glBindVertexArray (self->instance_buffer.vao_id);
+            glBindBuffer (GL_ARRAY_BUFFER, self->instance_buffer.buffer_id);
+            setup_instance_attributes (instance_base + op->instance_offset * sizeof (GskGLInstance));
+            instanced = TRUE;
+
+            glDrawArraysInstanced (GL_TRIANGLES, 0, GL_N_VERTICES, op->n_instances);
             break;
           }
 
@@ -3428,36 +3916,22 @@ gsk_gl_renderer_render_ops (GskGLRenderer *self)
       OP_PRINT ("\n");
     }
 
-  glDeleteVertexArrays (1, &vao_id);
-  glDeleteBuffers (1, &buffer_id);
+  glDisable (GL_STENCIL_TEST);
+  glColorMask (GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 }
 
+/* Builds and renders the ops for one rectangle of the render region */
 static void
-gsk_gl_renderer_do_render (GskRenderer           *renderer,
-                           GskRenderNode         *root,
-                           const graphene_rect_t *viewport,
-                           int                    fbo_id,
-                           int                    scale_factor)
+gsk_gl_renderer_render_pass (GskGLRenderer         *self,
+                             GskRenderNode         *root,
+                             const graphene_rect_t *viewport,
+                             int                    fbo_id,
+                             int                    scale_factor)
 {
-  GskGLRenderer *self = GSK_GL_RENDERER (renderer);
   graphene_matrix_t projection;
-#ifdef G_ENABLE_DEBUG
-  GskProfiler *profiler;
-  gint64 gpu_time, cpu_time, start_time;
-#endif
-  GPtrArray *removed;
-
-#ifdef G_ENABLE_DEBUG
-  profiler = gsk_renderer_get_profiler (renderer);
-#endif
 
-  if (self->gl_context == NULL)
-    {
-      GSK_RENDERER_NOTE (renderer, OPENGL, g_message ("No valid GL context associated to the renderer"));
-      return;
-    }
-
-  g_assert (gsk_gl_driver_in_frame (self->gl_driver));
+  /* Drop the ops and vertices of the previous pass */
+  ops_reset (&self->op_builder);
 
   /* Set up the modelview and projection matrices to fit our viewport */
   graphene_matrix_init_ortho (&projection,
@@ -3469,24 +3943,18 @@ gsk_gl_renderer_do_render (GskRenderer           *renderer,
                               ORTHO_FAR_PLANE);
   graphene_matrix_scale (&projection, 1, -1, 1);
 
-  removed = g_ptr_array_new ();
-  gsk_gl_texture_atlases_begin_frame (self->atlases, removed);
-  gsk_gl_glyph_cache_begin_frame (self->glyph_cache, self->gl_driver, removed);
-  gsk_gl_icon_cache_begin_frame (self->icon_cache, removed);
-  gsk_gl_shadow_cache_begin_frame (&self->shadow_cache, self->gl_driver);
-  g_ptr_array_unref (removed);
-
   ops_set_projection (&self->op_builder, &projection);
   ops_set_viewport (&self->op_builder, viewport);
   ops_set_modelview (&self->op_builder, gsk_transform_scale (NULL, scale_factor, scale_factor));
 
-  /* Initial clip is self->render_region! */
+  /* Initial clip is the rectangle of this pass, so everything
+   * outside of it gets culled while adding the render ops */
   if (self->render_region != NULL)
     {
       graphene_rect_t transformed_render_region;
       cairo_rectangle_int_t render_extents;
 
-      cairo_region_get_extents (self->render_region, &render_extents);
+      cairo_region_get_rectangle (self->render_region, self->render_pass, &render_extents);
 
       ops_transform_bounds_modelview (&self->op_builder,
                                       &GRAPHENE_RECT_INIT (render_extents.x,
@@ -3512,23 +3980,37 @@ gsk_gl_renderer_do_render (GskRenderer           *renderer,
   if (fbo_id != 0)
     ops_set_render_target (&self->op_builder, fbo_id);
 
+  gsk_gl_batcher_begin_frame (&self->batcher, self->programs);
+
+#ifdef G_ENABLE_DEBUG
+  self->root_render_target = fbo_id;
+#endif
+
   gdk_gl_context_push_debug_group (self->gl_context, "Adding render ops");
   gsk_gl_renderer_add_render_ops (self, root, &self->op_builder);
   gdk_gl_context_pop_debug_group (self->gl_context);
 
+#ifdef G_ENABLE_DEBUG
+  if (GSK_RENDERER_DEBUG_CHECK (GSK_RENDERER (self), OFFSCREEN_CACHE))
+    add_cached_region_ops (self, &self->op_builder);
+#endif
+
+  /* Glyphs have been rasterized in parallel while we added the ops */
+  gsk_gl_glyph_cache_upload_pending (self->glyph_cache);
+
   /* We correctly reset the state everywhere */
   g_assert_cmpint (self->op_builder.current_render_target, ==, fbo_id);
   ops_pop_modelview (&self->op_builder);
   ops_pop_clip (&self->op_builder);
   ops_finish (&self->op_builder);
 
-  /*g_message ("Ops: %u", self->render_ops->len);*/
+  gsk_gl_batcher_process (&self->batcher, &self->op_builder);
+  GSK_RENDERER_NOTE (GSK_RENDERER (self), BATCHING,
+                     g_message ("Draws: %u before batching, %u after",
+                                self->batcher.n_draws_before,
+                                self->batcher.n_draws_after));
 
-  /* Now actually draw things... */
-#ifdef G_ENABLE_DEBUG
-  gsk_gl_profiler_begin_gpu_region (self->gl_profiler);
-  gsk_profiler_timer_begin (profiler, self->profile_timers.cpu_time);
-#endif
+  /*g_message ("Ops: %u", self->render_ops->len);*/
 
   /* Actually do the rendering */
   if (fbo_id != 0)
@@ -3549,9 +4031,73 @@ gsk_gl_renderer_do_render (GskRenderer           *renderer,
   gdk_gl_context_push_debug_group (self->gl_context, "Rendering ops");
   gsk_gl_renderer_render_ops (self);
   gdk_gl_context_pop_debug_group (self->gl_context);
+}
+
+static void
+gsk_gl_renderer_do_render (GskRenderer           *renderer,
+                           GskRenderNode         *root,
+                           const graphene_rect_t *viewport,
+                           int                    fbo_id,
+                           int                    scale_factor)
+{
+  GskGLRenderer *self = GSK_GL_RENDERER (renderer);
+#ifdef G_ENABLE_DEBUG
+  GskProfiler *profiler;
+  gint64 gpu_time, cpu_time, start_time;
+#endif
+  GPtrArray *removed;
+  int n_passes;
+
+#ifdef G_ENABLE_DEBUG
+  profiler = gsk_renderer_get_profiler (renderer);
+#endif
+
+  if (self->gl_context == NULL)
+    {
+      GSK_RENDERER_NOTE (renderer, OPENGL, g_message ("No valid GL context associated to the renderer"));
+      return;
+    }
+
+  g_assert (gsk_gl_driver_in_frame (self->gl_driver));
+
+  removed = g_ptr_array_new ();
+  gsk_gl_texture_atlases_begin_frame (self->atlases, removed);
+  gsk_gl_glyph_cache_begin_frame (self->glyph_cache, self->gl_driver, removed);
+  gsk_gl_icon_cache_begin_frame (self->icon_cache, removed);
+  gsk_gl_texture_atlases_free_removed (self->atlases, removed);
+  gsk_gl_shadow_cache_begin_frame (&self->shadow_cache, self->gl_driver);
+  gsk_gl_offscreen_cache_begin_frame (&self->offscreen_cache, self->gl_driver);
+  g_ptr_array_unref (removed);
+
+  /* Now actually draw things... */
+#ifdef G_ENABLE_DEBUG
+  self->n_drawn_nodes = 0;
+  self->n_culled_nodes = 0;
+  gsk_gl_profiler_begin_gpu_region (self->gl_profiler);
+  gsk_profiler_timer_begin (profiler, self->profile_timers.cpu_time);
+#endif
+
+  n_passes = self->render_region ? cairo_region_num_rectangles (self->render_region) : 1;
+  for (self->render_pass = 0; self->render_pass < n_passes; self->render_pass ++)
+    gsk_gl_renderer_render_pass (self, root, viewport, fbo_id, scale_factor);
+  self->render_pass = 0;
+
+  /* All passes upload into the same region of the buffers */
+  gsk_gl_vertex_buffer_end_frame (&self->vertex_buffer);
+  if (use_instancing (self))
+    gsk_gl_vertex_buffer_end_frame (&self->instance_buffer);
 
 #ifdef G_ENABLE_DEBUG
   gsk_profiler_counter_inc (profiler, self->profile_counters.frames);
+  gsk_profiler_counter_set (profiler, self->profile_counters.nodes_drawn, self->n_drawn_nodes);
+  gsk_profiler_counter_set (profiler, self->profile_counters.nodes_culled, self->n_culled_nodes);
+  gsk_profiler_counter_set (profiler, self->profile_counters.atlas_occupancy,
+                            100 * gsk_gl_texture_atlases_get_occupancy (self->atlases));
+  gsk_profiler_counter_set (profiler, self->profile_counters.atlas_moves, self->atlases->n_moved);
+  gsk_profiler_counter_set (profiler, self->profile_counters.atlas_evictions, self->atlases->n_evicted);
+  gsk_profiler_counter_set (profiler, self->profile_counters.atlas_uploads, self->atlases->n_uploaded);
+  gsk_profiler_counter_set (profiler, self->profile_counters.offscreen_hits, self->offscreen_cache.n_hits);
+  gsk_profiler_counter_set (profiler, self->profile_counters.offscreen_misses, self->offscreen_cache.n_misses);
 
   start_time = gsk_profiler_timer_get_start (profiler, self->profile_timers.cpu_time);
   cpu_time = gsk_profiler_timer_end (profiler, self->profile_timers.cpu_time);
@@ -3627,6 +4173,32 @@ gsk_gl_renderer_render_texture (GskRenderer           *renderer,
   return texture;
 }
 
+/* Every pass builds and renders the ops of the nodes in one rectangle,
+ * so more passes only pay off if they leave out a lot of the extents,
+ * e.g. a blinking cursor and a spinner far away from each other. */
+#define MAX_RENDER_PASSES 3
+
+static gboolean
+render_region_is_worth_splitting (const cairo_region_t        *region,
+                                  const cairo_rectangle_int_t *extents)
+{
+  const int n_rects = cairo_region_num_rectangles (region);
+  cairo_rectangle_int_t rect;
+  gint64 area = 0;
+  int i;
+
+  if (n_rects < 2 || n_rects > MAX_RENDER_PASSES)
+    return FALSE;
+
+  for (i = 0; i < n_rects; i ++)
+    {
+      cairo_region_get_rectangle (region, i, &rect);
+      area += (gint64) rect.width * rect.height;
+    }
+
+  return area * 2 < (gint64) extents->width * extents->height;
+}
+
 static void
 gsk_gl_renderer_render (GskRenderer          *renderer,
                         GskRenderNode        *root,
@@ -3669,6 +4241,8 @@ gsk_gl_renderer_render (GskRenderer          *renderer,
 
       if (gdk_rectangle_equal (&extents, &whole_surface))
         self->render_region = NULL;
+      else if (render_region_is_worth_splitting (damage, &extents))
+        self->render_region = cairo_region_copy (damage);
       else
         self->render_region = cairo_region_create_rectangle (&extents);
     }
@@ -3716,12 +4290,25 @@ gsk_gl_renderer_init (GskGLRenderer *self)
 
   ops_init (&self->op_builder);
   self->op_builder.renderer = self;
+  gsk_gl_batcher_init (&self->batcher);
 
 #ifdef G_ENABLE_DEBUG
   {
     GskProfiler *profiler = gsk_renderer_get_profiler (GSK_RENDERER (self));
 
     self->profile_counters.frames = gsk_profiler_add_counter (profiler, "frames", "Frames", FALSE);
+    self->profile_counters.nodes_drawn = gsk_profiler_add_counter (profiler, "nodes-drawn", "Nodes drawn", TRUE);
+    self->profile_counters.nodes_culled = gsk_profiler_add_counter (profiler, "nodes-culled", "Nodes culled", TRUE);
+    self->profile_counters.vertex_bytes = gsk_profiler_add_counter (profiler, "vertex-bytes", "Vertex bytes uploaded", TRUE);
+    self->profile_counters.vertex_stalls = gsk_profiler_add_counter (profiler, "vertex-stalls", "Vertex buffer stalls", TRUE);
+    self->profile_counters.atlas_occupancy = gsk_profiler_add_counter (profiler, "atlas-occupancy", "Atlas occupancy (%)", TRUE);
+    self->profile_counters.atlas_moves = gsk_profiler_add_counter (profiler, "atlas-moves", "Atlas entries moved", TRUE);
+    self->profile_counters.atlas_evictions = gsk_profiler_add_counter (profiler, "atlas-evictions", "Atlas entries evicted", TRUE);
+    self->profile_counters.atlas_uploads = gsk_profiler_add_counter (profiler, "atlas-uploads", "Atlas entries uploaded", TRUE);
+    self->profile_counters.offscreen_hits = gsk_profiler_add_counter (profiler, "offscreen-hits", "Offscreen cache hits", TRUE);
+    self->profile_counters.offscreen_misses = gsk_profiler_add_counter (profiler, "offscreen-misses", "Offscreen cache misses", TRUE);
+
+    self->cached_regions = g_array_new (FALSE, FALSE, sizeof (graphene_rect_t));
 
     self->profile_timers.cpu_time = gsk_profiler_add_timer (profiler, "cpu-time", "CPU time", FALSE, TRUE);
     self->profile_timers.gpu_time = gsk_profiler_add_timer (profiler, "gpu-time", "GPU time", FALSE, TRUE);
@@ -1,6 +1,24 @@
 #include "gskglrenderopsprivate.h"
 #include "gsktransform.h"
 
+#include <math.h>
+
+typedef struct
+{
+  int render_target;
+  /* In framebuffer pixels */
+  int x;
+  int y;
+  int width;
+  int height;
+} ScissorStackEntry;
+
+typedef struct
+{
+  int render_target;
+  GskRoundedRect clip;
+} StencilStackEntry;
+
 static inline gboolean
 rect_equal (const graphene_rect_t *a,
             const graphene_rect_t *b)
@@ -68,6 +86,9 @@ ops_finish (RenderOpBuilder *builder)
     g_array_free (builder->clip_stack, TRUE);
   builder->clip_stack = NULL;
 
+  g_assert (builder->scissor_stack == NULL || builder->scissor_stack->len == 0);
+  g_assert (builder->stencil_stack == NULL || builder->stencil_stack->len == 0);
+
   builder->dx = 0;
   builder->dy = 0;
   builder->scale_x = 1;
@@ -200,12 +221,16 @@ ops_init (RenderOpBuilder *builder)
 
   op_buffer_init (&builder->render_ops);
   builder->vertices = g_array_new (FALSE, TRUE, sizeof (GskQuadVertex));
+  builder->instances = g_array_new (FALSE, TRUE, sizeof (GskGLInstance));
 }
 
 void
 ops_free (RenderOpBuilder *builder)
 {
+  g_clear_pointer (&builder->scissor_stack, g_array_unref);
+  g_clear_pointer (&builder->stencil_stack, g_array_unref);
   g_array_unref (builder->vertices);
+  g_array_unref (builder->instances);
   op_buffer_destroy (&builder->render_ops);
 }
 
@@ -255,6 +280,10 @@ ops_set_program (RenderOpBuilder *builder,
       program_state->viewport = builder->current_viewport;
     }
 
+  /* Instanced programs take clip and opacity from the instance data */
+  if (program->instanced)
+    return;
+
   if (!rounded_rect_equal (builder->current_clip, &program_state->clip))
     {
       OpClip *opc;
@@ -286,6 +315,9 @@ ops_set_clip (RenderOpBuilder      *builder,
       rounded_rect_equal (&current_program_state->clip, clip))
     return;
 
+  if (builder->current_program && builder->current_program->instanced)
+    return;
+
   if (!(op = op_buffer_peek_tail_checked (&builder->render_ops, OP_CHANGE_CLIP)))
     {
       op = op_buffer_add (&builder->render_ops, OP_CHANGE_CLIP);
@@ -348,6 +380,197 @@ ops_has_clip (RenderOpBuilder *self)
          self->clip_stack->len > 1;
 }
 
+/* Scissor and stencil clips only apply to the render target they were
+ * pushed for. Since they are properly nested, those are always the
+ * topmost entries of the stacks. */
+static const ScissorStackEntry *
+peek_scissor (RenderOpBuilder *builder)
+{
+  const ScissorStackEntry *entry;
+
+  if (builder->scissor_stack == NULL || builder->scissor_stack->len == 0)
+    return NULL;
+
+  entry = &g_array_index (builder->scissor_stack, ScissorStackEntry, builder->scissor_stack->len - 1);
+  if (entry->render_target != builder->current_render_target)
+    return NULL;
+
+  return entry;
+}
+
+static void
+sync_scissor (RenderOpBuilder *builder)
+{
+  const ScissorStackEntry *entry = peek_scissor (builder);
+  OpScissor *op;
+
+  if (!(op = op_buffer_peek_tail_checked (&builder->render_ops, OP_CHANGE_SCISSOR)))
+    op = op_buffer_add (&builder->render_ops, OP_CHANGE_SCISSOR);
+
+  op->render_target_id = builder->current_render_target;
+  op->enabled = entry != NULL;
+  if (entry != NULL)
+    {
+      op->x = entry->x;
+      op->y = entry->y;
+      op->width = entry->width;
+      op->height = entry->height;
+    }
+}
+
+/* @rect is in the same coordinates as the clip, i.e. transformed by
+ * the modelview. It gets intersected with the current scissor rect. */
+void
+ops_push_scissor (RenderOpBuilder       *builder,
+                  const graphene_rect_t *rect)
+{
+  const graphene_rect_t *viewport = &builder->current_viewport;
+  const ScissorStackEntry *prev;
+  ScissorStackEntry entry;
+  int x1, y1, x2, y2;
+
+  if (G_UNLIKELY (builder->scissor_stack == NULL))
+    builder->scissor_stack = g_array_new (FALSE, FALSE, sizeof (ScissorStackEntry));
+
+  /* Same pixels as the shader clip, which checks pixel centers, and
+   * flipped like gl_FragCoord. */
+  x1 = ceilf (rect->origin.x - viewport->origin.x - 0.5f);
+  x2 = ceilf (rect->origin.x + rect->size.width - viewport->origin.x - 0.5f);
+  y1 = ceilf (viewport->origin.y + viewport->size.height - (rect->origin.y + rect->size.height) - 0.5f);
+  y2 = ceilf (viewport->origin.y + viewport->size.height - rect->origin.y - 0.5f);
+
+  prev = peek_scissor (builder);
+  if (prev != NULL)
+    {
+      x1 = MAX (x1, prev->x);
+      y1 = MAX (y1, prev->y);
+      x2 = MIN (x2, prev->x + prev->width);
+      y2 = MIN (y2, prev->y + prev->height);
+    }
+
+  entry.render_target = builder->current_render_target;
+  entry.x = x1;
+  entry.y = y1;
+  entry.width = MAX (x2 - x1, 0);
+  entry.height = MAX (y2 - y1, 0);
+  g_array_append_val (builder->scissor_stack, entry);
+
+  sync_scissor (builder);
+}
+
+void
+ops_pop_scissor (RenderOpBuilder *builder)
+{
+  g_assert (peek_scissor (builder) != NULL);
+
+  g_array_set_size (builder->scissor_stack, builder->scissor_stack->len - 1);
+
+  sync_scissor (builder);
+}
+
+/* The number of stencil clips of the current render target */
+guint
+ops_get_stencil_level (RenderOpBuilder *builder)
+{
+  guint level = 0;
+  int i;
+
+  if (builder->stencil_stack == NULL)
+    return 0;
+
+  for (i = builder->stencil_stack->len - 1; i >= 0; i --)
+    {
+      const StencilStackEntry *entry = &g_array_index (builder->stencil_stack, StencilStackEntry, i);
+
+      if (entry->render_target != builder->current_render_target)
+        break;
+
+      level ++;
+    }
+
+  return level;
+}
+
+static void
+set_stencil (RenderOpBuilder *builder,
+             StencilMode      mode,
+             guint            level)
+{
+  OpStencil *op;
+
+  if (!(op = op_buffer_peek_tail_checked (&builder->render_ops, OP_CHANGE_STENCIL)))
+    op = op_buffer_add (&builder->render_ops, OP_CHANGE_STENCIL);
+
+  op->mode = mode;
+  op->level = level;
+}
+
+static void
+draw_stencil_clip (RenderOpBuilder      *builder,
+                   const GskRoundedRect *clip)
+{
+  const float min_x = clip->bounds.origin.x;
+  const float min_y = clip->bounds.origin.y;
+  const float max_x = min_x + clip->bounds.size.width;
+  const float max_y = min_y + clip->bounds.size.height;
+
+  /* The stencil program discards everything outside the clip */
+  ops_push_clip (builder, clip);
+  ops_set_modelview (builder, NULL);
+  ops_set_program (builder, &builder->programs->stencil_program);
+
+  ops_draw (builder, (GskQuadVertex[GL_N_VERTICES]) {
+    { { min_x, min_y }, { 0, 1 }, },
+    { { min_x, max_y }, { 0, 0 }, },
+    { { max_x, min_y }, { 1, 1 }, },
+
+    { { max_x, max_y }, { 1, 0 }, },
+    { { min_x, max_y }, { 0, 0 }, },
+    { { max_x, min_y }, { 1, 1 }, },
+  });
+
+  ops_pop_modelview (builder);
+  ops_pop_clip (builder);
+}
+
+/* Moves the current clip into the stencil buffer, so a different one
+ * can be pushed. The current render target must have a stencil buffer. */
+void
+ops_push_stencil_clip (RenderOpBuilder *builder)
+{
+  const guint level = ops_get_stencil_level (builder);
+  StencilStackEntry entry;
+
+  if (G_UNLIKELY (builder->stencil_stack == NULL))
+    builder->stencil_stack = g_array_new (FALSE, FALSE, sizeof (StencilStackEntry));
+
+  entry.render_target = builder->current_render_target;
+  entry.clip = *builder->current_clip;
+
+  set_stencil (builder, STENCIL_INCREMENT, level);
+  draw_stencil_clip (builder, &entry.clip);
+  set_stencil (builder, STENCIL_TEST, level + 1);
+
+  g_array_append_val (builder->stencil_stack, entry);
+}
+
+void
+ops_pop_stencil_clip (RenderOpBuilder *builder)
+{
+  const guint level = ops_get_stencil_level (builder);
+  const StencilStackEntry *entry;
+
+  g_assert (level > 0);
+
+  entry = &g_array_index (builder->stencil_stack, StencilStackEntry, builder->stencil_stack->len - 1);
+
+  set_stencil (builder, STENCIL_DECREMENT, level);
+  draw_stencil_clip (builder, &entry->clip);
+  set_stencil (builder, level > 1 ? STENCIL_TEST : STENCIL_OFF, level - 1);
+
+  g_array_set_size (builder->stencil_stack, builder->stencil_stack->len - 1);
+}
+
 static void
 ops_set_modelview_internal (RenderOpBuilder *builder,
                             GskTransform    *transform)
@@ -563,6 +786,13 @@ ops_set_render_target (RenderOpBuilder *builder,
 
   builder->current_render_target = render_target_id;
 
+  /* Changing the render target resets the scissor and stencil test,
+   * so bring back the ones of the new target, if any. */
+  if (peek_scissor (builder) != NULL)
+    sync_scissor (builder);
+  if (ops_get_stencil_level (builder) > 0)
+    set_stencil (builder, STENCIL_TEST, ops_get_stencil_level (builder));
+
   return prev_render_target;
 }
 
@@ -577,14 +807,17 @@ ops_set_opacity (RenderOpBuilder *builder,
   if (builder->current_opacity == opacity)
     return opacity;
 
+  prev_opacity = builder->current_opacity;
+  builder->current_opacity = opacity;
+
+  if (builder->current_program && builder->current_program->instanced)
+    return prev_opacity;
+
   if (!(op = op_buffer_peek_tail_checked (&builder->render_ops, OP_CHANGE_OPACITY)))
     op = op_buffer_add (&builder->render_ops, OP_CHANGE_OPACITY);
 
   op->opacity = opacity;
 
-  prev_opacity = builder->current_opacity;
-  builder->current_opacity = opacity;
-
   if (builder->current_program != NULL)
     current_program_state->opacity = opacity;
 
@@ -712,6 +945,30 @@ ops_draw (RenderOpBuilder     *builder,
   return &g_array_index (builder->vertices, GskQuadVertex, builder->vertices->len - GL_N_VERTICES);
 }
 
+/* Adds an instance to draw with the current (instanced) program.
+ * The caller is expected to fill in all of the returned data. */
+GskGLInstance *
+ops_draw_instance (RenderOpBuilder *builder)
+{
+  OpDrawInstanced *op;
+
+  g_assert (builder->current_program->instanced);
+
+  if ((op = op_buffer_peek_tail_checked (&builder->render_ops, OP_DRAW_INSTANCED)))
+    {
+      op->n_instances ++;
+    }
+  else
+    {
+      op = op_buffer_add (&builder->render_ops, OP_DRAW_INSTANCED);
+      op->instance_offset = builder->instances->len;
+      op->n_instances = 1;
+    }
+
+  g_array_set_size (builder->instances, builder->instances->len + 1);
+  return &g_array_index (builder->instances, GskGLInstance, builder->instances->len - 1);
+}
+
 /* The offset is only valid for the current modelview.
  * Setting a new modelview will add the offset to that matrix
  * and reset the internal offset to 0. */
@@ -736,6 +993,7 @@ ops_reset (RenderOpBuilder *builder)
 {
   op_buffer_clear (&builder->render_ops);
   g_array_set_size (builder->vertices, 0);
+  g_array_set_size (builder->instances, 0);
 }
 
 OpBuffer *
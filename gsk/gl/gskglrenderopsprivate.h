@@ -13,7 +13,19 @@
 #include "opbuffer.h"
 
 #define GL_N_VERTICES 6
-#define GL_N_PROGRAMS 13
+#define GL_N_PROGRAMS 15
+
+/* Per-instance data of the instanced program, see instanced.glsl.
+ * The clip and opacity are part of the instance instead of being
+ * uniforms, so runs of draws with different state can be merged. */
+typedef struct
+{
+  float rect[4];
+  float color[4];     /* Pre-multiplied, including opacity */
+  float outline[12];  /* A GskRoundedRect */
+  float params[4];    /* Spread, x offset, y offset, whether outline is used */
+  float clip[12];     /* A GskRoundedRect */
+} GskGLInstance;
 
 typedef struct
 {
@@ -35,6 +47,8 @@ struct _Program
   int index;        /* Into the renderer's program array */
 
   int id;
+  /* Takes its per-draw state from GskGLInstance */
+  guint instanced : 1;
   /* Common locations (gl_common)*/
   int source_location;
   int position_location;
@@ -139,9 +153,11 @@ typedef struct {
       Program coloring_program;
       Program cross_fade_program;
       Program inset_shadow_program;
+      Program instanced_program;
       Program linear_gradient_program;
       Program outset_shadow_program;
       Program repeat_program;
+      Program stencil_program;
       Program unblurred_outset_shadow_program;
     };
   };
@@ -163,6 +179,7 @@ typedef struct
 
   OpBuffer render_ops;
   GArray *vertices;
+  GArray *instances;
 
   GskGLRenderer *renderer;
 
@@ -174,6 +191,12 @@ typedef struct
   GArray *clip_stack;
   /* Pointer into clip_stack */
   const GskRoundedRect *current_clip;
+
+  /* Clips that are applied with glScissor() and the stencil buffer
+   * in addition to the one in current_clip. Unlike that, they are
+   * global state and not a uniform of the program. */
+  GArray *scissor_stack;
+  GArray *stencil_stack;
 } RenderOpBuilder;
 
 
@@ -203,6 +226,12 @@ void              ops_push_clip          (RenderOpBuilder         *builder,
                                           const GskRoundedRect    *clip);
 void              ops_pop_clip           (RenderOpBuilder         *builder);
 gboolean          ops_has_clip           (RenderOpBuilder         *builder);
+void              ops_push_scissor       (RenderOpBuilder         *builder,
+                                          const graphene_rect_t   *rect);
+void              ops_pop_scissor        (RenderOpBuilder         *builder);
+guint             ops_get_stencil_level  (RenderOpBuilder         *builder);
+void              ops_push_stencil_clip  (RenderOpBuilder         *builder);
+void              ops_pop_stencil_clip   (RenderOpBuilder         *builder);
 
 void              ops_transform_bounds_modelview (const RenderOpBuilder *builder,
                                                   const graphene_rect_t *src,
@@ -240,6 +269,8 @@ void              ops_set_border_color   (RenderOpBuilder         *builder,
 GskQuadVertex *   ops_draw               (RenderOpBuilder        *builder,
                                           const GskQuadVertex     vertex_data[GL_N_VERTICES]);
 
+GskGLInstance *   ops_draw_instance      (RenderOpBuilder        *builder);
+
 void              ops_offset             (RenderOpBuilder        *builder,
                                           float                   x,
                                           float                   y);
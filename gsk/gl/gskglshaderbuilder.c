@@ -6,6 +6,18 @@
 
 #include <gdk/gdk.h>
 #include <epoxy/gl.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <string.h>
+
+/* Cached program binaries start with this, followed by the binary
+ * format as a guint32 in host byte order. Bump the version when
+ * anything that isn't part of the shader source changes how programs
+ * get linked, like the attribute locations. */
+#define BINARY_CACHE_MAGIC "GSKPRG01"
+#define BINARY_CACHE_HEADER_SIZE (sizeof (BINARY_CACHE_MAGIC) - 1 + sizeof (guint32))
+
+#define N_SOURCE_STRINGS 8
 
 void
 gsk_gl_shader_builder_init (GskGLShaderBuilder *self,
@@ -30,6 +42,9 @@ gsk_gl_shader_builder_finish (GskGLShaderBuilder *self)
   g_bytes_unref (self->preamble);
   g_bytes_unref (self->vs_preamble);
   g_bytes_unref (self->fs_preamble);
+
+  g_free (self->cache_dir);
+  g_free (self->driver_id);
 }
 
 void
@@ -39,6 +54,159 @@ gsk_gl_shader_builder_set_glsl_version (GskGLShaderBuilder *self,
   self->version = version;
 }
 
+/* Lets gsk_gl_shader_builder_create_program() load programs from and
+ * save them to the user cache dir, keyed by the driver and the shader
+ * source. The context must be current. */
+void
+gsk_gl_shader_builder_enable_binary_cache (GskGLShaderBuilder *self,
+                                           GdkGLContext       *context)
+{
+  gboolean supported;
+  int n_formats = 0;
+  int maj, min;
+
+  gdk_gl_context_get_version (context, &maj, &min);
+
+  if (gdk_gl_context_get_use_es (context))
+    supported = maj >= 3 || epoxy_has_gl_extension ("GL_OES_get_program_binary");
+  else
+    supported = maj > 4 || (maj == 4 && min >= 1) ||
+                epoxy_has_gl_extension ("GL_ARB_get_program_binary");
+
+  /* Drivers may support the API without supporting any format */
+  if (supported)
+    glGetIntegerv (GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+
+  if (n_formats == 0)
+    {
+      GSK_NOTE (SHADERS, g_message ("Program binaries not supported, not caching programs"));
+      return;
+    }
+
+  self->driver_id = g_strdup_printf ("%s\n%s\n%s\n%s\n",
+                                     PACKAGE_VERSION,
+                                     (const char *) glGetString (GL_VENDOR),
+                                     (const char *) glGetString (GL_RENDERER),
+                                     (const char *) glGetString (GL_VERSION));
+  self->cache_dir = g_build_filename (g_get_user_cache_dir (), "gtk-4.0", "gsk-programs", NULL);
+  self->retrievable_hint = !gdk_gl_context_get_use_es (context) || maj >= 3;
+}
+
+static char *
+compute_cache_key (GskGLShaderBuilder *self,
+                   const char * const *vs_strings,
+                   const int          *vs_lengths,
+                   const char * const *fs_strings,
+                   const int          *fs_lengths)
+{
+  GChecksum *checksum;
+  char *key;
+  int i;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, (const guchar *) self->driver_id, -1);
+
+  for (i = 0; i < N_SOURCE_STRINGS; i ++)
+    g_checksum_update (checksum, (const guchar *) vs_strings[i], vs_lengths[i]);
+
+  /* Separate the two shaders, so moving code from one to the
+   * other can't produce the same key */
+  g_checksum_update (checksum, (const guchar *) "", 1);
+
+  for (i = 0; i < N_SOURCE_STRINGS; i ++)
+    g_checksum_update (checksum, (const guchar *) fs_strings[i], fs_lengths[i]);
+
+  key = g_strdup (g_checksum_get_string (checksum));
+  g_checksum_free (checksum);
+
+  return key;
+}
+
+/* Returns -1 if there is no usable binary for @key */
+static int
+load_program_binary (GskGLShaderBuilder *self,
+                     const char         *key)
+{
+  char *path;
+  char *contents = NULL;
+  gsize length;
+  guint32 format;
+  int program_id = -1;
+  int status;
+
+  path = g_build_filename (self->cache_dir, key, NULL);
+
+  if (!g_file_get_contents (path, &contents, &length, NULL))
+    goto out;
+
+  if (length <= BINARY_CACHE_HEADER_SIZE ||
+      memcmp (contents, BINARY_CACHE_MAGIC, strlen (BINARY_CACHE_MAGIC)) != 0)
+    {
+      GSK_NOTE (SHADERS, g_message ("Ignoring corrupt program binary %s", path));
+      g_unlink (path);
+      goto out;
+    }
+
+  memcpy (&format, contents + strlen (BINARY_CACHE_MAGIC), sizeof (guint32));
+
+  program_id = glCreateProgram ();
+  glProgramBinary (program_id, format,
+                   contents + BINARY_CACHE_HEADER_SIZE,
+                   length - BINARY_CACHE_HEADER_SIZE);
+
+  /* Driver updates may leave us with binaries the driver rejects
+   * even though the version string didn't change */
+  glGetProgramiv (program_id, GL_LINK_STATUS, &status);
+  if (status == GL_FALSE)
+    {
+      GSK_NOTE (SHADERS, g_message ("Driver rejected program binary %s", path));
+      glDeleteProgram (program_id);
+      program_id = -1;
+      g_unlink (path);
+    }
+
+out:
+  g_free (contents);
+  g_free (path);
+
+  return program_id;
+}
+
+static void
+save_program_binary (GskGLShaderBuilder *self,
+                     const char         *key,
+                     int                 program_id)
+{
+  GError *error = NULL;
+  char *contents;
+  char *path;
+  GLenum format;
+  int length = 0;
+
+  glGetProgramiv (program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+
+  contents = g_malloc (BINARY_CACHE_HEADER_SIZE + length);
+  glGetProgramBinary (program_id, length, &length, &format, contents + BINARY_CACHE_HEADER_SIZE);
+
+  memcpy (contents, BINARY_CACHE_MAGIC, strlen (BINARY_CACHE_MAGIC));
+  memcpy (contents + strlen (BINARY_CACHE_MAGIC), &(guint32) { format }, sizeof (guint32));
+
+  path = g_build_filename (self->cache_dir, key, NULL);
+
+  if (g_mkdir_with_parents (self->cache_dir, 0755) != 0 ||
+      !g_file_set_contents (path, contents, BINARY_CACHE_HEADER_SIZE + length, &error))
+    {
+      GSK_NOTE (SHADERS, g_message ("Failed to save program binary %s: %s",
+                                    path, error ? error->message : g_strerror (errno)));
+      g_clear_error (&error);
+    }
+
+  g_free (path);
+  g_free (contents);
+}
+
 static gboolean
 check_shader_error (int     shader_id,
                     GError **error)
@@ -84,10 +252,16 @@ gsk_gl_shader_builder_create_program (GskGLShaderBuilder  *self,
   const char *source;
   const char *vertex_shader_start;
   const char *fragment_shader_start;
+  const char *vs_strings[N_SOURCE_STRINGS];
+  const char *fs_strings[N_SOURCE_STRINGS];
+  int vs_lengths[N_SOURCE_STRINGS];
+  int fs_lengths[N_SOURCE_STRINGS];
+  char *cache_key = NULL;
   int vertex_id;
   int fragment_id;
   int program_id = -1;
   int status;
+  int i;
 
   g_assert (source_bytes);
 
@@ -105,28 +279,41 @@ gsk_gl_shader_builder_create_program (GskGLShaderBuilder  *self,
   g_snprintf (version_buffer, sizeof (version_buffer),
               "#version %d\n", self->version);
 
+  vs_strings[0] = fs_strings[0] = version_buffer;
+  vs_strings[1] = fs_strings[1] = self->debugging ? "#define GSK_DEBUG 1\n" : "";
+  vs_strings[2] = fs_strings[2] = self->legacy ? "#define GSK_LEGACY 1\n" : "";
+  vs_strings[3] = fs_strings[3] = self->gl3 ? "#define GSK_GL3 1\n" : "";
+  vs_strings[4] = fs_strings[4] = self->gles ? "#define GSK_GLES 1\n" : "";
+  vs_strings[5] = fs_strings[5] = g_bytes_get_data (self->preamble, NULL);
+  vs_strings[6] = g_bytes_get_data (self->vs_preamble, NULL);
+  fs_strings[6] = g_bytes_get_data (self->fs_preamble, NULL);
+  vs_strings[7] = vertex_shader_start;
+  fs_strings[7] = fragment_shader_start;
+
+  /* The preambles aren't nul-terminated as far as GL is concerned,
+   * and the checksum needs real lengths as well */
+  for (i = 0; i < N_SOURCE_STRINGS; i ++)
+    {
+      vs_lengths[i] = strlen (vs_strings[i]);
+      fs_lengths[i] = strlen (fs_strings[i]);
+    }
+  vs_lengths[7] = fragment_shader_start - vertex_shader_start;
+
+  if (self->cache_dir != NULL)
+    {
+      cache_key = compute_cache_key (self, vs_strings, vs_lengths, fs_strings, fs_lengths);
+      program_id = load_program_binary (self, cache_key);
+      if (program_id >= 0)
+        {
+          self->n_cache_hits ++;
+          goto out;
+        }
+
+      self->n_cache_misses ++;
+    }
+
   vertex_id = glCreateShader (GL_VERTEX_SHADER);
-  glShaderSource (vertex_id, 8,
-                  (const char *[]) {
-                    version_buffer,
-                    self->debugging ? "#define GSK_DEBUG 1\n" : "",
-                    self->legacy ? "#define GSK_LEGACY 1\n" : "",
-                    self->gl3 ? "#define GSK_GL3 1\n" : "",
-                    self->gles ? "#define GSK_GLES 1\n" : "",
-                    g_bytes_get_data (self->preamble, NULL),
-                    g_bytes_get_data (self->vs_preamble, NULL),
-                    vertex_shader_start
-                  },
-                  (int[]) {
-                    -1,
-                    -1,
-                    -1,
-                    -1,
-                    -1,
-                    -1,
-                    -1,
-                    fragment_shader_start - vertex_shader_start
-                  });
+  glShaderSource (vertex_id, N_SOURCE_STRINGS, vs_strings, vs_lengths);
   glCompileShader (vertex_id);
 
   if (!check_shader_error (vertex_id, error))
@@ -136,27 +323,7 @@ gsk_gl_shader_builder_create_program (GskGLShaderBuilder  *self,
     }
 
   fragment_id = glCreateShader (GL_FRAGMENT_SHADER);
-  glShaderSource (fragment_id, 8,
-                  (const char *[]) {
-                    version_buffer,
-                    self->debugging ? "#define GSK_DEBUG 1\n" : "",
-                    self->legacy ? "#define GSK_LEGACY 1\n" : "",
-                    self->gl3 ? "#define GSK_GL3 1\n" : "",
-                    self->gles ? "#define GSK_GLES 1\n" : "",
-                    g_bytes_get_data (self->preamble, NULL),
-                    g_bytes_get_data (self->fs_preamble, NULL),
-                    fragment_shader_start
-                  },
-                  (int[]) {
-                    -1,
-                    -1,
-                    -1,
-                    -1,
-                    -1,
-                    -1,
-                    -1,
-                    -1,
-                  });
+  glShaderSource (fragment_id, N_SOURCE_STRINGS, fs_strings, fs_lengths);
   glCompileShader (fragment_id);
 
   if (!check_shader_error (fragment_id, error))
@@ -168,6 +335,23 @@ gsk_gl_shader_builder_create_program (GskGLShaderBuilder  *self,
   program_id = glCreateProgram ();
   glAttachShader (program_id, vertex_id);
   glAttachShader (program_id, fragment_id);
+
+  /* Attributes the program doesn't have are simply ignored */
+  glBindAttribLocation (program_id, GSK_GL_ATTRIB_POSITION, "aPosition");
+  glBindAttribLocation (program_id, GSK_GL_ATTRIB_UV, "aUv");
+  glBindAttribLocation (program_id, GSK_GL_ATTRIB_RECT, "aRect");
+  glBindAttribLocation (program_id, GSK_GL_ATTRIB_COLOR, "aColor");
+  glBindAttribLocation (program_id, GSK_GL_ATTRIB_OUTLINE + 0, "aOutline0");
+  glBindAttribLocation (program_id, GSK_GL_ATTRIB_OUTLINE + 1, "aOutline1");
+  glBindAttribLocation (program_id, GSK_GL_ATTRIB_OUTLINE + 2, "aOutline2");
+  glBindAttribLocation (program_id, GSK_GL_ATTRIB_PARAMS, "aParams");
+  glBindAttribLocation (program_id, GSK_GL_ATTRIB_CLIP + 0, "aClip0");
+  glBindAttribLocation (program_id, GSK_GL_ATTRIB_CLIP + 1, "aClip1");
+  glBindAttribLocation (program_id, GSK_GL_ATTRIB_CLIP + 2, "aClip2");
+
+  if (cache_key != NULL && self->retrievable_hint)
+    glProgramParameteri (program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
   glLinkProgram (program_id);
 
   glGetProgramiv (program_id, GL_LINK_STATUS, &status);
@@ -188,6 +372,7 @@ gsk_gl_shader_builder_create_program (GskGLShaderBuilder  *self,
       g_free (buffer);
 
       glDeleteProgram (program_id);
+      program_id = -1;
 
       goto out;
     }
@@ -198,9 +383,12 @@ gsk_gl_shader_builder_create_program (GskGLShaderBuilder  *self,
   glDetachShader (program_id, fragment_id);
   glDeleteShader (fragment_id);
 
+  if (cache_key != NULL)
+    save_program_binary (self, cache_key, program_id);
+
 out:
+  g_free (cache_key);
   g_bytes_unref (source_bytes);
 
   return program_id;
 }
-
@@ -6,6 +6,18 @@
 
 G_BEGIN_DECLS
 
+/* Vertex attribute locations shared by all programs */
+enum {
+  GSK_GL_ATTRIB_POSITION,
+  GSK_GL_ATTRIB_UV,
+  /* Per-instance attributes of the instanced program */
+  GSK_GL_ATTRIB_RECT,
+  GSK_GL_ATTRIB_COLOR,
+  GSK_GL_ATTRIB_OUTLINE,      /* 3 locations */
+  GSK_GL_ATTRIB_PARAMS = GSK_GL_ATTRIB_OUTLINE + 3,
+  GSK_GL_ATTRIB_CLIP,         /* 3 locations */
+};
+
 typedef struct
 {
   GBytes *preamble;
@@ -14,6 +26,16 @@ typedef struct
 
   int version;
 
+  /* Where linked program binaries are kept, NULL if the driver
+   * doesn't support program binaries */
+  char *cache_dir;
+  /* Identifies the driver, part of every cache key */
+  char *driver_id;
+  guint n_cache_hits;
+  guint n_cache_misses;
+  /* glProgramParameteri() is missing with only GL_OES_get_program_binary */
+  guint retrievable_hint: 1;
+
   guint debugging: 1;
   guint gles: 1;
   guint gl3: 1;
@@ -30,6 +52,8 @@ void   gsk_gl_shader_builder_finish           (GskGLShaderBuilder  *self);
 
 void   gsk_gl_shader_builder_set_glsl_version (GskGLShaderBuilder  *self,
                                                int                  version);
+void   gsk_gl_shader_builder_enable_binary_cache (GskGLShaderBuilder *self,
+                                                  GdkGLContext       *context);
 
 int    gsk_gl_shader_builder_create_program   (GskGLShaderBuilder  *self,
                                                const char          *resource_path,
@@ -5,7 +5,10 @@
 #include "gdkglcontextprivate.h"
 #include <epoxy/gl.h>
 
-#define ATLAS_SIZE (512)
+/* The first atlas of each format is small, every further one is twice
+ * as big as the previous one, up to MAX_ATLAS_SIZE or what GL supports. */
+#define MIN_ATLAS_SIZE (512)
+#define MAX_ATLAS_SIZE (4096)
 #define MAX_OLD_RATIO 0.5
 
 static void
@@ -23,8 +26,9 @@ gsk_gl_texture_atlases_new (void)
 {
   GskGLTextureAtlases *self;
 
-  self = g_new (GskGLTextureAtlases, 1);
+  self = g_new0 (GskGLTextureAtlases, 1);
   self->atlases = g_ptr_array_new_with_free_func (free_atlas);
+  self->max_size = -1;
 
   self->ref_count = 1;
 
@@ -73,31 +77,49 @@ write_atlas_to_png (GskGLTextureAtlas *atlas,
 }
 #endif
 
+/* Moves the atlas with the highest ratio of old pixels to @removed,
+ * if that ratio is too high. Only one atlas is compacted per frame, so
+ * the work of moving the live entries is spread over several frames.
+ *
+ * The caches are expected to move all entries they still use off the
+ * atlases in @removed with gsk_gl_texture_atlases_move() and drop the
+ * other ones, before gsk_gl_texture_atlases_free_removed() is called.
+ */
 void
 gsk_gl_texture_atlases_begin_frame (GskGLTextureAtlases *self,
                                     GPtrArray           *removed)
 {
+  GskGLTextureAtlas *worst = NULL;
+  double worst_ratio = MAX_OLD_RATIO;
+  int worst_index = -1;
   int i;
 
-  for (i = self->atlases->len - 1; i >= 0; i--)
+  self->n_moved = 0;
+  self->n_evicted = 0;
+  self->n_uploaded = 0;
+
+  for (i = 0; i < self->atlases->len; i++)
     {
       GskGLTextureAtlas *atlas = g_ptr_array_index (self->atlases, i);
+      double ratio = gsk_gl_texture_atlas_get_unused_ratio (atlas);
 
-      if (gsk_gl_texture_atlas_get_unused_ratio (atlas) > MAX_OLD_RATIO)
+      if (ratio > worst_ratio)
         {
-          GSK_NOTE(GLYPH_CACHE,
-                   g_message ("Dropping atlas %d (%g.2%% old)", i,
-                              100.0 * gsk_gl_texture_atlas_get_unused_ratio (atlas)));
+          worst = atlas;
+          worst_ratio = ratio;
+          worst_index = i;
+        }
+    }
 
-          if (atlas->texture_id != 0)
-            {
-              glDeleteTextures (1, &atlas->texture_id);
-              atlas->texture_id = 0;
-            }
+  if (worst != NULL)
+    {
+      GSK_NOTE(GLYPH_CACHE,
+               g_message ("Compacting %dx%d atlas %u (%.2g%% old)",
+                          worst->width, worst->height, worst->texture_id,
+                          100.0 * worst_ratio));
 
-          g_ptr_array_add (removed, atlas);
-          g_ptr_array_remove_index (self->atlases, i);
-       }
+      g_ptr_array_add (removed, worst);
+      g_ptr_array_steal_index (self->atlases, worst_index);
     }
 
   GSK_NOTE(GLYPH_CACHE, {
@@ -130,20 +152,96 @@ gsk_gl_texture_atlases_begin_frame (GskGLTextureAtlases *self,
 #endif
 }
 
+void
+gsk_gl_texture_atlases_free_removed (GskGLTextureAtlases *self,
+                                     GPtrArray           *removed)
+{
+  guint i;
+
+  for (i = 0; i < removed->len; i++)
+    free_atlas (g_ptr_array_index (removed, i));
+
+  g_ptr_array_set_size (removed, 0);
+}
+
+/* Needs a current GL context */
+static void
+ensure_limits (GskGLTextureAtlases *self)
+{
+  GdkGLContext *context;
+  int maj, min;
+
+  if (self->max_size > 0)
+    return;
+
+  context = gdk_gl_context_get_current ();
+  gdk_gl_context_get_version (context, &maj, &min);
+
+  glGetIntegerv (GL_MAX_TEXTURE_SIZE, &self->max_size);
+  self->max_size = CLAMP (self->max_size, MIN_ATLAS_SIZE, MAX_ATLAS_SIZE);
+
+  /* We need R8 textures and swizzling so single channel atlases can be
+   * sampled just like the RGBA ones. */
+  if (gdk_gl_context_get_use_es (context))
+    self->has_alpha_format = maj >= 3;
+  else
+    self->has_alpha_format = (maj > 3 || (maj == 3 && min >= 3)) ||
+                             (epoxy_has_gl_extension ("GL_ARB_texture_rg") &&
+                              epoxy_has_gl_extension ("GL_ARB_texture_swizzle"));
+
+  GSK_NOTE(GLYPH_CACHE, g_message ("Atlases up to %dx%d, %s single channel atlases",
+                                   self->max_size, self->max_size,
+                                   self->has_alpha_format ? "with" : "without"));
+}
+
+static GskGLTextureAtlas *
+add_atlas (GskGLTextureAtlases     *self,
+           GskGLTextureAtlasFormat  format)
+{
+  GskGLTextureAtlas *atlas;
+  int size = MIN_ATLAS_SIZE;
+  int i;
+
+  for (i = 0; i < self->atlases->len; i++)
+    {
+      GskGLTextureAtlas *other = g_ptr_array_index (self->atlases, i);
+
+      if (other->format == format)
+        size = MAX (size, MIN (other->width * 2, self->max_size));
+    }
+
+  atlas = g_malloc (sizeof (GskGLTextureAtlas));
+  gsk_gl_texture_atlas_init (atlas, format, size, size);
+  g_ptr_array_add (self->atlases, atlas);
+
+  GSK_NOTE(GLYPH_CACHE, g_message ("adding new %dx%d %s atlas", size, size,
+                                   format == GSK_GL_TEXTURE_ATLAS_FORMAT_ALPHA ? "alpha" : "RGBA"));
+
+  return atlas;
+}
+
+/* If single channel atlases are not supported, ALPHA falls back to RGBA.
+ * Callers need to look at the format of the returned atlas. */
 gboolean
-gsk_gl_texture_atlases_pack (GskGLTextureAtlases *self,
-                             int                  width,
-                             int                  height,
-                             GskGLTextureAtlas  **atlas_out,
-                             int                 *out_x,
-                             int                 *out_y)
+gsk_gl_texture_atlases_pack (GskGLTextureAtlases     *self,
+                             GskGLTextureAtlasFormat  format,
+                             int                      width,
+                             int                      height,
+                             GskGLTextureAtlas      **atlas_out,
+                             int                     *out_x,
+                             int                     *out_y)
 {
   GskGLTextureAtlas *atlas;
   int x, y;
   int i;
 
-  g_assert (width  < ATLAS_SIZE);
-  g_assert (height < ATLAS_SIZE);
+  g_assert (width  < MIN_ATLAS_SIZE);
+  g_assert (height < MIN_ATLAS_SIZE);
+
+  ensure_limits (self);
+
+  if (format == GSK_GL_TEXTURE_ATLAS_FORMAT_ALPHA && !self->has_alpha_format)
+    format = GSK_GL_TEXTURE_ATLAS_FORMAT_RGBA;
 
   atlas = NULL;
 
@@ -151,7 +249,8 @@ gsk_gl_texture_atlases_pack (GskGLTextureAtlases *self,
     {
       atlas = g_ptr_array_index (self->atlases, i);
 
-      if (gsk_gl_texture_atlas_pack (atlas, width, height, &x, &y))
+      if (atlas->format == format &&
+          gsk_gl_texture_atlas_pack (atlas, width, height, &x, &y))
         break;
 
       atlas = NULL;
@@ -160,16 +259,11 @@ gsk_gl_texture_atlases_pack (GskGLTextureAtlases *self,
   if (atlas == NULL)
     {
       /* No atlas has enough space, so create a new one... */
-      atlas = g_malloc (sizeof (GskGLTextureAtlas));
-      gsk_gl_texture_atlas_init (atlas, ATLAS_SIZE, ATLAS_SIZE);
-      gsk_gl_texture_atlas_realize (atlas);
-      g_ptr_array_add (self->atlases, atlas);
+      atlas = add_atlas (self, format);
 
       /* Pack it onto that one, which surely has enough space... */
       if (!gsk_gl_texture_atlas_pack (atlas, width, height, &x, &y))
         g_assert_not_reached ();
-
-      GSK_NOTE(GLYPH_CACHE, g_message ("adding new atlas"));
     }
 
   *atlas_out = atlas;
@@ -179,14 +273,91 @@ gsk_gl_texture_atlases_pack (GskGLTextureAtlases *self,
   return TRUE;
 }
 
+/* Packs the given area of @from into one of the atlases with the same
+ * format and copies its contents over on the GPU, so the entry doesn't
+ * need to be rendered and uploaded again. */
+gboolean
+gsk_gl_texture_atlases_move (GskGLTextureAtlases *self,
+                             GskGLTextureAtlas   *from,
+                             int                  x,
+                             int                  y,
+                             int                  width,
+                             int                  height,
+                             GskGLTextureAtlas  **atlas_out,
+                             int                 *out_x,
+                             int                 *out_y)
+{
+  GskGLTextureAtlas *atlas;
+  int prev_fbo;
+
+  g_assert (!g_ptr_array_find (self->atlases, from, NULL));
+
+  if (from->texture_id == 0)
+    return FALSE;
+
+  gsk_gl_texture_atlases_pack (self, from->format, width, height, &atlas, out_x, out_y);
+
+  /* Only happens if the format isn't supported anymore */
+  if (atlas->format != from->format)
+    return FALSE;
+
+  glGetIntegerv (GL_FRAMEBUFFER_BINDING, &prev_fbo);
+
+  if (from->fbo_id == 0)
+    {
+      glGenFramebuffers (1, &from->fbo_id);
+      glBindFramebuffer (GL_FRAMEBUFFER, from->fbo_id);
+      glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, from->texture_id, 0);
+    }
+  else
+    {
+      glBindFramebuffer (GL_FRAMEBUFFER, from->fbo_id);
+    }
+
+  glBindTexture (GL_TEXTURE_2D, atlas->texture_id);
+  glCopyTexSubImage2D (GL_TEXTURE_2D, 0, *out_x, *out_y, x, y, width, height);
+
+  glBindFramebuffer (GL_FRAMEBUFFER, prev_fbo);
+
+  self->n_moved++;
+  *atlas_out = atlas;
+
+  return TRUE;
+}
+
+/* The ratio of pixels in all atlases that are taken by entries
+ * that are still in use. */
+double
+gsk_gl_texture_atlases_get_occupancy (const GskGLTextureAtlases *self)
+{
+  gint64 used = 0;
+  gint64 total = 0;
+  int i;
+
+  for (i = 0; i < self->atlases->len; i++)
+    {
+      const GskGLTextureAtlas *atlas = g_ptr_array_index (self->atlases, i);
+
+      used += atlas->packed_pixels - atlas->unused_pixels;
+      total += atlas->width * atlas->height;
+    }
+
+  if (total == 0)
+    return 0.0;
+
+  return (double) used / (double) total;
+}
+
 void
-gsk_gl_texture_atlas_init (GskGLTextureAtlas *self,
-                           int                width,
-                           int                height)
+gsk_gl_texture_atlas_init (GskGLTextureAtlas       *self,
+                           GskGLTextureAtlasFormat  format,
+                           int                      width,
+                           int                      height)
 {
   memset (self, 0, sizeof (*self));
 
   self->texture_id = 0;
+  self->format = format;
   self->width = width;
   self->height = height;
 
@@ -204,6 +375,12 @@ gsk_gl_texture_atlas_init (GskGLTextureAtlas *self,
 void
 gsk_gl_texture_atlas_free (GskGLTextureAtlas *self)
 {
+  if (self->fbo_id != 0)
+    {
+      glDeleteFramebuffers (1, &self->fbo_id);
+      self->fbo_id = 0;
+    }
+
   if (self->texture_id != 0)
     {
       glDeleteTextures (1, &self->texture_id);
@@ -253,6 +430,7 @@ gsk_gl_texture_atlas_pack (GskGLTextureAtlas *self,
     {
       *out_x = rect.x;
       *out_y = rect.y;
+      self->packed_pixels += width * height;
     }
 
   return rect.was_packed;
@@ -272,8 +450,9 @@ gsk_gl_texture_atlas_get_unused_ratio (const GskGLTextureAtlas *self)
  * the display gets closed.
  */
 static guint
-create_shared_texture (int width,
-                       int height)
+create_shared_texture (GskGLTextureAtlasFormat format,
+                       int                     width,
+                       int                     height)
 {
   guint texture_id;
 
@@ -286,7 +465,15 @@ create_shared_texture (int width,
   glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-  if (gdk_gl_context_get_use_es (gdk_gl_context_get_current ()))
+  if (format == GSK_GL_TEXTURE_ATLAS_FORMAT_ALPHA)
+    {
+      glTexImage2D (GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_ONE);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_ONE);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_ONE);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_RED);
+    }
+  else if (gdk_gl_context_get_use_es (gdk_gl_context_get_current ()))
     glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
   else
     glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
@@ -302,7 +489,7 @@ gsk_gl_texture_atlas_realize (GskGLTextureAtlas *atlas)
   if (atlas->texture_id)
     return;
 
-  atlas->texture_id = create_shared_texture (atlas->width, atlas->height);
+  atlas->texture_id = create_shared_texture (atlas->format, atlas->width, atlas->height);
   gdk_gl_context_label_object_printf (gdk_gl_context_get_current (),
                                       GL_TEXTURE, atlas->texture_id,
                                       "Texture atlas %d", atlas->texture_id);
@@ -6,6 +6,12 @@
 #include "gskglimageprivate.h"
 #include "gskgldriverprivate.h"
 
+typedef enum
+{
+  GSK_GL_TEXTURE_ATLAS_FORMAT_RGBA,
+  GSK_GL_TEXTURE_ATLAS_FORMAT_ALPHA, /* Single channel, sampled as (1, 1, 1, a) */
+} GskGLTextureAtlasFormat;
+
 struct _GskGLTextureAtlas
 {
   struct stbrp_context context;
@@ -14,8 +20,11 @@ struct _GskGLTextureAtlas
   int width;
   int height;
 
+  GskGLTextureAtlasFormat format;
   guint texture_id;
+  guint fbo_id; /* Only used while moving entries off the atlas */
 
+  int packed_pixels; /* Pixels of all rects packed into the atlas */
   int unused_pixels; /* Pixels of rects that have been used at some point,
                         But are now unused. */
 
@@ -28,23 +37,45 @@ struct _GskGLTextureAtlases
   int ref_count;
 
   GPtrArray *atlases;
+
+  int max_size; /* < 0 until we have a GL context to ask */
+  guint has_alpha_format : 1;
+
+  /* Statistics since the last gsk_gl_texture_atlases_begin_frame() */
+  guint n_moved;
+  guint n_evicted;
+  guint n_uploaded;
 };
 typedef struct _GskGLTextureAtlases GskGLTextureAtlases;
 
-GskGLTextureAtlases *gsk_gl_texture_atlases_new         (void);
-GskGLTextureAtlases *gsk_gl_texture_atlases_ref         (GskGLTextureAtlases *atlases);
-void                 gsk_gl_texture_atlases_unref       (GskGLTextureAtlases *atlases);
-
-void                 gsk_gl_texture_atlases_begin_frame (GskGLTextureAtlases *atlases,
-                                                         GPtrArray           *removed);
-gboolean             gsk_gl_texture_atlases_pack        (GskGLTextureAtlases *atlases,
-                                                         int                  width,
-                                                         int                  height,
-                                                         GskGLTextureAtlas  **atlas_out,
-                                                         int                 *out_x,
-                                                         int                 *out_y);
+GskGLTextureAtlases *gsk_gl_texture_atlases_new           (void);
+GskGLTextureAtlases *gsk_gl_texture_atlases_ref           (GskGLTextureAtlases *atlases);
+void                 gsk_gl_texture_atlases_unref         (GskGLTextureAtlases *atlases);
+
+void                 gsk_gl_texture_atlases_begin_frame   (GskGLTextureAtlases *atlases,
+                                                           GPtrArray           *removed);
+void                 gsk_gl_texture_atlases_free_removed  (GskGLTextureAtlases *atlases,
+                                                           GPtrArray           *removed);
+gboolean             gsk_gl_texture_atlases_pack          (GskGLTextureAtlases *atlases,
+                                                           GskGLTextureAtlasFormat format,
+                                                           int                  width,
+                                                           int                  height,
+                                                           GskGLTextureAtlas  **atlas_out,
+                                                           int                 *out_x,
+                                                           int                 *out_y);
+gboolean             gsk_gl_texture_atlases_move          (GskGLTextureAtlases *atlases,
+                                                           GskGLTextureAtlas   *from,
+                                                           int                  x,
+                                                           int                  y,
+                                                           int                  width,
+                                                           int                  height,
+                                                           GskGLTextureAtlas  **atlas_out,
+                                                           int                 *out_x,
+                                                           int                 *out_y);
+double               gsk_gl_texture_atlases_get_occupancy (const GskGLTextureAtlases *atlases);
 
 void        gsk_gl_texture_atlas_init              (GskGLTextureAtlas       *self,
+                                                    GskGLTextureAtlasFormat  format,
                                                     int                      width,
                                                     int                      height);
 
@@ -0,0 +1,225 @@
+#include "config.h"
+
+#include "gskglvertexbufferprivate.h"
+
+#include "gskdebugprivate.h"
+
+#include <string.h>
+
+/* Enough for ~2700 quads or ~1800 instances per frame before we need to grow */
+#define INITIAL_FRAME_SIZE (256 * 1024)
+
+#define PERSISTENT_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+/* Must be called with the VAO bound */
+static void
+create_storage (GskGLVertexBuffer *self)
+{
+  glGenBuffers (1, &self->buffer_id);
+  glBindBuffer (GL_ARRAY_BUFFER, self->buffer_id);
+
+  if (self->persistent)
+    {
+      const gsize size = self->frame_size * GSK_GL_VERTEX_BUFFER_N_FRAMES;
+
+      glBufferStorage (GL_ARRAY_BUFFER, size, NULL, PERSISTENT_FLAGS);
+      self->mapped = glMapBufferRange (GL_ARRAY_BUFFER, 0, size, PERSISTENT_FLAGS);
+    }
+  else
+    {
+      glBufferData (GL_ARRAY_BUFFER, self->frame_size, NULL, GL_STREAM_DRAW);
+    }
+
+  self->setup_attributes (0);
+}
+
+static void
+destroy_storage (GskGLVertexBuffer *self)
+{
+  if (self->mapped != NULL)
+    {
+      glBindBuffer (GL_ARRAY_BUFFER, self->buffer_id);
+      glUnmapBuffer (GL_ARRAY_BUFFER);
+      self->mapped = NULL;
+    }
+
+  glDeleteBuffers (1, &self->buffer_id);
+  self->buffer_id = 0;
+}
+
+/* Returns whether we had to block on the GPU */
+static gboolean
+wait_for_frame (GskGLVertexBuffer *self,
+                guint              frame)
+{
+  GLsync fence = self->fences[frame];
+  gboolean stalled = FALSE;
+  GLenum status;
+
+  if (fence == NULL)
+    return FALSE;
+
+  status = glClientWaitSync (fence, 0, 0);
+  if (status == GL_TIMEOUT_EXPIRED)
+    {
+      stalled = TRUE;
+      do
+        status = glClientWaitSync (fence, GL_SYNC_FLUSH_COMMANDS_BIT, G_GUINT64_CONSTANT (1000000000));
+      while (status == GL_TIMEOUT_EXPIRED);
+    }
+
+  glDeleteSync (fence);
+  self->fences[frame] = NULL;
+
+  return stalled;
+}
+
+void
+gsk_gl_vertex_buffer_init (GskGLVertexBuffer          *self,
+                           GdkGLContext               *context,
+                           GskGLVertexBufferSetupFunc  setup_attributes)
+{
+  int maj, min;
+
+  memset (self, 0, sizeof (*self));
+
+  self->setup_attributes = setup_attributes;
+
+  gdk_gl_context_get_version (context, &maj, &min);
+
+  /* Persistent mapping needs both buffer storage and fences so we
+   * know when the GPU is done reading a region. Everything else
+   * orphans the buffer each frame instead. */
+  if (!gdk_gl_context_get_use_es (context))
+    self->persistent = (maj > 4 || (maj == 4 && min >= 4) ||
+                        epoxy_has_gl_extension ("GL_ARB_buffer_storage")) &&
+                       (maj > 3 || (maj == 3 && min >= 2) ||
+                        epoxy_has_gl_extension ("GL_ARB_sync"));
+
+  GSK_NOTE (OPENGL, g_message ("Vertex buffer: %s",
+                               self->persistent ? "persistently mapped" : "orphaned"));
+
+  self->frame_size = INITIAL_FRAME_SIZE;
+
+  glGenVertexArrays (1, &self->vao_id);
+  glBindVertexArray (self->vao_id);
+  create_storage (self);
+  glBindVertexArray (0);
+}
+
+void
+gsk_gl_vertex_buffer_free (GskGLVertexBuffer *self)
+{
+  guint i;
+
+  for (i = 0; i < GSK_GL_VERTEX_BUFFER_N_FRAMES; i ++)
+    {
+      if (self->fences[i] != NULL)
+        glDeleteSync (self->fences[i]);
+      self->fences[i] = NULL;
+    }
+
+  if (self->buffer_id != 0)
+    destroy_storage (self);
+
+  glDeleteVertexArrays (1, &self->vao_id);
+  self->vao_id = 0;
+}
+
+/* Must be called with the VAO bound */
+static void
+grow (GskGLVertexBuffer *self,
+      gsize              size)
+{
+  guint i;
+
+  while (self->frame_size < size)
+    self->frame_size *= 2;
+
+  GSK_NOTE (OPENGL, g_message ("Growing vertex buffer to %" G_GSIZE_FORMAT " bytes per frame",
+                               self->frame_size));
+
+  if (self->persistent)
+    {
+      /* All regions are going to move, so nothing can be in flight */
+      for (i = 0; i < GSK_GL_VERTEX_BUFFER_N_FRAMES; i ++)
+        {
+          if (wait_for_frame (self, i))
+            self->n_stalls ++;
+        }
+
+      /* Draws from earlier uploads of this frame keep the old
+       * buffer alive until the GPU is done with them */
+      destroy_storage (self);
+      create_storage (self);
+      self->current_frame = 0;
+      self->frame_offset = 0;
+    }
+}
+
+/* Copies @size bytes of @data into the region of the current frame and
+ * leaves the VAO bound. Returns the offset of the data in bytes. This
+ * can be called multiple times per frame, each call appends to the
+ * region. */
+gsize
+gsk_gl_vertex_buffer_upload (GskGLVertexBuffer *self,
+                             gconstpointer      data,
+                             gsize              size)
+{
+  gsize offset;
+
+  self->uploaded_bytes += size;
+
+  glBindVertexArray (self->vao_id);
+  glBindBuffer (GL_ARRAY_BUFFER, self->buffer_id);
+
+  if (!self->persistent)
+    {
+      if (size > self->frame_size)
+        grow (self, size);
+
+      /* Orphan the old storage so the driver can hand out fresh memory
+       * instead of waiting for draws that still read from it. */
+      glBufferData (GL_ARRAY_BUFFER, self->frame_size, NULL, GL_STREAM_DRAW);
+      if (size > 0)
+        glBufferSubData (GL_ARRAY_BUFFER, 0, size, data);
+
+      return 0;
+    }
+
+  /* The first upload of a frame has to wait for the GPU to be done
+   * with the region, later ones append to it */
+  if (self->frame_offset == 0 &&
+      wait_for_frame (self, self->current_frame))
+    self->n_stalls ++;
+
+  if (self->frame_offset + size > self->frame_size)
+    grow (self, self->frame_offset + size);
+
+  offset = self->current_frame * self->frame_size + self->frame_offset;
+  if (size > 0)
+    memcpy (self->mapped + offset, data, size);
+
+  self->frame_offset += size;
+
+  return offset;
+}
+
+/* Must be called once per frame, after all uploads of the frame */
+void
+gsk_gl_vertex_buffer_end_frame (GskGLVertexBuffer *self)
+{
+  glBindVertexArray (0);
+
+  self->uploaded_bytes = 0;
+  self->n_stalls = 0;
+
+  if (!self->persistent)
+    return;
+
+  g_assert (self->fences[self->current_frame] == NULL);
+
+  self->fences[self->current_frame] = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  self->current_frame = (self->current_frame + 1) % GSK_GL_VERTEX_BUFFER_N_FRAMES;
+  self->frame_offset = 0;
+}
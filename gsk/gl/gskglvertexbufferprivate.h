@@ -0,0 +1,51 @@
+#ifndef __GSK_GL_VERTEX_BUFFER_PRIVATE_H__
+#define __GSK_GL_VERTEX_BUFFER_PRIVATE_H__
+
+#include <glib.h>
+#include <gdk/gdk.h>
+#include <epoxy/gl.h>
+
+#include "gskgldriverprivate.h"
+
+/* Number of frames we allow to be in flight before we have to wait
+ * for the GPU to be done with a region of the vertex buffer. */
+#define GSK_GL_VERTEX_BUFFER_N_FRAMES 3
+
+/* Sets up the vertex attributes of the bound VAO, pointing into
+ * the bound GL_ARRAY_BUFFER at @offset */
+typedef void (* GskGLVertexBufferSetupFunc) (gsize offset);
+
+typedef struct
+{
+  GskGLVertexBufferSetupFunc setup_attributes;
+
+  GLuint vao_id;
+  GLuint buffer_id;
+
+  /* Size in bytes of the region reserved for each frame */
+  gsize frame_size;
+  guint current_frame;
+  /* Bytes of the current frame's region that have been uploaded to */
+  gsize frame_offset;
+
+  /* Only used for persistently mapped buffers */
+  guint8 *mapped;
+  GLsync fences[GSK_GL_VERTEX_BUFFER_N_FRAMES];
+
+  /* Statistics of the current frame */
+  gsize uploaded_bytes;
+  guint n_stalls;
+
+  guint persistent : 1;
+} GskGLVertexBuffer;
+
+void  gsk_gl_vertex_buffer_init      (GskGLVertexBuffer          *self,
+                                      GdkGLContext               *context,
+                                      GskGLVertexBufferSetupFunc  setup_attributes);
+void  gsk_gl_vertex_buffer_free      (GskGLVertexBuffer          *self);
+gsize gsk_gl_vertex_buffer_upload    (GskGLVertexBuffer          *self,
+                                      gconstpointer               data,
+                                      gsize                       size);
+void  gsk_gl_vertex_buffer_end_frame (GskGLVertexBuffer          *self);
+
+#endif
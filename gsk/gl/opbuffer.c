@@ -30,6 +30,9 @@ static guint op_sizes[OP_LAST] = {
   sizeof (OpDebugGroup),
   0,
   sizeof (OpBlend),
+  sizeof (OpDrawInstanced),
+  sizeof (OpScissor),
+  sizeof (OpStencil),
 };
 
 void
@@ -131,3 +134,16 @@ op_buffer_add (OpBuffer *buffer,
 
   return &buffer->buf[entry.pos];
 }
+
+gpointer
+op_buffer_add_copy (OpBuffer      *buffer,
+                    OpKind         kind,
+                    gconstpointer  data)
+{
+  gpointer op = op_buffer_add (buffer, kind);
+
+  if (op_sizes[kind] > 0)
+    memcpy (op, data, op_sizes[kind]);
+
+  return op;
+}
@@ -38,6 +38,9 @@ typedef enum
   OP_PUSH_DEBUG_GROUP                  = 24,
   OP_POP_DEBUG_GROUP                   = 25,
   OP_CHANGE_BLEND                      = 26,
+  OP_DRAW_INSTANCED                    = 27,
+  OP_CHANGE_SCISSOR                    = 28,
+  OP_CHANGE_STENCIL                    = 29,
   OP_LAST
 } OpKind;
 
@@ -107,6 +110,12 @@ typedef struct
   gsize vao_size;
 } OpDraw;
 
+typedef struct
+{
+  gsize instance_offset;
+  gsize n_instances;
+} OpDrawInstanced;
+
 typedef struct
 {
   const GskColorStop *color_stops;
@@ -173,11 +182,41 @@ typedef struct
   float texture_rect[4];
 } OpRepeat;
 
+typedef struct
+{
+  int render_target_id;
+  /* In framebuffer pixels, ignored if the scissor test is disabled */
+  int x;
+  int y;
+  int width;
+  int height;
+  guint enabled : 1;
+} OpScissor;
+
+typedef enum
+{
+  STENCIL_OFF,
+  /* Only draw where the stencil value equals the level */
+  STENCIL_TEST,
+  /* Add or remove a clip, without drawing any color */
+  STENCIL_INCREMENT,
+  STENCIL_DECREMENT
+} StencilMode;
+
+typedef struct
+{
+  StencilMode mode;
+  guint level;
+} OpStencil;
+
 void     op_buffer_init            (OpBuffer *buffer);
 void     op_buffer_destroy         (OpBuffer *buffer);
 void     op_buffer_clear           (OpBuffer *buffer);
 gpointer op_buffer_add             (OpBuffer *buffer,
                                     OpKind    kind);
+gpointer op_buffer_add_copy        (OpBuffer      *buffer,
+                                    OpKind         kind,
+                                    gconstpointer  data);
 
 typedef struct
 {
@@ -22,6 +22,8 @@
 
 #include "gskcairoblurprivate.h"
 
+#include "gdk/gdkparalleltaskprivate.h"
+
 #include <math.h>
 #include <string.h>
 
@@ -185,6 +187,290 @@ flip_buffer (guchar *dst_buffer,
 #undef BLOCK_SIZE
 }
 
+/* The vectorized path below works on BLUR_LANES columns at once,
+ * running the same sliding window as blur_xspan() down the columns.
+ * Each lane keeps its sum in 16 bits, so it is only used while
+ * 255 * (d + 1) fits. The division is done with floats: the sum is
+ * exact and the result is at least 0.5 / d away from the next integer,
+ * so it rounds the same way as the integer division.
+ *
+ * The compiler picks SSE2, AVX2 or NEON instructions for the vector
+ * types. On x86-64 Linux, the kernel is also built for AVX2 and the
+ * best version is selected when the library is loaded.
+ */
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 9)
+#define HAVE_VECTOR_BLUR 1
+
+#define BLUR_LANES 16
+#define BLUR_MAX_VECTOR_D 254
+
+typedef guint8  BlurBytes  __attribute__ ((vector_size (BLUR_LANES)));
+typedef guint16 BlurSums   __attribute__ ((vector_size (BLUR_LANES * 2)));
+typedef gint32  BlurInts   __attribute__ ((vector_size (BLUR_LANES * 4)));
+typedef float   BlurFloats __attribute__ ((vector_size (BLUR_LANES * 4)));
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(__clang__)
+#define BLUR_TARGET_CLONES __attribute__ ((target_clones ("avx2", "default")))
+#else
+#define BLUR_TARGET_CLONES
+#endif
+
+static inline BlurSums
+load_lanes (const guchar *src)
+{
+  BlurBytes bytes;
+
+  memcpy (&bytes, src, sizeof (bytes));
+
+  return __builtin_convertvector (bytes, BlurSums);
+}
+
+BLUR_TARGET_CLONES
+static void
+blur_vspan_lanes (const guchar *src,
+                  int           src_stride,
+                  guchar       *dst,
+                  int           dst_stride,
+                  int           height,
+                  int           d,
+                  int           shift)
+{
+  BlurSums sum = { 0, };
+  const float bias = d / 2 + 0.5f;
+  const float scale = 1.0f / d;
+  int offset;
+  int i;
+
+  if (d % 2 == 1)
+    offset = d / 2;
+  else
+    offset = (d - shift) / 2;
+
+  for (i = -d + offset; i < height + offset; i++)
+    {
+      if (i >= 0 && i < height)
+        sum += load_lanes (src + i * src_stride);
+
+      if (i >= offset)
+        {
+          BlurFloats result;
+          BlurBytes bytes;
+
+          if (i >= d)
+            sum -= load_lanes (src + (i - d) * src_stride);
+
+          result = __builtin_convertvector (__builtin_convertvector (sum, BlurInts), BlurFloats);
+          result = (result + bias) * scale;
+          bytes = __builtin_convertvector (__builtin_convertvector (result, BlurInts), BlurBytes);
+          memcpy (dst + (i - offset) * dst_stride, &bytes, sizeof (bytes));
+        }
+    }
+}
+
+/* The scalar version of blur_vspan_lanes(), for the columns left over
+ * at the end */
+static void
+blur_vspan (const guchar *src,
+            int           src_stride,
+            guchar       *dst,
+            int           dst_stride,
+            int           height,
+            int           d,
+            int           shift)
+{
+  int offset;
+  int sum = 0;
+  int i;
+
+  if (d % 2 == 1)
+    offset = d / 2;
+  else
+    offset = (d - shift) / 2;
+
+  for (i = -d + offset; i < height + offset; i++)
+    {
+      if (i >= 0 && i < height)
+        sum += src[i * src_stride];
+
+      if (i >= offset)
+        {
+          if (i >= d)
+            sum -= src[(i - d) * src_stride];
+
+          dst[(i - offset) * dst_stride] = (sum + d / 2) / d;
+        }
+    }
+}
+
+static void
+blur_lanes (guchar   *src,
+            int       src_stride,
+            guchar   *dst,
+            int       dst_stride,
+            guchar   *tmp1,
+            guchar   *tmp2,
+            int       tmp_stride,
+            int       height,
+            int       d,
+            gboolean  vector)
+{
+  /* The same three passes as blur_rows() */
+  int shift1 = d % 2 == 1 ? 0 : 1;
+  int shift2 = d % 2 == 1 ? 0 : -1;
+  int d3 = d % 2 == 1 ? d : d + 1;
+
+  if (vector)
+    {
+      blur_vspan_lanes (src, src_stride, tmp1, tmp_stride, height, d, shift1);
+      blur_vspan_lanes (tmp1, tmp_stride, tmp2, tmp_stride, height, d, shift2);
+      blur_vspan_lanes (tmp2, tmp_stride, dst, dst_stride, height, d3, 0);
+    }
+  else
+    {
+      blur_vspan (src, src_stride, tmp1, tmp_stride, height, d, shift1);
+      blur_vspan (tmp1, tmp_stride, tmp2, tmp_stride, height, d, shift2);
+      blur_vspan (tmp2, tmp_stride, dst, dst_stride, height, d3, 0);
+    }
+}
+
+/* Blurs the columns from @first to @last vertically */
+static void
+blur_columns (guchar *buffer,
+              int     buffer_width,
+              int     buffer_height,
+              int     d,
+              int     first,
+              int     last)
+{
+  guchar *tmp;
+  int x;
+
+  tmp = g_malloc (2 * buffer_height * BLUR_LANES);
+
+  for (x = first; x + BLUR_LANES <= last; x += BLUR_LANES)
+    blur_lanes (buffer + x, buffer_width, buffer + x, buffer_width,
+                tmp, tmp + buffer_height * BLUR_LANES, BLUR_LANES,
+                buffer_height, d, TRUE);
+
+  for (; x < last; x++)
+    blur_lanes (buffer + x, buffer_width, buffer + x, buffer_width,
+                tmp, tmp + buffer_height, 1,
+                buffer_height, d, FALSE);
+
+  g_free (tmp);
+}
+
+/* Blurs the rows from @first to @last horizontally. Each group of
+ * BLUR_LANES rows is transposed into a small buffer, so the rows
+ * become the lanes, which is a lot cheaper than flipping the whole
+ * buffer.
+ */
+static void
+blur_rows_vector (guchar *buffer,
+                  int     buffer_width,
+                  int     buffer_height,
+                  int     d,
+                  int     first,
+                  int     last)
+{
+  guchar *lanes, *tmp;
+  int x, y, i;
+
+  lanes = g_malloc (3 * buffer_width * BLUR_LANES);
+  tmp = lanes + buffer_width * BLUR_LANES;
+
+  for (y = first; y + BLUR_LANES <= last; y += BLUR_LANES)
+    {
+      guchar *rows = buffer + y * buffer_width;
+
+      for (x = 0; x < buffer_width; x++)
+        for (i = 0; i < BLUR_LANES; i++)
+          lanes[x * BLUR_LANES + i] = rows[i * buffer_width + x];
+
+      blur_lanes (lanes, BLUR_LANES, lanes, BLUR_LANES,
+                  tmp, tmp + buffer_width * BLUR_LANES, BLUR_LANES,
+                  buffer_width, d, TRUE);
+
+      for (i = 0; i < BLUR_LANES; i++)
+        for (x = 0; x < buffer_width; x++)
+          rows[i * buffer_width + x] = lanes[x * BLUR_LANES + i];
+    }
+
+  if (y < last)
+    blur_rows (buffer + y * buffer_width, tmp, buffer_width, last - y, d);
+
+  g_free (lanes);
+}
+
+/* Surfaces with more pixels than this are blurred by several threads,
+ * each taking a range of rows or columns */
+#define PARALLEL_BLUR_PIXELS (512 * 512)
+
+typedef void (* BlurRangeFunc) (guchar *buffer,
+                                int     buffer_width,
+                                int     buffer_height,
+                                int     d,
+                                int     first,
+                                int     last);
+
+typedef struct
+{
+  BlurRangeFunc func;
+  guchar *buffer;
+  int buffer_width;
+  int buffer_height;
+  int d;
+  int n_items;
+  int items;
+} BlurJob;
+
+static void
+blur_task (gpointer data,
+           guint    index,
+           guint    n_tasks)
+{
+  BlurJob *job = data;
+
+  job->func (job->buffer, job->buffer_width, job->buffer_height, job->d,
+             (int) index * job->items, MIN (((int) index + 1) * job->items, job->n_items));
+}
+
+/* Runs @func on ranges of the @n_items rows or columns, in parallel
+ * for large buffers */
+static void
+blur_parallel (BlurRangeFunc  func,
+               guchar        *buffer,
+               int            buffer_width,
+               int            buffer_height,
+               int            d,
+               int            n_items)
+{
+  BlurJob job;
+  int n_tasks;
+
+  n_tasks = 1;
+  if (buffer_width * buffer_height >= PARALLEL_BLUR_PIXELS)
+    n_tasks = MIN ((int) gdk_parallel_task_get_max_tasks (), n_items / BLUR_LANES);
+
+  if (n_tasks < 2)
+    {
+      func (buffer, buffer_width, buffer_height, d, 0, n_items);
+      return;
+    }
+
+  /* Keep the ranges aligned, so only the last one has leftovers */
+  job = (BlurJob) {
+    func,
+    buffer, buffer_width, buffer_height,
+    d,
+    n_items, (n_items / n_tasks + BLUR_LANES - 1) & ~(BLUR_LANES - 1)
+  };
+  n_tasks = (n_items + job.items - 1) / job.items;
+
+  gdk_parallel_task_run (blur_task, &job, n_tasks);
+}
+#endif
+
 static void
 _boxblur (guchar      *buffer,
           int          width,
@@ -195,6 +481,19 @@ _boxblur (guchar      *buffer,
   guchar *flipped_buffer;
   int d = get_box_filter_size (radius);
 
+#ifdef HAVE_VECTOR_BLUR
+  if ((flags & GSK_BLUR_SCALAR) == 0 && d <= BLUR_MAX_VECTOR_D)
+    {
+      if (flags & GSK_BLUR_Y)
+        blur_parallel (blur_columns, buffer, width, height, d, width);
+
+      if (flags & GSK_BLUR_X)
+        blur_parallel (blur_rows_vector, buffer, width, height, d, height);
+
+      return;
+    }
+#endif
+
   flipped_buffer = g_malloc (width * height);
 
   if (flags & GSK_BLUR_Y)
@@ -33,7 +33,9 @@ typedef enum {
   GSK_BLUR_NONE = 0,
   GSK_BLUR_X = 1<<0,
   GSK_BLUR_Y = 1<<1,
-  GSK_BLUR_REPEAT = 1<<2
+  GSK_BLUR_REPEAT = 1<<2,
+  /* Only for testing: don't use the vectorized code */
+  GSK_BLUR_SCALAR = 1<<3
 } GskBlurFlags;
 
 void            gsk_cairo_blur_surface          (cairo_surface_t *surface,
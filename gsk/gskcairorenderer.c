@@ -26,8 +26,22 @@
 #include "gskrendererprivate.h"
 #include "gskrendernodeprivate.h"
 #include "gdk/gdktextureprivate.h"
+#include "gdk/gdkparalleltaskprivate.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <pango/pangocairo.h>
+
+/* Size of the tiles in pixels when rendering with threads */
+#define TILE_SIZE 256
 
 #ifdef G_ENABLE_DEBUG
+typedef struct {
+  GQuark tiles;
+  GQuark tiled_frames;
+  GQuark nodes_culled;
+} ProfileCounters;
+
 typedef struct {
   GQuark cpu_time;
   GQuark gpu_time;
@@ -40,7 +54,11 @@ struct _GskCairoRenderer
 
   GdkCairoContext *cairo_context;
 
+  /* Number of tasks rendering tiles, from GSK_CAIRO_THREADS */
+  guint n_tile_tasks;
+
 #ifdef G_ENABLE_DEBUG
+  ProfileCounters profile_counters;
   ProfileTimers profile_timers;
 #endif
 };
@@ -52,15 +70,42 @@ struct _GskCairoRendererClass
 
 G_DEFINE_TYPE (GskCairoRenderer, gsk_cairo_renderer, GSK_TYPE_RENDERER)
 
+typedef struct
+{
+  GskRenderNode *root;
+  cairo_matrix_t ctm;
+  cairo_rectangle_list_t *clip;
+  cairo_surface_t **surfaces;
+  guint n_tiles;
+#ifdef G_ENABLE_DEBUG
+  int *n_culled;
+#endif
+} GskCairoTiles;
+
 static gboolean
 gsk_cairo_renderer_realize (GskRenderer  *renderer,
                             GdkSurface   *surface,
                             GError      **error)
 {
   GskCairoRenderer *self = GSK_CAIRO_RENDERER (renderer);
+  const char *threads;
 
   self->cairo_context = gdk_surface_create_cairo_context (surface);
 
+  /* The tiles are rendered on the threads of gdk_parallel_task_run(),
+   * so there are never more tasks than CPUs */
+  threads = g_getenv ("GSK_CAIRO_THREADS");
+  if (threads)
+    {
+      guint max_tasks = gdk_parallel_task_get_max_tasks ();
+      int n_threads = atoi (threads);
+
+      if (n_threads < 0 || (guint) n_threads > max_tasks)
+        n_threads = max_tasks;
+
+      self->n_tile_tasks = n_threads;
+    }
+
   return TRUE;
 }
 
@@ -69,16 +114,283 @@ gsk_cairo_renderer_unrealize (GskRenderer *renderer)
 {
   GskCairoRenderer *self = GSK_CAIRO_RENDERER (renderer);
 
+  self->n_tile_tasks = 0;
+
   g_clear_object (&self->cairo_context);
 }
 
+/* Checks if the tree can be drawn in worker threads and gives
+ * the same result when drawn in tiles.
+ *
+ * Blurs draw into a group limited by the clip, so their result
+ * depends on the tile borders. Blurred box shadows also share a
+ * cache of corner masks. Cairo nodes
+ * replay recording surfaces, which isn't thread-safe, and GL
+ * textures need their context. Pango draws the boxes for unknown
+ * glyphs, which isn't thread-safe either.
+ *
+ * Text nodes get their scaled fonts created here, so workers only
+ * find them in the cache.
+ */
+static gboolean
+gsk_cairo_renderer_can_tile (GskRenderNode *node)
+{
+  guint i;
+
+  switch (gsk_render_node_get_node_type (node))
+    {
+    case GSK_COLOR_NODE:
+    case GSK_LINEAR_GRADIENT_NODE:
+    case GSK_REPEATING_LINEAR_GRADIENT_NODE:
+    case GSK_BORDER_NODE:
+      return TRUE;
+
+    case GSK_INSET_SHADOW_NODE:
+      return gsk_inset_shadow_node_get_blur_radius (node) <= 1.0;
+
+    case GSK_OUTSET_SHADOW_NODE:
+      return gsk_outset_shadow_node_get_blur_radius (node) <= 1.0;
+
+    case GSK_TEXTURE_NODE:
+      return GDK_IS_MEMORY_TEXTURE (gsk_texture_node_get_texture (node));
+
+    case GSK_TEXT_NODE:
+      {
+        const PangoGlyphInfo *glyphs = gsk_text_node_peek_glyphs (node);
+        PangoFont *font = gsk_text_node_peek_font (node);
+
+        for (i = 0; i < gsk_text_node_get_num_glyphs (node); i++)
+          {
+            if (glyphs[i].glyph & PANGO_GLYPH_UNKNOWN_FLAG)
+              return FALSE;
+          }
+
+        return pango_cairo_font_get_scaled_font (PANGO_CAIRO_FONT (font)) != NULL;
+      }
+
+    case GSK_CONTAINER_NODE:
+      for (i = 0; i < gsk_container_node_get_n_children (node); i++)
+        {
+          if (!gsk_cairo_renderer_can_tile (gsk_container_node_get_child (node, i)))
+            return FALSE;
+        }
+      return TRUE;
+
+    case GSK_TRANSFORM_NODE:
+      return gsk_cairo_renderer_can_tile (gsk_transform_node_get_child (node));
+
+    case GSK_OPACITY_NODE:
+      return gsk_cairo_renderer_can_tile (gsk_opacity_node_get_child (node));
+
+    case GSK_COLOR_MATRIX_NODE:
+      return gsk_cairo_renderer_can_tile (gsk_color_matrix_node_get_child (node));
+
+    case GSK_REPEAT_NODE:
+      return gsk_cairo_renderer_can_tile (gsk_repeat_node_get_child (node));
+
+    case GSK_CLIP_NODE:
+      return gsk_cairo_renderer_can_tile (gsk_clip_node_get_child (node));
+
+    case GSK_ROUNDED_CLIP_NODE:
+      return gsk_cairo_renderer_can_tile (gsk_rounded_clip_node_get_child (node));
+
+    case GSK_DEBUG_NODE:
+      return gsk_cairo_renderer_can_tile (gsk_debug_node_get_child (node));
+
+    case GSK_BLEND_NODE:
+      return gsk_cairo_renderer_can_tile (gsk_blend_node_get_bottom_child (node)) &&
+             gsk_cairo_renderer_can_tile (gsk_blend_node_get_top_child (node));
+
+    case GSK_CROSS_FADE_NODE:
+      return gsk_cairo_renderer_can_tile (gsk_cross_fade_node_get_start_child (node)) &&
+             gsk_cairo_renderer_can_tile (gsk_cross_fade_node_get_end_child (node));
+
+    case GSK_CAIRO_NODE:
+    case GSK_BLUR_NODE:
+    case GSK_SHADOW_NODE:
+    case GSK_NOT_A_RENDER_NODE:
+    default:
+      return FALSE;
+    }
+}
+
+/* Runs in a worker thread and renders every @n_tasks'th tile */
+static void
+gsk_cairo_renderer_render_tiles (gpointer data,
+                                 guint    index,
+                                 guint    n_tasks)
+{
+  GskCairoTiles *tiles = data;
+  guint t;
+  int i;
+
+  for (t = index; t < tiles->n_tiles; t += n_tasks)
+    {
+      cairo_t *cr;
+
+      cr = cairo_create (tiles->surfaces[t]);
+#ifdef G_ENABLE_DEBUG
+      gsk_render_node_set_culled_counter (cr, tiles->n_culled);
+#endif
+      cairo_set_matrix (cr, &tiles->ctm);
+      for (i = 0; i < tiles->clip->num_rectangles; i++)
+        {
+          const cairo_rectangle_t *rect = &tiles->clip->rectangles[i];
+
+          cairo_rectangle (cr, rect->x, rect->y, rect->width, rect->height);
+        }
+      cairo_clip (cr);
+
+      /* This skips the nodes outside of the tile */
+      gsk_render_node_draw (tiles->root, cr);
+
+      cairo_destroy (cr);
+    }
+}
+
+/* Renders @root into an image in tiles, using the worker threads,
+ * and paints the image onto @cr.
+ *
+ * The image uses the same device scale as the target of @cr and
+ * is aligned to its pixels. Painting it with the OVER operator then
+ * gives the same result as drawing the nodes directly.
+ *
+ * Returns: %FALSE if the frame is too small or can't be tiled
+ */
+static gboolean
+gsk_cairo_renderer_do_render_tiled (GskCairoRenderer *self,
+                                    cairo_t          *cr,
+                                    GskRenderNode    *root,
+                                    int              *n_culled)
+{
+  cairo_rectangle_list_t *clip;
+  cairo_surface_t *target, *image;
+  double cx1, cy1, cx2, cy2;
+  double x1, y1, x2, y2, px, py;
+  double sx, sy, ox, oy;
+  int x, y, width, height, stride;
+  GskCairoTiles tiles;
+  guchar *data;
+  guint i;
+
+#ifdef G_ENABLE_DEBUG
+  /* gsk_render_node_draw() outlines every node */
+  if (GSK_DEBUG_CHECK (GEOMETRY))
+    return FALSE;
+#endif
+
+  clip = cairo_copy_clip_rectangle_list (cr);
+  if (clip->status != CAIRO_STATUS_SUCCESS)
+    {
+      cairo_rectangle_list_destroy (clip);
+      return FALSE;
+    }
+
+  /* The clip extents in pixels of the target */
+  target = cairo_get_target (cr);
+  cairo_surface_get_device_scale (target, &sx, &sy);
+  cairo_surface_get_device_offset (target, &ox, &oy);
+  cairo_clip_extents (cr, &cx1, &cy1, &cx2, &cy2);
+  x1 = y1 = G_MAXDOUBLE;
+  x2 = y2 = -G_MAXDOUBLE;
+  for (i = 0; i < 4; i++)
+    {
+      px = i & 1 ? cx2 : cx1;
+      py = i & 2 ? cy2 : cy1;
+      cairo_user_to_device (cr, &px, &py);
+      px = px * sx + ox;
+      py = py * sy + oy;
+      x1 = MIN (x1, px); x2 = MAX (x2, px);
+      y1 = MIN (y1, py); y2 = MAX (y2, py);
+    }
+  x = floor (x1);
+  y = floor (y1);
+  width = ceil (x2) - x;
+  height = ceil (y2) - y;
+
+  if (width <= 0 || height <= 0 ||
+      (width <= TILE_SIZE && height <= TILE_SIZE) ||
+      !gsk_cairo_renderer_can_tile (root))
+    {
+      cairo_rectangle_list_destroy (clip);
+      return FALSE;
+    }
+
+  image = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  data = cairo_image_surface_get_data (image);
+  stride = cairo_image_surface_get_stride (image);
+
+  tiles.root = root;
+  tiles.clip = clip;
+  cairo_get_matrix (cr, &tiles.ctm);
+  tiles.n_tiles = ((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE);
+  tiles.surfaces = g_new (cairo_surface_t *, tiles.n_tiles);
+#ifdef G_ENABLE_DEBUG
+  tiles.n_culled = n_culled;
+#endif
+
+#ifdef G_ENABLE_DEBUG
+  {
+    GskProfiler *profiler = gsk_renderer_get_profiler (GSK_RENDERER (self));
+
+    gsk_profiler_counter_add (profiler, self->profile_counters.tiles, tiles.n_tiles);
+    gsk_profiler_counter_inc (profiler, self->profile_counters.tiled_frames);
+  }
+#endif
+
+  i = 0;
+  for (y = 0; y < height; y += TILE_SIZE)
+    for (x = 0; x < width; x += TILE_SIZE)
+      {
+        cairo_surface_t *surface;
+
+        surface = cairo_image_surface_create_for_data (data + y * stride + x * 4,
+                                                       CAIRO_FORMAT_ARGB32,
+                                                       MIN (TILE_SIZE, width - x),
+                                                       MIN (TILE_SIZE, height - y),
+                                                       stride);
+        cairo_surface_set_device_scale (surface, sx, sy);
+        cairo_surface_set_device_offset (surface,
+                                         ox - floor (x1) - x,
+                                         oy - floor (y1) - y);
+
+        tiles.surfaces[i++] = surface;
+      }
+
+  gdk_parallel_task_run (gsk_cairo_renderer_render_tiles,
+                         &tiles,
+                         MIN (self->n_tile_tasks, tiles.n_tiles));
+
+  for (i = 0; i < tiles.n_tiles; i++)
+    cairo_surface_destroy (tiles.surfaces[i]);
+  g_free (tiles.surfaces);
+  cairo_rectangle_list_destroy (clip);
+  cairo_surface_mark_dirty (image);
+
+  /* Put the image back at the same pixels */
+  cairo_surface_set_device_scale (image, sx, sy);
+  cairo_surface_set_device_offset (image, ox - floor (x1), oy - floor (y1));
+
+  cairo_save (cr);
+  cairo_identity_matrix (cr);
+  cairo_set_source_surface (cr, image, 0, 0);
+  cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_NEAREST);
+  cairo_paint (cr);
+  cairo_restore (cr);
+
+  cairo_surface_destroy (image);
+
+  return TRUE;
+}
+
 static void
 gsk_cairo_renderer_do_render (GskRenderer   *renderer,
                               cairo_t       *cr,
                               GskRenderNode *root)
 {
-#ifdef G_ENABLE_DEBUG
   GskCairoRenderer *self = GSK_CAIRO_RENDERER (renderer);
+  int n_culled = 0;
+#ifdef G_ENABLE_DEBUG
   GskProfiler *profiler;
   gint64 cpu_time;
 #endif
@@ -86,11 +398,17 @@ gsk_cairo_renderer_do_render (GskRenderer   *renderer,
 #ifdef G_ENABLE_DEBUG
   profiler = gsk_renderer_get_profiler (renderer);
   gsk_profiler_timer_begin (profiler, self->profile_timers.cpu_time);
+  gsk_render_node_set_culled_counter (cr, &n_culled);
 #endif
 
-  gsk_render_node_draw (root, cr);
+  if (self->n_tile_tasks < 2 ||
+      !gsk_cairo_renderer_do_render_tiled (self, cr, root, &n_culled))
+    gsk_render_node_draw (root, cr);
 
 #ifdef G_ENABLE_DEBUG
+  gsk_render_node_set_culled_counter (cr, NULL);
+  gsk_profiler_counter_set (profiler, self->profile_counters.nodes_culled, n_culled);
+
   cpu_time = gsk_profiler_timer_end (profiler, self->profile_timers.cpu_time);
   gsk_profiler_timer_set (profiler, self->profile_timers.cpu_time, cpu_time);
 
@@ -176,6 +494,10 @@ gsk_cairo_renderer_init (GskCairoRenderer *self)
 #ifdef G_ENABLE_DEBUG
   GskProfiler *profiler = gsk_renderer_get_profiler (GSK_RENDERER (self));
 
+  self->profile_counters.tiles = gsk_profiler_add_counter (profiler, "tiles", "Tiles", TRUE);
+  self->profile_counters.tiled_frames = gsk_profiler_add_counter (profiler, "tiled-frames", "Frames rendered in tiles", FALSE);
+  self->profile_counters.nodes_culled = gsk_profiler_add_counter (profiler, "cairo-nodes-culled", "Render nodes culled by Cairo", TRUE);
+
   self->profile_timers.cpu_time = gsk_profiler_add_timer (profiler, "cpu-time", "CPU time", FALSE, TRUE);
 #endif
 }
@@ -192,6 +514,10 @@ gsk_cairo_renderer_init (GskCairoRenderer *self)
  * content and will instead render an error marker. Its usage should be
  * avoided.
  *
+ * If the `GSK_CAIRO_THREADS` environment variable is set to a number
+ * greater than 1, large frames are split into tiles that are rendered
+ * by that many threads. A negative number uses one thread per CPU.
+ *
  * Returns: a new Cairo renderer.
  **/
 GskRenderer *
@@ -11,11 +11,13 @@ static const GDebugKey gsk_debug_keys[] = {
   { "fallback", GSK_DEBUG_FALLBACK },
   { "glyphcache", GSK_DEBUG_GLYPH_CACHE },
   { "diff", GSK_DEBUG_DIFF },
+  { "batching", GSK_DEBUG_BATCHING },
   { "geometry", GSK_DEBUG_GEOMETRY },
   { "full-redraw", GSK_DEBUG_FULL_REDRAW},
   { "sync", GSK_DEBUG_SYNC },
   { "vulkan-staging-image", GSK_DEBUG_VULKAN_STAGING_IMAGE },
-  { "vulkan-staging-buffer", GSK_DEBUG_VULKAN_STAGING_BUFFER }
+  { "vulkan-staging-buffer", GSK_DEBUG_VULKAN_STAGING_BUFFER },
+  { "offscreen-cache", GSK_DEBUG_OFFSCREEN_CACHE }
 };
 #endif
 
@@ -15,15 +15,17 @@ typedef enum {
   GSK_DEBUG_FALLBACK              = 1 <<  6,
   GSK_DEBUG_GLYPH_CACHE           = 1 <<  7,
   GSK_DEBUG_DIFF                  = 1 <<  8,
+  GSK_DEBUG_BATCHING              = 1 <<  9,
   /* flags below may affect behavior */
-  GSK_DEBUG_GEOMETRY              = 1 <<  9,
-  GSK_DEBUG_FULL_REDRAW           = 1 << 10,
-  GSK_DEBUG_SYNC                  = 1 << 11,
-  GSK_DEBUG_VULKAN_STAGING_IMAGE  = 1 << 12,
-  GSK_DEBUG_VULKAN_STAGING_BUFFER = 1 << 13
+  GSK_DEBUG_GEOMETRY              = 1 << 10,
+  GSK_DEBUG_FULL_REDRAW           = 1 << 11,
+  GSK_DEBUG_SYNC                  = 1 << 12,
+  GSK_DEBUG_VULKAN_STAGING_IMAGE  = 1 << 13,
+  GSK_DEBUG_VULKAN_STAGING_BUFFER = 1 << 14,
+  GSK_DEBUG_OFFSCREEN_CACHE       = 1 << 15
 } GskDebugFlags;
 
-#define GSK_DEBUG_ANY ((1 << 13) - 1)
+#define GSK_DEBUG_ANY ((1 << 14) - 1)
 
 GskDebugFlags gsk_get_debug_flags (void);
 void          gsk_set_debug_flags (GskDebugFlags flags);
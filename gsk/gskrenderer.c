@@ -70,6 +70,13 @@ typedef struct
   GskRenderNode *root_node;
 
   GskProfiler *profiler;
+  struct {
+    GQuark nodes_allocated;
+    GQuark nodes_live;
+    GQuark nodes_large;
+    GQuark node_slabs;
+    GQuark node_memory;
+  } profile_counters;
 
   GskDebugFlags debug_flags;
 
@@ -200,7 +207,32 @@ gsk_renderer_init (GskRenderer *self)
 
   priv->profiler = gsk_profiler_new ();
   priv->debug_flags = gsk_get_debug_flags ();
+
+#ifdef G_ENABLE_DEBUG
+  priv->profile_counters.nodes_allocated = gsk_profiler_add_counter (priv->profiler, "nodes-allocated", "Render nodes allocated", FALSE);
+  priv->profile_counters.nodes_live = gsk_profiler_add_counter (priv->profiler, "nodes-live", "Render nodes alive", FALSE);
+  priv->profile_counters.nodes_large = gsk_profiler_add_counter (priv->profiler, "nodes-large", "Render nodes outside of slabs", FALSE);
+  priv->profile_counters.node_slabs = gsk_profiler_add_counter (priv->profiler, "node-slabs", "Render node slabs", FALSE);
+  priv->profile_counters.node_memory = gsk_profiler_add_counter (priv->profiler, "node-memory", "Render node slab memory", FALSE);
+#endif
+}
+
+#ifdef G_ENABLE_DEBUG
+static void
+gsk_renderer_update_node_counters (GskRenderer *renderer)
+{
+  GskRendererPrivate *priv = gsk_renderer_get_instance_private (renderer);
+  GskRenderNodeAllocatorStats stats;
+
+  gsk_render_node_get_allocator_stats (&stats);
+
+  gsk_profiler_counter_set (priv->profiler, priv->profile_counters.nodes_allocated, stats.n_allocated);
+  gsk_profiler_counter_set (priv->profiler, priv->profile_counters.nodes_live, stats.n_live);
+  gsk_profiler_counter_set (priv->profiler, priv->profile_counters.nodes_large, stats.n_large);
+  gsk_profiler_counter_set (priv->profiler, priv->profile_counters.node_slabs, stats.n_slabs);
+  gsk_profiler_counter_set (priv->profiler, priv->profile_counters.node_memory, stats.slab_memory);
 }
+#endif
 
 /**
  * gsk_renderer_get_surface:
@@ -359,6 +391,8 @@ gsk_renderer_render_texture (GskRenderer           *renderer,
     {
       GString *buf = g_string_new ("*** Texture stats ***\n\n");
 
+      gsk_renderer_update_node_counters (renderer);
+
       gsk_profiler_append_counters (priv->profiler, buf);
       g_string_append_c (buf, '\n');
 
@@ -436,6 +470,8 @@ gsk_renderer_render (GskRenderer          *renderer,
     {
       GString *buf = g_string_new ("*** Frame stats ***\n\n");
 
+      gsk_renderer_update_node_counters (renderer);
+
       gsk_profiler_append_counters (priv->profiler, buf);
       g_string_append_c (buf, '\n');
 
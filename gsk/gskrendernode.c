@@ -42,11 +42,13 @@
 
 #include "gskdebugprivate.h"
 #include "gskrendererprivate.h"
+#include "gskrendernodebinaryprivate.h"
 #include "gskrendernodeparserprivate.h"
 
 #include <graphene-gobject.h>
 
 #include <math.h>
+#include <string.h>
 
 #include <gobject/gvaluecollector.h>
 
@@ -62,12 +64,274 @@ G_DEFINE_BOXED_TYPE (GskRenderNode, gsk_render_node,
 
 G_DEFINE_QUARK (gsk-serialization-error-quark, gsk_serialization_error)
 
+/* {{{ Node allocator */
+
+/* Render nodes are small, short-lived and created by the tens of
+ * thousands every frame, so instead of going through malloc for each
+ * of them, they are carved out of slabs. Every slab only holds nodes
+ * of one size class and is released once all its nodes are gone,
+ * which happens in bulk when the tree of a frame is dropped.
+ *
+ * Nodes that don't fit a size class, like containers with many
+ * children, are allocated with malloc.
+ */
+
+#define NODE_ALIGNMENT 16
+#define NODE_SLAB_SIZE (64 * 1024)
+#define NODE_MAX_SLAB_SIZE 512
+#define N_SIZE_CLASSES (NODE_MAX_SLAB_SIZE / NODE_ALIGNMENT)
+
+typedef struct _NodeSlab NodeSlab;
+
+struct _NodeSlab
+{
+  guint8 *data;
+  gpointer free_list;   /* freed nodes, linked through their first word */
+  gsize n_unused;       /* nodes at the end of data never handed out */
+  gsize n_used;
+  guint size_class;
+  guint index;
+
+  /* list of slabs with free space in the size class */
+  NodeSlab *prev;
+  NodeSlab *next;
+};
+
+typedef struct
+{
+  NodeSlab *partial;
+  NodeSlab *spare;
+} NodeSizeClass;
+
+G_LOCK_DEFINE_STATIC (node_allocator);
+static NodeSizeClass node_size_classes[N_SIZE_CLASSES];
+/* NodeSlab, index 0 is unused so 0 can mean "not from a slab" */
+static GPtrArray *node_slabs;
+static GArray *node_free_slab_indexes;
+static GskRenderNodeAllocatorStats node_allocator_stats;
+
+static inline gsize
+node_size_class_get_size (guint size_class)
+{
+  return (size_class + 1) * NODE_ALIGNMENT;
+}
+
+static NodeSlab *
+node_slab_new (guint size_class)
+{
+  NodeSlab *slab;
+
+  slab = g_slice_new0 (NodeSlab);
+  slab->data = g_malloc (NODE_SLAB_SIZE);
+  slab->size_class = size_class;
+  slab->n_unused = NODE_SLAB_SIZE / node_size_class_get_size (size_class);
+
+  if (node_slabs == NULL)
+    {
+      node_slabs = g_ptr_array_new ();
+      g_ptr_array_add (node_slabs, NULL);
+      node_free_slab_indexes = g_array_new (FALSE, FALSE, sizeof (guint));
+    }
+
+  if (node_free_slab_indexes->len > 0)
+    {
+      slab->index = g_array_index (node_free_slab_indexes, guint, node_free_slab_indexes->len - 1);
+      g_array_set_size (node_free_slab_indexes, node_free_slab_indexes->len - 1);
+      g_ptr_array_index (node_slabs, slab->index) = slab;
+    }
+  else
+    {
+      slab->index = node_slabs->len;
+      g_ptr_array_add (node_slabs, slab);
+    }
+
+  node_allocator_stats.n_slabs++;
+  node_allocator_stats.slab_memory += NODE_SLAB_SIZE;
+
+  return slab;
+}
+
+static void
+node_slab_free (NodeSlab *slab)
+{
+  g_ptr_array_index (node_slabs, slab->index) = NULL;
+  g_array_append_val (node_free_slab_indexes, slab->index);
+
+  node_allocator_stats.n_slabs--;
+  node_allocator_stats.slab_memory -= NODE_SLAB_SIZE;
+
+  g_free (slab->data);
+  g_slice_free (NodeSlab, slab);
+}
+
+static void
+node_size_class_link (NodeSizeClass *klass,
+                      NodeSlab      *slab)
+{
+  slab->prev = NULL;
+  slab->next = klass->partial;
+  if (klass->partial)
+    klass->partial->prev = slab;
+  klass->partial = slab;
+}
+
+static void
+node_size_class_unlink (NodeSizeClass *klass,
+                        NodeSlab      *slab)
+{
+  if (slab->prev)
+    slab->prev->next = slab->next;
+  else
+    klass->partial = slab->next;
+  if (slab->next)
+    slab->next->prev = slab->prev;
+
+  slab->prev = NULL;
+  slab->next = NULL;
+}
+
+static GskRenderNode *
+node_alloc (gsize size)
+{
+  GskRenderNode *node;
+  NodeSizeClass *klass;
+  NodeSlab *slab;
+  guint size_class;
+
+  if (size > NODE_MAX_SLAB_SIZE)
+    {
+      node = g_malloc0 (size);
+
+      G_LOCK (node_allocator);
+      node_allocator_stats.n_allocated++;
+      node_allocator_stats.n_live++;
+      node_allocator_stats.n_large++;
+      G_UNLOCK (node_allocator);
+
+      return node;
+    }
+
+  size_class = (size - 1) / NODE_ALIGNMENT;
+  klass = &node_size_classes[size_class];
+
+  G_LOCK (node_allocator);
+
+  slab = klass->partial;
+  if (slab == NULL)
+    {
+      if (klass->spare)
+        {
+          slab = klass->spare;
+          klass->spare = NULL;
+        }
+      else
+        slab = node_slab_new (size_class);
+
+      node_size_class_link (klass, slab);
+    }
+
+  if (slab->free_list)
+    {
+      node = slab->free_list;
+      slab->free_list = *(gpointer *) node;
+    }
+  else
+    {
+      gsize capacity = NODE_SLAB_SIZE / node_size_class_get_size (size_class);
+
+      node = (GskRenderNode *) (slab->data + (capacity - slab->n_unused) * node_size_class_get_size (size_class));
+      slab->n_unused--;
+    }
+
+  slab->n_used++;
+  if (slab->free_list == NULL && slab->n_unused == 0)
+    node_size_class_unlink (klass, slab);
+
+  node_allocator_stats.n_allocated++;
+  node_allocator_stats.n_live++;
+
+  G_UNLOCK (node_allocator);
+
+  memset (node, 0, node_size_class_get_size (size_class));
+  node->slab = slab->index;
+
+  return node;
+}
+
+static void
+node_free (GskRenderNode *node)
+{
+  NodeSizeClass *klass;
+  NodeSlab *slab;
+  gboolean was_full;
+
+  if (node->slab == 0)
+    {
+      G_LOCK (node_allocator);
+      node_allocator_stats.n_live--;
+      node_allocator_stats.n_large--;
+      G_UNLOCK (node_allocator);
+
+      g_free (node);
+      return;
+    }
+
+  G_LOCK (node_allocator);
+
+  slab = g_ptr_array_index (node_slabs, node->slab);
+  klass = &node_size_classes[slab->size_class];
+  was_full = slab->free_list == NULL && slab->n_unused == 0;
+
+  *(gpointer *) node = slab->free_list;
+  slab->free_list = node;
+  slab->n_used--;
+
+  if (slab->n_used == 0)
+    {
+      if (!was_full)
+        node_size_class_unlink (klass, slab);
+
+      /* Keep one empty slab around, so a size class that is
+       * repeatedly emptied and refilled doesn't hit malloc */
+      if (klass->spare)
+        node_slab_free (slab);
+      else
+        {
+          slab->free_list = NULL;
+          slab->n_unused = NODE_SLAB_SIZE / node_size_class_get_size (slab->size_class);
+          klass->spare = slab;
+        }
+    }
+  else if (was_full)
+    node_size_class_link (klass, slab);
+
+  node_allocator_stats.n_live--;
+
+  G_UNLOCK (node_allocator);
+}
+
+/*< private >
+ * gsk_render_node_get_allocator_stats:
+ * @stats: (out): return location for the statistics
+ *
+ * Retrieves statistics about the memory used for render nodes.
+ */
+void
+gsk_render_node_get_allocator_stats (GskRenderNodeAllocatorStats *stats)
+{
+  G_LOCK (node_allocator);
+  *stats = node_allocator_stats;
+  G_UNLOCK (node_allocator);
+}
+
+/* }}} */
+
 static void
 gsk_render_node_finalize (GskRenderNode *self)
 {
   self->node_class->finalize (self);
 
-  g_free (self);
+  node_free (self);
 }
 
 /*< private >
@@ -84,7 +348,7 @@ gsk_render_node_new (const GskRenderNodeClass *node_class, gsize extra_size)
   g_return_val_if_fail (node_class != NULL, NULL);
   g_return_val_if_fail (node_class->node_type != GSK_NOT_A_RENDER_NODE, NULL);
 
-  self = g_malloc0 (node_class->struct_size + extra_size);
+  self = node_alloc (node_class->struct_size + extra_size);
 
   self->node_class = node_class;
 
@@ -170,6 +434,26 @@ gsk_render_node_get_bounds (GskRenderNode   *node,
   graphene_rect_init_from_rect (bounds, &node->bounds);
 }
 
+#ifdef G_ENABLE_DEBUG
+static const cairo_user_data_key_t culled_nodes_key;
+
+/*< private >
+ * gsk_render_node_set_culled_counter:
+ * @cr: a cairo context
+ * @n_culled: (nullable): the counter or %NULL to stop counting
+ *
+ * Makes gsk_render_node_draw() count the nodes it skips when drawing
+ * to @cr in @n_culled. The counter is incremented atomically, so
+ * contexts drawn in different threads can share it.
+ */
+void
+gsk_render_node_set_culled_counter (cairo_t *cr,
+                                    int     *n_culled)
+{
+  cairo_set_user_data (cr, &culled_nodes_key, n_culled, NULL);
+}
+#endif
+
 /**
  * gsk_render_node_draw:
  * @node: a #GskRenderNode
@@ -183,15 +467,39 @@ gsk_render_node_get_bounds (GskRenderNode   *node,
  *
  * For advanced nodes that cannot be supported using Cairo, in particular
  * for nodes doing 3D operations, this function may fail.
+ *
+ * Nothing is drawn if the bounds of @node are outside of the clip
+ * of @cr.
  **/
 void
 gsk_render_node_draw (GskRenderNode *node,
                       cairo_t       *cr)
 {
+  double x1, y1, x2, y2;
+
   g_return_if_fail (GSK_IS_RENDER_NODE (node));
   g_return_if_fail (cr != NULL);
   g_return_if_fail (cairo_status (cr) == CAIRO_STATUS_SUCCESS);
 
+  /* Container, transform and clip nodes draw their children with
+   * this function, so this culls every subtree outside of the clip.
+   * The clip extents are in user space, so they already take the
+   * transforms of the parents into account.
+   */
+  cairo_clip_extents (cr, &x1, &y1, &x2, &y2);
+  if (!graphene_rect_intersection (&node->bounds,
+                                   &GRAPHENE_RECT_INIT (x1, y1, x2 - x1, y2 - y1),
+                                   NULL))
+    {
+#ifdef G_ENABLE_DEBUG
+      int *n_culled = cairo_get_user_data (cr, &culled_nodes_key);
+
+      if (n_culled)
+        g_atomic_int_inc (n_culled);
+#endif
+      return;
+    }
+
   cairo_save (cr);
 
   GSK_NOTE (CAIRO, g_message ("Rendering node %s[%p]",
@@ -271,6 +579,72 @@ gsk_render_node_diff_impossible (GskRenderNode  *node1,
   cairo_region_union_rectangle (region, &rect);
 }
 
+/*< private >
+ * gsk_render_node_get_hash:
+ * @node: a #GskRenderNode
+ *
+ * Gets a hash of the contents of @node. It covers the type, bounds,
+ * all properties and the hashes of all children. Textures, fonts and
+ * cairo surfaces are compared by identity.
+ *
+ * Equal nodes have the same hash, but nodes with the same hash may
+ * still differ, so use gsk_render_node_equal() to confirm a match.
+ * The hash is computed on first use and kept afterwards.
+ *
+ * Returns: the hash of @node, never 0
+ */
+guint64
+gsk_render_node_get_hash (GskRenderNode *node)
+{
+  guint64 hash;
+
+  if (G_LIKELY (node->hash))
+    return node->hash;
+
+  hash = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+  hash = gsk_render_node_hash_data (hash, &node->node_class->node_type, sizeof (GskRenderNodeType));
+  hash = gsk_render_node_hash_data (hash, &node->bounds, sizeof (graphene_rect_t));
+  hash = node->node_class->hash (node, hash);
+
+  /* 0 means "not computed yet" */
+  if (hash == 0)
+    hash = 1;
+
+  node->hash = hash;
+
+  return hash;
+}
+
+/*< private >
+ * gsk_render_node_equal:
+ * @node1: a #GskRenderNode
+ * @node2: the #GskRenderNode to compare with
+ *
+ * Checks if @node1 and @node2 have the same contents, using the same
+ * rules as gsk_render_node_get_hash(). Different hashes reject a pair
+ * early, so comparing two unrelated subtrees is cheap.
+ *
+ * Returns: %TRUE if @node1 and @node2 render the same
+ */
+gboolean
+gsk_render_node_equal (GskRenderNode *node1,
+                       GskRenderNode *node2)
+{
+  if (node1 == node2)
+    return TRUE;
+
+  if (gsk_render_node_get_hash (node1) != gsk_render_node_get_hash (node2))
+    return FALSE;
+
+  if (_gsk_render_node_get_node_type (node1) != _gsk_render_node_get_node_type (node2))
+    return FALSE;
+
+  if (memcmp (&node1->bounds, &node2->bounds, sizeof (graphene_rect_t)) != 0)
+    return FALSE;
+
+  return node1->node_class->equal (node1, node2);
+}
+
 /**
  * gsk_render_node_diff:
  * @node1: a #GskRenderNode
@@ -296,6 +670,10 @@ gsk_render_node_diff (GskRenderNode  *node1,
   if (node1 == node2)
     return;
 
+  /* Subtrees that were rebuilt with the same contents */
+  if (gsk_render_node_equal (node1, node2))
+    return;
+
   if (_gsk_render_node_get_node_type (node1) != _gsk_render_node_get_node_type (node2))
     return gsk_render_node_diff_impossible (node1, node2, region);
 
@@ -315,6 +693,11 @@ gsk_render_node_diff (GskRenderNode  *node1,
  * It is mostly intended for use inside a debugger to quickly dump a render
  * node to a file for later inspection.
  *
+ * If @filename ends in ".gskb", a compact binary format is written instead
+ * of the text format. It stores every texture and font only once and is
+ * much faster to load, but it can only be loaded on machines with the same
+ * byte order. gsk_render_node_deserialize() detects it automatically.
+ *
  * Returns: %TRUE if saving was successful
  **/
 gboolean
@@ -329,7 +712,10 @@ gsk_render_node_write_to_file (GskRenderNode *node,
   g_return_val_if_fail (filename != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  bytes = gsk_render_node_serialize (node);
+  if (g_str_has_suffix (filename, ".gskb"))
+    bytes = gsk_render_node_serialize_binary (node);
+  else
+    bytes = gsk_render_node_serialize (node);
   result = g_file_set_contents (filename,
                                 g_bytes_get_data (bytes, NULL),
                                 g_bytes_get_size (bytes),
@@ -348,6 +734,10 @@ gsk_render_node_write_to_file (GskRenderNode *node,
  * Loads data previously created via gsk_render_node_serialize(). For a
  * discussion of the supported format, see that function.
  *
+ * Files written in the binary format by gsk_render_node_write_to_file()
+ * are detected and loaded, too. Textures in them use @bytes directly, so
+ * loading from a #GMappedFile avoids copying the image data.
+ *
  * Returns: (nullable) (transfer full): a new #GskRenderNode or %NULL on
  *     error.
  **/
@@ -358,6 +748,19 @@ gsk_render_node_deserialize (GBytes            *bytes,
 {
   GskRenderNode *node = NULL;
 
+  if (gsk_render_node_is_binary (bytes))
+    {
+      GPtrArray *roots = gsk_render_node_deserialize_binary (bytes, error_func, user_data);
+
+      if (roots)
+        {
+          node = gsk_render_node_ref (g_ptr_array_index (roots, 0));
+          g_ptr_array_unref (roots);
+        }
+
+      return node;
+    }
+
   node = gsk_render_node_deserialize_from_bytes (bytes, error_func, user_data);
 
   return node;
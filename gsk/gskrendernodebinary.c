@@ -0,0 +1,1464 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gskrendernodebinaryprivate.h"
+
+#include "gskrendernodeprivate.h"
+#include "gskroundedrectprivate.h"
+#include "gsktransformprivate.h"
+
+#include "gdk/gdktextureprivate.h"
+#include <gtk/css/gtkcss.h>
+
+#include <pango/pangocairo.h>
+#include <string.h>
+
+/* The binary format is a header followed by a list of records. Every
+ * record starts with its tag and the size of its payload, which is
+ * padded to 4 bytes. Numbers are stored in host byte order, files
+ * from machines with a different byte order are rejected.
+ *
+ * Strings, textures and nodes are numbered in the order they appear
+ * and later records refer to them by that number, so every texture,
+ * font name and subtree is only stored once. Nodes are deduplicated
+ * both by identity and by content: two subtrees that serialize to the
+ * same records are the same subtree.
+ *
+ * Every ROOT record adds a toplevel node, which allows storing many
+ * frames that share most of their nodes in one file.
+ *
+ * Texture data is aligned to 16 bytes in the file, so textures can
+ * use the data of a mapped file without copying it.
+ */
+
+#define BINARY_MAGIC "\x89GSKNODE"
+#define BINARY_MAGIC_SIZE 8
+#define BINARY_VERSION 1
+#define BINARY_BYTE_ORDER 0x01020304
+#define BINARY_HEADER_SIZE (BINARY_MAGIC_SIZE + 2 * sizeof (guint32))
+
+#define TEXTURE_ALIGNMENT 16
+
+#define NO_INDEX G_MAXUINT32
+
+typedef enum {
+  RECORD_STRING = 1,
+  RECORD_TEXTURE,
+  RECORD_NODE,
+  RECORD_ROOT
+} RecordTag;
+
+/* {{{ Writing */
+
+struct _GskRenderNodeWriter
+{
+  GByteArray *data;
+
+  /* GskRenderNode => index + 1 */
+  GHashTable *nodes;
+  /* GBytes of node records => index + 1 */
+  GHashTable *node_records;
+  guint n_nodes;
+
+  /* GdkTexture => index + 1 */
+  GHashTable *textures;
+  /* checksum of the pixels => index + 1 */
+  GHashTable *texture_checksums;
+  guint n_textures;
+
+  /* char * => index + 1 */
+  GHashTable *strings;
+  guint n_strings;
+};
+
+static void
+append_uint32 (GByteArray *array,
+               guint32     value)
+{
+  g_byte_array_append (array, (guint8 *) &value, sizeof (guint32));
+}
+
+static void
+append_int32 (GByteArray *array,
+              gint32      value)
+{
+  g_byte_array_append (array, (guint8 *) &value, sizeof (gint32));
+}
+
+static void
+append_float (GByteArray *array,
+              float       value)
+{
+  g_byte_array_append (array, (guint8 *) &value, sizeof (float));
+}
+
+static void
+append_point (GByteArray             *array,
+              const graphene_point_t *point)
+{
+  append_float (array, point->x);
+  append_float (array, point->y);
+}
+
+static void
+append_rect (GByteArray            *array,
+             const graphene_rect_t *rect)
+{
+  append_float (array, rect->origin.x);
+  append_float (array, rect->origin.y);
+  append_float (array, rect->size.width);
+  append_float (array, rect->size.height);
+}
+
+static void
+append_rounded_rect (GByteArray           *array,
+                     const GskRoundedRect *rect)
+{
+  guint i;
+
+  append_rect (array, &rect->bounds);
+  for (i = 0; i < 4; i++)
+    {
+      append_float (array, rect->corner[i].width);
+      append_float (array, rect->corner[i].height);
+    }
+}
+
+static void
+append_rgba (GByteArray    *array,
+             const GdkRGBA *rgba)
+{
+  append_float (array, rgba->red);
+  append_float (array, rgba->green);
+  append_float (array, rgba->blue);
+  append_float (array, rgba->alpha);
+}
+
+/* Returns the offset of the payload */
+static gsize
+writer_begin_record (GskRenderNodeWriter *self,
+                     RecordTag            tag)
+{
+  append_uint32 (self->data, tag);
+  /* size, filled in by writer_end_record() */
+  append_uint32 (self->data, 0);
+
+  return self->data->len;
+}
+
+static void
+writer_end_record (GskRenderNodeWriter *self,
+                   gsize                payload_offset)
+{
+  guint32 size;
+
+  while (self->data->len % 4)
+    g_byte_array_append (self->data, (guint8 *) "", 1);
+
+  size = self->data->len - payload_offset;
+  memcpy (self->data->data + payload_offset - sizeof (guint32), &size, sizeof (guint32));
+}
+
+static guint32
+writer_add_string (GskRenderNodeWriter *self,
+                   const char          *string)
+{
+  gpointer index;
+  gsize offset;
+
+  if (string == NULL)
+    return NO_INDEX;
+
+  index = g_hash_table_lookup (self->strings, string);
+  if (index)
+    return GPOINTER_TO_UINT (index) - 1;
+
+  offset = writer_begin_record (self, RECORD_STRING);
+  g_byte_array_append (self->data, (guint8 *) string, strlen (string) + 1);
+  writer_end_record (self, offset);
+
+  g_hash_table_insert (self->strings, g_strdup (string), GUINT_TO_POINTER (++self->n_strings));
+
+  return self->n_strings - 1;
+}
+
+static guint32
+writer_add_pixels (GskRenderNodeWriter *self,
+                   GdkTexture          *texture,
+                   const guchar        *pixels,
+                   int                  width,
+                   int                  height,
+                   gsize                stride)
+{
+  GChecksum *checksum;
+  char *digest;
+  gpointer index;
+  gsize offset;
+  guint32 padding;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, (guchar *) &width, sizeof (int));
+  g_checksum_update (checksum, (guchar *) &height, sizeof (int));
+  g_checksum_update (checksum, pixels, stride * height);
+  digest = g_strdup (g_checksum_get_string (checksum));
+  g_checksum_free (checksum);
+
+  index = g_hash_table_lookup (self->texture_checksums, digest);
+  if (index)
+    {
+      g_free (digest);
+      if (texture)
+        g_hash_table_insert (self->textures, g_object_ref (texture), index);
+      return GPOINTER_TO_UINT (index) - 1;
+    }
+
+  offset = writer_begin_record (self, RECORD_TEXTURE);
+  append_uint32 (self->data, width);
+  append_uint32 (self->data, height);
+  append_uint32 (self->data, stride);
+  padding = (TEXTURE_ALIGNMENT - (self->data->len + sizeof (guint32)) % TEXTURE_ALIGNMENT) % TEXTURE_ALIGNMENT;
+  append_uint32 (self->data, padding);
+  g_byte_array_set_size (self->data, self->data->len + padding);
+  memset (self->data->data + self->data->len - padding, 0, padding);
+  g_byte_array_append (self->data, pixels, stride * height);
+  writer_end_record (self, offset);
+
+  self->n_textures++;
+  g_hash_table_insert (self->texture_checksums, digest, GUINT_TO_POINTER (self->n_textures));
+  if (texture)
+    g_hash_table_insert (self->textures, g_object_ref (texture), GUINT_TO_POINTER (self->n_textures));
+
+  return self->n_textures - 1;
+}
+
+static guint32
+writer_add_texture (GskRenderNodeWriter *self,
+                    GdkTexture          *texture)
+{
+  gpointer index;
+  guchar *pixels;
+  int width, height;
+  guint32 result;
+
+  index = g_hash_table_lookup (self->textures, texture);
+  if (index)
+    return GPOINTER_TO_UINT (index) - 1;
+
+  width = gdk_texture_get_width (texture);
+  height = gdk_texture_get_height (texture);
+  pixels = g_malloc (width * height * 4);
+  gdk_texture_download (texture, pixels, width * 4);
+
+  result = writer_add_pixels (self, texture, pixels, width, height, width * 4);
+
+  g_free (pixels);
+
+  return result;
+}
+
+static guint32
+writer_add_surface (GskRenderNodeWriter   *self,
+                    cairo_surface_t       *surface,
+                    const graphene_rect_t *bounds)
+{
+  cairo_surface_t *image;
+  cairo_t *cr;
+  guint32 result;
+
+  if (surface == NULL)
+    return NO_INDEX;
+
+  image = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                      ceilf (bounds->size.width),
+                                      ceilf (bounds->size.height));
+  cr = cairo_create (image);
+  cairo_translate (cr, - bounds->origin.x, - bounds->origin.y);
+  cairo_set_source_surface (cr, surface, 0, 0);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+  cairo_surface_flush (image);
+
+  result = writer_add_pixels (self,
+                              NULL,
+                              cairo_image_surface_get_data (image),
+                              cairo_image_surface_get_width (image),
+                              cairo_image_surface_get_height (image),
+                              cairo_image_surface_get_stride (image));
+
+  cairo_surface_destroy (image);
+
+  return result;
+}
+
+static guint32 writer_add_node (GskRenderNodeWriter *self,
+                                GskRenderNode       *node);
+
+static void
+append_node (GskRenderNodeWriter *self,
+             GByteArray          *record,
+             GskRenderNode       *node)
+{
+  append_uint32 (record, writer_add_node (self, node));
+}
+
+static void
+append_node_data (GskRenderNodeWriter *self,
+                  GByteArray          *record,
+                  GskRenderNode       *node)
+{
+  switch (gsk_render_node_get_node_type (node))
+    {
+    case GSK_CONTAINER_NODE:
+      {
+        guint i, n = gsk_container_node_get_n_children (node);
+        guint32 *children = g_new (guint32, n);
+
+        /* Children must be written before the container record */
+        for (i = 0; i < n; i++)
+          children[i] = writer_add_node (self, gsk_container_node_get_child (node, i));
+
+        append_uint32 (record, n);
+        for (i = 0; i < n; i++)
+          append_uint32 (record, children[i]);
+
+        g_free (children);
+      }
+      break;
+
+    case GSK_CAIRO_NODE:
+      append_rect (record, &node->bounds);
+      append_uint32 (record, writer_add_surface (self, gsk_cairo_node_peek_surface (node), &node->bounds));
+      break;
+
+    case GSK_COLOR_NODE:
+      append_rect (record, &node->bounds);
+      append_rgba (record, gsk_color_node_peek_color (node));
+      break;
+
+    case GSK_LINEAR_GRADIENT_NODE:
+    case GSK_REPEATING_LINEAR_GRADIENT_NODE:
+      {
+        const GskColorStop *stops = gsk_linear_gradient_node_peek_color_stops (node);
+        gsize i, n = gsk_linear_gradient_node_get_n_color_stops (node);
+
+        append_rect (record, &node->bounds);
+        append_point (record, gsk_linear_gradient_node_peek_start (node));
+        append_point (record, gsk_linear_gradient_node_peek_end (node));
+        append_uint32 (record, n);
+        for (i = 0; i < n; i++)
+          {
+            append_float (record, stops[i].offset);
+            append_rgba (record, &stops[i].color);
+          }
+      }
+      break;
+
+    case GSK_BORDER_NODE:
+      {
+        const float *widths = gsk_border_node_peek_widths (node);
+        const GdkRGBA *colors = gsk_border_node_peek_colors (node);
+        guint i;
+
+        append_rounded_rect (record, gsk_border_node_peek_outline (node));
+        for (i = 0; i < 4; i++)
+          append_float (record, widths[i]);
+        for (i = 0; i < 4; i++)
+          append_rgba (record, &colors[i]);
+      }
+      break;
+
+    case GSK_TEXTURE_NODE:
+      append_rect (record, &node->bounds);
+      append_uint32 (record, writer_add_texture (self, gsk_texture_node_get_texture (node)));
+      break;
+
+    case GSK_INSET_SHADOW_NODE:
+      append_rounded_rect (record, gsk_inset_shadow_node_peek_outline (node));
+      append_rgba (record, gsk_inset_shadow_node_peek_color (node));
+      append_float (record, gsk_inset_shadow_node_get_dx (node));
+      append_float (record, gsk_inset_shadow_node_get_dy (node));
+      append_float (record, gsk_inset_shadow_node_get_spread (node));
+      append_float (record, gsk_inset_shadow_node_get_blur_radius (node));
+      break;
+
+    case GSK_OUTSET_SHADOW_NODE:
+      append_rounded_rect (record, gsk_outset_shadow_node_peek_outline (node));
+      append_rgba (record, gsk_outset_shadow_node_peek_color (node));
+      append_float (record, gsk_outset_shadow_node_get_dx (node));
+      append_float (record, gsk_outset_shadow_node_get_dy (node));
+      append_float (record, gsk_outset_shadow_node_get_spread (node));
+      append_float (record, gsk_outset_shadow_node_get_blur_radius (node));
+      break;
+
+    case GSK_TRANSFORM_NODE:
+      {
+        char *transform = gsk_transform_to_string (gsk_transform_node_get_transform (node));
+
+        append_node (self, record, gsk_transform_node_get_child (node));
+        append_uint32 (record, writer_add_string (self, transform));
+
+        g_free (transform);
+      }
+      break;
+
+    case GSK_OPACITY_NODE:
+      append_node (self, record, gsk_opacity_node_get_child (node));
+      append_float (record, gsk_opacity_node_get_opacity (node));
+      break;
+
+    case GSK_COLOR_MATRIX_NODE:
+      {
+        float values[16];
+        guint i;
+
+        append_node (self, record, gsk_color_matrix_node_get_child (node));
+        graphene_matrix_to_float (gsk_color_matrix_node_peek_color_matrix (node), values);
+        for (i = 0; i < 16; i++)
+          append_float (record, values[i]);
+        graphene_vec4_to_float (gsk_color_matrix_node_peek_color_offset (node), values);
+        for (i = 0; i < 4; i++)
+          append_float (record, values[i]);
+      }
+      break;
+
+    case GSK_REPEAT_NODE:
+      append_rect (record, &node->bounds);
+      append_node (self, record, gsk_repeat_node_get_child (node));
+      append_rect (record, gsk_repeat_node_peek_child_bounds (node));
+      break;
+
+    case GSK_CLIP_NODE:
+      append_node (self, record, gsk_clip_node_get_child (node));
+      append_rect (record, gsk_clip_node_peek_clip (node));
+      break;
+
+    case GSK_ROUNDED_CLIP_NODE:
+      append_node (self, record, gsk_rounded_clip_node_get_child (node));
+      append_rounded_rect (record, gsk_rounded_clip_node_peek_clip (node));
+      break;
+
+    case GSK_SHADOW_NODE:
+      {
+        gsize i, n = gsk_shadow_node_get_n_shadows (node);
+
+        append_node (self, record, gsk_shadow_node_get_child (node));
+        append_uint32 (record, n);
+        for (i = 0; i < n; i++)
+          {
+            const GskShadow *shadow = gsk_shadow_node_peek_shadow (node, i);
+
+            append_rgba (record, &shadow->color);
+            append_float (record, shadow->dx);
+            append_float (record, shadow->dy);
+            append_float (record, shadow->radius);
+          }
+      }
+      break;
+
+    case GSK_BLEND_NODE:
+      {
+        guint32 bottom = writer_add_node (self, gsk_blend_node_get_bottom_child (node));
+        guint32 top = writer_add_node (self, gsk_blend_node_get_top_child (node));
+
+        append_uint32 (record, bottom);
+        append_uint32 (record, top);
+        append_uint32 (record, gsk_blend_node_get_blend_mode (node));
+      }
+      break;
+
+    case GSK_CROSS_FADE_NODE:
+      {
+        guint32 start = writer_add_node (self, gsk_cross_fade_node_get_start_child (node));
+        guint32 end = writer_add_node (self, gsk_cross_fade_node_get_end_child (node));
+
+        append_uint32 (record, start);
+        append_uint32 (record, end);
+        append_float (record, gsk_cross_fade_node_get_progress (node));
+      }
+      break;
+
+    case GSK_TEXT_NODE:
+      {
+        const PangoGlyphInfo *glyphs = gsk_text_node_peek_glyphs (node);
+        guint i, n = gsk_text_node_get_num_glyphs (node);
+        PangoFontDescription *desc;
+        char *font_name;
+
+        desc = pango_font_describe (gsk_text_node_peek_font (node));
+        font_name = pango_font_description_to_string (desc);
+        append_uint32 (record, writer_add_string (self, font_name));
+        g_free (font_name);
+        pango_font_description_free (desc);
+
+        append_rgba (record, gsk_text_node_peek_color (node));
+        append_point (record, gsk_text_node_get_offset (node));
+        append_uint32 (record, n);
+        for (i = 0; i < n; i++)
+          {
+            append_uint32 (record, glyphs[i].glyph);
+            append_int32 (record, glyphs[i].geometry.width);
+            append_int32 (record, glyphs[i].geometry.x_offset);
+            append_int32 (record, glyphs[i].geometry.y_offset);
+            append_uint32 (record, glyphs[i].attr.is_cluster_start);
+          }
+      }
+      break;
+
+    case GSK_BLUR_NODE:
+      append_node (self, record, gsk_blur_node_get_child (node));
+      append_float (record, gsk_blur_node_get_radius (node));
+      break;
+
+    case GSK_DEBUG_NODE:
+      append_node (self, record, gsk_debug_node_get_child (node));
+      append_uint32 (record, writer_add_string (self, gsk_debug_node_get_message (node)));
+      break;
+
+    case GSK_NOT_A_RENDER_NODE:
+    default:
+      g_assert_not_reached ();
+      break;
+    }
+}
+
+static guint32
+writer_add_node (GskRenderNodeWriter *self,
+                 GskRenderNode       *node)
+{
+  GByteArray *record;
+  GBytes *bytes;
+  gpointer index;
+  gsize offset;
+  guint32 result;
+
+  index = g_hash_table_lookup (self->nodes, node);
+  if (index)
+    return GPOINTER_TO_UINT (index) - 1;
+
+  record = g_byte_array_new ();
+  append_uint32 (record, gsk_render_node_get_node_type (node));
+  append_node_data (self, record, node);
+  bytes = g_byte_array_free_to_bytes (record);
+
+  index = g_hash_table_lookup (self->node_records, bytes);
+  if (index)
+    {
+      result = GPOINTER_TO_UINT (index) - 1;
+      g_bytes_unref (bytes);
+    }
+  else
+    {
+      offset = writer_begin_record (self, RECORD_NODE);
+      g_byte_array_append (self->data,
+                           g_bytes_get_data (bytes, NULL),
+                           g_bytes_get_size (bytes));
+      writer_end_record (self, offset);
+
+      result = self->n_nodes++;
+      g_hash_table_insert (self->node_records, bytes, GUINT_TO_POINTER (result + 1));
+    }
+
+  g_hash_table_insert (self->nodes, gsk_render_node_ref (node), GUINT_TO_POINTER (result + 1));
+
+  return result;
+}
+
+GskRenderNodeWriter *
+gsk_render_node_writer_new (void)
+{
+  GskRenderNodeWriter *self;
+
+  self = g_slice_new0 (GskRenderNodeWriter);
+
+  self->data = g_byte_array_new ();
+  g_byte_array_append (self->data, (guint8 *) BINARY_MAGIC, BINARY_MAGIC_SIZE);
+  append_uint32 (self->data, BINARY_VERSION);
+  append_uint32 (self->data, BINARY_BYTE_ORDER);
+
+  self->nodes = g_hash_table_new_full (NULL, NULL, (GDestroyNotify) gsk_render_node_unref, NULL);
+  self->node_records = g_hash_table_new_full (g_bytes_hash, g_bytes_equal, (GDestroyNotify) g_bytes_unref, NULL);
+  self->textures = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
+  self->texture_checksums = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->strings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  return self;
+}
+
+/* Adds @node as the next root. Nodes, textures and strings are
+ * shared with all roots added before. */
+void
+gsk_render_node_writer_add (GskRenderNodeWriter *self,
+                            GskRenderNode       *node)
+{
+  guint32 index;
+  gsize offset;
+
+  index = writer_add_node (self, node);
+
+  offset = writer_begin_record (self, RECORD_ROOT);
+  append_uint32 (self->data, index);
+  writer_end_record (self, offset);
+}
+
+GBytes *
+gsk_render_node_writer_free_to_bytes (GskRenderNodeWriter *self)
+{
+  GBytes *result;
+
+  result = g_byte_array_free_to_bytes (self->data);
+
+  g_hash_table_unref (self->nodes);
+  g_hash_table_unref (self->node_records);
+  g_hash_table_unref (self->textures);
+  g_hash_table_unref (self->texture_checksums);
+  g_hash_table_unref (self->strings);
+
+  g_slice_free (GskRenderNodeWriter, self);
+
+  return result;
+}
+
+GBytes *
+gsk_render_node_serialize_binary (GskRenderNode *node)
+{
+  GskRenderNodeWriter *writer;
+
+  writer = gsk_render_node_writer_new ();
+  gsk_render_node_writer_add (writer, node);
+
+  return gsk_render_node_writer_free_to_bytes (writer);
+}
+
+/* }}} */
+/* {{{ Reading */
+
+typedef struct
+{
+  GBytes *bytes;
+  const guchar *data;
+  gsize size;
+
+  /* Position in the current record and its end */
+  gsize pos;
+  gsize end;
+  gboolean failed;
+
+  GskParseErrorFunc error_func;
+  gpointer user_data;
+
+  GPtrArray *strings;
+  GPtrArray *textures;
+  GPtrArray *nodes;
+  /* font name => PangoFont */
+  GHashTable *fonts;
+} Reader;
+
+static void
+reader_error (Reader     *self,
+              const char *format,
+              ...) G_GNUC_PRINTF (2, 3);
+
+static void
+reader_error (Reader     *self,
+              const char *format,
+              ...)
+{
+  GtkCssLocation location = { 0, };
+  GtkCssSection *section;
+  GError *error;
+  va_list args;
+
+  if (self->failed)
+    return;
+
+  self->failed = TRUE;
+
+  if (self->error_func == NULL)
+    return;
+
+  va_start (args, format);
+  error = g_error_new_valist (GTK_CSS_PARSER_ERROR, GTK_CSS_PARSER_ERROR_SYNTAX, format, args);
+  va_end (args);
+
+  location.bytes = self->pos;
+  location.line_bytes = self->pos;
+  section = gtk_css_section_new (NULL, &location, &location);
+
+  self->error_func (section, error, self->user_data);
+
+  gtk_css_section_unref (section);
+  g_error_free (error);
+}
+
+static gboolean
+reader_has (Reader *self,
+            gsize   size)
+{
+  if (self->failed)
+    return FALSE;
+
+  if (self->end - self->pos < size)
+    {
+      reader_error (self, "Unexpected end of record");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static guint32
+read_uint32 (Reader *self)
+{
+  guint32 result;
+
+  if (!reader_has (self, sizeof (guint32)))
+    return 0;
+
+  memcpy (&result, self->data + self->pos, sizeof (guint32));
+  self->pos += sizeof (guint32);
+
+  return result;
+}
+
+static gint32
+read_int32 (Reader *self)
+{
+  return (gint32) read_uint32 (self);
+}
+
+static float
+read_float (Reader *self)
+{
+  float result;
+
+  if (!reader_has (self, sizeof (float)))
+    return 0;
+
+  memcpy (&result, self->data + self->pos, sizeof (float));
+  self->pos += sizeof (float);
+
+  return result;
+}
+
+static void
+read_point (Reader           *self,
+            graphene_point_t *point)
+{
+  point->x = read_float (self);
+  point->y = read_float (self);
+}
+
+static void
+read_rect (Reader          *self,
+           graphene_rect_t *rect)
+{
+  rect->origin.x = read_float (self);
+  rect->origin.y = read_float (self);
+  rect->size.width = read_float (self);
+  rect->size.height = read_float (self);
+}
+
+static void
+read_rounded_rect (Reader         *self,
+                   GskRoundedRect *rect)
+{
+  guint i;
+
+  read_rect (self, &rect->bounds);
+  for (i = 0; i < 4; i++)
+    {
+      rect->corner[i].width = read_float (self);
+      rect->corner[i].height = read_float (self);
+    }
+}
+
+static void
+read_rgba (Reader  *self,
+           GdkRGBA *rgba)
+{
+  rgba->red = read_float (self);
+  rgba->green = read_float (self);
+  rgba->blue = read_float (self);
+  rgba->alpha = read_float (self);
+}
+
+/* Returns a borrowed reference or %NULL */
+static GskRenderNode *
+read_node (Reader *self)
+{
+  guint32 index = read_uint32 (self);
+
+  if (self->failed)
+    return NULL;
+
+  if (index >= self->nodes->len)
+    {
+      reader_error (self, "Invalid node reference %u", index);
+      return NULL;
+    }
+
+  return g_ptr_array_index (self->nodes, index);
+}
+
+static const char *
+read_string (Reader *self)
+{
+  guint32 index = read_uint32 (self);
+
+  if (self->failed || index == NO_INDEX)
+    return NULL;
+
+  if (index >= self->strings->len)
+    {
+      reader_error (self, "Invalid string reference %u", index);
+      return NULL;
+    }
+
+  return g_ptr_array_index (self->strings, index);
+}
+
+static GdkTexture *
+read_texture (Reader *self)
+{
+  guint32 index = read_uint32 (self);
+
+  if (self->failed || index == NO_INDEX)
+    return NULL;
+
+  if (index >= self->textures->len)
+    {
+      reader_error (self, "Invalid texture reference %u", index);
+      return NULL;
+    }
+
+  return g_ptr_array_index (self->textures, index);
+}
+
+static PangoFont *
+reader_get_font (Reader     *self,
+                 const char *name)
+{
+  PangoFontDescription *desc;
+  PangoFontMap *font_map;
+  PangoContext *context;
+  PangoFont *font;
+
+  font = g_hash_table_lookup (self->fonts, name);
+  if (font)
+    return font;
+
+  desc = pango_font_description_from_string (name);
+  font_map = pango_cairo_font_map_get_default ();
+  context = pango_font_map_create_context (font_map);
+  font = pango_font_map_load_font (font_map, context, desc);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+
+  if (font == NULL)
+    {
+      reader_error (self, "Could not load font \"%s\"", name);
+      return NULL;
+    }
+
+  g_hash_table_insert (self->fonts, g_strdup (name), font);
+
+  return font;
+}
+
+static void
+read_string_record (Reader *self)
+{
+  const char *s = (const char *) self->data + self->pos;
+
+  if (memchr (s, '\0', self->end - self->pos) == NULL)
+    {
+      reader_error (self, "Unterminated string");
+      return;
+    }
+
+  g_ptr_array_add (self->strings, g_strdup (s));
+}
+
+static void
+read_texture_record (Reader *self)
+{
+  guint32 width, height, stride, padding;
+  GBytes *pixels;
+
+  width = read_uint32 (self);
+  height = read_uint32 (self);
+  stride = read_uint32 (self);
+  padding = read_uint32 (self);
+
+  if (self->failed)
+    return;
+
+  if (width == 0 || height == 0 || width > G_MAXINT / 4 || stride < width * 4 ||
+      padding >= TEXTURE_ALIGNMENT ||
+      padding > self->end - self->pos ||
+      (self->end - self->pos - padding) / stride < height)
+    {
+      reader_error (self, "Invalid texture");
+      return;
+    }
+
+  self->pos += padding;
+
+  /* Doesn't copy, if bytes come from a mapped file this is zero-copy */
+  pixels = g_bytes_new_from_bytes (self->bytes, self->pos, (gsize) stride * height);
+  g_ptr_array_add (self->textures,
+                   gdk_memory_texture_new (width, height, GDK_MEMORY_DEFAULT, pixels, stride));
+  g_bytes_unref (pixels);
+}
+
+static GskRenderNode *
+read_node_data (Reader            *self,
+                GskRenderNodeType  type)
+{
+  graphene_rect_t bounds;
+
+  switch (type)
+    {
+    case GSK_CONTAINER_NODE:
+      {
+        GskRenderNode **children;
+        GskRenderNode *result;
+        guint32 i, n;
+
+        n = read_uint32 (self);
+        if (!reader_has (self, (gsize) n * sizeof (guint32)))
+          return NULL;
+
+        children = g_new (GskRenderNode *, n);
+        for (i = 0; i < n; i++)
+          children[i] = read_node (self);
+
+        result = self->failed ? NULL : gsk_container_node_new (children, n);
+        g_free (children);
+
+        return result;
+      }
+
+    case GSK_CAIRO_NODE:
+      {
+        GskRenderNode *result;
+        GdkTexture *pixels;
+
+        read_rect (self, &bounds);
+        pixels = read_texture (self);
+        if (self->failed)
+          return NULL;
+
+        result = gsk_cairo_node_new (&bounds);
+        if (pixels)
+          {
+            cairo_t *cr = gsk_cairo_node_get_draw_context (result);
+            cairo_surface_t *surface = gdk_texture_download_surface (pixels);
+
+            cairo_set_source_surface (cr, surface, bounds.origin.x, bounds.origin.y);
+            cairo_paint (cr);
+            cairo_destroy (cr);
+            cairo_surface_destroy (surface);
+          }
+
+        return result;
+      }
+
+    case GSK_COLOR_NODE:
+      {
+        GdkRGBA color;
+
+        read_rect (self, &bounds);
+        read_rgba (self, &color);
+        if (self->failed)
+          return NULL;
+
+        return gsk_color_node_new (&color, &bounds);
+      }
+
+    case GSK_LINEAR_GRADIENT_NODE:
+    case GSK_REPEATING_LINEAR_GRADIENT_NODE:
+      {
+        graphene_point_t start, end;
+        GskColorStop *stops;
+        GskRenderNode *result;
+        guint32 i, n;
+
+        read_rect (self, &bounds);
+        read_point (self, &start);
+        read_point (self, &end);
+        n = read_uint32 (self);
+        if (!reader_has (self, (gsize) n * 5 * sizeof (float)))
+          return NULL;
+
+        if (n < 2)
+          {
+            reader_error (self, "Gradient node with %u color stops", n);
+            return NULL;
+          }
+
+        stops = g_new (GskColorStop, n);
+        for (i = 0; i < n; i++)
+          {
+            stops[i].offset = read_float (self);
+            read_rgba (self, &stops[i].color);
+
+            /* Also rejects NaN offsets */
+            if (!(stops[i].offset >= (i > 0 ? stops[i - 1].offset : 0) && stops[i].offset <= 1))
+              {
+                reader_error (self, "Invalid color stop offset %g", stops[i].offset);
+                g_free (stops);
+                return NULL;
+              }
+          }
+
+        if (type == GSK_LINEAR_GRADIENT_NODE)
+          result = gsk_linear_gradient_node_new (&bounds, &start, &end, stops, n);
+        else
+          result = gsk_repeating_linear_gradient_node_new (&bounds, &start, &end, stops, n);
+
+        g_free (stops);
+
+        return result;
+      }
+
+    case GSK_BORDER_NODE:
+      {
+        GskRoundedRect outline;
+        float widths[4];
+        GdkRGBA colors[4];
+        guint i;
+
+        read_rounded_rect (self, &outline);
+        for (i = 0; i < 4; i++)
+          widths[i] = read_float (self);
+        for (i = 0; i < 4; i++)
+          read_rgba (self, &colors[i]);
+        if (self->failed)
+          return NULL;
+
+        return gsk_border_node_new (&outline, widths, colors);
+      }
+
+    case GSK_TEXTURE_NODE:
+      {
+        GdkTexture *texture;
+
+        read_rect (self, &bounds);
+        texture = read_texture (self);
+        if (self->failed)
+          return NULL;
+        if (texture == NULL)
+          {
+            reader_error (self, "Texture node without texture");
+            return NULL;
+          }
+
+        return gsk_texture_node_new (texture, &bounds);
+      }
+
+    case GSK_INSET_SHADOW_NODE:
+    case GSK_OUTSET_SHADOW_NODE:
+      {
+        GskRoundedRect outline;
+        GdkRGBA color;
+        float dx, dy, spread, blur;
+
+        read_rounded_rect (self, &outline);
+        read_rgba (self, &color);
+        dx = read_float (self);
+        dy = read_float (self);
+        spread = read_float (self);
+        blur = read_float (self);
+        if (self->failed)
+          return NULL;
+
+        if (type == GSK_INSET_SHADOW_NODE)
+          return gsk_inset_shadow_node_new (&outline, &color, dx, dy, spread, blur);
+        else
+          return gsk_outset_shadow_node_new (&outline, &color, dx, dy, spread, blur);
+      }
+
+    case GSK_TRANSFORM_NODE:
+      {
+        GskRenderNode *child, *result;
+        GskTransform *transform = NULL;
+        const char *string;
+
+        child = read_node (self);
+        string = read_string (self);
+        if (self->failed)
+          return NULL;
+
+        if (string == NULL)
+          {
+            reader_error (self, "Transform node without transform");
+            return NULL;
+          }
+
+        if (!gsk_transform_parse (string, &transform))
+          {
+            reader_error (self, "Invalid transform \"%s\"", string);
+            return NULL;
+          }
+
+        /* Identity transforms parse to NULL, do what the text parser does */
+        if (transform == NULL)
+          transform = gsk_transform_new ();
+
+        result = gsk_transform_node_new (child, transform);
+        gsk_transform_unref (transform);
+
+        return result;
+      }
+
+    case GSK_OPACITY_NODE:
+      {
+        GskRenderNode *child;
+        float opacity;
+
+        child = read_node (self);
+        opacity = read_float (self);
+        if (self->failed)
+          return NULL;
+
+        return gsk_opacity_node_new (child, opacity);
+      }
+
+    case GSK_COLOR_MATRIX_NODE:
+      {
+        graphene_matrix_t matrix;
+        graphene_vec4_t offset;
+        GskRenderNode *child;
+        float values[16];
+        guint i;
+
+        child = read_node (self);
+        for (i = 0; i < 16; i++)
+          values[i] = read_float (self);
+        graphene_matrix_init_from_float (&matrix, values);
+        for (i = 0; i < 4; i++)
+          values[i] = read_float (self);
+        graphene_vec4_init_from_float (&offset, values);
+        if (self->failed)
+          return NULL;
+
+        return gsk_color_matrix_node_new (child, &matrix, &offset);
+      }
+
+    case GSK_REPEAT_NODE:
+      {
+        graphene_rect_t child_bounds;
+        GskRenderNode *child;
+
+        read_rect (self, &bounds);
+        child = read_node (self);
+        read_rect (self, &child_bounds);
+        if (self->failed)
+          return NULL;
+
+        return gsk_repeat_node_new (&bounds, child, &child_bounds);
+      }
+
+    case GSK_CLIP_NODE:
+      {
+        GskRenderNode *child;
+        graphene_rect_t clip;
+
+        child = read_node (self);
+        read_rect (self, &clip);
+        if (self->failed)
+          return NULL;
+
+        return gsk_clip_node_new (child, &clip);
+      }
+
+    case GSK_ROUNDED_CLIP_NODE:
+      {
+        GskRenderNode *child;
+        GskRoundedRect clip;
+
+        child = read_node (self);
+        read_rounded_rect (self, &clip);
+        if (self->failed)
+          return NULL;
+
+        return gsk_rounded_clip_node_new (child, &clip);
+      }
+
+    case GSK_SHADOW_NODE:
+      {
+        GskRenderNode *child, *result;
+        GskShadow *shadows;
+        guint32 i, n;
+
+        child = read_node (self);
+        n = read_uint32 (self);
+        if (!reader_has (self, (gsize) n * 7 * sizeof (float)))
+          return NULL;
+
+        if (n == 0)
+          {
+            reader_error (self, "Shadow node without shadows");
+            return NULL;
+          }
+
+        shadows = g_new (GskShadow, n);
+        for (i = 0; i < n; i++)
+          {
+            read_rgba (self, &shadows[i].color);
+            shadows[i].dx = read_float (self);
+            shadows[i].dy = read_float (self);
+            shadows[i].radius = read_float (self);
+          }
+
+        result = gsk_shadow_node_new (child, shadows, n);
+        g_free (shadows);
+
+        return result;
+      }
+
+    case GSK_BLEND_NODE:
+      {
+        GskRenderNode *bottom, *top;
+        guint32 mode;
+
+        bottom = read_node (self);
+        top = read_node (self);
+        mode = read_uint32 (self);
+        if (self->failed)
+          return NULL;
+
+        if (mode > GSK_BLEND_MODE_LUMINOSITY)
+          {
+            reader_error (self, "Invalid blend mode %u", mode);
+            return NULL;
+          }
+
+        return gsk_blend_node_new (bottom, top, mode);
+      }
+
+    case GSK_CROSS_FADE_NODE:
+      {
+        GskRenderNode *start, *end;
+        float progress;
+
+        start = read_node (self);
+        end = read_node (self);
+        progress = read_float (self);
+        if (self->failed)
+          return NULL;
+
+        return gsk_cross_fade_node_new (start, end, progress);
+      }
+
+    case GSK_TEXT_NODE:
+      {
+        PangoGlyphString *glyphs;
+        graphene_point_t offset;
+        GskRenderNode *result;
+        const char *font_name;
+        PangoFont *font;
+        GdkRGBA color;
+        guint32 i, n;
+
+        font_name = read_string (self);
+        read_rgba (self, &color);
+        read_point (self, &offset);
+        n = read_uint32 (self);
+        if (!reader_has (self, (gsize) n * 5 * sizeof (guint32)))
+          return NULL;
+
+        if (font_name == NULL)
+          {
+            reader_error (self, "Text node without font");
+            return NULL;
+          }
+        font = reader_get_font (self, font_name);
+        if (font == NULL)
+          return NULL;
+
+        glyphs = pango_glyph_string_new ();
+        pango_glyph_string_set_size (glyphs, n);
+        for (i = 0; i < n; i++)
+          {
+            glyphs->glyphs[i].glyph = read_uint32 (self);
+            glyphs->glyphs[i].geometry.width = read_int32 (self);
+            glyphs->glyphs[i].geometry.x_offset = read_int32 (self);
+            glyphs->glyphs[i].geometry.y_offset = read_int32 (self);
+            glyphs->glyphs[i].attr.is_cluster_start = read_uint32 (self) ? 1 : 0;
+          }
+
+        result = gsk_text_node_new (font, glyphs, &color, &offset);
+        pango_glyph_string_free (glyphs);
+
+        if (result == NULL)
+          reader_error (self, "Glyphs result in empty text");
+
+        return result;
+      }
+
+    case GSK_BLUR_NODE:
+      {
+        GskRenderNode *child;
+        float radius;
+
+        child = read_node (self);
+        radius = read_float (self);
+        if (self->failed)
+          return NULL;
+
+        return gsk_blur_node_new (child, radius);
+      }
+
+    case GSK_DEBUG_NODE:
+      {
+        GskRenderNode *child;
+        const char *message;
+
+        child = read_node (self);
+        message = read_string (self);
+        if (self->failed)
+          return NULL;
+
+        return gsk_debug_node_new (child, g_strdup (message));
+      }
+
+    case GSK_NOT_A_RENDER_NODE:
+    default:
+      reader_error (self, "Unknown node type %u", type);
+      return NULL;
+    }
+}
+
+static void
+read_node_record (Reader *self)
+{
+  GskRenderNode *node;
+
+  node = read_node_data (self, read_uint32 (self));
+  if (node == NULL)
+    {
+      /* Later records refer to nodes by index, so skipping one
+       * would make them refer to the wrong nodes */
+      reader_error (self, "Invalid node");
+      return;
+    }
+
+  g_ptr_array_add (self->nodes, node);
+}
+
+gboolean
+gsk_render_node_is_binary (GBytes *bytes)
+{
+  gsize size;
+  const guchar *data = g_bytes_get_data (bytes, &size);
+
+  return size >= BINARY_MAGIC_SIZE &&
+         memcmp (data, BINARY_MAGIC, BINARY_MAGIC_SIZE) == 0;
+}
+
+/* Returns the roots in @bytes, or %NULL on error */
+GPtrArray *
+gsk_render_node_deserialize_binary (GBytes            *bytes,
+                                    GskParseErrorFunc  error_func,
+                                    gpointer           user_data)
+{
+  Reader reader = { 0, };
+  GPtrArray *roots;
+  guint32 version, byte_order;
+
+  g_return_val_if_fail (gsk_render_node_is_binary (bytes), NULL);
+
+  reader.bytes = bytes;
+  reader.data = g_bytes_get_data (bytes, &reader.size);
+  reader.error_func = error_func;
+  reader.user_data = user_data;
+  reader.pos = BINARY_MAGIC_SIZE;
+  reader.end = reader.size;
+  reader.strings = g_ptr_array_new_with_free_func (g_free);
+  reader.textures = g_ptr_array_new_with_free_func (g_object_unref);
+  reader.nodes = g_ptr_array_new_with_free_func ((GDestroyNotify) gsk_render_node_unref);
+  reader.fonts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+
+  roots = g_ptr_array_new_with_free_func ((GDestroyNotify) gsk_render_node_unref);
+
+  version = read_uint32 (&reader);
+  byte_order = read_uint32 (&reader);
+  if (!reader.failed && byte_order != BINARY_BYTE_ORDER)
+    reader_error (&reader, "File was written on a machine with a different byte order");
+  else if (!reader.failed && version != BINARY_VERSION)
+    reader_error (&reader, "Unsupported version %u", version);
+
+  while (!reader.failed && reader.pos < reader.size)
+    {
+      guint32 tag, size;
+
+      reader.end = reader.size;
+      tag = read_uint32 (&reader);
+      size = read_uint32 (&reader);
+      if (!reader_has (&reader, size))
+        break;
+
+      reader.end = reader.pos + size;
+
+      switch (tag)
+        {
+        case RECORD_STRING:
+          read_string_record (&reader);
+          break;
+
+        case RECORD_TEXTURE:
+          read_texture_record (&reader);
+          break;
+
+        case RECORD_NODE:
+          read_node_record (&reader);
+          break;
+
+        case RECORD_ROOT:
+          {
+            GskRenderNode *node = read_node (&reader);
+
+            if (node)
+              g_ptr_array_add (roots, gsk_render_node_ref (node));
+          }
+          break;
+
+        default:
+          /* Skip unknown records, so later versions can add optional ones */
+          break;
+        }
+
+      reader.pos = reader.end;
+    }
+
+  if (!reader.failed && roots->len == 0)
+    reader_error (&reader, "No render node in file");
+
+  g_ptr_array_unref (reader.strings);
+  g_ptr_array_unref (reader.textures);
+  g_ptr_array_unref (reader.nodes);
+  g_hash_table_unref (reader.fonts);
+
+  if (reader.failed)
+    g_clear_pointer (&roots, g_ptr_array_unref);
+
+  return roots;
+}
+
+/* }}} */
@@ -0,0 +1,24 @@
+#ifndef __GSK_RENDER_NODE_BINARY_PRIVATE_H__
+#define __GSK_RENDER_NODE_BINARY_PRIVATE_H__
+
+#include "gskrendernode.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GskRenderNodeWriter GskRenderNodeWriter;
+
+GskRenderNodeWriter *   gsk_render_node_writer_new              (void);
+void                    gsk_render_node_writer_add              (GskRenderNodeWriter    *self,
+                                                                 GskRenderNode          *node);
+GBytes *                gsk_render_node_writer_free_to_bytes    (GskRenderNodeWriter    *self);
+
+GBytes *                gsk_render_node_serialize_binary        (GskRenderNode          *node);
+
+gboolean                gsk_render_node_is_binary               (GBytes                 *bytes);
+GPtrArray *             gsk_render_node_deserialize_binary      (GBytes                 *bytes,
+                                                                 GskParseErrorFunc       error_func,
+                                                                 gpointer                user_data);
+
+G_END_DECLS
+
+#endif /* __GSK_RENDER_NODE_BINARY_PRIVATE_H__ */
@@ -99,6 +99,25 @@ gsk_color_node_diff (GskRenderNode  *node1,
   gsk_render_node_diff_impossible (node1, node2, region);
 }
 
+static guint64
+gsk_color_node_hash (GskRenderNode *node,
+                     guint64        hash)
+{
+  GskColorNode *self = (GskColorNode *) node;
+
+  return gsk_render_node_hash_data (hash, &self->color, sizeof (GdkRGBA));
+}
+
+static gboolean
+gsk_color_node_equal (GskRenderNode *node1,
+                      GskRenderNode *node2)
+{
+  GskColorNode *self1 = (GskColorNode *) node1;
+  GskColorNode *self2 = (GskColorNode *) node2;
+
+  return memcmp (&self1->color, &self2->color, sizeof (GdkRGBA)) == 0;
+}
+
 static const GskRenderNodeClass GSK_COLOR_NODE_CLASS = {
   GSK_COLOR_NODE,
   sizeof (GskColorNode),
@@ -107,6 +126,8 @@ static const GskRenderNodeClass GSK_COLOR_NODE_CLASS = {
   gsk_color_node_draw,
   gsk_render_node_can_diff_true,
   gsk_color_node_diff,
+  gsk_color_node_hash,
+  gsk_color_node_equal,
 };
 
 const GdkRGBA *
@@ -228,6 +249,30 @@ gsk_linear_gradient_node_diff (GskRenderNode  *node1,
   gsk_render_node_diff_impossible (node1, node2, region);
 }
 
+static guint64
+gsk_linear_gradient_node_hash (GskRenderNode *node,
+                               guint64        hash)
+{
+  GskLinearGradientNode *self = (GskLinearGradientNode *) node;
+
+  hash = gsk_render_node_hash_data (hash, &self->start, sizeof (graphene_point_t));
+  hash = gsk_render_node_hash_data (hash, &self->end, sizeof (graphene_point_t));
+  return gsk_render_node_hash_data (hash, self->stops, sizeof (GskColorStop) * self->n_stops);
+}
+
+static gboolean
+gsk_linear_gradient_node_equal (GskRenderNode *node1,
+                                GskRenderNode *node2)
+{
+  GskLinearGradientNode *self1 = (GskLinearGradientNode *) node1;
+  GskLinearGradientNode *self2 = (GskLinearGradientNode *) node2;
+
+  return memcmp (&self1->start, &self2->start, sizeof (graphene_point_t)) == 0 &&
+         memcmp (&self1->end, &self2->end, sizeof (graphene_point_t)) == 0 &&
+         self1->n_stops == self2->n_stops &&
+         memcmp (self1->stops, self2->stops, sizeof (GskColorStop) * self1->n_stops) == 0;
+}
+
 static const GskRenderNodeClass GSK_LINEAR_GRADIENT_NODE_CLASS = {
   GSK_LINEAR_GRADIENT_NODE,
   sizeof (GskLinearGradientNode),
@@ -236,6 +281,8 @@ static const GskRenderNodeClass GSK_LINEAR_GRADIENT_NODE_CLASS = {
   gsk_linear_gradient_node_draw,
   gsk_render_node_can_diff_true,
   gsk_linear_gradient_node_diff,
+  gsk_linear_gradient_node_hash,
+  gsk_linear_gradient_node_equal,
 };
 
 static const GskRenderNodeClass GSK_REPEATING_LINEAR_GRADIENT_NODE_CLASS = {
@@ -246,6 +293,8 @@ static const GskRenderNodeClass GSK_REPEATING_LINEAR_GRADIENT_NODE_CLASS = {
   gsk_linear_gradient_node_draw,
   gsk_render_node_can_diff_true,
   gsk_linear_gradient_node_diff,
+  gsk_linear_gradient_node_hash,
+  gsk_linear_gradient_node_equal,
 };
 
 /**
@@ -547,6 +596,29 @@ gsk_border_node_diff (GskRenderNode  *node1,
   gsk_render_node_diff_impossible (node1, node2, region);
 }
 
+static guint64
+gsk_border_node_hash (GskRenderNode *node,
+                      guint64        hash)
+{
+  GskBorderNode *self = (GskBorderNode *) node;
+
+  hash = gsk_render_node_hash_data (hash, &self->outline, sizeof (GskRoundedRect));
+  hash = gsk_render_node_hash_data (hash, self->border_width, sizeof (self->border_width));
+  return gsk_render_node_hash_data (hash, self->border_color, sizeof (self->border_color));
+}
+
+static gboolean
+gsk_border_node_equal (GskRenderNode *node1,
+                       GskRenderNode *node2)
+{
+  GskBorderNode *self1 = (GskBorderNode *) node1;
+  GskBorderNode *self2 = (GskBorderNode *) node2;
+
+  return memcmp (&self1->outline, &self2->outline, sizeof (GskRoundedRect)) == 0 &&
+         memcmp (self1->border_width, self2->border_width, sizeof (self1->border_width)) == 0 &&
+         memcmp (self1->border_color, self2->border_color, sizeof (self1->border_color)) == 0;
+}
+
 static const GskRenderNodeClass GSK_BORDER_NODE_CLASS = {
   GSK_BORDER_NODE,
   sizeof (GskBorderNode),
@@ -555,6 +627,8 @@ static const GskRenderNodeClass GSK_BORDER_NODE_CLASS = {
   gsk_border_node_draw,
   gsk_render_node_can_diff_true,
   gsk_border_node_diff,
+  gsk_border_node_hash,
+  gsk_border_node_equal,
 };
 
 const GskRoundedRect *
@@ -680,6 +754,25 @@ gsk_texture_node_diff (GskRenderNode  *node1,
   gsk_render_node_diff_impossible (node1, node2, region);
 }
 
+static guint64
+gsk_texture_node_hash (GskRenderNode *node,
+                       guint64        hash)
+{
+  GskTextureNode *self = (GskTextureNode *) node;
+
+  return gsk_render_node_hash_data (hash, &self->texture, sizeof (GdkTexture *));
+}
+
+static gboolean
+gsk_texture_node_equal (GskRenderNode *node1,
+                        GskRenderNode *node2)
+{
+  GskTextureNode *self1 = (GskTextureNode *) node1;
+  GskTextureNode *self2 = (GskTextureNode *) node2;
+
+  return self1->texture == self2->texture;
+}
+
 static const GskRenderNodeClass GSK_TEXTURE_NODE_CLASS = {
   GSK_TEXTURE_NODE,
   sizeof (GskTextureNode),
@@ -688,6 +781,8 @@ static const GskRenderNodeClass GSK_TEXTURE_NODE_CLASS = {
   gsk_texture_node_draw,
   gsk_render_node_can_diff_true,
   gsk_texture_node_diff,
+  gsk_texture_node_hash,
+  gsk_texture_node_equal,
 };
 
 /**
@@ -1148,6 +1243,35 @@ gsk_inset_shadow_node_diff (GskRenderNode  *node1,
   gsk_render_node_diff_impossible (node1, node2, region);
 }
 
+static guint64
+gsk_inset_shadow_node_hash (GskRenderNode *node,
+                            guint64        hash)
+{
+  GskInsetShadowNode *self = (GskInsetShadowNode *) node;
+
+  hash = gsk_render_node_hash_data (hash, &self->outline, sizeof (GskRoundedRect));
+  hash = gsk_render_node_hash_data (hash, &self->color, sizeof (GdkRGBA));
+  hash = gsk_render_node_hash_data (hash, &self->dx, sizeof (float));
+  hash = gsk_render_node_hash_data (hash, &self->dy, sizeof (float));
+  hash = gsk_render_node_hash_data (hash, &self->spread, sizeof (float));
+  return gsk_render_node_hash_data (hash, &self->blur_radius, sizeof (float));
+}
+
+static gboolean
+gsk_inset_shadow_node_equal (GskRenderNode *node1,
+                             GskRenderNode *node2)
+{
+  GskInsetShadowNode *self1 = (GskInsetShadowNode *) node1;
+  GskInsetShadowNode *self2 = (GskInsetShadowNode *) node2;
+
+  return memcmp (&self1->outline, &self2->outline, sizeof (GskRoundedRect)) == 0 &&
+         memcmp (&self1->color, &self2->color, sizeof (GdkRGBA)) == 0 &&
+         self1->dx == self2->dx &&
+         self1->dy == self2->dy &&
+         self1->spread == self2->spread &&
+         self1->blur_radius == self2->blur_radius;
+}
+
 static const GskRenderNodeClass GSK_INSET_SHADOW_NODE_CLASS = {
   GSK_INSET_SHADOW_NODE,
   sizeof (GskInsetShadowNode),
@@ -1156,6 +1280,8 @@ static const GskRenderNodeClass GSK_INSET_SHADOW_NODE_CLASS = {
   gsk_inset_shadow_node_draw,
   gsk_render_node_can_diff_true,
   gsk_inset_shadow_node_diff,
+  gsk_inset_shadow_node_hash,
+  gsk_inset_shadow_node_equal,
 };
 
 /**
@@ -1417,6 +1543,35 @@ gsk_outset_shadow_node_diff (GskRenderNode  *node1,
   gsk_render_node_diff_impossible (node1, node2, region);
 }
 
+static guint64
+gsk_outset_shadow_node_hash (GskRenderNode *node,
+                             guint64        hash)
+{
+  GskOutsetShadowNode *self = (GskOutsetShadowNode *) node;
+
+  hash = gsk_render_node_hash_data (hash, &self->outline, sizeof (GskRoundedRect));
+  hash = gsk_render_node_hash_data (hash, &self->color, sizeof (GdkRGBA));
+  hash = gsk_render_node_hash_data (hash, &self->dx, sizeof (float));
+  hash = gsk_render_node_hash_data (hash, &self->dy, sizeof (float));
+  hash = gsk_render_node_hash_data (hash, &self->spread, sizeof (float));
+  return gsk_render_node_hash_data (hash, &self->blur_radius, sizeof (float));
+}
+
+static gboolean
+gsk_outset_shadow_node_equal (GskRenderNode *node1,
+                              GskRenderNode *node2)
+{
+  GskOutsetShadowNode *self1 = (GskOutsetShadowNode *) node1;
+  GskOutsetShadowNode *self2 = (GskOutsetShadowNode *) node2;
+
+  return memcmp (&self1->outline, &self2->outline, sizeof (GskRoundedRect)) == 0 &&
+         memcmp (&self1->color, &self2->color, sizeof (GdkRGBA)) == 0 &&
+         self1->dx == self2->dx &&
+         self1->dy == self2->dy &&
+         self1->spread == self2->spread &&
+         self1->blur_radius == self2->blur_radius;
+}
+
 static const GskRenderNodeClass GSK_OUTSET_SHADOW_NODE_CLASS = {
   GSK_OUTSET_SHADOW_NODE,
   sizeof (GskOutsetShadowNode),
@@ -1425,6 +1580,8 @@ static const GskRenderNodeClass GSK_OUTSET_SHADOW_NODE_CLASS = {
   gsk_outset_shadow_node_draw,
   gsk_render_node_can_diff_true,
   gsk_outset_shadow_node_diff,
+  gsk_outset_shadow_node_hash,
+  gsk_outset_shadow_node_equal,
 };
 
 /**
@@ -1569,6 +1726,26 @@ gsk_cairo_node_draw (GskRenderNode *node,
   cairo_paint (cr);
 }
 
+static guint64
+gsk_cairo_node_hash (GskRenderNode *node,
+                     guint64        hash)
+{
+  GskCairoNode *self = (GskCairoNode *) node;
+
+  /* The recorded contents can't be compared, only the surface */
+  return gsk_render_node_hash_data (hash, &self->surface, sizeof (cairo_surface_t *));
+}
+
+static gboolean
+gsk_cairo_node_equal (GskRenderNode *node1,
+                      GskRenderNode *node2)
+{
+  GskCairoNode *self1 = (GskCairoNode *) node1;
+  GskCairoNode *self2 = (GskCairoNode *) node2;
+
+  return self1->surface == self2->surface;
+}
+
 static const GskRenderNodeClass GSK_CAIRO_NODE_CLASS = {
   GSK_CAIRO_NODE,
   sizeof (GskCairoNode),
@@ -1577,6 +1754,8 @@ static const GskRenderNodeClass GSK_CAIRO_NODE_CLASS = {
   gsk_cairo_node_draw,
   gsk_render_node_can_diff_true,
   gsk_render_node_diff_impossible,
+  gsk_cairo_node_hash,
+  gsk_cairo_node_equal,
 };
 
 cairo_surface_t *
@@ -1771,6 +1950,40 @@ gsk_container_node_diff (GskRenderNode  *node1,
   gsk_render_node_diff_impossible (node1, node2, region);
 }
 
+static guint64
+gsk_container_node_hash (GskRenderNode *node,
+                         guint64        hash)
+{
+  GskContainerNode *self = (GskContainerNode *) node;
+  guint i;
+
+  hash = gsk_render_node_hash_data (hash, &self->n_children, sizeof (guint));
+  for (i = 0; i < self->n_children; i++)
+    hash = gsk_render_node_hash_child (hash, self->children[i]);
+
+  return hash;
+}
+
+static gboolean
+gsk_container_node_equal (GskRenderNode *node1,
+                          GskRenderNode *node2)
+{
+  GskContainerNode *self1 = (GskContainerNode *) node1;
+  GskContainerNode *self2 = (GskContainerNode *) node2;
+  guint i;
+
+  if (self1->n_children != self2->n_children)
+    return FALSE;
+
+  for (i = 0; i < self1->n_children; i++)
+    {
+      if (!gsk_render_node_equal (self1->children[i], self2->children[i]))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 static const GskRenderNodeClass GSK_CONTAINER_NODE_CLASS = {
   GSK_CONTAINER_NODE,
   sizeof (GskContainerNode),
@@ -1779,6 +1992,8 @@ static const GskRenderNodeClass GSK_CONTAINER_NODE_CLASS = {
   gsk_container_node_draw,
   gsk_container_node_can_diff,
   gsk_container_node_diff,
+  gsk_container_node_hash,
+  gsk_container_node_equal,
 };
 
 /**
@@ -1986,6 +2201,41 @@ gsk_transform_node_diff (GskRenderNode  *node1,
     }
 }
 
+static guint64
+gsk_transform_node_hash (GskRenderNode *node,
+                         guint64        hash)
+{
+  GskTransformNode *self = (GskTransformNode *) node;
+  graphene_matrix_t matrix;
+  float values[16];
+
+  gsk_transform_to_matrix (self->transform, &matrix);
+  graphene_matrix_to_float (&matrix, values);
+
+  hash = gsk_render_node_hash_child (hash, self->child);
+  return gsk_render_node_hash_data (hash, values, sizeof (values));
+}
+
+static gboolean
+gsk_transform_node_equal (GskRenderNode *node1,
+                          GskRenderNode *node2)
+{
+  GskTransformNode *self1 = (GskTransformNode *) node1;
+  GskTransformNode *self2 = (GskTransformNode *) node2;
+  graphene_matrix_t matrix1, matrix2;
+  float values1[16], values2[16];
+
+  if (!gsk_render_node_equal (self1->child, self2->child))
+    return FALSE;
+
+  gsk_transform_to_matrix (self1->transform, &matrix1);
+  gsk_transform_to_matrix (self2->transform, &matrix2);
+  graphene_matrix_to_float (&matrix1, values1);
+  graphene_matrix_to_float (&matrix2, values2);
+
+  return memcmp (values1, values2, sizeof (values1)) == 0;
+}
+
 static const GskRenderNodeClass GSK_TRANSFORM_NODE_CLASS = {
   GSK_TRANSFORM_NODE,
   sizeof (GskTransformNode),
@@ -1994,6 +2244,8 @@ static const GskRenderNodeClass GSK_TRANSFORM_NODE_CLASS = {
   gsk_transform_node_draw,
   gsk_transform_node_can_diff,
   gsk_transform_node_diff,
+  gsk_transform_node_hash,
+  gsk_transform_node_equal,
 };
 
 /**
@@ -2106,6 +2358,26 @@ gsk_debug_node_diff (GskRenderNode  *node1,
   gsk_render_node_diff (self1->child, self2->child, region);
 }
 
+static guint64
+gsk_debug_node_hash (GskRenderNode *node,
+                     guint64        hash)
+{
+  GskDebugNode *self = (GskDebugNode *) node;
+
+  /* The message doesn't change the rendering */
+  return gsk_render_node_hash_child (hash, self->child);
+}
+
+static gboolean
+gsk_debug_node_equal (GskRenderNode *node1,
+                      GskRenderNode *node2)
+{
+  GskDebugNode *self1 = (GskDebugNode *) node1;
+  GskDebugNode *self2 = (GskDebugNode *) node2;
+
+  return gsk_render_node_equal (self1->child, self2->child);
+}
+
 static const GskRenderNodeClass GSK_DEBUG_NODE_CLASS = {
   GSK_DEBUG_NODE,
   sizeof (GskDebugNode),
@@ -2114,6 +2386,8 @@ static const GskRenderNodeClass GSK_DEBUG_NODE_CLASS = {
   gsk_debug_node_draw,
   gsk_debug_node_can_diff,
   gsk_debug_node_diff,
+  gsk_debug_node_hash,
+  gsk_debug_node_equal,
 };
 
 /**
@@ -2238,6 +2512,27 @@ gsk_opacity_node_diff (GskRenderNode  *node1,
     gsk_render_node_diff_impossible (node1, node2, region);
 }
 
+static guint64
+gsk_opacity_node_hash (GskRenderNode *node,
+                       guint64        hash)
+{
+  GskOpacityNode *self = (GskOpacityNode *) node;
+
+  hash = gsk_render_node_hash_child (hash, self->child);
+  return gsk_render_node_hash_data (hash, &self->opacity, sizeof (float));
+}
+
+static gboolean
+gsk_opacity_node_equal (GskRenderNode *node1,
+                        GskRenderNode *node2)
+{
+  GskOpacityNode *self1 = (GskOpacityNode *) node1;
+  GskOpacityNode *self2 = (GskOpacityNode *) node2;
+
+  return self1->opacity == self2->opacity &&
+         gsk_render_node_equal (self1->child, self2->child);
+}
+
 static const GskRenderNodeClass GSK_OPACITY_NODE_CLASS = {
   GSK_OPACITY_NODE,
   sizeof (GskOpacityNode),
@@ -2246,6 +2541,8 @@ static const GskRenderNodeClass GSK_OPACITY_NODE_CLASS = {
   gsk_opacity_node_draw,
   gsk_render_node_can_diff_true,
   gsk_opacity_node_diff,
+  gsk_opacity_node_hash,
+  gsk_opacity_node_equal,
 };
 
 /**
@@ -2407,6 +2704,41 @@ gsk_color_matrix_node_draw (GskRenderNode *node,
   cairo_pattern_destroy (pattern);
 }
 
+static guint64
+gsk_color_matrix_node_hash (GskRenderNode *node,
+                            guint64        hash)
+{
+  GskColorMatrixNode *self = (GskColorMatrixNode *) node;
+  float values[16];
+
+  hash = gsk_render_node_hash_child (hash, self->child);
+  graphene_matrix_to_float (&self->color_matrix, values);
+  hash = gsk_render_node_hash_data (hash, values, sizeof (float) * 16);
+  graphene_vec4_to_float (&self->color_offset, values);
+  return gsk_render_node_hash_data (hash, values, sizeof (float) * 4);
+}
+
+static gboolean
+gsk_color_matrix_node_equal (GskRenderNode *node1,
+                             GskRenderNode *node2)
+{
+  GskColorMatrixNode *self1 = (GskColorMatrixNode *) node1;
+  GskColorMatrixNode *self2 = (GskColorMatrixNode *) node2;
+  float values1[16], values2[16];
+
+  graphene_matrix_to_float (&self1->color_matrix, values1);
+  graphene_matrix_to_float (&self2->color_matrix, values2);
+  if (memcmp (values1, values2, sizeof (float) * 16) != 0)
+    return FALSE;
+
+  graphene_vec4_to_float (&self1->color_offset, values1);
+  graphene_vec4_to_float (&self2->color_offset, values2);
+  if (memcmp (values1, values2, sizeof (float) * 4) != 0)
+    return FALSE;
+
+  return gsk_render_node_equal (self1->child, self2->child);
+}
+
 static const GskRenderNodeClass GSK_COLOR_MATRIX_NODE_CLASS = {
   GSK_COLOR_MATRIX_NODE,
   sizeof (GskColorMatrixNode),
@@ -2415,6 +2747,8 @@ static const GskRenderNodeClass GSK_COLOR_MATRIX_NODE_CLASS = {
   gsk_color_matrix_node_draw,
   gsk_render_node_can_diff_true,
   gsk_render_node_diff_impossible,
+  gsk_color_matrix_node_hash,
+  gsk_color_matrix_node_equal,
 };
 
 /**
@@ -2547,6 +2881,27 @@ gsk_repeat_node_draw (GskRenderNode *node,
   cairo_fill (cr);
 }
 
+static guint64
+gsk_repeat_node_hash (GskRenderNode *node,
+                      guint64        hash)
+{
+  GskRepeatNode *self = (GskRepeatNode *) node;
+
+  hash = gsk_render_node_hash_child (hash, self->child);
+  return gsk_render_node_hash_data (hash, &self->child_bounds, sizeof (graphene_rect_t));
+}
+
+static gboolean
+gsk_repeat_node_equal (GskRenderNode *node1,
+                       GskRenderNode *node2)
+{
+  GskRepeatNode *self1 = (GskRepeatNode *) node1;
+  GskRepeatNode *self2 = (GskRepeatNode *) node2;
+
+  return memcmp (&self1->child_bounds, &self2->child_bounds, sizeof (graphene_rect_t)) == 0 &&
+         gsk_render_node_equal (self1->child, self2->child);
+}
+
 static const GskRenderNodeClass GSK_REPEAT_NODE_CLASS = {
   GSK_REPEAT_NODE,
   sizeof (GskRepeatNode),
@@ -2555,6 +2910,8 @@ static const GskRenderNodeClass GSK_REPEAT_NODE_CLASS = {
   gsk_repeat_node_draw,
   gsk_render_node_can_diff_true,
   gsk_render_node_diff_impossible,
+  gsk_repeat_node_hash,
+  gsk_repeat_node_equal,
 };
 
 /**
@@ -2673,6 +3030,27 @@ gsk_clip_node_diff (GskRenderNode  *node1,
     }
 }
 
+static guint64
+gsk_clip_node_hash (GskRenderNode *node,
+                    guint64        hash)
+{
+  GskClipNode *self = (GskClipNode *) node;
+
+  hash = gsk_render_node_hash_child (hash, self->child);
+  return gsk_render_node_hash_data (hash, &self->clip, sizeof (graphene_rect_t));
+}
+
+static gboolean
+gsk_clip_node_equal (GskRenderNode *node1,
+                     GskRenderNode *node2)
+{
+  GskClipNode *self1 = (GskClipNode *) node1;
+  GskClipNode *self2 = (GskClipNode *) node2;
+
+  return memcmp (&self1->clip, &self2->clip, sizeof (graphene_rect_t)) == 0 &&
+         gsk_render_node_equal (self1->child, self2->child);
+}
+
 static const GskRenderNodeClass GSK_CLIP_NODE_CLASS = {
   GSK_CLIP_NODE,
   sizeof (GskClipNode),
@@ -2681,6 +3059,8 @@ static const GskRenderNodeClass GSK_CLIP_NODE_CLASS = {
   gsk_clip_node_draw,
   gsk_render_node_can_diff_true,
   gsk_clip_node_diff,
+  gsk_clip_node_hash,
+  gsk_clip_node_equal,
 };
 
 /**
@@ -2802,6 +3182,27 @@ gsk_rounded_clip_node_diff (GskRenderNode  *node1,
     }
 }
 
+static guint64
+gsk_rounded_clip_node_hash (GskRenderNode *node,
+                            guint64        hash)
+{
+  GskRoundedClipNode *self = (GskRoundedClipNode *) node;
+
+  hash = gsk_render_node_hash_child (hash, self->child);
+  return gsk_render_node_hash_data (hash, &self->clip, sizeof (GskRoundedRect));
+}
+
+static gboolean
+gsk_rounded_clip_node_equal (GskRenderNode *node1,
+                             GskRenderNode *node2)
+{
+  GskRoundedClipNode *self1 = (GskRoundedClipNode *) node1;
+  GskRoundedClipNode *self2 = (GskRoundedClipNode *) node2;
+
+  return memcmp (&self1->clip, &self2->clip, sizeof (GskRoundedRect)) == 0 &&
+         gsk_render_node_equal (self1->child, self2->child);
+}
+
 static const GskRenderNodeClass GSK_ROUNDED_CLIP_NODE_CLASS = {
   GSK_ROUNDED_CLIP_NODE,
   sizeof (GskRoundedClipNode),
@@ -2810,6 +3211,8 @@ static const GskRenderNodeClass GSK_ROUNDED_CLIP_NODE_CLASS = {
   gsk_rounded_clip_node_draw,
   gsk_render_node_can_diff_true,
   gsk_rounded_clip_node_diff,
+  gsk_rounded_clip_node_hash,
+  gsk_rounded_clip_node_equal,
 };
 
 /**
@@ -3013,6 +3416,28 @@ gsk_shadow_node_get_bounds (GskShadowNode *self,
   bounds->size.height += top + bottom;
 }
 
+static guint64
+gsk_shadow_node_hash (GskRenderNode *node,
+                      guint64        hash)
+{
+  GskShadowNode *self = (GskShadowNode *) node;
+
+  hash = gsk_render_node_hash_child (hash, self->child);
+  return gsk_render_node_hash_data (hash, self->shadows, sizeof (GskShadow) * self->n_shadows);
+}
+
+static gboolean
+gsk_shadow_node_equal (GskRenderNode *node1,
+                       GskRenderNode *node2)
+{
+  GskShadowNode *self1 = (GskShadowNode *) node1;
+  GskShadowNode *self2 = (GskShadowNode *) node2;
+
+  return self1->n_shadows == self2->n_shadows &&
+         memcmp (self1->shadows, self2->shadows, sizeof (GskShadow) * self1->n_shadows) == 0 &&
+         gsk_render_node_equal (self1->child, self2->child);
+}
+
 static const GskRenderNodeClass GSK_SHADOW_NODE_CLASS = {
   GSK_SHADOW_NODE,
   sizeof (GskShadowNode),
@@ -3021,6 +3446,8 @@ static const GskRenderNodeClass GSK_SHADOW_NODE_CLASS = {
   gsk_shadow_node_draw,
   gsk_render_node_can_diff_true,
   gsk_shadow_node_diff,
+  gsk_shadow_node_hash,
+  gsk_shadow_node_equal,
 };
 
 /**
@@ -3191,6 +3618,29 @@ gsk_blend_node_diff (GskRenderNode  *node1,
     }
 }
 
+static guint64
+gsk_blend_node_hash (GskRenderNode *node,
+                     guint64        hash)
+{
+  GskBlendNode *self = (GskBlendNode *) node;
+
+  hash = gsk_render_node_hash_child (hash, self->bottom);
+  hash = gsk_render_node_hash_child (hash, self->top);
+  return gsk_render_node_hash_data (hash, &self->blend_mode, sizeof (GskBlendMode));
+}
+
+static gboolean
+gsk_blend_node_equal (GskRenderNode *node1,
+                      GskRenderNode *node2)
+{
+  GskBlendNode *self1 = (GskBlendNode *) node1;
+  GskBlendNode *self2 = (GskBlendNode *) node2;
+
+  return self1->blend_mode == self2->blend_mode &&
+         gsk_render_node_equal (self1->bottom, self2->bottom) &&
+         gsk_render_node_equal (self1->top, self2->top);
+}
+
 static const GskRenderNodeClass GSK_BLEND_NODE_CLASS = {
   GSK_BLEND_NODE,
   sizeof (GskBlendNode),
@@ -3199,6 +3649,8 @@ static const GskRenderNodeClass GSK_BLEND_NODE_CLASS = {
   gsk_blend_node_draw,
   gsk_render_node_can_diff_true,
   gsk_blend_node_diff,
+  gsk_blend_node_hash,
+  gsk_blend_node_equal,
 };
 
 /**
@@ -3323,6 +3775,29 @@ gsk_cross_fade_node_diff (GskRenderNode  *node1,
   gsk_render_node_diff_impossible (node1, node2, region);
 }
 
+static guint64
+gsk_cross_fade_node_hash (GskRenderNode *node,
+                          guint64        hash)
+{
+  GskCrossFadeNode *self = (GskCrossFadeNode *) node;
+
+  hash = gsk_render_node_hash_child (hash, self->start);
+  hash = gsk_render_node_hash_child (hash, self->end);
+  return gsk_render_node_hash_data (hash, &self->progress, sizeof (float));
+}
+
+static gboolean
+gsk_cross_fade_node_equal (GskRenderNode *node1,
+                           GskRenderNode *node2)
+{
+  GskCrossFadeNode *self1 = (GskCrossFadeNode *) node1;
+  GskCrossFadeNode *self2 = (GskCrossFadeNode *) node2;
+
+  return self1->progress == self2->progress &&
+         gsk_render_node_equal (self1->start, self2->start) &&
+         gsk_render_node_equal (self1->end, self2->end);
+}
+
 static const GskRenderNodeClass GSK_CROSS_FADE_NODE_CLASS = {
   GSK_CROSS_FADE_NODE,
   sizeof (GskCrossFadeNode),
@@ -3331,6 +3806,8 @@ static const GskRenderNodeClass GSK_CROSS_FADE_NODE_CLASS = {
   gsk_cross_fade_node_draw,
   gsk_render_node_can_diff_true,
   gsk_cross_fade_node_diff,
+  gsk_cross_fade_node_hash,
+  gsk_cross_fade_node_equal,
 };
 
 /**
@@ -3478,6 +3955,59 @@ gsk_text_node_diff (GskRenderNode  *node1,
   gsk_render_node_diff_impossible (node1, node2, region);
 }
 
+static guint64
+gsk_text_node_hash (GskRenderNode *node,
+                    guint64        hash)
+{
+  GskTextNode *self = (GskTextNode *) node;
+  guint i;
+
+  /* Fonts are shared by the font map, so identity is good enough */
+  hash = gsk_render_node_hash_data (hash, &self->font, sizeof (PangoFont *));
+  hash = gsk_render_node_hash_data (hash, &self->color, sizeof (GdkRGBA));
+  hash = gsk_render_node_hash_data (hash, &self->offset, sizeof (graphene_point_t));
+  for (i = 0; i < self->num_glyphs; i++)
+    {
+      const PangoGlyphInfo *glyph = &self->glyphs[i];
+      guint32 cluster_start = glyph->attr.is_cluster_start;
+
+      /* Hash the fields individually, the attr bitfield has unused bits */
+      hash = gsk_render_node_hash_data (hash, &glyph->glyph, sizeof (PangoGlyph));
+      hash = gsk_render_node_hash_data (hash, &glyph->geometry, sizeof (PangoGlyphGeometry));
+      hash = gsk_render_node_hash_data (hash, &cluster_start, sizeof (guint32));
+    }
+
+  return hash;
+}
+
+static gboolean
+gsk_text_node_equal (GskRenderNode *node1,
+                     GskRenderNode *node2)
+{
+  GskTextNode *self1 = (GskTextNode *) node1;
+  GskTextNode *self2 = (GskTextNode *) node2;
+  guint i;
+
+  if (self1->font != self2->font ||
+      memcmp (&self1->color, &self2->color, sizeof (GdkRGBA)) != 0 ||
+      memcmp (&self1->offset, &self2->offset, sizeof (graphene_point_t)) != 0 ||
+      self1->num_glyphs != self2->num_glyphs)
+    return FALSE;
+
+  for (i = 0; i < self1->num_glyphs; i++)
+    {
+      const PangoGlyphInfo *glyph1 = &self1->glyphs[i];
+      const PangoGlyphInfo *glyph2 = &self2->glyphs[i];
+
+      if (glyph1->glyph != glyph2->glyph ||
+          memcmp (&glyph1->geometry, &glyph2->geometry, sizeof (PangoGlyphGeometry)) != 0 ||
+          glyph1->attr.is_cluster_start != glyph2->attr.is_cluster_start)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 static const GskRenderNodeClass GSK_TEXT_NODE_CLASS = {
   GSK_TEXT_NODE,
   sizeof (GskTextNode),
@@ -3486,6 +4016,8 @@ static const GskRenderNodeClass GSK_TEXT_NODE_CLASS = {
   gsk_text_node_draw,
   gsk_render_node_can_diff_true,
   gsk_text_node_diff,
+  gsk_text_node_hash,
+  gsk_text_node_equal,
 };
 
 static gboolean
@@ -3860,6 +4392,27 @@ gsk_blur_node_diff (GskRenderNode  *node1,
     }
 }
 
+static guint64
+gsk_blur_node_hash (GskRenderNode *node,
+                    guint64        hash)
+{
+  GskBlurNode *self = (GskBlurNode *) node;
+
+  hash = gsk_render_node_hash_child (hash, self->child);
+  return gsk_render_node_hash_data (hash, &self->radius, sizeof (float));
+}
+
+static gboolean
+gsk_blur_node_equal (GskRenderNode *node1,
+                     GskRenderNode *node2)
+{
+  GskBlurNode *self1 = (GskBlurNode *) node1;
+  GskBlurNode *self2 = (GskBlurNode *) node2;
+
+  return self1->radius == self2->radius &&
+         gsk_render_node_equal (self1->child, self2->child);
+}
+
 static const GskRenderNodeClass GSK_BLUR_NODE_CLASS = {
   GSK_BLUR_NODE,
   sizeof (GskBlurNode),
@@ -3868,6 +4421,8 @@ static const GskRenderNodeClass GSK_BLUR_NODE_CLASS = {
   gsk_blur_node_draw,
   gsk_render_node_can_diff_true,
   gsk_blur_node_diff,
+  gsk_blur_node_hash,
+  gsk_blur_node_equal,
 };
 
 /**
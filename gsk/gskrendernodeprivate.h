@@ -15,8 +15,13 @@ struct _GskRenderNode
   const GskRenderNodeClass *node_class;
 
   volatile int ref_count;
+  /* index of the slab the node was allocated from, or 0 */
+  guint slab;
 
   graphene_rect_t bounds;
+
+  /* content hash, 0 if not computed yet */
+  guint64 hash;
 };
 
 struct _GskRenderNodeClass
@@ -33,19 +38,73 @@ struct _GskRenderNodeClass
   void            (* diff)        (GskRenderNode  *node1,
                                    GskRenderNode  *node2,
                                    cairo_region_t *region);
+  guint64         (* hash)        (GskRenderNode  *node,
+                                   guint64         hash);
+  gboolean        (* equal)       (GskRenderNode  *node1,
+                                   GskRenderNode  *node2);
+};
+
+typedef struct _GskRenderNodeAllocatorStats GskRenderNodeAllocatorStats;
+
+struct _GskRenderNodeAllocatorStats
+{
+  guint64 n_allocated;          /* nodes allocated since startup */
+  gsize n_live;                 /* nodes currently alive */
+  gsize n_large;                /* alive nodes too big for a slab */
+  gsize n_slabs;                /* slabs, including cached empty ones */
+  gsize slab_memory;            /* bytes held by slabs */
 };
 
 GskRenderNode * gsk_render_node_new              (const GskRenderNodeClass  *node_class,
                                                   gsize                      extra_size);
+void            gsk_render_node_get_allocator_stats
+                                                 (GskRenderNodeAllocatorStats *stats);
+#ifdef G_ENABLE_DEBUG
+void            gsk_render_node_set_culled_counter (cairo_t                 *cr,
+                                                    int                     *n_culled);
+#endif
 
 gboolean        gsk_render_node_can_diff         (const GskRenderNode       *node1,
                                                   const GskRenderNode       *node2) G_GNUC_PURE;
+GDK_AVAILABLE_IN_ALL
 void            gsk_render_node_diff             (GskRenderNode             *node1,
                                                   GskRenderNode             *node2,
                                                   cairo_region_t            *region);
 void            gsk_render_node_diff_impossible  (GskRenderNode             *node1,
                                                   GskRenderNode             *node2,
                                                   cairo_region_t            *region);
+GDK_AVAILABLE_IN_ALL
+guint64         gsk_render_node_get_hash         (GskRenderNode             *node);
+GDK_AVAILABLE_IN_ALL
+gboolean        gsk_render_node_equal            (GskRenderNode             *node1,
+                                                  GskRenderNode             *node2);
+
+/* FNV-1a, used by the hash vfuncs to add their data to @hash */
+static inline guint64
+gsk_render_node_hash_data (guint64       hash,
+                           gconstpointer data,
+                           gsize         size)
+{
+  const guchar *bytes = data;
+  gsize i;
+
+  for (i = 0; i < size; i++)
+    {
+      hash ^= bytes[i];
+      hash *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+
+  return hash;
+}
+
+static inline guint64
+gsk_render_node_hash_child (guint64        hash,
+                            GskRenderNode *child)
+{
+  guint64 child_hash = gsk_render_node_get_hash (child);
+
+  return gsk_render_node_hash_data (hash, &child_hash, sizeof (guint64));
+}
 
 
 G_END_DECLS
@@ -0,0 +1,70 @@
+// Only used with GL3, where the per-draw state comes from instance
+// attributes instead of uniforms. See GskGLInstance.
+
+// VERTEX_SHADER:
+_IN_ vec4 aRect;
+_IN_ vec4 aColor;
+_IN_ vec4 aOutline0;
+_IN_ vec4 aOutline1;
+_IN_ vec4 aOutline2;
+_IN_ vec4 aParams; // spread, offset, whether to use the outline
+_IN_ vec4 aClip0;
+_IN_ vec4 aClip1;
+_IN_ vec4 aClip2;
+
+_OUT_ vec4 final_color;
+_OUT_ float use_outline;
+_OUT_ _ROUNDED_RECT_UNIFORM_ transformed_outside_outline;
+_OUT_ _ROUNDED_RECT_UNIFORM_ transformed_inside_outline;
+_OUT_ _ROUNDED_RECT_UNIFORM_ clip_rect;
+
+// Same order as the vertices of ops_draw()
+const vec2 corners[6] = vec2[6](vec2(0.0, 0.0), vec2(0.0, 1.0), vec2(1.0, 0.0),
+                                vec2(1.0, 1.0), vec2(0.0, 1.0), vec2(1.0, 0.0));
+
+void main() {
+  vec2 position = aRect.xy + aRect.zw * corners[gl_VertexID];
+
+  gl_Position = u_projection * u_modelview * vec4(position, 0.0, 1.0);
+
+  // Already pre-multiplied and including the opacity
+  final_color = aColor;
+  use_outline = aParams.w;
+
+  RoundedRect outside = create_rect(vec4[3](aOutline0, aOutline1, aOutline2));
+  RoundedRect inside = rounded_rect_shrink(outside, vec4(aParams.x));
+
+  rounded_rect_offset(inside, aParams.yz);
+
+  rounded_rect_transform(outside, u_modelview);
+  rounded_rect_transform(inside, u_modelview);
+
+  rounded_rect_encode(outside, transformed_outside_outline);
+  rounded_rect_encode(inside, transformed_inside_outline);
+
+  // The clip has already been transformed on the CPU
+  rounded_rect_encode(create_rect(vec4[3](aClip0, aClip1, aClip2)), clip_rect);
+}
+
+// FRAGMENT_SHADER:
+_IN_ vec4 final_color;
+_IN_ float use_outline;
+_IN_ _ROUNDED_RECT_UNIFORM_ transformed_outside_outline;
+_IN_ _ROUNDED_RECT_UNIFORM_ transformed_inside_outline;
+_IN_ _ROUNDED_RECT_UNIFORM_ clip_rect;
+
+void main() {
+  vec4 f = gl_FragCoord;
+
+  f.x += u_viewport.x;
+  f.y = (u_viewport.y + u_viewport.w) - f.y;
+
+  float alpha = 1.0;
+
+  if (use_outline > 0.5)
+    alpha = clamp (rounded_rect_coverage(decode_rect(transformed_outside_outline), f.xy) -
+                   rounded_rect_coverage(decode_rect(transformed_inside_outline), f.xy),
+                   0.0, 1.0);
+
+  outputColor = final_color * alpha * rounded_rect_coverage(decode_rect(clip_rect), f.xy);
+}
@@ -0,0 +1,18 @@
+// VERTEX_SHADER:
+void main() {
+  gl_Position = u_projection * u_modelview * vec4(aPosition, 0.0, 1.0);
+}
+
+// FRAGMENT_SHADER:
+void main() {
+  vec4 f = gl_FragCoord;
+
+  f.x += u_viewport.x;
+  f.y = (u_viewport.y + u_viewport.w) - f.y;
+
+  // Only the fragments we don't discard touch the stencil buffer
+  if (rounded_rect_coverage(create_rect(u_clip_rect), f.xy) < 0.5)
+    discard;
+
+  setOutputColor(vec4(1.0));
+}
@@ -8,6 +8,7 @@
 #include "gskrendererprivate.h"
 
 #include <graphene.h>
+#include <math.h>
 
 /* Parameters for our cache eviction strategy.
  *
@@ -115,8 +116,7 @@ gsk_vulkan_glyph_cache_class_init (GskVulkanGlyphCacheClass *klass)
 typedef struct {
   PangoFont *font;
   PangoGlyph glyph;
-  guint xshift;
-  guint yshift;
+  guint xshift; /* Subpixel position, in quarter pixels */
   guint scale; /* times 1024 */
 } GlyphCacheKey;
 
@@ -129,7 +129,6 @@ glyph_cache_equal (gconstpointer v1, gconstpointer v2)
   return key1->font == key2->font &&
          key1->glyph == key2->glyph &&
          key1->xshift == key2->xshift &&
-         key1->yshift == key2->yshift &&
          key1->scale == key2->scale;
 }
 
@@ -138,7 +137,7 @@ glyph_cache_hash (gconstpointer v)
 {
   const GlyphCacheKey *key = v;
 
-  return GPOINTER_TO_UINT (key->font) ^ key->glyph ^ (key->xshift << 24) ^ (key->yshift << 26) ^ key->scale;
+  return GPOINTER_TO_UINT (key->font) ^ key->glyph ^ (key->xshift << 24) ^ key->scale;
 }
 
 static void
@@ -274,7 +273,7 @@ render_glyph (Atlas          *atlas,
     gi.geometry.x_offset = key->xshift * 256;
   else
     gi.geometry.x_offset = key->xshift * 256 - value->draw_x * 1024;
-  gi.geometry.y_offset = key->yshift * 256 - value->draw_y * 1024;
+  gi.geometry.y_offset = - value->draw_y * 1024;
 
   glyphs.num_glyphs = 1;
   glyphs.glyphs = &gi;
@@ -332,29 +331,28 @@ gsk_vulkan_glyph_cache_new (GskRenderer      *renderer,
   return cache;
 }
 
-#define PHASE(x) ((x % PANGO_SCALE) * 4 / PANGO_SCALE)
+/* Glyphs are only positioned with subpixel precision horizontally,
+ * so there are at most 4 entries per glyph and scale. The glyph needs
+ * to be drawn at gsk_vulkan_glyph_cache_snap() of its position. */
+#define PHASE(x) ((int)(floor (4 * (x + 0.125)) - 4 * floor (x + 0.125)))
 
 GskVulkanCachedGlyph *
 gsk_vulkan_glyph_cache_lookup (GskVulkanGlyphCache *cache,
                                gboolean             create,
                                PangoFont           *font,
                                PangoGlyph           glyph,
-                               int                  x,
-                               int                  y,
+                               float                x,
                                float                scale)
 {
   GlyphCacheKey lookup_key;
   GskVulkanCachedGlyph *value;
   guint xshift;
-  guint yshift;
 
   xshift = PHASE (x);
-  yshift = PHASE (y);
 
   lookup_key.font = font;
   lookup_key.glyph = glyph;
   lookup_key.xshift = xshift;
-  lookup_key.yshift = yshift;
   lookup_key.scale = (guint)(scale * 1024);
 
   value = g_hash_table_lookup (cache->hash_table, &lookup_key);
@@ -381,6 +379,10 @@ gsk_vulkan_glyph_cache_lookup (GskVulkanGlyphCache *cache,
       pango_font_get_glyph_extents (font, glyph, &ink_rect, NULL);
       pango_extents_to_pixels (&ink_rect, NULL);
 
+      /* The shifted glyph can reach into the next pixel */
+      if (xshift != 0)
+        ink_rect.width += 1;
+
       value->draw_x = ink_rect.x;
       value->draw_y = ink_rect.y;
       value->draw_width = ink_rect.width;
@@ -390,7 +392,6 @@ gsk_vulkan_glyph_cache_lookup (GskVulkanGlyphCache *cache,
       key->font = g_object_ref (font);
       key->glyph = glyph;
       key->xshift = xshift;
-      key->yshift = yshift;
       key->scale = (guint)(scale * 1024);
 
       if (ink_rect.width > 0 && ink_rect.height > 0)
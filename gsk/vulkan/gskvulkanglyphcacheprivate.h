@@ -22,9 +22,7 @@ GskVulkanCachedGlyph *gsk_vulkan_glyph_cache_lookup         (GskVulkanGlyphCache
                                                              gboolean             create,
                                                              PangoFont           *font,
                                                              PangoGlyph           glyph,
-                                                             int                  x,
-                                                             int                  y,
-
+                                                             float                x,
                                                              float                scale);
 
 void                  gsk_vulkan_glyph_cache_begin_frame    (GskVulkanGlyphCache *cache);
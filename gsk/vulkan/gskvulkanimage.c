@@ -204,7 +204,8 @@ gsk_vulkan_image_new (GdkVulkanContext      *context,
                       VkImageUsageFlags      usage,
                       VkImageLayout          layout,
                       VkAccessFlags          access,
-                      VkMemoryPropertyFlags  memory)
+                      VkMemoryPropertyFlags  memory,
+                      GskVulkanMemoryFlags   memory_flags)
 {
   VkMemoryRequirements requirements;
   GskVulkanImage *self;
@@ -240,15 +241,18 @@ gsk_vulkan_image_new (GdkVulkanContext      *context,
                                 self->vk_image,
                                 &requirements);
 
+  if (tiling == VK_IMAGE_TILING_OPTIMAL)
+    memory_flags |= GSK_VULKAN_MEMORY_OPTIMAL_TILING;
+
   self->memory = gsk_vulkan_memory_new (context,
-                                        requirements.memoryTypeBits,
+                                        &requirements,
                                         memory,
-                                        requirements.size);
+                                        memory_flags);
 
   GSK_VK_CHECK (vkBindImageMemory, gdk_vulkan_context_get_device (context),
                                    self->vk_image,
                                    gsk_vulkan_memory_get_device_memory (self->memory),
-                                   0);
+                                   gsk_vulkan_memory_get_offset (self->memory));
   return self;
 }
 
@@ -368,7 +372,8 @@ gsk_vulkan_image_new_from_data_via_staging_buffer (GskVulkanUploader *uploader,
                                VK_IMAGE_USAGE_SAMPLED_BIT,
                                VK_IMAGE_LAYOUT_UNDEFINED,
                                VK_ACCESS_TRANSFER_WRITE_BIT,
-                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                               0);
 
   gsk_vulkan_uploader_add_image_barrier (uploader,
                                          FALSE,
@@ -429,7 +434,8 @@ gsk_vulkan_image_new_from_data_via_staging_image (GskVulkanUploader *uploader,
                                   VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
                                   VK_IMAGE_LAYOUT_PREINITIALIZED,
                                   VK_ACCESS_TRANSFER_WRITE_BIT,
-                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                  GSK_VULKAN_MEMORY_TRANSIENT);
 
   gsk_vulkan_image_upload_data (staging, data, width, height, stride);
 
@@ -441,7 +447,8 @@ gsk_vulkan_image_new_from_data_via_staging_image (GskVulkanUploader *uploader,
                                VK_IMAGE_USAGE_SAMPLED_BIT,
                                VK_IMAGE_LAYOUT_UNDEFINED,
                                VK_ACCESS_TRANSFER_WRITE_BIT,
-                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                               0);
 
   gsk_vulkan_uploader_add_image_barrier (uploader,
                                          FALSE,
@@ -512,7 +519,8 @@ gsk_vulkan_image_new_from_data_directly (GskVulkanUploader *uploader,
                                VK_IMAGE_USAGE_SAMPLED_BIT,
                                VK_IMAGE_LAYOUT_PREINITIALIZED,
                                VK_ACCESS_HOST_WRITE_BIT,
-                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                               0);
 
   gsk_vulkan_image_upload_data (self, data, width, height, stride);
 
@@ -578,7 +586,8 @@ gsk_vulkan_image_new_for_framebuffer (GdkVulkanContext *context,
                                VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
                                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
                                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                               0);
 
   gsk_vulkan_image_ensure_view (self, VK_FORMAT_B8G8R8A8_UNORM);
 
@@ -599,7 +608,8 @@ gsk_vulkan_image_new_for_atlas (GdkVulkanContext *context,
                                VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                                VK_IMAGE_LAYOUT_UNDEFINED,
                                0,
-                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                               0);
 
   gsk_vulkan_image_ensure_view (self, VK_FORMAT_B8G8R8A8_UNORM);
 
@@ -622,7 +632,8 @@ gsk_vulkan_image_new_for_texture (GdkVulkanContext *context,
                                VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
                                VK_IMAGE_LAYOUT_UNDEFINED,
                                0,
-                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                               0);
 
   gsk_vulkan_image_ensure_view (self, VK_FORMAT_B8G8R8A8_UNORM);
 
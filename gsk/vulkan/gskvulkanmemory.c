@@ -3,52 +3,386 @@
 #include "gskvulkanpipelineprivate.h"
 #include "gskvulkanmemoryprivate.h"
 
-struct _GskVulkanMemory
+#include "gskdebugprivate.h"
+
+/* Drivers limit the number of allocations (maxMemoryAllocationCount is
+ * often 4096) and allocating is slow, so we allocate large blocks and
+ * hand out pieces of them.
+ *
+ * Every memory type has three pools of blocks: one for linear resources
+ * (buffers and linear images), one for optimally tiled images, so the
+ * two never share a page, and one for transient allocations that only
+ * live for a frame. The first two use a first-fit free list, the
+ * transient pool simply bumps an offset that goes back to 0 once all
+ * allocations of a block have been freed.
+ */
+
+#define BLOCK_SIZE (16 * 1024 * 1024)
+/* Anything bigger gets a block of its own */
+#define MAX_SUBALLOCATION_SIZE (BLOCK_SIZE / 4)
+
+#define ALIGN(x, a) (((x) + (a) - 1) / (a) * (a))
+
+typedef enum {
+  POOL_LINEAR,
+  POOL_OPTIMAL,
+  POOL_TRANSIENT,
+  N_POOLS
+} PoolKind;
+
+typedef struct _GskVulkanAllocator GskVulkanAllocator;
+typedef struct _GskVulkanMemoryBlock GskVulkanMemoryBlock;
+
+typedef struct
 {
-  GdkVulkanContext *vulkan;
+  VkDeviceSize offset;
+  VkDeviceSize size;
+} FreeRange;
 
-  gsize size;
+struct _GskVulkanMemoryBlock
+{
+  GskVulkanAllocator *allocator;
+  guint type_index;
+  PoolKind kind;
 
   VkDeviceMemory vk_memory;
+  VkDeviceSize size;
+
+  /* Host visible blocks are mapped once and stay mapped */
+  guchar *map;
+
+  guint n_allocations;
+
+  /* Sorted by offset, not used for transient blocks */
+  GArray *free_ranges;
+  /* Transient blocks allocate from here on */
+  VkDeviceSize top;
+
+  guint dedicated : 1;
 };
 
-GskVulkanMemory *
-gsk_vulkan_memory_new (GdkVulkanContext      *context,
-                       uint32_t               allowed_types,
-                       VkMemoryPropertyFlags  flags,
-                       gsize                  size)
+struct _GskVulkanAllocator
 {
+  GdkVulkanContext *vulkan;
+
   VkPhysicalDeviceMemoryProperties properties;
-  GskVulkanMemory *self;
-  uint32_t i;
+  VkDeviceSize non_coherent_atom_size;
 
-  self = g_slice_new0 (GskVulkanMemory);
+  GPtrArray *pools[VK_MAX_MEMORY_TYPES][N_POOLS];
 
-  self->vulkan = g_object_ref (context);
-  self->size = size;
+  GskVulkanMemoryStats stats;
+};
+
+struct _GskVulkanMemory
+{
+  GdkVulkanContext *vulkan;
+
+  GskVulkanMemoryBlock *block;
+  VkDeviceSize offset;
+  VkDeviceSize size;
+};
+
+static void
+gsk_vulkan_memory_block_free (GskVulkanMemoryBlock *block)
+{
+  GskVulkanAllocator *allocator = block->allocator;
+  VkDevice device = gdk_vulkan_context_get_device (allocator->vulkan);
+
+  if (block->n_allocations > 0)
+    g_warning ("Freeing Vulkan memory block with %u allocations left", block->n_allocations);
+
+  if (block->map)
+    vkUnmapMemory (device, block->vk_memory);
+
+  vkFreeMemory (device, block->vk_memory, NULL);
+
+  allocator->stats.allocated -= block->size;
+  allocator->stats.n_blocks --;
+
+  g_clear_pointer (&block->free_ranges, g_array_unref);
+  g_slice_free (GskVulkanMemoryBlock, block);
+}
+
+static void
+gsk_vulkan_allocator_free (gpointer data)
+{
+  GskVulkanAllocator *allocator = data;
+  guint i, j;
+
+  for (i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+    for (j = 0; j < N_POOLS; j++)
+      g_clear_pointer (&allocator->pools[i][j], g_ptr_array_unref);
+
+  g_slice_free (GskVulkanAllocator, allocator);
+}
+
+static GskVulkanAllocator *
+get_allocator (GdkVulkanContext *context)
+{
+  GskVulkanAllocator *allocator;
+  VkPhysicalDeviceProperties device_properties;
+
+  allocator = g_object_get_data (G_OBJECT (context), "gsk-vulkan-allocator");
+  if (allocator)
+    return allocator;
+
+  allocator = g_slice_new0 (GskVulkanAllocator);
+  allocator->vulkan = context;
 
   vkGetPhysicalDeviceMemoryProperties (gdk_vulkan_context_get_physical_device (context),
-                                       &properties);
+                                       &allocator->properties);
+  vkGetPhysicalDeviceProperties (gdk_vulkan_context_get_physical_device (context),
+                                 &device_properties);
+  allocator->non_coherent_atom_size = device_properties.limits.nonCoherentAtomSize;
+
+  g_object_set_data_full (G_OBJECT (context), "gsk-vulkan-allocator",
+                          allocator, gsk_vulkan_allocator_free);
+
+  return allocator;
+}
 
-  for (i = 0; i < properties.memoryTypeCount; i++)
+static guint
+find_memory_type (GskVulkanAllocator    *allocator,
+                  uint32_t               allowed_types,
+                  VkMemoryPropertyFlags  flags)
+{
+  uint32_t i;
+
+  for (i = 0; i < allocator->properties.memoryTypeCount; i++)
     {
       if (!(allowed_types & (1 << i)))
         continue;
 
-      if ((properties.memoryTypes[i].propertyFlags & flags) == flags)
+      if ((allocator->properties.memoryTypes[i].propertyFlags & flags) == flags)
         break;
-  }
+    }
+
+  g_assert (i < allocator->properties.memoryTypeCount);
 
-  g_assert (i < properties.memoryTypeCount);
+  return i;
+}
+
+static GskVulkanMemoryBlock *
+gsk_vulkan_memory_block_new (GskVulkanAllocator *allocator,
+                             guint               type_index,
+                             PoolKind            kind,
+                             VkDeviceSize        size,
+                             gboolean            dedicated)
+{
+  GskVulkanMemoryBlock *block;
 
-  GSK_VK_CHECK (vkAllocateMemory, gdk_vulkan_context_get_device (context),
+  block = g_slice_new0 (GskVulkanMemoryBlock);
+  block->allocator = allocator;
+  block->type_index = type_index;
+  block->kind = kind;
+  block->size = size;
+  block->dedicated = dedicated;
+
+  GSK_VK_CHECK (vkAllocateMemory, gdk_vulkan_context_get_device (allocator->vulkan),
                                   &(VkMemoryAllocateInfo) {
                                       .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
                                       .allocationSize = size,
-                                      .memoryTypeIndex = i
+                                      .memoryTypeIndex = type_index
                                   },
                                   NULL,
-                                  &self->vk_memory);
+                                  &block->vk_memory);
+
+  if (!dedicated && kind != POOL_TRANSIENT)
+    {
+      block->free_ranges = g_array_new (FALSE, FALSE, sizeof (FreeRange));
+      g_array_append_val (block->free_ranges, ((FreeRange) { 0, size }));
+    }
+
+  allocator->stats.allocated += size;
+  allocator->stats.n_blocks ++;
+
+  GSK_NOTE (VULKAN, g_message ("Allocated %s%s block of %" G_GUINT64_FORMAT " bytes in memory type %u",
+                               dedicated ? "dedicated " : "",
+                               kind == POOL_TRANSIENT ? "transient" : kind == POOL_OPTIMAL ? "optimal" : "linear",
+                               (guint64) size, type_index));
+
+  return block;
+}
+
+static gboolean
+gsk_vulkan_memory_block_alloc (GskVulkanMemoryBlock *block,
+                               VkDeviceSize          size,
+                               VkDeviceSize          alignment,
+                               VkDeviceSize         *out_offset)
+{
+  guint i;
+
+  if (block->dedicated)
+    {
+      if (block->n_allocations > 0)
+        return FALSE;
+
+      *out_offset = 0;
+      return TRUE;
+    }
+
+  if (block->kind == POOL_TRANSIENT)
+    {
+      VkDeviceSize offset = ALIGN (block->top, alignment);
+
+      if (offset + size > block->size)
+        return FALSE;
+
+      block->top = offset + size;
+      *out_offset = offset;
+      return TRUE;
+    }
+
+  for (i = 0; i < block->free_ranges->len; i++)
+    {
+      FreeRange *range = &g_array_index (block->free_ranges, FreeRange, i);
+      VkDeviceSize offset = ALIGN (range->offset, alignment);
+      VkDeviceSize range_end = range->offset + range->size;
+
+      if (offset + size > range_end)
+        continue;
+
+      /* Keep the padding in front as a range of its own */
+      if (offset > range->offset)
+        {
+          range->size = offset - range->offset;
+          if (offset + size < range_end)
+            g_array_insert_val (block->free_ranges, i + 1,
+                                ((FreeRange) { offset + size, range_end - (offset + size) }));
+        }
+      else if (offset + size < range_end)
+        {
+          range->offset = offset + size;
+          range->size = range_end - range->offset;
+        }
+      else
+        {
+          g_array_remove_index (block->free_ranges, i);
+        }
+
+      *out_offset = offset;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+gsk_vulkan_memory_block_release (GskVulkanMemoryBlock *block,
+                                 VkDeviceSize          offset,
+                                 VkDeviceSize          size)
+{
+  FreeRange *prev, *next;
+  guint i;
+
+  if (block->dedicated)
+    return;
+
+  if (block->kind == POOL_TRANSIENT)
+    {
+      if (block->n_allocations == 0)
+        block->top = 0;
+      return;
+    }
+
+  for (i = 0; i < block->free_ranges->len; i++)
+    {
+      if (g_array_index (block->free_ranges, FreeRange, i).offset > offset)
+        break;
+    }
+
+  prev = i > 0 ? &g_array_index (block->free_ranges, FreeRange, i - 1) : NULL;
+  next = i < block->free_ranges->len ? &g_array_index (block->free_ranges, FreeRange, i) : NULL;
+
+  if (prev && prev->offset + prev->size == offset)
+    {
+      prev->size += size;
+
+      if (next && offset + size == next->offset)
+        {
+          prev->size += next->size;
+          g_array_remove_index (block->free_ranges, i);
+        }
+    }
+  else if (next && offset + size == next->offset)
+    {
+      next->offset = offset;
+      next->size += size;
+    }
+  else
+    {
+      g_array_insert_val (block->free_ranges, i, ((FreeRange) { offset, size }));
+    }
+}
+
+GskVulkanMemory *
+gsk_vulkan_memory_new (GdkVulkanContext           *context,
+                       const VkMemoryRequirements *requirements,
+                       VkMemoryPropertyFlags       properties,
+                       GskVulkanMemoryFlags        flags)
+{
+  GskVulkanAllocator *allocator;
+  GskVulkanMemoryBlock *block = NULL;
+  GskVulkanMemory *self;
+  VkDeviceSize offset = 0;
+  GPtrArray *pool;
+  PoolKind kind;
+  guint type_index;
+  guint i;
+
+  allocator = get_allocator (context);
+  type_index = find_memory_type (allocator, requirements->memoryTypeBits, properties);
+
+  if (flags & GSK_VULKAN_MEMORY_OPTIMAL_TILING)
+    kind = POOL_OPTIMAL;
+  else if (flags & GSK_VULKAN_MEMORY_TRANSIENT)
+    kind = POOL_TRANSIENT;
+  else
+    kind = POOL_LINEAR;
+
+  if (allocator->pools[type_index][kind] == NULL)
+    allocator->pools[type_index][kind] = g_ptr_array_new_with_free_func ((GDestroyNotify) gsk_vulkan_memory_block_free);
+  pool = allocator->pools[type_index][kind];
+
+  if (requirements->size > MAX_SUBALLOCATION_SIZE)
+    {
+      block = gsk_vulkan_memory_block_new (allocator, type_index, kind, requirements->size, TRUE);
+      g_ptr_array_add (pool, block);
+    }
+  else
+    {
+      for (i = 0; i < pool->len; i++)
+        {
+          GskVulkanMemoryBlock *candidate = g_ptr_array_index (pool, i);
+
+          if (!candidate->dedicated &&
+              gsk_vulkan_memory_block_alloc (candidate, requirements->size, requirements->alignment, &offset))
+            {
+              block = candidate;
+              break;
+            }
+        }
+
+      if (block == NULL)
+        {
+          block = gsk_vulkan_memory_block_new (allocator, type_index, kind, BLOCK_SIZE, FALSE);
+          g_ptr_array_add (pool, block);
+
+          if (!gsk_vulkan_memory_block_alloc (block, requirements->size, requirements->alignment, &offset))
+            g_assert_not_reached ();
+        }
+    }
+
+  block->n_allocations ++;
+  allocator->stats.used += requirements->size;
+  allocator->stats.n_allocations ++;
+
+  self = g_slice_new0 (GskVulkanMemory);
+
+  self->vulkan = g_object_ref (context);
+  self->block = block;
+  self->offset = offset;
+  self->size = requirements->size;
 
   return self;
 }
@@ -56,9 +390,20 @@ gsk_vulkan_memory_new (GdkVulkanContext      *context,
 void
 gsk_vulkan_memory_free (GskVulkanMemory *self)
 {
-  vkFreeMemory (gdk_vulkan_context_get_device (self->vulkan),
-                self->vk_memory,
-                NULL);
+  GskVulkanMemoryBlock *block = self->block;
+  GskVulkanAllocator *allocator = block->allocator;
+  GPtrArray *pool = allocator->pools[block->type_index][block->kind];
+
+  block->n_allocations --;
+  gsk_vulkan_memory_block_release (block, self->offset, self->size);
+
+  allocator->stats.used -= self->size;
+  allocator->stats.n_allocations --;
+
+  /* Keep one empty block per pool around, so we don't allocate
+   * and free a block every frame */
+  if (block->n_allocations == 0 && (block->dedicated || pool->len > 1))
+    g_ptr_array_remove_fast (pool, block);
 
   g_object_unref (self->vulkan);
 
@@ -68,28 +413,95 @@ gsk_vulkan_memory_free (GskVulkanMemory *self)
 VkDeviceMemory
 gsk_vulkan_memory_get_device_memory (GskVulkanMemory *self)
 {
-  return self->vk_memory;
+  return self->block->vk_memory;
+}
+
+VkDeviceSize
+gsk_vulkan_memory_get_offset (GskVulkanMemory *self)
+{
+  return self->offset;
 }
 
 guchar *
 gsk_vulkan_memory_map (GskVulkanMemory *self)
 {
-  void *data;
+  GskVulkanMemoryBlock *block = self->block;
+
+  if (block->map == NULL)
+    {
+      void *data;
 
-  GSK_VK_CHECK (vkMapMemory, gdk_vulkan_context_get_device (self->vulkan),
-                             self->vk_memory,
-                             0,
-                             self->size,
-                             0,
-                             &data);
+      GSK_VK_CHECK (vkMapMemory, gdk_vulkan_context_get_device (self->vulkan),
+                                 block->vk_memory,
+                                 0,
+                                 VK_WHOLE_SIZE,
+                                 0,
+                                 &data);
+      block->map = data;
+    }
 
-  return data;
+  return block->map + self->offset;
 }
 
 void
 gsk_vulkan_memory_unmap (GskVulkanMemory *self)
 {
-  vkUnmapMemory (gdk_vulkan_context_get_device (self->vulkan),
-                 self->vk_memory);
+  GskVulkanAllocator *allocator = self->block->allocator;
+  VkDeviceSize atom = allocator->non_coherent_atom_size;
+  VkDeviceSize start, end;
+
+  /* The block stays mapped, but writes to non-coherent memory
+   * need to be made visible to the device */
+  if (allocator->properties.memoryTypes[self->block->type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+    return;
+
+  start = self->offset / atom * atom;
+  end = MIN (ALIGN (self->offset + self->size, atom), self->block->size);
+
+  GSK_VK_CHECK (vkFlushMappedMemoryRanges, gdk_vulkan_context_get_device (self->vulkan),
+                                           1,
+                                           &(VkMappedMemoryRange) {
+                                               .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+                                               .memory = self->block->vk_memory,
+                                               .offset = start,
+                                               .size = end - start
+                                           });
+}
+
+void
+gsk_vulkan_memory_get_stats (GdkVulkanContext     *context,
+                             GskVulkanMemoryStats *stats)
+{
+  *stats = get_allocator (context)->stats;
 }
 
+/* Frees all memory blocks of @context. Must be called before the
+ * device of @context goes away and after all memory has been freed. */
+void
+gsk_vulkan_memory_release (GdkVulkanContext *context)
+{
+  GskVulkanAllocator *allocator;
+  guint i, j, k;
+
+  allocator = g_object_get_data (G_OBJECT (context), "gsk-vulkan-allocator");
+  if (allocator == NULL)
+    return;
+
+  for (i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+    for (j = 0; j < N_POOLS; j++)
+      {
+        GPtrArray *pool = allocator->pools[i][j];
+
+        if (pool == NULL)
+          continue;
+
+        for (k = 0; k < pool->len; k++)
+          {
+            GskVulkanMemoryBlock *block = g_ptr_array_index (pool, k);
+
+            g_assert (block->n_allocations == 0);
+          }
+      }
+
+  g_object_set_data (G_OBJECT (context), "gsk-vulkan-allocator", NULL);
+}
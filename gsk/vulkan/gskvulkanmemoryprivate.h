@@ -7,17 +7,44 @@ G_BEGIN_DECLS
 
 typedef struct _GskVulkanMemory GskVulkanMemory;
 
+typedef enum {
+  /* For images with VK_IMAGE_TILING_OPTIMAL, which must not share
+   * pages with linear resources, see bufferImageGranularity */
+  GSK_VULKAN_MEMORY_OPTIMAL_TILING = 1 << 0,
+  /* Freed again once the frame is done, like vertex data and
+   * staging buffers. These use a linear allocator. */
+  GSK_VULKAN_MEMORY_TRANSIENT      = 1 << 1
+} GskVulkanMemoryFlags;
+
+typedef struct {
+  gsize allocated;      /* Bytes of device memory allocated from the driver */
+  gsize used;           /* Bytes of that in use */
+  guint n_blocks;       /* Number of vkAllocateMemory() allocations */
+  guint n_allocations;  /* Number of GskVulkanMemory */
+} GskVulkanMemoryStats;
+
+GDK_AVAILABLE_IN_ALL
 GskVulkanMemory *       gsk_vulkan_memory_new                           (GdkVulkanContext       *context,
-                                                                         uint32_t                allowed_types,
+                                                                         const VkMemoryRequirements *requirements,
                                                                          VkMemoryPropertyFlags   properties,
-                                                                         gsize                   size);
+                                                                         GskVulkanMemoryFlags    flags);
+GDK_AVAILABLE_IN_ALL
 void                    gsk_vulkan_memory_free                          (GskVulkanMemory        *memory);
 
+GDK_AVAILABLE_IN_ALL
 VkDeviceMemory          gsk_vulkan_memory_get_device_memory             (GskVulkanMemory        *self);
+GDK_AVAILABLE_IN_ALL
+VkDeviceSize            gsk_vulkan_memory_get_offset                    (GskVulkanMemory        *self);
 
 guchar *                gsk_vulkan_memory_map                           (GskVulkanMemory        *self);
 void                    gsk_vulkan_memory_unmap                         (GskVulkanMemory        *self);
 
+GDK_AVAILABLE_IN_ALL
+void                    gsk_vulkan_memory_get_stats                     (GdkVulkanContext       *context,
+                                                                         GskVulkanMemoryStats   *stats);
+GDK_AVAILABLE_IN_ALL
+void                    gsk_vulkan_memory_release                       (GdkVulkanContext       *context);
+
 G_END_DECLS
 
 #endif /* __GSK_VULKAN_MEMORY_PRIVATE_H__ */
@@ -6,6 +6,7 @@
 #include "gskvulkanshaderprivate.h"
 
 #include <graphene.h>
+#include <errno.h>
 
 typedef struct _GskVulkanPipelinePrivate GskVulkanPipelinePrivate;
 
@@ -24,6 +25,164 @@ struct _GskVulkanPipelinePrivate
 
 G_DEFINE_TYPE_WITH_PRIVATE (GskVulkanPipeline, gsk_vulkan_pipeline, G_TYPE_OBJECT)
 
+/* The pipeline cache is shared by all pipelines of a context and saved
+ * to disk when the context goes away, so pipelines don't have to be
+ * compiled from scratch on every startup.
+ *
+ * The driver refuses cache data from a different device or driver
+ * version itself, but we key the file name on those, too, so
+ * switching between GPUs doesn't make them overwrite each other's
+ * caches.
+ */
+typedef struct
+{
+  GdkVulkanContext *vulkan;
+  VkPipelineCache vk_pipeline_cache;
+  char *filename;
+  gsize loaded_size;
+} GskVulkanPipelineCache;
+
+static char *
+get_pipeline_cache_filename (GdkVulkanContext *context)
+{
+  VkPhysicalDeviceProperties properties;
+  GString *name;
+  char *filename;
+  gsize i;
+
+  vkGetPhysicalDeviceProperties (gdk_vulkan_context_get_physical_device (context), &properties);
+
+  name = g_string_new (NULL);
+  for (i = 0; i < VK_UUID_SIZE; i++)
+    g_string_append_printf (name, "%02x", properties.pipelineCacheUUID[i]);
+  g_string_append_printf (name, "-%04x-%04x-%08x",
+                          properties.vendorID, properties.deviceID, properties.driverVersion);
+
+  filename = g_build_filename (g_get_user_cache_dir (), "gtk-4.0", "vulkan-pipelines", name->str, NULL);
+
+  g_string_free (name, TRUE);
+
+  return filename;
+}
+
+static void
+gsk_vulkan_pipeline_cache_save (GskVulkanPipelineCache *cache)
+{
+  VkDevice device = gdk_vulkan_context_get_device (cache->vulkan);
+  GError *error = NULL;
+  char *dirname;
+  size_t size;
+  void *data;
+
+  if (GSK_VK_CHECK (vkGetPipelineCacheData, device, cache->vk_pipeline_cache, &size, NULL) != VK_SUCCESS)
+    return;
+
+  /* Nothing was added */
+  if (size == cache->loaded_size)
+    return;
+
+  data = g_malloc (size);
+  if (GSK_VK_CHECK (vkGetPipelineCacheData, device, cache->vk_pipeline_cache, &size, data) == VK_SUCCESS)
+    {
+      dirname = g_path_get_dirname (cache->filename);
+
+      if (g_mkdir_with_parents (dirname, 0755) != 0 ||
+          !g_file_set_contents (cache->filename, data, size, &error))
+        {
+          GSK_NOTE (VULKAN, g_message ("Failed to save pipeline cache %s: %s",
+                                       cache->filename, error ? error->message : g_strerror (errno)));
+          g_clear_error (&error);
+        }
+      else
+        {
+          GSK_NOTE (VULKAN, g_message ("Saved %" G_GSIZE_FORMAT " bytes of pipeline cache to %s",
+                                       (gsize) size, cache->filename));
+        }
+
+      g_free (dirname);
+    }
+
+  g_free (data);
+}
+
+static void
+gsk_vulkan_pipeline_cache_free (gpointer data)
+{
+  GskVulkanPipelineCache *cache = data;
+
+  gsk_vulkan_pipeline_cache_save (cache);
+
+  vkDestroyPipelineCache (gdk_vulkan_context_get_device (cache->vulkan),
+                          cache->vk_pipeline_cache,
+                          NULL);
+
+  g_free (cache->filename);
+  g_slice_free (GskVulkanPipelineCache, cache);
+}
+
+static VkPipelineCache
+gsk_vulkan_pipeline_cache_get (GdkVulkanContext *context)
+{
+  static GMutex lock;
+  GskVulkanPipelineCache *cache;
+  char *contents = NULL;
+  gsize length = 0;
+
+  /* Pipelines get created on worker threads, too */
+  g_mutex_lock (&lock);
+
+  cache = g_object_get_data (G_OBJECT (context), "gsk-vulkan-pipeline-cache");
+  if (cache == NULL)
+    {
+      cache = g_slice_new0 (GskVulkanPipelineCache);
+      cache->vulkan = context;
+      cache->filename = get_pipeline_cache_filename (context);
+
+      if (!g_file_get_contents (cache->filename, &contents, &length, NULL))
+        length = 0;
+
+      if (GSK_VK_CHECK (vkCreatePipelineCache, gdk_vulkan_context_get_device (context),
+                                               &(VkPipelineCacheCreateInfo) {
+                                                   .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+                                                   .initialDataSize = length,
+                                                   .pInitialData = contents
+                                               },
+                                               NULL,
+                                               &cache->vk_pipeline_cache) != VK_SUCCESS)
+        {
+          /* Try again without the data, in case it was bad */
+          length = 0;
+          GSK_VK_CHECK (vkCreatePipelineCache, gdk_vulkan_context_get_device (context),
+                                               &(VkPipelineCacheCreateInfo) {
+                                                   .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+                                               },
+                                               NULL,
+                                               &cache->vk_pipeline_cache);
+        }
+
+      GSK_NOTE (VULKAN, g_message ("Loaded %" G_GSIZE_FORMAT " bytes of pipeline cache from %s",
+                                   length, cache->filename));
+
+      cache->loaded_size = length;
+      g_free (contents);
+
+      g_object_set_data_full (G_OBJECT (context), "gsk-vulkan-pipeline-cache",
+                              cache, gsk_vulkan_pipeline_cache_free);
+    }
+
+  g_mutex_unlock (&lock);
+
+  return cache->vk_pipeline_cache;
+}
+
+/* Saves and frees the pipeline cache of @context. Must be called
+ * before the device of @context goes away. */
+void
+gsk_vulkan_pipeline_cache_release (GdkVulkanContext *context)
+{
+  g_object_set_data (G_OBJECT (context), "gsk-vulkan-pipeline-cache", NULL);
+}
+
 static void
 gsk_vulkan_pipeline_finalize (GObject *gobject)
 {
@@ -77,6 +236,7 @@ gsk_vulkan_pipeline_new_full (GType                    pipeline_type,
   GskVulkanPipelinePrivate *priv;
   GskVulkanPipeline *self;
   VkDevice device;
+  gint64 start_time G_GNUC_UNUSED;
 
   g_return_val_if_fail (g_type_is_a (pipeline_type, GSK_TYPE_VULKAN_PIPELINE), NULL);
   g_return_val_if_fail (layout != VK_NULL_HANDLE, NULL);
@@ -95,8 +255,10 @@ gsk_vulkan_pipeline_new_full (GType                    pipeline_type,
   priv->vertex_shader = gsk_vulkan_shader_new_from_resource (context, GSK_VULKAN_SHADER_VERTEX, shader_name, NULL);
   priv->fragment_shader = gsk_vulkan_shader_new_from_resource (context, GSK_VULKAN_SHADER_FRAGMENT, shader_name, NULL);
 
+  start_time = g_get_monotonic_time ();
+
   GSK_VK_CHECK (vkCreateGraphicsPipelines, device,
-                                           VK_NULL_HANDLE,
+                                           gsk_vulkan_pipeline_cache_get (context),
                                            1,
                                            &(VkGraphicsPipelineCreateInfo) {
                                                .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
@@ -169,6 +331,10 @@ gsk_vulkan_pipeline_new_full (GType                    pipeline_type,
                                            NULL,
                                            &priv->pipeline);
 
+  GSK_NOTE (VULKAN, g_message ("Created %s pipeline for %s shaders in %.3f ms",
+                               G_OBJECT_TYPE_NAME (self), shader_name,
+                               (double) (g_get_monotonic_time () - start_time) / G_TIME_SPAN_MILLISECOND));
+
   return self;
 }
 
@@ -49,6 +49,10 @@ struct _GskVulkanRender
   VkDescriptorSet *descriptor_sets;
   gsize n_descriptor_sets;
   GskVulkanPipeline *pipelines[GSK_VULKAN_N_PIPELINES];
+  /* Protects pipelines while pipeline_thread is running */
+  GMutex pipeline_lock;
+  GThread *pipeline_thread;
+  int pipeline_thread_cancelled;
 
   GskVulkanImage *target;
 
@@ -118,6 +122,7 @@ gsk_vulkan_render_new (GskRenderer      *renderer,
   self->vulkan = context;
   self->renderer = renderer;
   self->framebuffers = g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_mutex_init (&self->pipeline_lock);
   self->descriptor_set_indexes = g_hash_table_new_full (desc_set_index_hash, desc_set_index_equal, NULL, g_free);
 
   device = gdk_vulkan_context_get_device (self->vulkan);
@@ -373,62 +378,134 @@ gsk_vulkan_render_upload (GskVulkanRender *self)
   gsk_vulkan_uploader_upload (self->uploader);
 }
 
+static const struct {
+  const char *name;
+  guint num_textures;
+  GskVulkanPipeline * (* create_func) (GdkVulkanContext *context, VkPipelineLayout layout, const char *name, VkRenderPass render_pass);
+} pipeline_info[GSK_VULKAN_N_PIPELINES] = {
+  { "texture",                    1, gsk_vulkan_texture_pipeline_new },
+  { "texture-clip",               1, gsk_vulkan_texture_pipeline_new },
+  { "texture-clip-rounded",       1, gsk_vulkan_texture_pipeline_new },
+  { "color",                      0, gsk_vulkan_color_pipeline_new },
+  { "color-clip",                 0, gsk_vulkan_color_pipeline_new },
+  { "color-clip-rounded",         0, gsk_vulkan_color_pipeline_new },
+  { "linear",                     0, gsk_vulkan_linear_gradient_pipeline_new },
+  { "linear-clip",                0, gsk_vulkan_linear_gradient_pipeline_new },
+  { "linear-clip-rounded",        0, gsk_vulkan_linear_gradient_pipeline_new },
+  { "color-matrix",               1, gsk_vulkan_effect_pipeline_new },
+  { "color-matrix-clip",          1, gsk_vulkan_effect_pipeline_new },
+  { "color-matrix-clip-rounded",  1, gsk_vulkan_effect_pipeline_new },
+  { "border",                     0, gsk_vulkan_border_pipeline_new },
+  { "border-clip",                0, gsk_vulkan_border_pipeline_new },
+  { "border-clip-rounded",        0, gsk_vulkan_border_pipeline_new },
+  { "inset-shadow",               0, gsk_vulkan_box_shadow_pipeline_new },
+  { "inset-shadow-clip",          0, gsk_vulkan_box_shadow_pipeline_new },
+  { "inset-shadow-clip-rounded",  0, gsk_vulkan_box_shadow_pipeline_new },
+  { "outset-shadow",              0, gsk_vulkan_box_shadow_pipeline_new },
+  { "outset-shadow-clip",         0, gsk_vulkan_box_shadow_pipeline_new },
+  { "outset-shadow-clip-rounded", 0, gsk_vulkan_box_shadow_pipeline_new },
+  { "blur",                       1, gsk_vulkan_blur_pipeline_new },
+  { "blur-clip",                  1, gsk_vulkan_blur_pipeline_new },
+  { "blur-clip-rounded",          1, gsk_vulkan_blur_pipeline_new },
+  { "mask",                       1, gsk_vulkan_text_pipeline_new },
+  { "mask-clip",                  1, gsk_vulkan_text_pipeline_new },
+  { "mask-clip-rounded",          1, gsk_vulkan_text_pipeline_new },
+  { "texture",                    1, gsk_vulkan_color_text_pipeline_new },
+  { "texture-clip",               1, gsk_vulkan_color_text_pipeline_new },
+  { "texture-clip-rounded",       1, gsk_vulkan_color_text_pipeline_new },
+  { "crossfade",                  2, gsk_vulkan_cross_fade_pipeline_new },
+  { "crossfade-clip",             2, gsk_vulkan_cross_fade_pipeline_new },
+  { "crossfade-clip-rounded",     2, gsk_vulkan_cross_fade_pipeline_new },
+  { "blendmode",                  2, gsk_vulkan_blend_mode_pipeline_new },
+  { "blendmode-clip",             2, gsk_vulkan_blend_mode_pipeline_new },
+  { "blendmode-clip-rounded",     2, gsk_vulkan_blend_mode_pipeline_new },
+};
+
+static GskVulkanPipeline *
+gsk_vulkan_render_create_pipeline (GskVulkanRender       *self,
+                                   GskVulkanPipelineType  type)
+{
+  return pipeline_info[type].create_func (self->vulkan,
+                                          self->pipeline_layout[pipeline_info[type].num_textures],
+                                          pipeline_info[type].name,
+                                          self->render_pass);
+}
+
+/* Stores @pipeline unless another thread was faster and returns
+ * the pipeline that ended up being used. */
+static GskVulkanPipeline *
+gsk_vulkan_render_add_pipeline (GskVulkanRender       *self,
+                                GskVulkanPipelineType  type,
+                                GskVulkanPipeline     *pipeline)
+{
+  GskVulkanPipeline *result;
+
+  g_mutex_lock (&self->pipeline_lock);
+  if (self->pipelines[type] == NULL)
+    {
+      self->pipelines[type] = pipeline;
+      pipeline = NULL;
+    }
+  result = self->pipelines[type];
+  g_mutex_unlock (&self->pipeline_lock);
+
+  g_clear_object (&pipeline);
+
+  return result;
+}
+
+static gpointer
+gsk_vulkan_render_create_pipelines_thread (gpointer data)
+{
+  GskVulkanRender *self = data;
+  GskVulkanPipelineType type;
+  gboolean exists;
+
+  for (type = 0; type < GSK_VULKAN_N_PIPELINES; type++)
+    {
+      if (g_atomic_int_get (&self->pipeline_thread_cancelled))
+        break;
+
+      g_mutex_lock (&self->pipeline_lock);
+      exists = self->pipelines[type] != NULL;
+      g_mutex_unlock (&self->pipeline_lock);
+
+      if (!exists)
+        gsk_vulkan_render_add_pipeline (self, type, gsk_vulkan_render_create_pipeline (self, type));
+    }
+
+  return NULL;
+}
+
+/* Creates all pipelines in a thread, so that the first use of a node
+ * type doesn't have to wait for it. Pipelines that are needed before
+ * the thread gets to them are created right away. */
+void
+gsk_vulkan_render_create_pipelines_async (GskVulkanRender *self)
+{
+  g_return_if_fail (self->pipeline_thread == NULL);
+
+  self->pipeline_thread = g_thread_new ("GskVulkanPipelines",
+                                        gsk_vulkan_render_create_pipelines_thread,
+                                        self);
+}
+
 GskVulkanPipeline *
 gsk_vulkan_render_get_pipeline (GskVulkanRender       *self,
                                 GskVulkanPipelineType  type)
 {
-  static const struct {
-    const char *name;
-    guint num_textures;
-    GskVulkanPipeline * (* create_func) (GdkVulkanContext *context, VkPipelineLayout layout, const char *name, VkRenderPass render_pass);
-  } pipeline_info[GSK_VULKAN_N_PIPELINES] = {
-    { "texture",                    1, gsk_vulkan_texture_pipeline_new },
-    { "texture-clip",               1, gsk_vulkan_texture_pipeline_new },
-    { "texture-clip-rounded",       1, gsk_vulkan_texture_pipeline_new },
-    { "color",                      0, gsk_vulkan_color_pipeline_new },
-    { "color-clip",                 0, gsk_vulkan_color_pipeline_new },
-    { "color-clip-rounded",         0, gsk_vulkan_color_pipeline_new },
-    { "linear",                     0, gsk_vulkan_linear_gradient_pipeline_new },
-    { "linear-clip",                0, gsk_vulkan_linear_gradient_pipeline_new },
-    { "linear-clip-rounded",        0, gsk_vulkan_linear_gradient_pipeline_new },
-    { "color-matrix",               1, gsk_vulkan_effect_pipeline_new },
-    { "color-matrix-clip",          1, gsk_vulkan_effect_pipeline_new },
-    { "color-matrix-clip-rounded",  1, gsk_vulkan_effect_pipeline_new },
-    { "border",                     0, gsk_vulkan_border_pipeline_new },
-    { "border-clip",                0, gsk_vulkan_border_pipeline_new },
-    { "border-clip-rounded",        0, gsk_vulkan_border_pipeline_new },
-    { "inset-shadow",               0, gsk_vulkan_box_shadow_pipeline_new },
-    { "inset-shadow-clip",          0, gsk_vulkan_box_shadow_pipeline_new },
-    { "inset-shadow-clip-rounded",  0, gsk_vulkan_box_shadow_pipeline_new },
-    { "outset-shadow",              0, gsk_vulkan_box_shadow_pipeline_new },
-    { "outset-shadow-clip",         0, gsk_vulkan_box_shadow_pipeline_new },
-    { "outset-shadow-clip-rounded", 0, gsk_vulkan_box_shadow_pipeline_new },
-    { "blur",                       1, gsk_vulkan_blur_pipeline_new },
-    { "blur-clip",                  1, gsk_vulkan_blur_pipeline_new },
-    { "blur-clip-rounded",          1, gsk_vulkan_blur_pipeline_new },
-    { "mask",                       1, gsk_vulkan_text_pipeline_new },
-    { "mask-clip",                  1, gsk_vulkan_text_pipeline_new },
-    { "mask-clip-rounded",          1, gsk_vulkan_text_pipeline_new },
-    { "texture",                    1, gsk_vulkan_color_text_pipeline_new },
-    { "texture-clip",               1, gsk_vulkan_color_text_pipeline_new },
-    { "texture-clip-rounded",       1, gsk_vulkan_color_text_pipeline_new },
-    { "crossfade",                  2, gsk_vulkan_cross_fade_pipeline_new },
-    { "crossfade-clip",             2, gsk_vulkan_cross_fade_pipeline_new },
-    { "crossfade-clip-rounded",     2, gsk_vulkan_cross_fade_pipeline_new },
-    { "blendmode",                  2, gsk_vulkan_blend_mode_pipeline_new },
-    { "blendmode-clip",             2, gsk_vulkan_blend_mode_pipeline_new },
-    { "blendmode-clip-rounded",     2, gsk_vulkan_blend_mode_pipeline_new },
-  };
+  GskVulkanPipeline *pipeline;
 
   g_return_val_if_fail (type < GSK_VULKAN_N_PIPELINES, NULL);
 
-  if (self->pipelines[type] == NULL)
-    self->pipelines[type] = pipeline_info[type].create_func (self->vulkan,
-                                                             self->pipeline_layout[pipeline_info[type].num_textures],
-                                                             pipeline_info[type].name,
-                                                             self->render_pass);
+  g_mutex_lock (&self->pipeline_lock);
+  pipeline = self->pipelines[type];
+  g_mutex_unlock (&self->pipeline_lock);
 
-  return self->pipelines[type];
+  if (pipeline == NULL)
+    pipeline = gsk_vulkan_render_add_pipeline (self, type, gsk_vulkan_render_create_pipeline (self, type));
+
+  return pipeline;
 }
 
 VkDescriptorSet
@@ -711,8 +788,15 @@ gsk_vulkan_render_free (GskVulkanRender *self)
     }
   g_hash_table_unref (self->framebuffers);
 
+  if (self->pipeline_thread)
+    {
+      g_atomic_int_set (&self->pipeline_thread_cancelled, TRUE);
+      g_thread_join (self->pipeline_thread);
+    }
+
   for (i = 0; i < GSK_VULKAN_N_PIPELINES; i++)
     g_clear_object (&self->pipelines[i]);
+  g_mutex_clear (&self->pipeline_lock);
 
   g_clear_pointer (&self->uploader, gsk_vulkan_uploader_free);
 
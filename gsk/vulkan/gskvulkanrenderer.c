@@ -6,8 +6,10 @@
 #include "gskprivate.h"
 #include "gskrendererprivate.h"
 #include "gskrendernodeprivate.h"
+#include "gskroundedrectprivate.h"
 #include "gskvulkanbufferprivate.h"
 #include "gskvulkanimageprivate.h"
+#include "gskvulkanmemoryprivate.h"
 #include "gskvulkanpipelineprivate.h"
 #include "gskvulkanrenderprivate.h"
 #include "gskvulkanglyphcacheprivate.h"
@@ -25,12 +27,31 @@ struct _GskVulkanTextureData {
   GskVulkanRenderer *renderer;
 };
 
+/* Fallback images that weren't used for this many frames are dropped */
+#define MAX_FALLBACK_AGE 3
+
+typedef struct {
+  GskRenderNode *node;
+  GskVulkanImage *image;
+  int scale_factor;
+  /* The area of node that image covers */
+  graphene_rect_t area;
+  /* The rounded clip that was applied, if any */
+  gboolean has_clip;
+  GskRoundedRect clip;
+  guint64 last_used;
+} GskVulkanFallbackData;
+
 #ifdef G_ENABLE_DEBUG
 typedef struct {
   GQuark frames;
   GQuark render_passes;
   GQuark fallback_pixels;
+  GQuark fallback_reused_pixels;
   GQuark texture_pixels;
+  GQuark memory_allocated;
+  GQuark memory_used;
+  GQuark memory_blocks;
 } ProfileCounters;
 
 typedef struct {
@@ -57,6 +78,10 @@ struct _GskVulkanRenderer
 
   GskVulkanGlyphCache *glyph_cache;
 
+  /* GskRenderNode => GskVulkanFallbackData */
+  GHashTable *fallbacks;
+  guint64 frame;
+
 #ifdef G_ENABLE_DEBUG
   ProfileCounters profile_counters;
   ProfileTimers profile_timers;
@@ -70,6 +95,46 @@ struct _GskVulkanRendererClass
 
 G_DEFINE_TYPE (GskVulkanRenderer, gsk_vulkan_renderer, GSK_TYPE_RENDERER)
 
+#ifdef G_ENABLE_DEBUG
+static void
+gsk_vulkan_renderer_update_memory_counters (GskVulkanRenderer *self,
+                                            GskProfiler       *profiler)
+{
+  GskVulkanMemoryStats stats;
+
+  gsk_vulkan_memory_get_stats (self->vulkan, &stats);
+
+  gsk_profiler_counter_set (profiler, self->profile_counters.memory_allocated, stats.allocated);
+  gsk_profiler_counter_set (profiler, self->profile_counters.memory_used, stats.used);
+  gsk_profiler_counter_set (profiler, self->profile_counters.memory_blocks, stats.n_blocks);
+}
+#endif
+
+static void
+gsk_vulkan_fallback_data_free (gpointer data)
+{
+  GskVulkanFallbackData *fallback = data;
+
+  gsk_render_node_unref (fallback->node);
+  g_object_unref (fallback->image);
+
+  g_slice_free (GskVulkanFallbackData, fallback);
+}
+
+static void
+gsk_vulkan_renderer_expire_fallbacks (GskVulkanRenderer *self)
+{
+  GskVulkanFallbackData *fallback;
+  GHashTableIter iter;
+
+  g_hash_table_iter_init (&iter, self->fallbacks);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &fallback))
+    {
+      if (self->frame - fallback->last_used > MAX_FALLBACK_AGE)
+        g_hash_table_iter_remove (&iter);
+    }
+}
+
 static void
 gsk_vulkan_renderer_free_targets (GskVulkanRenderer *self)
 {
@@ -130,6 +195,7 @@ gsk_vulkan_renderer_realize (GskRenderer  *renderer,
   gsk_vulkan_renderer_update_images_cb (self->vulkan, self);
 
   self->render = gsk_vulkan_render_new (renderer, self->vulkan);
+  gsk_vulkan_render_create_pipelines_async (self->render);
 
   self->glyph_cache = gsk_vulkan_glyph_cache_new (renderer, self->vulkan);
 
@@ -143,6 +209,7 @@ gsk_vulkan_renderer_unrealize (GskRenderer *renderer)
   GSList *l;
 
   g_clear_object (&self->glyph_cache);
+  g_hash_table_remove_all (self->fallbacks);
 
   for (l = self->textures; l; l = l->next)
     {
@@ -160,6 +227,11 @@ gsk_vulkan_renderer_unrealize (GskRenderer *renderer)
                                        gsk_vulkan_renderer_update_images_cb,
                                        self);
 
+  /* Everything using them is gone now, free the memory blocks and
+   * the pipeline cache while we still have a device */
+  gsk_vulkan_memory_release (self->vulkan);
+  gsk_vulkan_pipeline_cache_release (self->vulkan);
+
   g_clear_object (&self->vulkan);
 }
 
@@ -180,6 +252,7 @@ gsk_vulkan_renderer_render_texture (GskRenderer           *renderer,
 #ifdef G_ENABLE_DEBUG
   profiler = gsk_renderer_get_profiler (renderer);
   gsk_profiler_counter_set (profiler, self->profile_counters.fallback_pixels, 0);
+  gsk_profiler_counter_set (profiler, self->profile_counters.fallback_reused_pixels, 0);
   gsk_profiler_counter_set (profiler, self->profile_counters.texture_pixels, 0);
   gsk_profiler_counter_set (profiler, self->profile_counters.render_passes, 0);
   gsk_profiler_timer_begin (profiler, self->profile_timers.cpu_time);
@@ -209,6 +282,8 @@ gsk_vulkan_renderer_render_texture (GskRenderer           *renderer,
   cpu_time = gsk_profiler_timer_end (profiler, self->profile_timers.cpu_time);
   gsk_profiler_timer_set (profiler, self->profile_timers.cpu_time, cpu_time);
 
+  gsk_vulkan_renderer_update_memory_counters (self, profiler);
+
   gsk_profiler_push_samples (profiler);
 
   if (GDK_PROFILER_IS_RUNNING)
@@ -242,11 +317,15 @@ gsk_vulkan_renderer_render (GskRenderer          *renderer,
 #ifdef G_ENABLE_DEBUG
   profiler = gsk_renderer_get_profiler (renderer);
   gsk_profiler_counter_set (profiler, self->profile_counters.fallback_pixels, 0);
+  gsk_profiler_counter_set (profiler, self->profile_counters.fallback_reused_pixels, 0);
   gsk_profiler_counter_set (profiler, self->profile_counters.texture_pixels, 0);
   gsk_profiler_counter_set (profiler, self->profile_counters.render_passes, 0);
   gsk_profiler_timer_begin (profiler, self->profile_timers.cpu_time);
 #endif
 
+  self->frame++;
+  gsk_vulkan_renderer_expire_fallbacks (self);
+
   gdk_draw_context_begin_frame (GDK_DRAW_CONTEXT (self->vulkan), region);
   render = self->render;
 
@@ -265,17 +344,32 @@ gsk_vulkan_renderer_render (GskRenderer          *renderer,
   cpu_time = gsk_profiler_timer_end (profiler, self->profile_timers.cpu_time);
   gsk_profiler_timer_set (profiler, self->profile_timers.cpu_time, cpu_time);
 
+  gsk_vulkan_renderer_update_memory_counters (self, profiler);
+
   gsk_profiler_push_samples (profiler);
 #endif
 
   gdk_draw_context_end_frame (GDK_DRAW_CONTEXT (self->vulkan));
 }
 
+static void
+gsk_vulkan_renderer_finalize (GObject *object)
+{
+  GskVulkanRenderer *self = GSK_VULKAN_RENDERER (object);
+
+  g_hash_table_unref (self->fallbacks);
+
+  G_OBJECT_CLASS (gsk_vulkan_renderer_parent_class)->finalize (object);
+}
+
 static void
 gsk_vulkan_renderer_class_init (GskVulkanRendererClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GskRendererClass *renderer_class = GSK_RENDERER_CLASS (klass);
 
+  object_class->finalize = gsk_vulkan_renderer_finalize;
+
   renderer_class->realize = gsk_vulkan_renderer_realize;
   renderer_class->unrealize = gsk_vulkan_renderer_unrealize;
   renderer_class->render = gsk_vulkan_renderer_render;
@@ -291,11 +385,17 @@ gsk_vulkan_renderer_init (GskVulkanRenderer *self)
 
   gsk_ensure_resources ();
 
+  self->fallbacks = g_hash_table_new_full (NULL, NULL, NULL, gsk_vulkan_fallback_data_free);
+
 #ifdef G_ENABLE_DEBUG
   self->profile_counters.frames = gsk_profiler_add_counter (profiler, "frames", "Frames", FALSE);
   self->profile_counters.render_passes = gsk_profiler_add_counter (profiler, "render-passes", "Render passes", FALSE);
-  self->profile_counters.fallback_pixels = gsk_profiler_add_counter (profiler, "fallback-pixels", "Fallback pixels", TRUE);
+  self->profile_counters.fallback_pixels = gsk_profiler_add_counter (profiler, "fallback-pixels", "Fallback pixels rasterized", TRUE);
+  self->profile_counters.fallback_reused_pixels = gsk_profiler_add_counter (profiler, "fallback-reused-pixels", "Fallback pixels reused", TRUE);
   self->profile_counters.texture_pixels = gsk_profiler_add_counter (profiler, "texture-pixels", "Texture pixels", TRUE);
+  self->profile_counters.memory_allocated = gsk_profiler_add_counter (profiler, "memory-allocated", "Device memory allocated", FALSE);
+  self->profile_counters.memory_used = gsk_profiler_add_counter (profiler, "memory-used", "Device memory used", FALSE);
+  self->profile_counters.memory_blocks = gsk_profiler_add_counter (profiler, "memory-blocks", "Device memory blocks", FALSE);
 
   self->profile_timers.cpu_time = gsk_profiler_add_timer (profiler, "cpu-time", "CPU time", FALSE, TRUE);
   if (GSK_RENDERER_DEBUG_CHECK (GSK_RENDERER (self), SYNC))
@@ -362,6 +462,57 @@ gsk_vulkan_renderer_ref_texture_image (GskVulkanRenderer *self,
   return image;
 }
 
+/* Returns a reference to a previously rasterized image of @node that
+ * covers @area, or %NULL. @clip is the rounded clip that must have
+ * been applied when rasterizing, if any. @image_area is set to the
+ * area of @node covered by the image. */
+GskVulkanImage *
+gsk_vulkan_renderer_ref_fallback_image (GskVulkanRenderer     *self,
+                                        GskRenderNode         *node,
+                                        int                    scale_factor,
+                                        const GskRoundedRect  *clip,
+                                        const graphene_rect_t *area,
+                                        graphene_rect_t       *image_area)
+{
+  GskVulkanFallbackData *fallback;
+
+  fallback = g_hash_table_lookup (self->fallbacks, node);
+  if (fallback == NULL ||
+      fallback->scale_factor != scale_factor ||
+      fallback->has_clip != (clip != NULL) ||
+      (clip && !gsk_rounded_rect_equal (&fallback->clip, clip)) ||
+      !graphene_rect_contains_rect (&fallback->area, area))
+    return NULL;
+
+  fallback->last_used = self->frame;
+  *image_area = fallback->area;
+
+  return g_object_ref (fallback->image);
+}
+
+void
+gsk_vulkan_renderer_cache_fallback_image (GskVulkanRenderer     *self,
+                                          GskRenderNode         *node,
+                                          int                    scale_factor,
+                                          const GskRoundedRect  *clip,
+                                          const graphene_rect_t *image_area,
+                                          GskVulkanImage        *image)
+{
+  GskVulkanFallbackData *fallback;
+
+  fallback = g_slice_new0 (GskVulkanFallbackData);
+  fallback->node = gsk_render_node_ref (node);
+  fallback->image = g_object_ref (image);
+  fallback->scale_factor = scale_factor;
+  fallback->area = *image_area;
+  fallback->has_clip = clip != NULL;
+  if (clip)
+    gsk_rounded_rect_init_copy (&fallback->clip, clip);
+  fallback->last_used = self->frame;
+
+  g_hash_table_replace (self->fallbacks, node, fallback);
+}
+
 GskVulkanImage *
 gsk_vulkan_renderer_ref_glyph_image (GskVulkanRenderer  *self,
                                      GskVulkanUploader  *uploader,
@@ -374,22 +525,20 @@ guint
 gsk_vulkan_renderer_cache_glyph (GskVulkanRenderer *self,
                                  PangoFont         *font,
                                  PangoGlyph         glyph,
-                                 int                x,
-                                 int                y,
+                                 float              x,
                                  float              scale)
 {
-  return gsk_vulkan_glyph_cache_lookup (self->glyph_cache, TRUE, font, glyph, x, y, scale)->texture_index;
+  return gsk_vulkan_glyph_cache_lookup (self->glyph_cache, TRUE, font, glyph, x, scale)->texture_index;
 }
 
 GskVulkanCachedGlyph *
 gsk_vulkan_renderer_get_cached_glyph (GskVulkanRenderer *self,
                                       PangoFont         *font,
                                       PangoGlyph         glyph,
-                                      int                x,
-                                      int                y,
+                                      float              x,
                                       float              scale)
 {
-  return gsk_vulkan_glyph_cache_lookup (self->glyph_cache, FALSE, font, glyph, x, y, scale);
+  return gsk_vulkan_glyph_cache_lookup (self->glyph_cache, FALSE, font, glyph, x, scale);
 }
 
 /**
@@ -4,12 +4,27 @@
 #include "gskvulkanrenderer.h"
 #include "gskvulkanimageprivate.h"
 
+#include <math.h>
+
 G_BEGIN_DECLS
 
 GskVulkanImage *        gsk_vulkan_renderer_ref_texture_image           (GskVulkanRenderer      *self,
                                                                          GdkTexture             *texture,
                                                                          GskVulkanUploader      *uploader);
 
+GskVulkanImage *        gsk_vulkan_renderer_ref_fallback_image          (GskVulkanRenderer      *self,
+                                                                         GskRenderNode          *node,
+                                                                         int                     scale_factor,
+                                                                         const GskRoundedRect   *clip,
+                                                                         const graphene_rect_t  *area,
+                                                                         graphene_rect_t        *image_area);
+void                    gsk_vulkan_renderer_cache_fallback_image        (GskVulkanRenderer      *self,
+                                                                         GskRenderNode          *node,
+                                                                         int                     scale_factor,
+                                                                         const GskRoundedRect   *clip,
+                                                                         const graphene_rect_t  *image_area,
+                                                                         GskVulkanImage         *image);
+
 typedef struct
 {
   guint texture_index;
@@ -27,11 +42,19 @@ typedef struct
   guint64 timestamp;
 } GskVulkanCachedGlyph;
 
+/* Where to draw a cached glyph for a glyph positioned at @x, horizontally.
+ * The remaining quarter pixels are part of the cached glyph, vertical
+ * positions are just rounded. */
+static inline float
+gsk_vulkan_glyph_cache_snap (float x)
+{
+  return floorf (x + 0.125f);
+}
+
 guint                  gsk_vulkan_renderer_cache_glyph      (GskVulkanRenderer *renderer,
                                                              PangoFont         *font,
                                                              PangoGlyph         glyph,
-                                                             int                x,
-                                                             int                y,
+                                                             float              x,
                                                              float              scale);
 
 GskVulkanImage *       gsk_vulkan_renderer_ref_glyph_image  (GskVulkanRenderer *self,
@@ -41,8 +64,7 @@ GskVulkanImage *       gsk_vulkan_renderer_ref_glyph_image  (GskVulkanRenderer *
 GskVulkanCachedGlyph * gsk_vulkan_renderer_get_cached_glyph (GskVulkanRenderer *self,
                                                              PangoFont         *font,
                                                              PangoGlyph         glyph,
-                                                             int                x,
-                                                             int                y,
+                                                             float              x,
                                                              float              scale);
 
 
@@ -73,6 +73,7 @@ struct _GskVulkanOpRender
   gsize                descriptor_set_index2; /* descriptor index for the second source (if relevant) */
   graphene_rect_t      source_rect; /* area that source maps to */
   graphene_rect_t      source2_rect; /* area that source2 maps to */
+  graphene_rect_t      bounds; /* area to draw (only for fallbacks, node bounds otherwise) */
 };
 
 struct _GskVulkanOpText
@@ -125,6 +126,7 @@ struct _GskVulkanRenderPass
   GskVulkanBuffer *vertex_data;
 
   GQuark fallback_pixels;
+  GQuark fallback_reused_pixels;
   GQuark texture_pixels;
 };
 
@@ -206,6 +208,7 @@ gsk_vulkan_render_pass_new (GdkVulkanContext  *context,
 
 #ifdef G_ENABLE_DEBUG
   self->fallback_pixels = g_quark_from_static_string ("fallback-pixels");
+  self->fallback_reused_pixels = g_quark_from_static_string ("fallback-reused-pixels");
   self->texture_pixels = g_quark_from_static_string ("texture-pixels");
 #endif
 
@@ -349,6 +352,7 @@ gsk_vulkan_render_pass_add_node (GskVulkanRenderPass           *self,
         const PangoGlyphInfo *glyphs = gsk_text_node_peek_glyphs (node);
         guint num_glyphs = gsk_text_node_get_num_glyphs (node);
         gboolean has_color_glyphs = gsk_text_node_has_color_glyphs (node);
+        const graphene_point_t *offset = gsk_text_node_get_offset (node);
         int i;
         guint count;
         guint texture_index;
@@ -393,8 +397,7 @@ gsk_vulkan_render_pass_add_node (GskVulkanRenderPass           *self,
             texture_index = gsk_vulkan_renderer_cache_glyph (renderer,
                                                              (PangoFont *)font,
                                                              gi->glyph,
-                                                             x_position + gi->geometry.x_offset,
-                                                             gi->geometry.y_offset,
+                                                             offset->x + (float) (x_position + gi->geometry.x_offset) / PANGO_SCALE,
                                                              op.text.scale);
             if (op.text.texture_index == G_MAXUINT)
               op.text.texture_index = texture_index;
@@ -807,66 +810,105 @@ gsk_vulkan_render_pass_upload_fallback (GskVulkanRenderPass  *self,
                                         GskVulkanRender      *render,
                                         GskVulkanUploader    *uploader)
 {
+  GskVulkanRenderer *renderer = GSK_VULKAN_RENDERER (gsk_vulkan_render_get_renderer (render));
+  const GskRoundedRect *rounded_clip;
+  graphene_rect_t image_area;
   GskRenderNode *node;
   cairo_surface_t *surface;
   cairo_t *cr;
 
   node = op->node;
 
-  GSK_RENDERER_NOTE (gsk_vulkan_render_get_renderer (render), FALLBACK,
-            g_message ("Upload op=%s, node %s[%p], bounds %gx%g",
-                     op->type == GSK_VULKAN_OP_FALLBACK_CLIP ? "fallback-clip" :
-                     (op->type == GSK_VULKAN_OP_FALLBACK_ROUNDED_CLIP ? "fallback-rounded-clip" : "fallback"),
-                     node->node_class->type_name, node,
-                     ceil (node->bounds.size.width),
-                     ceil (node->bounds.size.height)));
-#ifdef G_ENABLE_DEBUG
-  {
-    GskProfiler *profiler = gsk_renderer_get_profiler (gsk_vulkan_render_get_renderer (render));
-    gsk_profiler_counter_add (profiler,
-                              self->fallback_pixels,
-                              ceil (node->bounds.size.width) * ceil (node->bounds.size.height));
-  }
-#endif
-
-  /* XXX: We could intersect bounds with clip bounds here */
-  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
-                                        ceil (node->bounds.size.width * self->scale_factor),
-                                        ceil (node->bounds.size.height * self->scale_factor));
-  cairo_surface_set_device_scale (surface, self->scale_factor, self->scale_factor);
-  cr = cairo_create (surface);
-  cairo_translate (cr, -node->bounds.origin.x, -node->bounds.origin.y);
-
-  if (op->type == GSK_VULKAN_OP_FALLBACK_CLIP)
+  /* Only rasterize the visible part of the node. Rectangular clips are
+   * then done by only drawing that part, rounded ones are done by cairo. */
+  if (op->type == GSK_VULKAN_OP_FALLBACK)
     {
-      cairo_rectangle (cr,
-                       op->clip.bounds.origin.x, op->clip.bounds.origin.y,
-                       op->clip.bounds.size.width, op->clip.bounds.size.height);
-      cairo_clip (cr);
+      op->bounds = node->bounds;
+      rounded_clip = NULL;
     }
-  else if (op->type == GSK_VULKAN_OP_FALLBACK_ROUNDED_CLIP)
+  else
     {
-      gsk_rounded_rect_path (&op->clip, cr);
-      cairo_clip (cr);
+      if (!graphene_rect_intersection (&node->bounds, &op->clip.bounds, &op->bounds))
+        op->bounds = node->bounds;
+      rounded_clip = op->type == GSK_VULKAN_OP_FALLBACK_ROUNDED_CLIP ? &op->clip : NULL;
     }
-  else
+
+  op->source = gsk_vulkan_renderer_ref_fallback_image (renderer,
+                                                       node,
+                                                       self->scale_factor,
+                                                       rounded_clip,
+                                                       &op->bounds,
+                                                       &image_area);
+
+  if (op->source)
     {
-      g_assert (op->type == GSK_VULKAN_OP_FALLBACK);
+#ifdef G_ENABLE_DEBUG
+      gsk_profiler_counter_add (gsk_renderer_get_profiler (GSK_RENDERER (renderer)),
+                                self->fallback_reused_pixels,
+                                ceil (op->bounds.size.width) * ceil (op->bounds.size.height));
+#endif
     }
+  else
+    {
+      /* Align to device pixels, so the image can be used for any
+       * part of it later */
+      image_area.origin.x = floor (op->bounds.origin.x * self->scale_factor) / self->scale_factor;
+      image_area.origin.y = floor (op->bounds.origin.y * self->scale_factor) / self->scale_factor;
+      image_area.size.width = ceil ((op->bounds.origin.x + op->bounds.size.width) * self->scale_factor) / self->scale_factor - image_area.origin.x;
+      image_area.size.height = ceil ((op->bounds.origin.y + op->bounds.size.height) * self->scale_factor) / self->scale_factor - image_area.origin.y;
+
+      GSK_RENDERER_NOTE (GSK_RENDERER (renderer), FALLBACK,
+                g_message ("Upload op=%s, node %s[%p], bounds %gx%g, visible %gx%g",
+                         op->type == GSK_VULKAN_OP_FALLBACK_CLIP ? "fallback-clip" :
+                         (op->type == GSK_VULKAN_OP_FALLBACK_ROUNDED_CLIP ? "fallback-rounded-clip" : "fallback"),
+                         node->node_class->type_name, node,
+                         ceil (node->bounds.size.width),
+                         ceil (node->bounds.size.height),
+                         image_area.size.width,
+                         image_area.size.height));
+#ifdef G_ENABLE_DEBUG
+      gsk_profiler_counter_add (gsk_renderer_get_profiler (GSK_RENDERER (renderer)),
+                                self->fallback_pixels,
+                                ceil (image_area.size.width) * ceil (image_area.size.height));
+#endif
 
-  gsk_render_node_draw (node, cr);
+      surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                            round (image_area.size.width * self->scale_factor),
+                                            round (image_area.size.height * self->scale_factor));
+      cairo_surface_set_device_scale (surface, self->scale_factor, self->scale_factor);
+      cr = cairo_create (surface);
+      cairo_translate (cr, -image_area.origin.x, -image_area.origin.y);
 
-  cairo_destroy (cr);
+      if (rounded_clip)
+        {
+          gsk_rounded_rect_path (rounded_clip, cr);
+          cairo_clip (cr);
+        }
 
-  op->source = gsk_vulkan_image_new_from_data (uploader,
-                                               cairo_image_surface_get_data (surface),
-                                               cairo_image_surface_get_width (surface),
-                                               cairo_image_surface_get_height (surface),
-                                               cairo_image_surface_get_stride (surface));
+      gsk_render_node_draw (node, cr);
 
-  op->source_rect = GRAPHENE_RECT_INIT(0, 0, 1, 1);
+      cairo_destroy (cr);
 
-  cairo_surface_destroy (surface);
+      op->source = gsk_vulkan_image_new_from_data (uploader,
+                                                   cairo_image_surface_get_data (surface),
+                                                   cairo_image_surface_get_width (surface),
+                                                   cairo_image_surface_get_height (surface),
+                                                   cairo_image_surface_get_stride (surface));
+
+      cairo_surface_destroy (surface);
+
+      gsk_vulkan_renderer_cache_fallback_image (renderer,
+                                                node,
+                                                self->scale_factor,
+                                                rounded_clip,
+                                                &image_area,
+                                                op->source);
+    }
+
+  op->source_rect = GRAPHENE_RECT_INIT ((op->bounds.origin.x - image_area.origin.x) / image_area.size.width,
+                                        (op->bounds.origin.y - image_area.origin.y) / image_area.size.height,
+                                        op->bounds.size.width / image_area.size.width,
+                                        op->bounds.size.height / image_area.size.height);
 
   gsk_vulkan_render_add_cleanup_image (render, op->source);
 }
@@ -1164,6 +1206,16 @@ gsk_vulkan_render_pass_collect_vertex_data (GskVulkanRenderPass *self,
         case GSK_VULKAN_OP_FALLBACK:
         case GSK_VULKAN_OP_FALLBACK_CLIP:
         case GSK_VULKAN_OP_FALLBACK_ROUNDED_CLIP:
+          {
+            op->render.vertex_offset = offset + n_bytes;
+            gsk_vulkan_texture_pipeline_collect_vertex_data (GSK_VULKAN_TEXTURE_PIPELINE (op->render.pipeline),
+                                                             data + n_bytes + offset,
+                                                             &op->render.bounds,
+                                                             &op->render.source_rect);
+            n_bytes += op->render.vertex_count;
+          }
+          break;
+
         case GSK_VULKAN_OP_TEXTURE:
           {
             op->render.vertex_offset = offset + n_bytes;
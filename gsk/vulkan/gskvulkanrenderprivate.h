@@ -75,6 +75,7 @@ void                    gsk_vulkan_render_add_render_pass               (GskVulk
 
 void                    gsk_vulkan_render_upload                        (GskVulkanRender        *self);
 
+void                    gsk_vulkan_render_create_pipelines_async        (GskVulkanRender        *self);
 GskVulkanPipeline *     gsk_vulkan_render_get_pipeline                  (GskVulkanRender        *self,
                                                                          GskVulkanPipelineType   pipeline_type);
 VkDescriptorSet         gsk_vulkan_render_get_descriptor_set            (GskVulkanRender        *self,
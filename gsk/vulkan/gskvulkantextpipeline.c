@@ -127,16 +127,15 @@ gsk_vulkan_text_pipeline_collect_vertex_data (GskVulkanTextPipeline  *pipeline,
 
       if (gi->glyph != PANGO_GLYPH_EMPTY)
         {
-          double cx = (x_position + gi->geometry.x_offset) / PANGO_SCALE;
-          double cy = gi->geometry.y_offset / PANGO_SCALE;
+          float x = offset->x + (float) (x_position + gi->geometry.x_offset) / PANGO_SCALE;
+          float y = offset->y + (float) gi->geometry.y_offset / PANGO_SCALE;
           GskVulkanTextInstance *instance = &instances[count];
           GskVulkanCachedGlyph *glyph;
 
           glyph = gsk_vulkan_renderer_get_cached_glyph (renderer,
                                                         font,
                                                         gi->glyph,
-                                                        x_position + gi->geometry.x_offset,
-                                                        gi->geometry.y_offset,
+                                                        x,
                                                         scale);
 
           instance->tex_rect[0] = glyph->tx;
@@ -144,8 +143,8 @@ gsk_vulkan_text_pipeline_collect_vertex_data (GskVulkanTextPipeline  *pipeline,
           instance->tex_rect[2] = glyph->tw;
           instance->tex_rect[3] = glyph->th;
 
-          instance->rect[0] = offset->x + cx + glyph->draw_x;
-          instance->rect[1] = offset->y + cy + glyph->draw_y;
+          instance->rect[0] = gsk_vulkan_glyph_cache_snap (x) + glyph->draw_x;
+          instance->rect[1] = floorf (y + 0.5f) + glyph->draw_y;
           instance->rect[2] = glyph->draw_width;
           instance->rect[3] = glyph->draw_height;
 
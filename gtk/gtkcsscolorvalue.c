@@ -220,6 +220,16 @@ gtk_css_value_color_transition (GtkCssValue *start,
   return _gtk_css_color_value_new_mix (start, end, progress);
 }
 
+static guint
+gtk_css_value_color_hash (const GtkCssValue *value)
+{
+  /* Only literals are computed, so only they get interned */
+  if (value->type == COLOR_TYPE_LITERAL)
+    return gdk_rgba_hash (&value->sym_col.rgba);
+
+  return value->type;
+}
+
 static void
 gtk_css_value_color_print (const GtkCssValue *value,
                            GString           *string)
@@ -291,7 +301,8 @@ static const GtkCssValueClass GTK_CSS_VALUE_COLOR = {
   gtk_css_value_color_transition,
   NULL,
   NULL,
-  gtk_css_value_color_print
+  gtk_css_value_color_print,
+  gtk_css_value_color_hash
 };
 
 static void
@@ -486,6 +497,8 @@ static GtkCssValue transparent_black_singleton = { &GTK_CSS_VALUE_COLOR, 1, TRUE
                                                    .sym_col.rgba = {0, 0, 0, 0} };
 static GtkCssValue white_singleton             = { &GTK_CSS_VALUE_COLOR, 1, TRUE, COLOR_TYPE_LITERAL, NULL,
                                                    .sym_col.rgba = {1, 1, 1, 1} };
+static GtkCssValue black_singleton             = { &GTK_CSS_VALUE_COLOR, 1, TRUE, COLOR_TYPE_LITERAL, NULL,
+                                                   .sym_col.rgba = {0, 0, 0, 1} };
 
 
 GtkCssValue *
@@ -513,6 +526,9 @@ _gtk_css_color_value_new_literal (const GdkRGBA *color)
   if (gdk_rgba_equal (color, &transparent_black_singleton.sym_col.rgba))
     return _gtk_css_value_ref (&transparent_black_singleton);
 
+  if (gdk_rgba_equal (color, &black_singleton.sym_col.rgba))
+    return _gtk_css_value_ref (&black_singleton);
+
   value = _gtk_css_value_new (GtkCssValue, &GTK_CSS_VALUE_COLOR);
   value->type = COLOR_TYPE_LITERAL;
   value->is_computed = TRUE;
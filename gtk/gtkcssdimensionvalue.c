@@ -133,6 +133,15 @@ gtk_css_value_dimension_equal (const GtkCssValue *number1,
          number1->value == number2->value;
 }
 
+static guint
+gtk_css_value_dimension_hash (const GtkCssValue *number)
+{
+  /* 0.0 and -0.0 compare equal, so they need to hash the same */
+  double value = number->value == 0 ? 0 : number->value;
+
+  return g_double_hash (&value) ^ number->unit;
+}
+
 static void
 gtk_css_value_dimension_print (const GtkCssValue *number,
                             GString           *string)
@@ -263,7 +272,8 @@ static const GtkCssNumberValueClass GTK_CSS_VALUE_DIMENSION = {
     gtk_css_value_dimension_transition,
     NULL,
     NULL,
-    gtk_css_value_dimension_print
+    gtk_css_value_dimension_print,
+    gtk_css_value_dimension_hash
   },
   gtk_css_value_dimension_get,
   gtk_css_value_dimension_get_dimension,
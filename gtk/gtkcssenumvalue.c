@@ -1185,6 +1185,12 @@ gtk_css_value_flags_equal (const GtkCssValue *enum1,
   return enum1->value == enum2->value;
 }
 
+static guint
+gtk_css_value_flags_hash (const GtkCssValue *value)
+{
+  return value->value;
+}
+
 static void
 gtk_css_value_flags_print (const FlagsValue  *values,
                            guint              n_values,
@@ -1237,7 +1243,8 @@ static const GtkCssValueClass GTK_CSS_VALUE_FONT_VARIANT_LIGATURE = {
   gtk_css_value_enum_transition,
   NULL,
   NULL,
-  gtk_css_font_variant_ligature_value_print
+  gtk_css_font_variant_ligature_value_print,
+  gtk_css_value_flags_hash
 };
 
 static gboolean
@@ -1345,7 +1352,8 @@ static const GtkCssValueClass GTK_CSS_VALUE_FONT_VARIANT_NUMERIC = {
   gtk_css_value_enum_transition,
   NULL,
   NULL,
-  gtk_css_font_variant_numeric_value_print
+  gtk_css_font_variant_numeric_value_print,
+  gtk_css_value_flags_hash
 };
 
 static gboolean
@@ -1450,7 +1458,8 @@ static const GtkCssValueClass GTK_CSS_VALUE_FONT_VARIANT_EAST_ASIAN = {
   gtk_css_value_enum_transition,
   NULL,
   NULL,
-  gtk_css_font_variant_east_asian_value_print
+  gtk_css_font_variant_east_asian_value_print,
+  gtk_css_value_flags_hash
 };
 
 #ifdef _MSC_VER
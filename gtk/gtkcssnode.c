@@ -21,13 +21,18 @@
 
 #include "gtkcssstaticstyleprivate.h"
 #include "gtkcssanimatedstyleprivate.h"
+#include "gtkcssselectorprivate.h"
 #include "gtkcssstylepropertyprivate.h"
+#include "gtkdebug.h"
 #include "gtkintl.h"
 #include "gtkmarshalers.h"
 #include "gtksettingsprivate.h"
 #include "gtktypebuiltins.h"
 #include "gtkprivate.h"
 #include "gdkprofilerprivate.h"
+#include "gdkparalleltaskprivate.h"
+
+#include <stdlib.h>
 
 /*
  * CSS nodes are the backbone of the GtkStyleContext implementation and
@@ -126,8 +131,43 @@ gtk_css_node_get_style_provider_or_null (GtkCssNode *cssnode)
 
 static int invalidated_nodes;
 static int created_styles;
+static int matched_styles;
 static guint invalidated_nodes_counter;
 static guint created_styles_counter;
+static guint matched_styles_counter;
+
+/* Parallel selector matching
+ *
+ * Matching nodes against the style sheets only reads the node tree and
+ * the style providers. So when a lot of nodes need new styles,
+ * gtk_css_node_validate() first matches them on worker threads, and
+ * gtk_css_node_create_style() picks up the results. Computing the values
+ * stays on this thread, as GtkCssValue reference counting is not atomic
+ * and computing values can query settings, icon themes and load images.
+ *
+ * This is enabled by setting GTK_CSS_THREADS to the number of threads
+ * to use, or to a negative number to use one thread per CPU. The threads
+ * come from the pool of gdk_parallel_task_run(), so there are never more
+ * than one per CPU.
+ */
+
+#define MIN_PARALLEL_NODES 256
+
+typedef struct _GtkCssNodeMatches GtkCssNodeMatches;
+
+struct _GtkCssNodeMatches
+{
+  GtkCssNodeMatches *outer;     /* when validating recursively */
+  GPtrArray *nodes;
+  GtkStyleProvider **providers;
+  GtkCssStaticStyleMatch **matches;
+  GHashTable *indexes;          /* GtkCssNode => index + 1 */
+  gboolean stale;               /* the tree changed after matching */
+  guint nodes_per_task;
+};
+
+static GtkCssNodeMatches *current_matches;
+static gboolean propagating_changes;
 
 static void
 gtk_css_node_set_invalid (GtkCssNode *node,
@@ -355,14 +395,35 @@ store_in_global_parent_cache (GtkCssNode                  *node,
                                                  style);
 }
 
+static GtkCssStaticStyleMatch *
+gtk_css_node_lookup_match (GtkCssNode *cssnode)
+{
+  guint index;
+
+  if (current_matches == NULL || current_matches->stale)
+    return NULL;
+
+  index = GPOINTER_TO_UINT (g_hash_table_lookup (current_matches->indexes, cssnode));
+  if (index == 0)
+    return NULL;
+
+  if (current_matches->providers[index - 1] != gtk_css_node_get_style_provider (cssnode))
+    return NULL;
+
+  return current_matches->matches[index - 1];
+}
+
 static GtkCssStyle *
 gtk_css_node_create_style (GtkCssNode                   *cssnode,
                            const GtkCountingBloomFilter *filter,
                            GtkCssChange                  change)
 {
   const GtkCssNodeDeclaration *decl;
+  GtkCssStaticStyleMatch *match;
+  GtkStyleProvider *provider;
   GtkCssStyle *style;
   GtkCssChange style_change;
+  gboolean is_first, is_last;
 
   decl = gtk_css_node_get_declaration (cssnode);
 
@@ -370,6 +431,18 @@ gtk_css_node_create_style (GtkCssNode                   *cssnode,
   if (style)
     return g_object_ref (style);
 
+  provider = gtk_css_node_get_style_provider (cssnode);
+  is_first = gtk_css_node_is_first_child (cssnode);
+  is_last = gtk_css_node_is_last_child (cssnode);
+
+  style = gtk_css_node_style_cache_lookup_shared (cssnode, provider, is_first, is_last);
+  if (style)
+    {
+      style = g_object_ref (style);
+      store_in_global_parent_cache (cssnode, decl, style);
+      return style;
+    }
+
   created_styles++;
 
   if (change & GTK_CSS_CHANGE_NEEDS_RECOMPUTE)
@@ -382,11 +455,24 @@ gtk_css_node_create_style (GtkCssNode                   *cssnode,
       style_change = gtk_css_static_style_get_change (gtk_css_style_get_static_style (cssnode->style));
     }
 
-  style = gtk_css_static_style_new_compute (gtk_css_node_get_style_provider (cssnode),
-                                            filter,
-                                            cssnode,
-                                            style_change);
+  match = gtk_css_node_lookup_match (cssnode);
+  if (match)
+    {
+      matched_styles++;
+      style = gtk_css_static_style_new_compute_for_match (provider,
+                                                          match,
+                                                          cssnode,
+                                                          style_change);
+    }
+  else
+    {
+      style = gtk_css_static_style_new_compute (provider,
+                                                filter,
+                                                cssnode,
+                                                style_change);
+    }
 
+  gtk_css_node_style_cache_insert_shared (cssnode, provider, is_first, is_last, style);
   store_in_global_parent_cache (cssnode, decl, style);
 
   return style;
@@ -631,6 +717,7 @@ gtk_css_node_class_init (GtkCssNodeClass *klass)
     {
       invalidated_nodes_counter = gdk_profiler_define_int_counter ("invalidated-nodes", "CSS Node Invalidations");
       created_styles_counter = gdk_profiler_define_int_counter ("created-styles", "CSS Style Creations");
+      matched_styles_counter = gdk_profiler_define_int_counter ("matched-styles", "CSS Styles Matched in Parallel");
     }
 }
 
@@ -934,7 +1021,9 @@ gtk_css_node_propagate_pending_changes (GtkCssNode *cssnode,
        child = gtk_css_node_get_next_sibling (child))
     {
       child_change = child->pending_changes;
+      propagating_changes = TRUE;
       gtk_css_node_invalidate (child, change);
+      propagating_changes = FALSE;
       if (child->visible)
         change |= _gtk_css_change_for_sibling (child_change);
     }
@@ -1291,6 +1380,17 @@ gtk_css_node_invalidate (GtkCssNode   *cssnode,
   if (change == 0)
     return;
 
+  /* Anything but propagating the changes we predicted while validating
+   * can change the tree under the matches */
+  if (!propagating_changes &&
+      (change & ~(GTK_CSS_CHANGE_TIMESTAMP | GTK_CSS_CHANGE_ANIMATIONS)))
+    {
+      GtkCssNodeMatches *matches;
+
+      for (matches = current_matches; matches; matches = matches->outer)
+        matches->stale = TRUE;
+    }
+
   cssnode->pending_changes |= change;
 
   if (cssnode->parent)
@@ -1298,6 +1398,154 @@ gtk_css_node_invalidate (GtkCssNode   *cssnode,
   gtk_css_node_invalidate_style (cssnode);
 }
 
+static void
+gtk_css_node_match_task (gpointer data,
+                         guint    index,
+                         guint    n_tasks)
+{
+  GtkCssNodeMatches *matches = data;
+  guint i, start, end;
+
+  start = index * matches->nodes_per_task;
+  end = MIN (start + matches->nodes_per_task, matches->nodes->len);
+
+  for (i = start; i < end; i++)
+    {
+      GtkCountingBloomFilter filter = GTK_COUNTING_BLOOM_FILTER_INIT;
+      GtkCssNode *node = g_ptr_array_index (matches->nodes, i);
+      GtkCssNode *ancestor;
+
+      for (ancestor = node->parent; ancestor; ancestor = ancestor->parent)
+        gtk_css_node_declaration_add_bloom_hashes (ancestor->decl, &filter);
+
+      matches->matches[i] = gtk_css_static_style_match (matches->providers[i], &filter, node);
+    }
+}
+
+/* Returns the number of tasks to split matching into, 1 if it
+ * isn't done in parallel */
+static guint
+gtk_css_node_get_n_match_tasks (void)
+{
+  static gsize n_tasks;
+
+  if (g_once_init_enter (&n_tasks))
+    {
+      guint max_tasks = gdk_parallel_task_get_max_tasks ();
+      const char *threads;
+      int n_threads = 1;
+
+      threads = g_getenv ("GTK_CSS_THREADS");
+      if (threads)
+        n_threads = atoi (threads);
+
+      if (n_threads < 0 || (guint) n_threads > max_tasks)
+        n_threads = max_tasks;
+
+      g_once_init_leave (&n_tasks, MAX (n_threads, 1));
+    }
+
+  return n_tasks;
+}
+
+/* Collects the nodes that gtk_css_node_validate_internal() will most
+ * likely create new styles for. This follows what
+ * gtk_css_node_ensure_style() and gtk_css_node_propagate_pending_changes()
+ * do, assuming that every new style differs from the old one. Getting it
+ * wrong only means matching nodes twice or not in parallel.
+ */
+static void
+gtk_css_node_collect_matches (GPtrArray    *nodes,
+                              GtkCssNode   *cssnode,
+                              GtkCssChange  change)
+{
+  GtkCssChange child_change;
+  GtkCssNode *child;
+
+  change |= cssnode->pending_changes;
+
+  if (!cssnode->invalid && change == 0)
+    return;
+
+  child_change = _gtk_css_change_for_child (change);
+
+  if (change != 0 &&
+      gtk_css_style_needs_recreation (GTK_CSS_STYLE (gtk_css_style_get_static_style (cssnode->style)), change))
+    {
+      g_ptr_array_add (nodes, g_object_ref (cssnode));
+      child_change |= GTK_CSS_CHANGE_PARENT_STYLE;
+    }
+
+  for (child = gtk_css_node_get_first_child (cssnode);
+       child;
+       child = gtk_css_node_get_next_sibling (child))
+    {
+      if (!child->visible)
+        continue;
+
+      gtk_css_node_collect_matches (nodes, child, child_change);
+      child_change |= _gtk_css_change_for_sibling (child->pending_changes);
+    }
+}
+
+static GtkCssNodeMatches *
+gtk_css_node_matches_new (GtkCssNode *cssnode)
+{
+  GtkCssNodeMatches *matches;
+  GPtrArray *nodes;
+  guint n_tasks, i;
+
+  n_tasks = gtk_css_node_get_n_match_tasks ();
+  if (n_tasks < 2)
+    return NULL;
+
+  nodes = g_ptr_array_new_with_free_func (g_object_unref);
+  gtk_css_node_collect_matches (nodes, cssnode, 0);
+  if (nodes->len < MIN_PARALLEL_NODES)
+    {
+      g_ptr_array_unref (nodes);
+      return NULL;
+    }
+
+  matches = g_slice_new0 (GtkCssNodeMatches);
+  matches->nodes = nodes;
+  matches->providers = g_new (GtkStyleProvider *, nodes->len);
+  matches->matches = g_new0 (GtkCssStaticStyleMatch *, nodes->len);
+  matches->indexes = g_hash_table_new (NULL, NULL);
+
+  /* The array keeps the nodes alive, so the addresses in the hash
+   * table stay valid */
+  for (i = 0; i < nodes->len; i++)
+    {
+      GtkCssNode *node = g_ptr_array_index (nodes, i);
+
+      matches->providers[i] = gtk_css_node_get_style_provider (node);
+      g_hash_table_insert (matches->indexes, node, GUINT_TO_POINTER (i + 1));
+    }
+
+  matches->nodes_per_task = (nodes->len + n_tasks - 1) / n_tasks;
+  n_tasks = (nodes->len + matches->nodes_per_task - 1) / matches->nodes_per_task;
+
+  gdk_parallel_task_run (gtk_css_node_match_task, matches, n_tasks);
+
+  return matches;
+}
+
+static void
+gtk_css_node_matches_free (GtkCssNodeMatches *matches)
+{
+  guint i;
+
+  for (i = 0; i < matches->nodes->len; i++)
+    gtk_css_static_style_match_free (matches->matches[i]);
+
+  g_free (matches->matches);
+  g_free (matches->providers);
+  g_hash_table_unref (matches->indexes);
+  g_ptr_array_unref (matches->nodes);
+  g_slice_free (GtkCssNodeMatches, matches);
+}
+
 static void
 gtk_css_node_validate_internal (GtkCssNode             *cssnode,
                                 GtkCountingBloomFilter *filter,
@@ -1342,6 +1590,7 @@ void
 gtk_css_node_validate (GtkCssNode *cssnode)
 {
   GtkCountingBloomFilter filter = GTK_COUNTING_BLOOM_FILTER_INIT;
+  GtkCssNodeMatches *matches;
   gint64 timestamp;
   gint64 before = g_get_monotonic_time ();
 
@@ -1349,16 +1598,51 @@ gtk_css_node_validate (GtkCssNode *cssnode)
 
   timestamp = gtk_css_node_get_timestamp (cssnode);
 
+  matches = gtk_css_node_matches_new (cssnode);
+  if (matches)
+    {
+      matches->outer = current_matches;
+      current_matches = matches;
+    }
+
   gtk_css_node_validate_internal (cssnode, &filter, timestamp);
 
+  if (matches)
+    {
+      current_matches = matches->outer;
+      gtk_css_node_matches_free (matches);
+    }
+
+#ifdef G_ENABLE_DEBUG
+  if (GTK_DEBUG_CHECK (CSS))
+    {
+      guint tested, filtered, matched;
+      guint values_interned, values_shared, groups_interned, groups_shared;
+      gsize groups_saved;
+
+      _gtk_css_selector_tree_take_statistics (&tested, &filtered, &matched);
+      if (tested > 0)
+        g_message ("css validation: %u selectors tested, %u skipped by the bloom filter, %u rules matched",
+                   tested, filtered, matched);
+
+      gtk_css_value_take_intern_statistics (&values_interned, &values_shared);
+      gtk_css_values_take_intern_statistics (&groups_interned, &groups_shared, &groups_saved);
+      if (values_shared > 0 || groups_shared > 0)
+        g_message ("css validation: %u values shared, %u interned; %u value groups shared (%" G_GSIZE_FORMAT " bytes), %u interned",
+                   values_shared, values_interned, groups_shared, groups_saved, groups_interned);
+    }
+#endif
+
   if (GDK_PROFILER_IS_RUNNING)
     {
       gint64 after = g_get_monotonic_time ();
       gdk_profiler_add_mark (before, (after - before), "css validation", "");
       gdk_profiler_set_int_counter (invalidated_nodes_counter, after, invalidated_nodes);
       gdk_profiler_set_int_counter (created_styles_counter, after, created_styles);
+      gdk_profiler_set_int_counter (matched_styles_counter, after, matched_styles);
       invalidated_nodes = 0;
       created_styles = 0;
+      matched_styles = 0;
     }
 }
 
@@ -94,8 +94,10 @@ struct _GtkCssNodeClass
 
 GType                   gtk_css_node_get_type           (void) G_GNUC_CONST;
 
+GDK_AVAILABLE_IN_ALL
 GtkCssNode *            gtk_css_node_new                (void);
 
+GDK_AVAILABLE_IN_ALL
 void                    gtk_css_node_set_parent         (GtkCssNode            *cssnode,
                                                          GtkCssNode            *parent);
 void                    gtk_css_node_insert_after       (GtkCssNode            *parent,
@@ -127,6 +129,7 @@ GtkStateFlags           gtk_css_node_get_state          (GtkCssNode            *
 void                    gtk_css_node_set_classes        (GtkCssNode            *cssnode,
                                                          const char           **classes);
 char **                 gtk_css_node_get_classes        (GtkCssNode            *cssnode);
+GDK_AVAILABLE_IN_ALL
 void                    gtk_css_node_add_class          (GtkCssNode            *cssnode,
                                                          GQuark                 style_class);
 void                    gtk_css_node_remove_class       (GtkCssNode            *cssnode,
@@ -138,6 +141,7 @@ const GQuark *          gtk_css_node_list_classes       (GtkCssNode            *
 
 const GtkCssNodeDeclaration *
                         gtk_css_node_get_declaration    (GtkCssNode            *cssnode) G_GNUC_PURE;
+GDK_AVAILABLE_IN_ALL
 GtkCssStyle *           gtk_css_node_get_style          (GtkCssNode            *cssnode) G_GNUC_PURE;
 
 
@@ -148,6 +152,7 @@ void                    gtk_css_node_invalidate_frame_clock
                                                          gboolean               just_timestamp);
 void                    gtk_css_node_invalidate         (GtkCssNode            *cssnode,
                                                          GtkCssChange           change);
+GDK_AVAILABLE_IN_ALL
 void                    gtk_css_node_validate           (GtkCssNode            *cssnode);
 
 GtkStyleProvider *      gtk_css_node_get_style_provider (GtkCssNode            *cssnode) G_GNUC_PURE;
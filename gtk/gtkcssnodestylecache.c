@@ -20,7 +20,9 @@
 #include "gtkcssnodestylecacheprivate.h"
 
 #include "gtkdebug.h"
+#include "gtkcssnodeprivate.h"
 #include "gtkcssstaticstyleprivate.h"
+#include "gtkstyleproviderprivate.h"
 
 struct _GtkCssNodeStyleCache {
   guint        ref_count;
@@ -180,3 +182,278 @@ gtk_css_node_style_cache_lookup (GtkCssNodeStyleCache        *parent,
   return gtk_css_node_style_cache_ref (result);
 }
 
+
+/* The shared style cache
+ *
+ * The caches above only share styles between children of the same
+ * parent. The shared cache also shares them between nodes in different
+ * places of the tree, like identical rows in different lists.
+ *
+ * Styles are keyed by the provider, the parent's style, the declarations
+ * of the node and all its ancestors, and whether the node is the first or
+ * last child. Styles that depend on the position of an ancestor or on the
+ * siblings of an ancestor are not shared. All styles are dropped when any
+ * style provider changes.
+ */
+
+#define MAX_SHARED_STYLES 1024
+
+typedef struct _GtkCssSharedStyle GtkCssSharedStyle;
+
+struct _GtkCssSharedStyle {
+  GtkStyleProvider       *provider;
+  GtkCssStyle            *parent_style;
+  guint                   flags;
+  guint                   hash;
+  /* Either the node we look up, or the declarations of the
+   * node and all its ancestors */
+  GtkCssNode             *node;
+  guint                   n_decls;
+  GtkCssNodeDeclaration **decls;
+
+  GtkCssStyle            *style;
+  GList                   link;
+};
+
+static GHashTable *shared_styles;
+static GQueue shared_styles_lru = G_QUEUE_INIT;
+static guint shared_styles_generation;
+static guint shared_styles_hits;
+static guint shared_styles_misses;
+
+static guint
+gtk_css_shared_style_hash (gconstpointer item)
+{
+  const GtkCssSharedStyle *shared = item;
+
+  return shared->hash;
+}
+
+static guint
+gtk_css_shared_style_compute_hash (GtkStyleProvider            *provider,
+                                   GtkCssStyle                 *parent_style,
+                                   const GtkCssNodeDeclaration *decl,
+                                   guint                        flags)
+{
+  return (gtk_css_node_declaration_hash (decl) << 2 | flags)
+         ^ g_direct_hash (parent_style)
+         ^ g_direct_hash (provider);
+}
+
+static gboolean
+gtk_css_shared_style_equal_node (const GtkCssSharedStyle *shared,
+                                 GtkCssNode              *node)
+{
+  guint i;
+
+  for (i = 0; i < shared->n_decls; i++)
+    {
+      if (node == NULL ||
+          !gtk_css_node_declaration_equal (shared->decls[i], gtk_css_node_get_declaration (node)))
+        return FALSE;
+
+      node = gtk_css_node_get_parent (node);
+    }
+
+  return node == NULL;
+}
+
+static gboolean
+gtk_css_shared_style_equal (gconstpointer item1,
+                            gconstpointer item2)
+{
+  const GtkCssSharedStyle *shared1 = item1;
+  const GtkCssSharedStyle *shared2 = item2;
+  guint i;
+
+  if (shared1->provider != shared2->provider ||
+      shared1->parent_style != shared2->parent_style ||
+      shared1->flags != shared2->flags)
+    return FALSE;
+
+  if (shared1->node)
+    return gtk_css_shared_style_equal_node (shared2, shared1->node);
+  if (shared2->node)
+    return gtk_css_shared_style_equal_node (shared1, shared2->node);
+
+  if (shared1->n_decls != shared2->n_decls)
+    return FALSE;
+
+  for (i = 0; i < shared1->n_decls; i++)
+    {
+      if (!gtk_css_node_declaration_equal (shared1->decls[i], shared2->decls[i]))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+gtk_css_shared_style_free (gpointer item)
+{
+  GtkCssSharedStyle *shared = item;
+  guint i;
+
+  g_queue_unlink (&shared_styles_lru, &shared->link);
+
+  for (i = 0; i < shared->n_decls; i++)
+    gtk_css_node_declaration_unref (shared->decls[i]);
+  g_free (shared->decls);
+  g_object_unref (shared->parent_style);
+  g_object_unref (shared->style);
+
+  g_slice_free (GtkCssSharedStyle, shared);
+}
+
+static gboolean
+may_be_shared (GtkCssNode  *node,
+               GtkCssStyle *style)
+{
+  GtkCssNode *parent;
+
+  if (!may_be_stored_in_cache (style))
+    return FALSE;
+
+  /* Nodes with the same declarations and the same parent style can
+   * still differ in the positions and siblings of their ancestors */
+  if (gtk_css_static_style_get_change (GTK_CSS_STATIC_STYLE (style)) &
+      (GTK_CSS_CHANGE_PARENT_FIRST_CHILD | GTK_CSS_CHANGE_PARENT_LAST_CHILD |
+       GTK_CSS_CHANGE_PARENT_NTH_CHILD | GTK_CSS_CHANGE_PARENT_NTH_LAST_CHILD |
+       GTK_CSS_CHANGE_ANY_PARENT_SIBLING))
+    return FALSE;
+
+  /* Animated parent styles change every frame, so nothing would ever
+   * be found */
+  parent = gtk_css_node_get_parent (node);
+  if (parent == NULL ||
+      !gtk_css_style_is_static (gtk_css_node_get_style (parent)))
+    return FALSE;
+
+  return TRUE;
+}
+
+static void
+gtk_css_shared_styles_check_generation (void)
+{
+  if (shared_styles_generation == gtk_style_provider_get_generation ())
+    return;
+
+  if (shared_styles)
+    g_hash_table_remove_all (shared_styles);
+
+  shared_styles_generation = gtk_style_provider_get_generation ();
+}
+
+GtkCssStyle *
+gtk_css_node_style_cache_lookup_shared (GtkCssNode       *node,
+                                        GtkStyleProvider *provider,
+                                        gboolean          is_first,
+                                        gboolean          is_last)
+{
+  GtkCssSharedStyle key, *shared;
+  GtkCssNode *parent;
+
+  parent = gtk_css_node_get_parent (node);
+  if (parent == NULL ||
+      !gtk_css_style_is_static (gtk_css_node_get_style (parent)))
+    return NULL;
+
+  if (shared_styles == NULL)
+    {
+      shared_styles_misses++;
+      return NULL;
+    }
+
+  gtk_css_shared_styles_check_generation ();
+
+  key.provider = provider;
+  key.parent_style = gtk_css_node_get_style (parent);
+  key.flags = (is_first ? 0x2 : 0) | (is_last ? 0x1 : 0);
+  key.hash = gtk_css_shared_style_compute_hash (provider,
+                                                key.parent_style,
+                                                gtk_css_node_get_declaration (node),
+                                                key.flags);
+  key.node = node;
+  key.n_decls = 0;
+  key.decls = NULL;
+
+  shared = g_hash_table_lookup (shared_styles, &key);
+  if (shared == NULL)
+    {
+      shared_styles_misses++;
+      return NULL;
+    }
+
+  shared_styles_hits++;
+
+  g_queue_unlink (&shared_styles_lru, &shared->link);
+  g_queue_push_head_link (&shared_styles_lru, &shared->link);
+
+  return shared->style;
+}
+
+void
+gtk_css_node_style_cache_insert_shared (GtkCssNode       *node,
+                                        GtkStyleProvider *provider,
+                                        gboolean          is_first,
+                                        gboolean          is_last,
+                                        GtkCssStyle      *style)
+{
+  GtkCssSharedStyle *shared;
+  GtkCssNode *iter;
+  guint i;
+
+  if (!may_be_shared (node, style))
+    return;
+
+  if (shared_styles == NULL)
+    shared_styles = g_hash_table_new_full (gtk_css_shared_style_hash,
+                                           gtk_css_shared_style_equal,
+                                           gtk_css_shared_style_free,
+                                           NULL);
+
+  gtk_css_shared_styles_check_generation ();
+
+  shared = g_slice_new0 (GtkCssSharedStyle);
+  shared->provider = provider;
+  shared->parent_style = g_object_ref (gtk_css_node_get_style (gtk_css_node_get_parent (node)));
+  shared->flags = (is_first ? 0x2 : 0) | (is_last ? 0x1 : 0);
+  shared->hash = gtk_css_shared_style_compute_hash (provider,
+                                                    shared->parent_style,
+                                                    gtk_css_node_get_declaration (node),
+                                                    shared->flags);
+
+  for (iter = node; iter; iter = gtk_css_node_get_parent (iter))
+    shared->n_decls++;
+  shared->decls = g_new (GtkCssNodeDeclaration *, shared->n_decls);
+  for (iter = node, i = 0; iter; iter = gtk_css_node_get_parent (iter), i++)
+    shared->decls[i] = gtk_css_node_declaration_ref ((GtkCssNodeDeclaration *) gtk_css_node_get_declaration (iter));
+
+  shared->style = g_object_ref (style);
+  shared->link.data = shared;
+
+  /* Replaces (and frees) an equal entry */
+  g_hash_table_add (shared_styles, shared);
+  g_queue_push_head_link (&shared_styles_lru, &shared->link);
+
+  while (shared_styles_lru.length > MAX_SHARED_STYLES)
+    g_hash_table_remove (shared_styles, g_queue_peek_tail (&shared_styles_lru));
+}
+
+/**
+ * gtk_css_node_style_cache_get_statistics:
+ * @n_styles: (out): return location for the number of cached styles
+ * @hits: (out): return location for the number of lookups that found a style
+ * @misses: (out): return location for the number of lookups that did not
+ *
+ * Gets statistics about the shared style cache, for the inspector.
+ */
+void
+gtk_css_node_style_cache_get_statistics (guint *n_styles,
+                                         guint *hits,
+                                         guint *misses)
+{
+  *n_styles = shared_styles_lru.length;
+  *hits = shared_styles_hits;
+  *misses = shared_styles_misses;
+}
@@ -41,6 +41,19 @@ GtkCssNodeStyleCache *  gtk_css_node_style_cache_lookup         (GtkCssNodeStyle
                                                                  gboolean                     is_first,
                                                                  gboolean                     is_last);
 
+GtkCssStyle *           gtk_css_node_style_cache_lookup_shared  (GtkCssNode             *node,
+                                                                 GtkStyleProvider       *provider,
+                                                                 gboolean                is_first,
+                                                                 gboolean                is_last);
+void                    gtk_css_node_style_cache_insert_shared  (GtkCssNode             *node,
+                                                                 GtkStyleProvider       *provider,
+                                                                 gboolean                is_first,
+                                                                 gboolean                is_last,
+                                                                 GtkCssStyle            *style);
+void                    gtk_css_node_style_cache_get_statistics (guint                  *n_styles,
+                                                                 guint                  *hits,
+                                                                 guint                  *misses);
+
 G_END_DECLS
 
 #endif /* __GTK_CSS_NODE_STYLE_CACHE_PRIVATE_H__ */
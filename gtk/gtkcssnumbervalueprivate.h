@@ -71,6 +71,7 @@ GtkCssValue *   gtk_css_number_value_try_add        (GtkCssValue            *val
                                                      GtkCssValue            *value2);
 gint            gtk_css_number_value_get_calc_term_order (const GtkCssValue *value);
 
+GDK_AVAILABLE_IN_ALL
 double          _gtk_css_number_value_get           (const GtkCssValue      *number,
                                                      double                  one_hundred_percent) G_GNUC_PURE;
 
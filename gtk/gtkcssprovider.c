@@ -26,6 +26,7 @@
 #include "gtkcssparserprivate.h"
 #include "gtkcssselectorprivate.h"
 #include "gtkcssshorthandpropertyprivate.h"
+#include "gtkdebug.h"
 #include "gtksettingsprivate.h"
 #include "gtkstyleprovider.h"
 #include "gtkstylecontextprivate.h"
@@ -85,6 +86,7 @@ struct _GtkCssProviderClass
 
 typedef struct GtkCssRuleset GtkCssRuleset;
 typedef struct _GtkCssScanner GtkCssScanner;
+typedef struct _GtkCssProviderCompile GtkCssProviderCompile;
 typedef struct _PropertyValue PropertyValue;
 typedef enum ParserScope ParserScope;
 typedef enum ParserSymbol ParserSymbol;
@@ -109,6 +111,8 @@ struct _GtkCssScanner
   GtkCssProvider *provider;
   GtkCssParser *parser;
   GtkCssScanner *parent;
+  GBytes *bytes;
+  guint source;
 };
 
 struct _GtkCssProviderPrivate
@@ -122,6 +126,9 @@ struct _GtkCssProviderPrivate
   GtkCssSelectorTree *tree;
   GResource *resource;
   gchar *path;
+
+  /* only set while loading a file that can be cached */
+  GtkCssProviderCompile *compile;
 };
 
 enum {
@@ -303,6 +310,7 @@ gtk_css_scanner_destroy (GtkCssScanner *scanner)
 {
   g_object_unref (scanner->provider);
   gtk_css_parser_unref (scanner->parser);
+  g_bytes_unref (scanner->bytes);
 
   g_slice_free (GtkCssScanner, scanner);
 }
@@ -323,8 +331,12 @@ gtk_css_scanner_parser_error (GtkCssParser         *parser,
                               gpointer              user_data)
 {
   GtkCssScanner *scanner = user_data;
+  GtkCssProviderPrivate *priv = gtk_css_provider_get_instance_private (scanner->provider);
   GtkCssSection *section;
 
+  if (priv->compile)
+    priv->compile->n_errors++;
+
   section = gtk_css_section_new (gtk_css_parser_get_file (parser),
                                  start,
                                  end);
@@ -347,6 +359,7 @@ gtk_css_scanner_new (GtkCssProvider *provider,
   g_object_ref (provider);
   scanner->provider = provider;
   scanner->parent = parent;
+  scanner->bytes = g_bytes_ref (bytes);
 
   scanner->parser = gtk_css_parser_new_for_bytes (bytes,
                                                   file,
@@ -374,6 +387,247 @@ gtk_css_scanner_would_recurse (GtkCssScanner *scanner,
   return FALSE;
 }
 
+/* Compiled style sheets
+ *
+ * Loading a file parses it, sorts the rulesets and builds the selector
+ * tree. To skip all of that on the next start, we write the result to
+ * the user's cache directory and use it as long as the checksums of the
+ * file and its imports still match.
+ *
+ * GtkCssValue has no serialized form, so we remember the text each value
+ * was parsed from and parse it again when loading the cache. Identical
+ * declarations are only stored and parsed once, and all declarations of
+ * a file are parsed with a single parser.
+ *
+ * Values are recorded per property, as different properties often share
+ * the same value, like the initial value or a zero length. Every style
+ * stores the id of its property next to the declaration of its value.
+ */
+
+#define GTK_CSS_CACHE_FORMAT "(sa(sss)a(us)a(sus)a(sus)aa(uui)auasay)"
+#define GTK_CSS_CACHE_VERSION 3
+
+typedef struct {
+  guint source;
+  GtkStyleProperty *property;
+} CompiledDeclaration;
+
+typedef struct {
+  GtkCssStyleProperty *property;
+  GtkCssValue *value;
+  guint declaration;
+  int subproperty;
+} CompiledValue;
+
+typedef struct {
+  guint source;
+  char *text;
+} CompiledText;
+
+struct _GtkCssProviderCompile
+{
+  GPtrArray *files;                     /* GFile of every loaded file */
+  GPtrArray *checksums;                 /* SHA-256 of every loaded file */
+  GPtrArray *texts;                     /* GString of declarations per file */
+  GArray *declarations;                 /* CompiledDeclaration */
+  GHashTable *declaration_indexes;      /* "source property text" => index + 1 */
+  GHashTable *values;                   /* set of CompiledValue, by property and value */
+  GHashTable *colors;                   /* name => CompiledText */
+  GHashTable *keyframes;                /* name => CompiledText */
+  guint n_errors;
+};
+
+static guint
+compiled_value_hash (gconstpointer data)
+{
+  const CompiledValue *value = data;
+
+  return g_direct_hash (value->property) ^ g_direct_hash (value->value);
+}
+
+static gboolean
+compiled_value_equal (gconstpointer data1,
+                      gconstpointer data2)
+{
+  const CompiledValue *value1 = data1;
+  const CompiledValue *value2 = data2;
+
+  return value1->property == value2->property &&
+         value1->value == value2->value;
+}
+
+static void
+compiled_value_free (gpointer data)
+{
+  CompiledValue *value = data;
+
+  _gtk_css_value_unref (value->value);
+  g_slice_free (CompiledValue, value);
+}
+
+static void
+compiled_text_free (gpointer data)
+{
+  CompiledText *text = data;
+
+  g_free (text->text);
+  g_slice_free (CompiledText, text);
+}
+
+static void
+free_string (gpointer data)
+{
+  g_string_free (data, TRUE);
+}
+
+static GtkCssProviderCompile *
+gtk_css_provider_compile_new (void)
+{
+  GtkCssProviderCompile *compile;
+
+  compile = g_slice_new0 (GtkCssProviderCompile);
+  compile->files = g_ptr_array_new_with_free_func (g_object_unref);
+  compile->checksums = g_ptr_array_new_with_free_func (g_free);
+  compile->texts = g_ptr_array_new_with_free_func (free_string);
+  compile->declarations = g_array_new (FALSE, FALSE, sizeof (CompiledDeclaration));
+  compile->declaration_indexes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  compile->values = g_hash_table_new_full (compiled_value_hash, compiled_value_equal, compiled_value_free, NULL);
+  compile->colors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, compiled_text_free);
+  compile->keyframes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, compiled_text_free);
+
+  return compile;
+}
+
+static void
+gtk_css_provider_compile_free (GtkCssProviderCompile *compile)
+{
+  g_ptr_array_unref (compile->files);
+  g_ptr_array_unref (compile->checksums);
+  g_ptr_array_unref (compile->texts);
+  g_array_unref (compile->declarations);
+  g_hash_table_unref (compile->declaration_indexes);
+  g_hash_table_unref (compile->values);
+  g_hash_table_unref (compile->colors);
+  g_hash_table_unref (compile->keyframes);
+
+  g_slice_free (GtkCssProviderCompile, compile);
+}
+
+static guint
+gtk_css_provider_compile_add_source (GtkCssProviderCompile *compile,
+                                     GFile                 *file,
+                                     GBytes                *bytes)
+{
+  g_ptr_array_add (compile->files, g_object_ref (file));
+  g_ptr_array_add (compile->checksums, g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, bytes));
+  g_ptr_array_add (compile->texts, g_string_new (NULL));
+
+  return compile->files->len - 1;
+}
+
+/* Returns the text from @start up to the current token */
+static char *
+gtk_css_scanner_get_text (GtkCssScanner *scanner,
+                          gsize          start)
+{
+  const char *data;
+  gsize size, end;
+
+  data = g_bytes_get_data (scanner->bytes, &size);
+  end = gtk_css_parser_get_start_location (scanner->parser)->bytes;
+  end = CLAMP (end, start, size);
+
+  return g_strndup (data + start, end - start);
+}
+
+static void
+gtk_css_provider_compile_add_value (GtkCssProviderCompile *compile,
+                                    GtkCssStyleProperty   *property,
+                                    GtkCssValue           *value,
+                                    guint                  declaration,
+                                    int                    subproperty)
+{
+  CompiledValue key = { property, value, };
+  CompiledValue *compiled;
+
+  /* Parsing the same text again gives an equal value, so it is fine
+   * if a value was already recorded from a different declaration.
+   */
+  if (g_hash_table_contains (compile->values, &key))
+    return;
+
+  compiled = g_slice_new (CompiledValue);
+  compiled->property = property;
+  compiled->value = _gtk_css_value_ref (value);
+  compiled->declaration = declaration;
+  compiled->subproperty = subproperty;
+  g_hash_table_add (compile->values, compiled);
+}
+
+static void
+gtk_css_scanner_record_value (GtkCssScanner    *scanner,
+                              GtkStyleProperty *property,
+                              gsize             start,
+                              GtkCssValue      *value)
+{
+  GtkCssProviderPrivate *priv = gtk_css_provider_get_instance_private (scanner->provider);
+  GtkCssProviderCompile *compile = priv->compile;
+  char *text, *key;
+  guint index;
+
+  text = gtk_css_scanner_get_text (scanner, start);
+  key = g_strdup_printf ("%u %s %s", scanner->source, _gtk_style_property_get_name (property), text);
+  index = GPOINTER_TO_UINT (g_hash_table_lookup (compile->declaration_indexes, key));
+  if (index == 0)
+    {
+      CompiledDeclaration declaration = { scanner->source, property };
+      GString *string = g_ptr_array_index (compile->texts, scanner->source);
+
+      g_string_append (string, text);
+      g_string_append_c (string, ';');
+      g_array_append_val (compile->declarations, declaration);
+      index = compile->declarations->len;
+      g_hash_table_insert (compile->declaration_indexes, key, GUINT_TO_POINTER (index));
+    }
+  else
+    g_free (key);
+  g_free (text);
+
+  if (GTK_IS_CSS_SHORTHAND_PROPERTY (property))
+    {
+      GtkCssShorthandProperty *shorthand = GTK_CSS_SHORTHAND_PROPERTY (property);
+      guint i;
+
+      for (i = 0; i < _gtk_css_shorthand_property_get_n_subproperties (shorthand); i++)
+        gtk_css_provider_compile_add_value (compile,
+                                            _gtk_css_shorthand_property_get_subproperty (shorthand, i),
+                                            _gtk_css_array_value_get_nth (value, i),
+                                            index - 1, i);
+    }
+  else
+    {
+      gtk_css_provider_compile_add_value (compile,
+                                          GTK_CSS_STYLE_PROPERTY (property),
+                                          value,
+                                          index - 1, -1);
+    }
+}
+
+static void
+gtk_css_scanner_record_text (GtkCssScanner *scanner,
+                             GHashTable    *table,
+                             const char    *name,
+                             gsize          start)
+{
+  CompiledText *text;
+
+  text = g_slice_new (CompiledText);
+  text->source = scanner->source;
+  text->text = gtk_css_scanner_get_text (scanner, start);
+
+  g_hash_table_insert (table, g_strdup (name), text);
+}
+
 static void
 gtk_css_provider_init (GtkCssProvider *css_provider)
 {
@@ -678,6 +932,7 @@ parse_color_definition (GtkCssScanner *scanner)
   GtkCssProviderPrivate *priv = gtk_css_provider_get_instance_private (scanner->provider);
   GtkCssValue *color;
   char *name;
+  gsize start;
 
   if (!gtk_css_parser_try_at_keyword (scanner->parser, "define-color"))
     return FALSE;
@@ -686,6 +941,9 @@ parse_color_definition (GtkCssScanner *scanner)
   if (name == NULL)
     return TRUE;
 
+  gtk_css_parser_get_token (scanner->parser);
+  start = gtk_css_parser_get_start_location (scanner->parser)->bytes;
+
   color = _gtk_css_color_value_parse (scanner->parser);
   if (color == NULL)
     {
@@ -702,6 +960,9 @@ parse_color_definition (GtkCssScanner *scanner)
       return TRUE;
     }
 
+  if (priv->compile)
+    gtk_css_scanner_record_text (scanner, priv->compile->colors, name, start);
+
   g_hash_table_insert (priv->symbolic_colors, name, color);
 
   return TRUE;
@@ -713,6 +974,7 @@ parse_keyframes (GtkCssScanner *scanner)
   GtkCssProviderPrivate *priv = gtk_css_provider_get_instance_private (scanner->provider);
   GtkCssKeyframes *keyframes;
   char *name;
+  gsize start;
 
   if (!gtk_css_parser_try_at_keyword (scanner->parser, "keyframes"))
     return FALSE;
@@ -729,9 +991,16 @@ parse_keyframes (GtkCssScanner *scanner)
 
   gtk_css_parser_end_block_prelude (scanner->parser);
 
+  gtk_css_parser_get_token (scanner->parser);
+  start = gtk_css_parser_get_start_location (scanner->parser)->bytes;
+
   keyframes = _gtk_css_keyframes_parse (scanner->parser);
   if (keyframes != NULL)
-    g_hash_table_insert (priv->keyframes, name, keyframes);
+    {
+      if (priv->compile)
+        gtk_css_scanner_record_text (scanner, priv->compile->keyframes, name, start);
+      g_hash_table_insert (priv->keyframes, name, keyframes);
+    }
 
   if (!gtk_css_parser_has_token (scanner->parser, GTK_CSS_TOKEN_EOF))
     gtk_css_parser_error_syntax (scanner->parser, "Expected '}' after declarations");
@@ -811,8 +1080,10 @@ parse_declaration (GtkCssScanner *scanner,
 
   if (property)
     {
+      GtkCssProviderPrivate *priv = gtk_css_provider_get_instance_private (scanner->provider);
       GtkCssSection *section;
       GtkCssValue *value;
+      gsize start;
 
       if (!gtk_css_parser_try_token (scanner->parser, GTK_CSS_TOKEN_COLON))
         {
@@ -822,6 +1093,9 @@ parse_declaration (GtkCssScanner *scanner,
           return;
         }
 
+      gtk_css_parser_get_token (scanner->parser);
+      start = gtk_css_parser_get_start_location (scanner->parser)->bytes;
+
       value = _gtk_style_property_parse_value (property,
                                                scanner->parser);
 
@@ -838,6 +1112,9 @@ parse_declaration (GtkCssScanner *scanner,
           return;
         }
 
+      if (priv->compile)
+        gtk_css_scanner_record_value (scanner, property, start, value);
+
       if (gtk_keep_css_sections)
         {
           section = gtk_css_section_new (gtk_css_parser_get_file (scanner->parser),
@@ -1013,14 +1290,606 @@ gtk_css_provider_postprocess (GtkCssProvider *css_provider)
     gdk_profiler_end_mark (before, "create selector tree", NULL);
 }
 
+static gboolean
+gtk_css_provider_use_cache (void)
+{
+#ifdef VERIFY_TREE
+  /* The selectors are not cached */
+  return FALSE;
+#endif
+
+  /* Neither are the sections */
+  if (gtk_keep_css_sections)
+    return FALSE;
+
+  if (GTK_DEBUG_CHECK (NO_CSS_CACHE))
+    return FALSE;
+
+  return TRUE;
+}
+
+static char *
+gtk_css_provider_get_cache_path (GFile *file)
+{
+  char *uri, *checksum, *basename, *path;
+
+  uri = g_file_get_uri (file);
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, uri, -1);
+  basename = g_strconcat (checksum, ".cache", NULL);
+  path = g_build_filename (g_get_user_cache_dir (), "gtk-4.0", "css", basename, NULL);
+
+  g_free (basename);
+  g_free (checksum);
+  g_free (uri);
+
+  return path;
+}
+
+static char *
+gtk_css_provider_get_cache_version (void)
+{
+  /* Selector classes and value parsing change between versions,
+   * and the selector tree is stored in host layout.
+   */
+  return g_strdup_printf ("GtkCssProvider %d %d.%d.%d %u %d",
+                          GTK_CSS_CACHE_VERSION,
+                          GTK_MAJOR_VERSION, GTK_MINOR_VERSION, GTK_MICRO_VERSION,
+                          (guint) sizeof (gpointer),
+                          G_BYTE_ORDER);
+}
+
+static void
+gtk_css_provider_add_compiled_texts (GVariantBuilder *builder,
+                                     GHashTable      *table)
+{
+  GHashTableIter iter;
+  gpointer name, value;
+
+  g_variant_builder_open (builder, G_VARIANT_TYPE ("a(sus)"));
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, &name, &value))
+    {
+      CompiledText *text = value;
+
+      g_variant_builder_add (builder, "(sus)", name, text->source, text->text);
+    }
+  g_variant_builder_close (builder);
+}
+
+static void
+gtk_css_provider_save_cache (GtkCssProvider *self,
+                             GFile          *file)
+{
+  GtkCssProviderPrivate *priv = gtk_css_provider_get_instance_private (self);
+  GtkCssProviderCompile *compile = priv->compile;
+  GVariantBuilder builder;
+  GHashTable *style_indexes;
+  GPtrArray *styles, *strings;
+  gpointer *matches;
+  GVariant *variant;
+  GBytes *tree;
+  char *version, *path, *dir;
+  guint i, j;
+
+  style_indexes = g_hash_table_new (NULL, NULL);
+  styles = g_ptr_array_new ();
+  for (i = 0; i < priv->rulesets->len; i++)
+    {
+      GtkCssRuleset *ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, i);
+
+      if (g_hash_table_contains (style_indexes, ruleset->styles))
+        continue;
+
+      for (j = 0; j < ruleset->n_styles; j++)
+        {
+          CompiledValue key = { ruleset->styles[j].property, ruleset->styles[j].value, };
+
+          if (!g_hash_table_contains (compile->values, &key))
+            {
+              g_hash_table_unref (style_indexes);
+              g_ptr_array_unref (styles);
+              return;
+            }
+        }
+
+      g_hash_table_insert (style_indexes, ruleset->styles, GUINT_TO_POINTER (styles->len));
+      g_ptr_array_add (styles, ruleset);
+    }
+
+  matches = g_new (gpointer, priv->rulesets->len);
+  for (i = 0; i < priv->rulesets->len; i++)
+    matches[i] = &g_array_index (priv->rulesets, GtkCssRuleset, i);
+  strings = g_ptr_array_new ();
+  tree = _gtk_css_selector_tree_serialize (priv->tree, matches, priv->rulesets->len, strings);
+  g_free (matches);
+
+  version = gtk_css_provider_get_cache_version ();
+  g_variant_builder_init (&builder, G_VARIANT_TYPE (GTK_CSS_CACHE_FORMAT));
+  g_variant_builder_add (&builder, "s", version);
+  g_free (version);
+
+  g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(sss)"));
+  for (i = 0; i < compile->files->len; i++)
+    {
+      char *uri = g_file_get_uri (g_ptr_array_index (compile->files, i));
+      GString *text = g_ptr_array_index (compile->texts, i);
+
+      g_variant_builder_add (&builder, "(sss)",
+                             uri,
+                             g_ptr_array_index (compile->checksums, i),
+                             text->str);
+      g_free (uri);
+    }
+  g_variant_builder_close (&builder);
+
+  g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(us)"));
+  for (i = 0; i < compile->declarations->len; i++)
+    {
+      CompiledDeclaration *declaration = &g_array_index (compile->declarations, CompiledDeclaration, i);
+
+      g_variant_builder_add (&builder, "(us)",
+                             declaration->source,
+                             _gtk_style_property_get_name (declaration->property));
+    }
+  g_variant_builder_close (&builder);
+
+  gtk_css_provider_add_compiled_texts (&builder, compile->colors);
+  gtk_css_provider_add_compiled_texts (&builder, compile->keyframes);
+
+  g_variant_builder_open (&builder, G_VARIANT_TYPE ("aa(uui)"));
+  for (i = 0; i < styles->len; i++)
+    {
+      GtkCssRuleset *ruleset = g_ptr_array_index (styles, i);
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(uui)"));
+      for (j = 0; j < ruleset->n_styles; j++)
+        {
+          CompiledValue key = { ruleset->styles[j].property, ruleset->styles[j].value, };
+          CompiledValue *value = g_hash_table_lookup (compile->values, &key);
+
+          g_variant_builder_add (&builder, "(uui)",
+                                 _gtk_css_style_property_get_id (value->property),
+                                 value->declaration,
+                                 value->subproperty);
+        }
+      g_variant_builder_close (&builder);
+    }
+  g_variant_builder_close (&builder);
+
+  g_variant_builder_open (&builder, G_VARIANT_TYPE ("au"));
+  for (i = 0; i < priv->rulesets->len; i++)
+    {
+      GtkCssRuleset *ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, i);
+
+      g_variant_builder_add (&builder, "u", GPOINTER_TO_UINT (g_hash_table_lookup (style_indexes, ruleset->styles)));
+    }
+  g_variant_builder_close (&builder);
+
+  g_ptr_array_add (strings, NULL);
+  g_variant_builder_add (&builder, "^as", strings->pdata);
+  g_variant_builder_add_value (&builder,
+                               g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, tree, TRUE));
+
+  variant = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  path = gtk_css_provider_get_cache_path (file);
+  dir = g_path_get_dirname (path);
+  if (g_mkdir_with_parents (dir, 0700) == 0)
+    g_file_set_contents (path, g_variant_get_data (variant), g_variant_get_size (variant), NULL);
+
+  g_free (dir);
+  g_free (path);
+  g_variant_unref (variant);
+  g_bytes_unref (tree);
+  g_ptr_array_unref (strings);
+  g_ptr_array_unref (styles);
+  g_hash_table_unref (style_indexes);
+}
+
+static void
+gtk_css_cache_parser_error (GtkCssParser         *parser,
+                            const GtkCssLocation *start,
+                            const GtkCssLocation *end,
+                            const GError         *error,
+                            gpointer              user_data)
+{
+  gboolean *failed = user_data;
+
+  *failed = TRUE;
+}
+
+static GtkCssParser *
+gtk_css_cache_parser_new (const char *text,
+                          GFile      *file,
+                          gboolean   *failed)
+{
+  GtkCssParser *parser;
+  GBytes *bytes;
+
+  bytes = g_bytes_new_static (text, strlen (text));
+  parser = gtk_css_parser_new_for_bytes (bytes, file, NULL, gtk_css_cache_parser_error, failed, NULL);
+  g_bytes_unref (bytes);
+
+  return parser;
+}
+
+static gboolean
+gtk_css_provider_load_compiled_texts (GtkCssProvider *self,
+                                      GVariant       *texts,
+                                      GFile         **files,
+                                      gsize           n_files,
+                                      gboolean        keyframes)
+{
+  GtkCssProviderPrivate *priv = gtk_css_provider_get_instance_private (self);
+  GVariantIter iter;
+  const char *name, *text;
+  gboolean failed = FALSE;
+  guint source;
+
+  g_variant_iter_init (&iter, texts);
+  while (!failed && g_variant_iter_next (&iter, "(&su&s)", &name, &source, &text))
+    {
+      GtkCssParser *parser;
+
+      if (source >= n_files)
+        return FALSE;
+
+      parser = gtk_css_cache_parser_new (text, files[source], &failed);
+
+      if (keyframes)
+        {
+          GtkCssKeyframes *value = _gtk_css_keyframes_parse (parser);
+
+          if (value)
+            g_hash_table_insert (priv->keyframes, g_strdup (name), value);
+          else
+            failed = TRUE;
+        }
+      else
+        {
+          GtkCssValue *value = _gtk_css_color_value_parse (parser);
+
+          if (value)
+            g_hash_table_insert (priv->symbolic_colors, g_strdup (name), value);
+          else
+            failed = TRUE;
+        }
+
+      if (!gtk_css_parser_has_token (parser, GTK_CSS_TOKEN_EOF))
+        failed = TRUE;
+
+      gtk_css_parser_unref (parser);
+    }
+
+  return !failed;
+}
+
+static GtkCssValue **
+gtk_css_provider_load_compiled_declarations (GVariant          *sources,
+                                             GVariant          *declarations,
+                                             GFile            **files,
+                                             gsize              n_files,
+                                             GtkStyleProperty **properties)
+{
+  GtkCssParser **parsers;
+  GtkCssValue **values;
+  gboolean failed = FALSE;
+  gsize i, n;
+
+  parsers = g_new0 (GtkCssParser *, n_files);
+  for (i = 0; i < n_files; i++)
+    {
+      const char *text;
+
+      g_variant_get_child (sources, i, "(&s&s&s)", NULL, NULL, &text);
+      parsers[i] = gtk_css_cache_parser_new (text, files[i], &failed);
+    }
+
+  n = g_variant_n_children (declarations);
+  values = g_new0 (GtkCssValue *, n);
+  for (i = 0; i < n && !failed; i++)
+    {
+      const char *name;
+      guint source;
+
+      g_variant_get_child (declarations, i, "(u&s)", &source, &name);
+      properties[i] = _gtk_style_property_lookup (name);
+      if (source >= n_files || properties[i] == NULL)
+        {
+          failed = TRUE;
+          break;
+        }
+
+      gtk_css_parser_start_semicolon_block (parsers[source], GTK_CSS_TOKEN_EOF);
+      values[i] = _gtk_style_property_parse_value (properties[i], parsers[source]);
+      if (values[i] == NULL ||
+          !gtk_css_parser_has_token (parsers[source], GTK_CSS_TOKEN_EOF))
+        failed = TRUE;
+      gtk_css_parser_end_block (parsers[source]);
+    }
+
+  for (i = 0; i < n_files; i++)
+    gtk_css_parser_unref (parsers[i]);
+  g_free (parsers);
+
+  if (failed)
+    {
+      for (i = 0; i < n; i++)
+        g_clear_pointer (&values[i], _gtk_css_value_unref);
+      g_free (values);
+      return NULL;
+    }
+
+  return values;
+}
+
+static PropertyValue *
+gtk_css_provider_load_compiled_styles (GVariant          *styles,
+                                       GtkCssValue      **values,
+                                       GtkStyleProperty **properties,
+                                       gsize              n_values)
+{
+  PropertyValue *result;
+  gsize i, n;
+
+  n = g_variant_n_children (styles);
+  result = g_new0 (PropertyValue, n);
+
+  for (i = 0; i < n; i++)
+    {
+      GtkStyleProperty *property;
+      GtkCssValue *value;
+      guint id, declaration;
+      int sub;
+
+      g_variant_get_child (styles, i, "(uui)", &id, &declaration, &sub);
+      if (id >= _gtk_css_style_property_get_n_properties () || declaration >= n_values)
+        goto fail;
+
+      result[i].property = _gtk_css_style_property_lookup_by_id (id);
+      property = properties[declaration];
+      value = values[declaration];
+
+      /* The declaration must be for this property, or for a shorthand
+       * that sets it */
+      if (sub < 0)
+        {
+          if (property != GTK_STYLE_PROPERTY (result[i].property))
+            goto fail;
+
+          result[i].value = _gtk_css_value_ref (value);
+        }
+      else
+        {
+          GtkCssShorthandProperty *shorthand;
+
+          if (!GTK_IS_CSS_SHORTHAND_PROPERTY (property))
+            goto fail;
+
+          shorthand = GTK_CSS_SHORTHAND_PROPERTY (property);
+          if (sub >= _gtk_css_shorthand_property_get_n_subproperties (shorthand) ||
+              _gtk_css_shorthand_property_get_subproperty (shorthand, sub) != result[i].property)
+            goto fail;
+
+          result[i].value = _gtk_css_value_ref (_gtk_css_array_value_get_nth (value, sub));
+        }
+    }
+
+  return result;
+
+fail:
+  for (i = 0; i < n; i++)
+    g_clear_pointer (&result[i].value, _gtk_css_value_unref);
+  g_free (result);
+  return NULL;
+}
+
+static gboolean
+gtk_css_provider_load_cache (GtkCssProvider *self,
+                             GFile          *file)
+{
+  GtkCssProviderPrivate *priv = gtk_css_provider_get_instance_private (self);
+  GMappedFile *mapped;
+  GBytes *bytes;
+  GVariant *variant, *sources, *child, *styles, *rulesets;
+  GtkStyleProperty **properties = NULL;
+  GtkCssValue **values = NULL;
+  PropertyValue **blocks = NULL;
+  GtkCssSelectorTree ***selector_matches;
+  gpointer *matches;
+  GFile **files;
+  const char **strings;
+  char *path, *version;
+  const char *cache_version;
+  gsize i, n_files, n_values = 0, n_blocks, n_rulesets, n_strings;
+  gboolean result = FALSE;
+
+  path = gtk_css_provider_get_cache_path (file);
+  mapped = g_mapped_file_new (path, FALSE, NULL);
+  g_free (path);
+  if (mapped == NULL)
+    return FALSE;
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  g_mapped_file_unref (mapped);
+  variant = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (GTK_CSS_CACHE_FORMAT), bytes, FALSE));
+  g_bytes_unref (bytes);
+
+  version = gtk_css_provider_get_cache_version ();
+  g_variant_get_child (variant, 0, "&s", &cache_version);
+  if (!g_str_equal (version, cache_version))
+    {
+      g_free (version);
+      g_variant_unref (variant);
+      return FALSE;
+    }
+  g_free (version);
+
+  /* Check that none of the files changed */
+  sources = g_variant_get_child_value (variant, 1);
+  n_files = g_variant_n_children (sources);
+  files = g_new0 (GFile *, n_files + 1);
+  for (i = 0; i < n_files; i++)
+    {
+      const char *uri, *checksum;
+      GBytes *contents;
+      char *current;
+
+      g_variant_get_child (sources, i, "(&s&s&s)", &uri, &checksum, NULL);
+      files[i] = g_file_new_for_uri (uri);
+      if (i == 0 && !g_file_equal (files[i], file))
+        goto out;
+
+      contents = g_file_load_bytes (files[i], NULL, NULL, NULL);
+      if (contents == NULL)
+        goto out;
+
+      current = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, contents);
+      g_bytes_unref (contents);
+      if (!g_str_equal (current, checksum))
+        {
+          g_free (current);
+          goto out;
+        }
+      g_free (current);
+    }
+  if (n_files == 0)
+    goto out;
+
+  child = g_variant_get_child_value (variant, 2);
+  n_values = g_variant_n_children (child);
+  properties = g_new0 (GtkStyleProperty *, n_values);
+  values = gtk_css_provider_load_compiled_declarations (sources, child, files, n_files, properties);
+  g_variant_unref (child);
+  if (values == NULL)
+    goto out;
+
+  for (i = 3; i <= 4; i++)
+    {
+      gboolean loaded;
+
+      child = g_variant_get_child_value (variant, i);
+      loaded = gtk_css_provider_load_compiled_texts (self, child, files, n_files, i == 4);
+      g_variant_unref (child);
+      if (!loaded)
+        goto out;
+    }
+
+  styles = g_variant_get_child_value (variant, 5);
+  n_blocks = g_variant_n_children (styles);
+  blocks = g_new0 (PropertyValue *, n_blocks);
+  rulesets = g_variant_get_child_value (variant, 6);
+  n_rulesets = g_variant_n_children (rulesets);
+  g_array_set_size (priv->rulesets, n_rulesets);
+  memset (priv->rulesets->data, 0, n_rulesets * sizeof (GtkCssRuleset));
+
+  for (i = 0; i < n_rulesets; i++)
+    {
+      GtkCssRuleset *ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, i);
+      GVariant *block;
+      guint index;
+
+      g_variant_get_child (rulesets, i, "u", &index);
+      if (index >= n_blocks)
+        break;
+
+      block = g_variant_get_child_value (styles, index);
+      if (blocks[index] == NULL)
+        {
+          blocks[index] = gtk_css_provider_load_compiled_styles (block, values, properties, n_values);
+          if (blocks[index] == NULL)
+            {
+              g_variant_unref (block);
+              break;
+            }
+          ruleset->owns_styles = TRUE;
+        }
+      ruleset->styles = blocks[index];
+      ruleset->n_styles = g_variant_n_children (block);
+      g_variant_unref (block);
+    }
+  g_variant_unref (styles);
+  g_variant_unref (rulesets);
+  if (i < n_rulesets)
+    goto out;
+
+  matches = g_new (gpointer, n_rulesets);
+  selector_matches = g_new (GtkCssSelectorTree **, n_rulesets);
+  for (i = 0; i < n_rulesets; i++)
+    {
+      GtkCssRuleset *ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, i);
+
+      matches[i] = ruleset;
+      selector_matches[i] = &ruleset->selector_match;
+    }
+
+  child = g_variant_get_child_value (variant, 7);
+  strings = g_variant_get_strv (child, &n_strings);
+  g_variant_unref (child);
+  child = g_variant_get_child_value (variant, 8);
+  bytes = g_variant_get_data_as_bytes (child);
+  g_variant_unref (child);
+  result = _gtk_css_selector_tree_deserialize (bytes,
+                                               strings, n_strings,
+                                               matches, selector_matches, n_rulesets,
+                                               &priv->tree);
+  g_bytes_unref (bytes);
+  g_free (strings);
+  g_free (selector_matches);
+  g_free (matches);
+
+out:
+  if (!result)
+    {
+      g_hash_table_remove_all (priv->symbolic_colors);
+      g_hash_table_remove_all (priv->keyframes);
+      for (i = 0; i < priv->rulesets->len; i++)
+        gtk_css_ruleset_clear (&g_array_index (priv->rulesets, GtkCssRuleset, i));
+      g_array_set_size (priv->rulesets, 0);
+    }
+
+  if (values)
+    {
+      for (i = 0; i < n_values; i++)
+        _gtk_css_value_unref (values[i]);
+      g_free (values);
+    }
+  g_free (properties);
+  g_free (blocks);
+  for (i = 0; i < n_files; i++)
+    g_clear_object (&files[i]);
+  g_free (files);
+  g_variant_unref (sources);
+  g_variant_unref (variant);
+
+  return result;
+}
+
 static void
 gtk_css_provider_load_internal (GtkCssProvider *self,
                                 GtkCssScanner  *parent,
                                 GFile          *file,
                                 GBytes         *bytes)
 {
+  GtkCssProviderPrivate *priv = gtk_css_provider_get_instance_private (self);
   gint64 before = g_get_monotonic_time ();
 
+  if (parent == NULL && file != NULL && gtk_css_provider_use_cache ())
+    {
+      if (gtk_css_provider_load_cache (self, file))
+        {
+          if (GDK_PROFILER_IS_RUNNING)
+            {
+              char *uri = g_file_get_uri (file);
+              gdk_profiler_end_mark (before, "theme cache load", uri);
+              g_free (uri);
+            }
+          return;
+        }
+
+      priv->compile = gtk_css_provider_compile_new ();
+    }
+
   if (bytes == NULL)
     {
       GError *load_error = NULL;
@@ -1057,6 +1926,8 @@ gtk_css_provider_load_internal (GtkCssProvider *self,
                                      parent,
                                      file,
                                      bytes);
+      if (priv->compile)
+        scanner->source = gtk_css_provider_compile_add_source (priv->compile, file, bytes);
 
       parse_stylesheet (scanner);
 
@@ -1068,6 +1939,14 @@ gtk_css_provider_load_internal (GtkCssProvider *self,
       g_bytes_unref (bytes);
     }
 
+  if (parent == NULL && priv->compile)
+    {
+      if (priv->compile->n_errors == 0 && priv->compile->files->len > 0)
+        gtk_css_provider_save_cache (self, file);
+
+      g_clear_pointer (&priv->compile, gtk_css_provider_compile_free);
+    }
+
   if (GDK_PROFILER_IS_RUNNING)
     {
       char *uri = g_file_get_uri (file);
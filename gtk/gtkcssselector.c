@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include "gtkcssprovider.h"
+#include "gtkdebug.h"
 #include "gtkstylecontextprivate.h"
 
 #include <errno.h>
@@ -117,6 +118,7 @@ union _GtkCssSelector
 };
 
 #define GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET G_MAXINT32
+#define GTK_CSS_SELECTOR_TREE_N_ANCESTOR_HASHES 3
 struct _GtkCssSelectorTree
 {
   GtkCssSelector selector;
@@ -124,8 +126,40 @@ struct _GtkCssSelectorTree
   gint32 previous_offset;
   gint32 sibling_offset;
   gint32 matches_offset; /* pointers that we return as matches if selector matches */
+  /* bloom filter hashes of ancestors that every match at or below this
+   * node requires, see gtk_css_selector_tree_compute_ancestor_hashes() */
+  guint16 ancestor_hashes[GTK_CSS_SELECTOR_TREE_N_ANCESTOR_HASHES];
+  guint16 n_ancestor_hashes;
 };
 
+/* The roots of a tree whose selector is a name, class or id are indexed
+ * by the hash of that selector, so matching only needs to look at the
+ * roots that can match the name, classes and id of a node. The index is
+ * allocated in front of the first root.
+ */
+typedef struct {
+  guint hash;
+  gint32 offset;                /* of the root, relative to the first root */
+} GtkCssSelectorTreeIndexEntry;
+
+typedef struct {
+  GtkCssSelectorTreeIndexEntry *entries; /* sorted by hash */
+  guint n_entries;
+  gint32 *others;               /* offsets of roots that are not indexed */
+  guint n_others;
+} GtkCssSelectorTreeIndex;
+
+typedef struct {
+  guint tested;                 /* selectors matched against a node */
+  guint filtered;               /* subtrees skipped by the bloom filter */
+} GtkCssSelectorMatchStats;
+
+/* Statistics for GTK_DEBUG=css, these are updated from all threads
+ * that match styles */
+static int selectors_tested;
+static int selectors_filtered;
+static int rules_matched;
+
 static gboolean
 gtk_css_selector_equal (const GtkCssSelector *a,
 			const GtkCssSelector *b)
@@ -1901,28 +1935,46 @@ gtk_css_selector_tree_found_match (const GtkCssSelectorTree  *tree,
     g_ptr_array_insert_sorted (*results, matches[i]);
 }
 
+static inline gboolean
+gtk_css_selector_tree_may_match (const GtkCssSelectorTree     *tree,
+                                 const GtkCountingBloomFilter *filter)
+{
+  guint i;
+
+  for (i = 0; i < tree->n_ancestor_hashes; i++)
+    {
+      if (!gtk_counting_bloom_filter_may_contain (filter, tree->ancestor_hashes[i]))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 static gboolean
 gtk_css_selector_tree_match (const GtkCssSelectorTree      *tree,
                              const GtkCountingBloomFilter  *filter,
-                             gboolean                       match_filter,
                              GtkCssNode                    *node,
-                             GPtrArray                    **results)
+                             GPtrArray                    **results,
+                             GtkCssSelectorMatchStats      *stats)
 {
   const GtkCssSelectorTree *prev;
   GtkCssNode *child;
 
-  if (match_filter && tree->selector.class->category == GTK_CSS_SELECTOR_CATEGORY_SIMPLE_RADICAL &&
-      !gtk_counting_bloom_filter_may_contain (filter, gtk_css_selector_hash_one (&tree->selector)))
-    return FALSE;
+  /* The ancestor hashes don't depend on @node, so if they fail here,
+   * they fail for all other nodes the caller iterates over */
+  if (filter && !gtk_css_selector_tree_may_match (tree, filter))
+    {
+      stats->filtered++;
+      return FALSE;
+    }
+
+  stats->tested++;
 
   if (!gtk_css_selector_match_one (&tree->selector, node))
     return TRUE;
 
   gtk_css_selector_tree_found_match (tree, results);
 
-  if (filter && !gtk_css_selector_is_simple (&tree->selector))
-    match_filter = tree->selector.class->category == GTK_CSS_SELECTOR_CATEGORY_PARENT;
-
   for (prev = gtk_css_selector_tree_get_previous (tree);
        prev != NULL;
        prev = gtk_css_selector_tree_get_sibling (prev))
@@ -1931,7 +1983,7 @@ gtk_css_selector_tree_match (const GtkCssSelectorTree      *tree,
            child;
            child = gtk_css_selector_iterator (&tree->selector, node, child))
         {
-          if (!gtk_css_selector_tree_match (prev, filter, match_filter, child, results))
+          if (!gtk_css_selector_tree_match (prev, filter, child, results, stats))
             break;
         }
     }
@@ -1939,22 +1991,124 @@ gtk_css_selector_tree_match (const GtkCssSelectorTree      *tree,
   return TRUE;
 }
 
+static inline GtkCssSelectorTreeIndex *
+gtk_css_selector_tree_get_index (const GtkCssSelectorTree *tree)
+{
+  return ((GtkCssSelectorTreeIndex *) tree) - 1;
+}
+
+/* Calls @func for all roots of @tree that can match @node */
+static void
+gtk_css_selector_tree_foreach_root (const GtkCssSelectorTree *tree,
+                                    GtkCssNode               *node,
+                                    void                    (* func) (const GtkCssSelectorTree *root,
+                                                                      gpointer                  data),
+                                    gpointer                  data)
+{
+  const GtkCssSelectorTreeIndex *index;
+  const GQuark *classes;
+  guint hashes[2];
+  guint i, n_classes, n_hashes;
+
+  if (tree == NULL)
+    return;
+
+  index = gtk_css_selector_tree_get_index (tree);
+
+  for (i = 0; i < index->n_others; i++)
+    func (gtk_css_selector_tree_at_offset (tree, index->others[i]), data);
+
+  if (index->n_entries == 0)
+    return;
+
+  n_hashes = 0;
+  hashes[n_hashes++] = gtk_css_hash_name (gtk_css_node_get_name (node));
+  if (gtk_css_node_get_id (node))
+    hashes[n_hashes++] = gtk_css_hash_id (gtk_css_node_get_id (node));
+  classes = gtk_css_node_list_classes (node, &n_classes);
+
+  for (i = 0; i < n_hashes + n_classes; i++)
+    {
+      guint hash, lo, hi;
+
+      hash = i < n_hashes ? hashes[i] : gtk_css_hash_class (classes[i - n_hashes]);
+
+      /* Find the first entry with this hash */
+      lo = 0;
+      hi = index->n_entries;
+      while (lo < hi)
+        {
+          guint mid = (lo + hi) / 2;
+
+          if (index->entries[mid].hash < hash)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+
+      for (; lo < index->n_entries && index->entries[lo].hash == hash; lo++)
+        func (gtk_css_selector_tree_at_offset (tree, index->entries[lo].offset), data);
+    }
+}
+
+typedef struct {
+  const GtkCountingBloomFilter *filter;
+  GtkCssNode *node;
+  GPtrArray *results;
+  GtkCssSelectorMatchStats stats;
+} MatchAllData;
+
+static void
+match_root (const GtkCssSelectorTree *root,
+            gpointer                  user_data)
+{
+  MatchAllData *data = user_data;
+
+  gtk_css_selector_tree_match (root, data->filter, data->node, &data->results, &data->stats);
+}
+
 GPtrArray *
 _gtk_css_selector_tree_match_all (const GtkCssSelectorTree     *tree,
                                   const GtkCountingBloomFilter *filter,
                                   GtkCssNode                   *node)
 {
-  const GtkCssSelectorTree *iter;
-  GPtrArray *results = NULL;
+  MatchAllData data = { filter, node, NULL, { 0, 0 } };
+
+  gtk_css_selector_tree_foreach_root (tree, node, match_root, &data);
 
-  for (iter = tree;
-       iter != NULL;
-       iter = gtk_css_selector_tree_get_sibling (iter))
+  if (GTK_DEBUG_CHECK (CSS))
     {
-      gtk_css_selector_tree_match (iter, filter, FALSE, node, &results);
+      g_atomic_int_add (&selectors_tested, data.stats.tested);
+      g_atomic_int_add (&selectors_filtered, data.stats.filtered);
+      if (data.results)
+        g_atomic_int_add (&rules_matched, data.results->len);
     }
 
-  return results;
+  return data.results;
+}
+
+/**
+ * _gtk_css_selector_tree_take_statistics:
+ * @tested: (out): return location for the number of selectors that were
+ *     matched against nodes
+ * @filtered: (out): return location for the number of subtrees of
+ *     selectors that were skipped because of the bloom filter
+ * @matched: (out): return location for the number of rules that matched
+ *
+ * Gets the statistics collected by _gtk_css_selector_tree_match_all()
+ * while GTK_DEBUG=css is set, and resets them.
+ */
+void
+_gtk_css_selector_tree_take_statistics (guint *tested,
+                                        guint *filtered,
+                                        guint *matched)
+{
+  *tested = g_atomic_int_get (&selectors_tested);
+  g_atomic_int_add (&selectors_tested, - (int) *tested);
+  *filtered = g_atomic_int_get (&selectors_filtered);
+  g_atomic_int_add (&selectors_filtered, - (int) *filtered);
+  *matched = g_atomic_int_get (&rules_matched);
+  g_atomic_int_add (&rules_matched, - (int) *matched);
 }
 
 gboolean
@@ -1963,6 +2117,21 @@ _gtk_css_selector_tree_is_empty (const GtkCssSelectorTree *tree)
   return tree == NULL;
 }
 
+typedef struct {
+  const GtkCountingBloomFilter *filter;
+  GtkCssNode *node;
+  GtkCssChange change;
+} ChangeAllData;
+
+static void
+get_change_root (const GtkCssSelectorTree *root,
+                 gpointer                  user_data)
+{
+  ChangeAllData *data = user_data;
+
+  data->change |= gtk_css_selector_tree_get_change (root, data->filter, data->node, FALSE);
+}
+
 GtkCssChange
 gtk_css_selector_tree_get_change_all (const GtkCssSelectorTree     *tree,
                                       const GtkCountingBloomFilter *filter,
@@ -1970,9 +2139,21 @@ gtk_css_selector_tree_get_change_all (const GtkCssSelectorTree     *tree,
 {
   GtkCssChange change = 0;
 
-  for (; tree != NULL;
-       tree = gtk_css_selector_tree_get_sibling (tree))
-    change |= gtk_css_selector_tree_get_change (tree, filter, node, FALSE);
+  if (node)
+    {
+      ChangeAllData data = { filter, node, 0 };
+
+      /* Roots that are not found don't match @node, so they can't
+       * contribute any change */
+      gtk_css_selector_tree_foreach_root (tree, node, get_change_root, &data);
+      change = data.change;
+    }
+  else
+    {
+      for (; tree != NULL;
+           tree = gtk_css_selector_tree_get_sibling (tree))
+        change |= gtk_css_selector_tree_get_change (tree, filter, node, FALSE);
+    }
 
   /* Never return reserved bit set */
   return change & ~GTK_CSS_CHANGE_RESERVED_BIT;
@@ -2084,10 +2265,15 @@ _gtk_css_selector_tree_match_print (const GtkCssSelectorTree *tree,
 void
 _gtk_css_selector_tree_free (GtkCssSelectorTree *tree)
 {
+  GtkCssSelectorTreeIndex *index;
+
   if (tree == NULL)
     return;
 
-  g_free (tree);
+  index = gtk_css_selector_tree_get_index (tree);
+  g_free (index->entries);
+  g_free (index->others);
+  g_free (index);
 }
 
 
@@ -2272,6 +2458,119 @@ fixup_offsets (GtkCssSelectorTree *tree, guint8 *data)
     }
 }
 
+/* Collects the hashes of the name, class and id selectors that must
+ * match an ancestor of the node for any rule at or below @tree to match.
+ * @ancestor says if @tree matches an ancestor, which is the case if the
+ * closest combinator on the way to the root is a descendant or child
+ * combinator. Matches below @tree may need different ancestors, so only
+ * the hashes that all of them need are kept.
+ */
+static void
+gtk_css_selector_tree_compute_ancestor_hashes (GtkCssSelectorTree *tree,
+                                               gboolean            ancestor)
+{
+  for (; tree != NULL; tree = (GtkCssSelectorTree *) gtk_css_selector_tree_get_sibling (tree))
+    {
+      const GtkCssSelectorTree *previous, *prev;
+      gboolean previous_ancestor;
+      guint i, j, n;
+
+      if (gtk_css_selector_is_simple (&tree->selector))
+        previous_ancestor = ancestor;
+      else
+        previous_ancestor = tree->selector.class->category == GTK_CSS_SELECTOR_CATEGORY_PARENT;
+
+      previous = gtk_css_selector_tree_get_previous (tree);
+      gtk_css_selector_tree_compute_ancestor_hashes ((GtkCssSelectorTree *) previous, previous_ancestor);
+
+      n = 0;
+      if (ancestor && tree->selector.class->category == GTK_CSS_SELECTOR_CATEGORY_SIMPLE_RADICAL)
+        tree->ancestor_hashes[n++] = gtk_css_selector_hash_one (&tree->selector);
+
+      /* A rule that ends here doesn't need anything further down */
+      if (previous != NULL && gtk_css_selector_tree_get_matches (tree) == NULL)
+        {
+          for (i = 0; i < previous->n_ancestor_hashes && n < GTK_CSS_SELECTOR_TREE_N_ANCESTOR_HASHES; i++)
+            {
+              guint16 hash = previous->ancestor_hashes[i];
+              gboolean needed = TRUE;
+
+              for (j = 0; j < n && needed; j++)
+                needed = tree->ancestor_hashes[j] != hash;
+
+              for (prev = gtk_css_selector_tree_get_sibling (previous); prev && needed; prev = gtk_css_selector_tree_get_sibling (prev))
+                {
+                  needed = FALSE;
+                  for (j = 0; j < prev->n_ancestor_hashes; j++)
+                    {
+                      if (prev->ancestor_hashes[j] == hash)
+                        {
+                          needed = TRUE;
+                          break;
+                        }
+                    }
+                }
+
+              if (needed)
+                tree->ancestor_hashes[n++] = hash;
+            }
+        }
+
+      tree->n_ancestor_hashes = n;
+    }
+}
+
+static int
+compare_index_entries (gconstpointer a,
+                       gconstpointer b)
+{
+  const GtkCssSelectorTreeIndexEntry *entry_a = a;
+  const GtkCssSelectorTreeIndexEntry *entry_b = b;
+
+  if (entry_a->hash < entry_b->hash)
+    return -1;
+  else if (entry_a->hash > entry_b->hash)
+    return 1;
+  else
+    return entry_a->offset - entry_b->offset;
+}
+
+/* Computes the data that only exists in memory, @tree must be
+ * allocated after a #GtkCssSelectorTreeIndex */
+static void
+gtk_css_selector_tree_prepare (GtkCssSelectorTree *tree)
+{
+  GtkCssSelectorTreeIndex *index = gtk_css_selector_tree_get_index (tree);
+  const GtkCssSelectorTree *root;
+  GArray *entries, *others;
+
+  gtk_css_selector_tree_compute_ancestor_hashes (tree, FALSE);
+
+  entries = g_array_new (FALSE, FALSE, sizeof (GtkCssSelectorTreeIndexEntry));
+  others = g_array_new (FALSE, FALSE, sizeof (gint32));
+
+  for (root = tree; root != NULL; root = gtk_css_selector_tree_get_sibling (root))
+    {
+      gint32 offset = (const guint8 *) root - (const guint8 *) tree;
+
+      if (root->selector.class->category == GTK_CSS_SELECTOR_CATEGORY_SIMPLE_RADICAL)
+        {
+          GtkCssSelectorTreeIndexEntry entry = { gtk_css_selector_hash_one (&root->selector), offset };
+
+          g_array_append_val (entries, entry);
+        }
+      else
+        g_array_append_val (others, offset);
+    }
+
+  g_array_sort (entries, compare_index_entries);
+
+  index->n_entries = entries->len;
+  index->entries = (GtkCssSelectorTreeIndexEntry *) g_array_free (entries, FALSE);
+  index->n_others = others->len;
+  index->others = (gint32 *) g_array_free (others, FALSE);
+}
+
 GtkCssSelectorTree *
 _gtk_css_selector_tree_builder_build (GtkCssSelectorTreeBuilder *builder)
 {
@@ -2283,7 +2582,13 @@ _gtk_css_selector_tree_builder_build (GtkCssSelectorTreeBuilder *builder)
   GtkCssSelectorRuleSetInfo *info;
 
   array = g_byte_array_new ();
-  subdivide_infos (array, builder->infos, GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET);
+  /* Leave room for the index */
+  g_byte_array_set_size (array, sizeof (GtkCssSelectorTreeIndex));
+  if (subdivide_infos (array, builder->infos, GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET) == GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET)
+    {
+      g_byte_array_free (array, TRUE);
+      return NULL;
+    }
 
   len = array->len;
   data = g_byte_array_free (array, FALSE);
@@ -2291,9 +2596,10 @@ _gtk_css_selector_tree_builder_build (GtkCssSelectorTreeBuilder *builder)
   /* shrink to final size */
   data = g_realloc (data, len);
 
-  tree = (GtkCssSelectorTree *)data;
+  tree = (GtkCssSelectorTree *) (data + sizeof (GtkCssSelectorTreeIndex));
 
   fixup_offsets (tree, data);
+  gtk_css_selector_tree_prepare (tree);
 
   /* Convert offsets to final pointers */
   for (l = builder->infos; l != NULL; l = l->next)
@@ -2314,3 +2620,318 @@ _gtk_css_selector_tree_builder_build (GtkCssSelectorTreeBuilder *builder)
 
   return tree;
 }
+
+/* Serialization of a selector tree, used for caching compiled style sheets.
+ *
+ * The tree already lives in a single block with node-relative offsets, so
+ * we copy that block and replace the few pointers in it: selector classes
+ * become indexes into selector_classes, quarks become indexes into a string
+ * table and matches become (index + 1) into the array passed by the caller,
+ * keeping 0 as the terminator. The index and the ancestor hashes depend on
+ * the values of the quarks, so they are computed again when loading.
+ */
+
+static const GtkCssSelectorClass *selector_classes[] = {
+  &GTK_CSS_SELECTOR_DESCENDANT,
+  &GTK_CSS_SELECTOR_CHILD,
+  &GTK_CSS_SELECTOR_SIBLING,
+  &GTK_CSS_SELECTOR_ADJACENT,
+  &GTK_CSS_SELECTOR_ANY,
+  &GTK_CSS_SELECTOR_NOT_ANY,
+  &GTK_CSS_SELECTOR_NAME,
+  &GTK_CSS_SELECTOR_NOT_NAME,
+  &GTK_CSS_SELECTOR_CLASS,
+  &GTK_CSS_SELECTOR_NOT_CLASS,
+  &GTK_CSS_SELECTOR_ID,
+  &GTK_CSS_SELECTOR_NOT_ID,
+  &GTK_CSS_SELECTOR_PSEUDOCLASS_STATE,
+  &GTK_CSS_SELECTOR_NOT_PSEUDOCLASS_STATE,
+  &GTK_CSS_SELECTOR_PSEUDOCLASS_POSITION,
+  &GTK_CSS_SELECTOR_NOT_PSEUDOCLASS_POSITION,
+};
+
+static GQuark *
+gtk_css_selector_get_quark (GtkCssSelector *selector)
+{
+  if (selector->class == &GTK_CSS_SELECTOR_NAME ||
+      selector->class == &GTK_CSS_SELECTOR_NOT_NAME)
+    return &selector->name.name;
+  else if (selector->class == &GTK_CSS_SELECTOR_CLASS ||
+           selector->class == &GTK_CSS_SELECTOR_NOT_CLASS)
+    return &selector->style_class.style_class;
+  else if (selector->class == &GTK_CSS_SELECTOR_ID ||
+           selector->class == &GTK_CSS_SELECTOR_NOT_ID)
+    return &selector->id.name;
+  else
+    return NULL;
+}
+
+static gsize
+gtk_css_selector_tree_get_size (const GtkCssSelectorTree *tree,
+                                const guint8             *data)
+{
+  gsize size = 0;
+
+  for (; tree != NULL; tree = gtk_css_selector_tree_get_sibling (tree))
+    {
+      gpointer *matches;
+
+      size = MAX (size, (gsize) ((const guint8 *) (tree + 1) - data));
+
+      matches = gtk_css_selector_tree_get_matches (tree);
+      if (matches)
+        {
+          while (*matches)
+            matches++;
+          size = MAX (size, (gsize) ((const guint8 *) (matches + 1) - data));
+        }
+
+      size = MAX (size, gtk_css_selector_tree_get_size (gtk_css_selector_tree_get_previous (tree), data));
+    }
+
+  return size;
+}
+
+static void
+gtk_css_selector_tree_serialize_nodes (GtkCssSelectorTree *tree,
+                                       GHashTable         *match_indexes,
+                                       GHashTable         *string_indexes,
+                                       GPtrArray          *strings)
+{
+  for (; tree != NULL; tree = (GtkCssSelectorTree *) gtk_css_selector_tree_get_sibling (tree))
+    {
+      GQuark *quark;
+      gpointer *matches;
+      guint i;
+
+      quark = gtk_css_selector_get_quark (&tree->selector);
+      if (quark)
+        {
+          const char *string = g_quark_to_string (*quark);
+          gpointer index;
+
+          if (!g_hash_table_lookup_extended (string_indexes, string, NULL, &index))
+            {
+              index = GUINT_TO_POINTER (strings->len);
+              g_hash_table_insert (string_indexes, (gpointer) string, index);
+              g_ptr_array_add (strings, (gpointer) string);
+            }
+          *quark = GPOINTER_TO_UINT (index);
+        }
+
+      for (i = 0; i < G_N_ELEMENTS (selector_classes); i++)
+        {
+          if (selector_classes[i] == tree->selector.class)
+            break;
+        }
+      g_assert (i < G_N_ELEMENTS (selector_classes));
+      tree->selector.class = GSIZE_TO_POINTER (i);
+
+      matches = gtk_css_selector_tree_get_matches (tree);
+      if (matches)
+        {
+          for (; *matches; matches++)
+            {
+              *matches = g_hash_table_lookup (match_indexes, *matches);
+              g_assert (*matches != NULL);
+            }
+        }
+
+      gtk_css_selector_tree_serialize_nodes ((GtkCssSelectorTree *) gtk_css_selector_tree_get_previous (tree),
+                                             match_indexes,
+                                             string_indexes,
+                                             strings);
+    }
+}
+
+/* Returns the serialized form of @tree. All rulesets matched by @tree
+ * must be in @matches. The strings used by the tree are appended to
+ * @strings, they are interned and must not be freed.
+ */
+GBytes *
+_gtk_css_selector_tree_serialize (const GtkCssSelectorTree *tree,
+                                  gpointer                 *matches,
+                                  guint                     n_matches,
+                                  GPtrArray                *strings)
+{
+  GHashTable *match_indexes, *string_indexes;
+  guint8 *data;
+  gsize size;
+  guint i;
+
+  if (tree == NULL)
+    return g_bytes_new (NULL, 0);
+
+  size = gtk_css_selector_tree_get_size (tree, (const guint8 *) tree);
+  data = g_memdup (tree, size);
+
+  match_indexes = g_hash_table_new (NULL, NULL);
+  for (i = 0; i < n_matches; i++)
+    g_hash_table_insert (match_indexes, matches[i], GUINT_TO_POINTER (i + 1));
+  string_indexes = g_hash_table_new (g_str_hash, g_str_equal);
+
+  gtk_css_selector_tree_serialize_nodes ((GtkCssSelectorTree *) data,
+                                         match_indexes,
+                                         string_indexes,
+                                         strings);
+
+  g_hash_table_unref (match_indexes);
+  g_hash_table_unref (string_indexes);
+
+  return g_bytes_new_take (data, size);
+}
+
+static gboolean
+gtk_css_selector_tree_check_offset (const GtkCssSelectorTree *tree,
+                                    gint32                    offset,
+                                    const guint8             *data,
+                                    gsize                     size,
+                                    gsize                     needed)
+{
+  gint64 pos;
+
+  /* Children, siblings and matches always come after their node */
+  if (offset <= 0)
+    return FALSE;
+
+  pos = ((const guint8 *) tree - data) + (gint64) offset;
+
+  return pos % sizeof (gpointer) == 0 && pos + needed <= size;
+}
+
+static gboolean
+gtk_css_selector_tree_deserialize_nodes (GtkCssSelectorTree   *tree,
+                                         GtkCssSelectorTree   *parent,
+                                         const guint8         *data,
+                                         gsize                 size,
+                                         const char * const   *strings,
+                                         guint                 n_strings,
+                                         gpointer             *matches,
+                                         GtkCssSelectorTree ***selector_matches,
+                                         guint                 n_matches)
+{
+  while (TRUE)
+    {
+      GQuark *quark;
+      guint index;
+
+      if (parent == NULL)
+        {
+          if (tree->parent_offset != GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET)
+            return FALSE;
+        }
+      else if ((guint8 *) tree + tree->parent_offset != (guint8 *) parent)
+        return FALSE;
+
+      index = GPOINTER_TO_SIZE (tree->selector.class);
+      if (index >= G_N_ELEMENTS (selector_classes))
+        return FALSE;
+      tree->selector.class = selector_classes[index];
+
+      quark = gtk_css_selector_get_quark (&tree->selector);
+      if (quark)
+        {
+          if (*quark >= n_strings)
+            return FALSE;
+          *quark = g_quark_from_string (strings[*quark]);
+        }
+
+      if (tree->matches_offset != GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET)
+        {
+          gpointer *m;
+
+          if (!gtk_css_selector_tree_check_offset (tree, tree->matches_offset, data, size, sizeof (gpointer)))
+            return FALSE;
+
+          for (m = gtk_css_selector_tree_get_matches (tree); *m; m++)
+            {
+              index = GPOINTER_TO_SIZE (*m);
+              if (index > n_matches ||
+                  (guint8 *) (m + 2) > data + size ||
+                  *selector_matches[index - 1] != NULL)
+                return FALSE;
+
+              *m = matches[index - 1];
+              *selector_matches[index - 1] = tree;
+            }
+        }
+
+      if (tree->previous_offset != GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET)
+        {
+          if (!gtk_css_selector_tree_check_offset (tree, tree->previous_offset, data, size, sizeof (GtkCssSelectorTree)) ||
+              !gtk_css_selector_tree_deserialize_nodes ((GtkCssSelectorTree *) gtk_css_selector_tree_get_previous (tree),
+                                                        tree,
+                                                        data, size,
+                                                        strings, n_strings,
+                                                        matches, selector_matches, n_matches))
+            return FALSE;
+        }
+
+      if (tree->sibling_offset == GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET)
+        return TRUE;
+
+      if (!gtk_css_selector_tree_check_offset (tree, tree->sibling_offset, data, size, sizeof (GtkCssSelectorTree)))
+        return FALSE;
+
+      tree = (GtkCssSelectorTree *) gtk_css_selector_tree_get_sibling (tree);
+    }
+}
+
+/* Recreates a tree from the result of _gtk_css_selector_tree_serialize().
+ * @matches and @selector_matches take the place of the arguments to
+ * _gtk_css_selector_tree_builder_add(). Returns %FALSE if @bytes does
+ * not describe a valid tree.
+ */
+gboolean
+_gtk_css_selector_tree_deserialize (GBytes               *bytes,
+                                    const char * const   *strings,
+                                    guint                 n_strings,
+                                    gpointer             *matches,
+                                    GtkCssSelectorTree ***selector_matches,
+                                    guint                 n_matches,
+                                    GtkCssSelectorTree  **out_tree)
+{
+  GtkCssSelectorTree *tree;
+  guint8 *data;
+  gsize i, size;
+
+  for (i = 0; i < n_matches; i++)
+    *selector_matches[i] = NULL;
+
+  size = g_bytes_get_size (bytes);
+  if (size == 0)
+    {
+      *out_tree = NULL;
+      return n_matches == 0;
+    }
+
+  if (size < sizeof (GtkCssSelectorTree))
+    return FALSE;
+
+  data = g_malloc (sizeof (GtkCssSelectorTreeIndex) + size);
+  tree = (GtkCssSelectorTree *) (data + sizeof (GtkCssSelectorTreeIndex));
+  memcpy (tree, g_bytes_get_data (bytes, NULL), size);
+
+  if (!gtk_css_selector_tree_deserialize_nodes (tree, NULL,
+                                                (const guint8 *) tree, size,
+                                                strings, n_strings,
+                                                matches, selector_matches, n_matches))
+    {
+      g_free (data);
+      return FALSE;
+    }
+
+  for (i = 0; i < n_matches; i++)
+    {
+      if (*selector_matches[i] == NULL)
+        {
+          g_free (data);
+          return FALSE;
+        }
+    }
+
+  gtk_css_selector_tree_prepare (tree);
+
+  *out_tree = tree;
+  return TRUE;
+}
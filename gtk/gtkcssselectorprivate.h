@@ -51,6 +51,9 @@ GtkCssChange gtk_css_selector_tree_get_change_all    (const GtkCssSelectorTree *
 void         _gtk_css_selector_tree_match_print      (const GtkCssSelectorTree *tree,
 						      GString                  *str);
 gboolean     _gtk_css_selector_tree_is_empty         (const GtkCssSelectorTree *tree) G_GNUC_CONST;
+void         _gtk_css_selector_tree_take_statistics  (guint                    *tested,
+                                                      guint                    *filtered,
+                                                      guint                    *matched);
 
 
 
@@ -62,6 +65,18 @@ void                       _gtk_css_selector_tree_builder_add   (GtkCssSelectorT
 GtkCssSelectorTree *       _gtk_css_selector_tree_builder_build (GtkCssSelectorTreeBuilder *builder);
 void                       _gtk_css_selector_tree_builder_free  (GtkCssSelectorTreeBuilder *builder);
 
+GBytes *                   _gtk_css_selector_tree_serialize     (const GtkCssSelectorTree  *tree,
+                                                                 gpointer                  *matches,
+                                                                 guint                      n_matches,
+                                                                 GPtrArray                 *strings);
+gboolean                   _gtk_css_selector_tree_deserialize   (GBytes                    *bytes,
+                                                                 const char * const        *strings,
+                                                                 guint                      n_strings,
+                                                                 gpointer                  *matches,
+                                                                 GtkCssSelectorTree      ***selector_matches,
+                                                                 guint                      n_matches,
+                                                                 GtkCssSelectorTree       **out_tree);
+
 G_END_DECLS
 
 #endif /* __GTK_CSS_SELECTOR_PRIVATE_H__ */
@@ -152,17 +152,39 @@ gtk_css_value_shadow_equal (const GtkCssValue *value1,
       const ShadowValue *shadow2 = &value2->shadows[i];
 
       if (shadow1->inset != shadow2->inset ||
-          _gtk_css_value_equal (shadow1->hoffset, shadow2->hoffset) ||
-          _gtk_css_value_equal (shadow1->voffset, shadow2->voffset) ||
-          _gtk_css_value_equal (shadow1->radius, shadow2->radius) ||
-          _gtk_css_value_equal (shadow1->spread, shadow2->spread) ||
-          _gtk_css_value_equal (shadow1->color, shadow2->color))
+          !_gtk_css_value_equal (shadow1->hoffset, shadow2->hoffset) ||
+          !_gtk_css_value_equal (shadow1->voffset, shadow2->voffset) ||
+          !_gtk_css_value_equal (shadow1->radius, shadow2->radius) ||
+          !_gtk_css_value_equal (shadow1->spread, shadow2->spread) ||
+          !_gtk_css_value_equal (shadow1->color, shadow2->color))
         return FALSE;
     }
 
   return TRUE;
 }
 
+static guint
+gtk_css_value_shadow_hash (const GtkCssValue *value)
+{
+  guint i, hash;
+
+  hash = value->n_shadows;
+
+  for (i = 0; i < value->n_shadows; i++)
+    {
+      const ShadowValue *shadow = &value->shadows[i];
+
+      hash = hash * 31 + shadow->inset;
+      hash = hash * 31 + gtk_css_value_hash (shadow->hoffset);
+      hash = hash * 31 + gtk_css_value_hash (shadow->voffset);
+      hash = hash * 31 + gtk_css_value_hash (shadow->radius);
+      hash = hash * 31 + gtk_css_value_hash (shadow->spread);
+      hash = hash * 31 + gtk_css_value_hash (shadow->color);
+    }
+
+  return hash;
+}
+
 static GtkCssValue *
 gtk_css_value_shadow_transition (GtkCssValue *start,
                                  GtkCssValue *end,
@@ -285,7 +307,8 @@ static const GtkCssValueClass GTK_CSS_VALUE_SHADOW = {
   gtk_css_value_shadow_transition,
   NULL,
   NULL,
-  gtk_css_value_shadow_print
+  gtk_css_value_shadow_print,
+  gtk_css_value_shadow_hash
 };
 
 static GtkCssValue none_singleton = { &GTK_CSS_VALUE_SHADOW, 1, TRUE, 0 };
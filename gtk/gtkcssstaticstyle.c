@@ -214,6 +214,8 @@ gtk_css_ ## NAME ## _values_new_compute (GtkCssStaticStyle *sstyle, \
                                           lookup->values[id].value, \
                                           lookup->values[id].section); \
     } \
+\
+  style->NAME = (GtkCss ## TYPE ## Values *)gtk_css_values_intern ((GtkCssValues *)style->NAME); \
 } \
 static GtkBitmask * gtk_css_ ## NAME ## _values_mask; \
 static GtkCssValues * gtk_css_ ## NAME ## _initial_values; \
@@ -986,15 +988,40 @@ gtk_css_lookup_resolve (GtkCssLookup      *lookup,
     gtk_css_other_values_new_compute (sstyle, provider, parent_style, lookup);
 }
 
+static GtkCssStyle *
+gtk_css_static_style_new_for_lookup (GtkStyleProvider *provider,
+                                     GtkCssLookup     *lookup,
+                                     GtkCssNode       *node,
+                                     GtkCssChange      change)
+{
+  GtkCssStaticStyle *result;
+  GtkCssNode *parent;
+
+  result = g_object_new (GTK_TYPE_CSS_STATIC_STYLE, NULL);
+
+  result->change = change;
+
+  if (node)
+    parent = gtk_css_node_get_parent (node);
+  else
+    parent = NULL;
+
+  gtk_css_lookup_resolve (lookup,
+                          provider,
+                          result,
+                          parent ? gtk_css_node_get_style (parent) : NULL);
+
+  return GTK_CSS_STYLE (result);
+}
+
 GtkCssStyle *
 gtk_css_static_style_new_compute (GtkStyleProvider             *provider,
                                   const GtkCountingBloomFilter *filter,
                                   GtkCssNode                   *node,
                                   GtkCssChange                  change)
 {
-  GtkCssStaticStyle *result;
+  GtkCssStyle *result;
   GtkCssLookup lookup;
-  GtkCssNode *parent;
 
   _gtk_css_lookup_init (&lookup);
 
@@ -1005,23 +1032,104 @@ gtk_css_static_style_new_compute (GtkStyleProvider             *provider,
                                &lookup,
                                change == 0 ? &change : NULL);
 
-  result = g_object_new (GTK_TYPE_CSS_STATIC_STYLE, NULL);
+  result = gtk_css_static_style_new_for_lookup (provider, &lookup, node, change);
 
-  result->change = change;
+  _gtk_css_lookup_destroy (&lookup);
 
-  if (node)
-    parent = gtk_css_node_get_parent (node);
-  else
-    parent = NULL;
+  return result;
+}
 
-  gtk_css_lookup_resolve (&lookup,
-                          provider,
-                          result,
-                          parent ? gtk_css_node_get_style (parent) : NULL);
+typedef struct {
+  guint id;
+  GtkCssLookupValue value;
+} GtkCssStaticStyleMatchValue;
+
+struct _GtkCssStaticStyleMatch
+{
+  GtkCssChange change;
+  guint n_values;
+  GtkCssStaticStyleMatchValue values[1];
+};
+
+/* Does the part of gtk_css_static_style_new_compute() that only reads
+ * the provider and the node tree, so it can run on a different thread.
+ */
+GtkCssStaticStyleMatch *
+gtk_css_static_style_match (GtkStyleProvider             *provider,
+                            const GtkCountingBloomFilter *filter,
+                            GtkCssNode                   *node)
+{
+  GtkCssStaticStyleMatch *match;
+  GtkCssLookup lookup;
+  GtkCssChange change;
+  guint i, n;
+
+  _gtk_css_lookup_init (&lookup);
+
+  gtk_style_provider_lookup (provider, filter, node, &lookup, &change);
+
+  n = 0;
+  for (i = 0; i < GTK_CSS_PROPERTY_N_PROPERTIES; i++)
+    {
+      if (lookup.values[i].value)
+        n++;
+    }
+
+  match = g_malloc (G_STRUCT_OFFSET (GtkCssStaticStyleMatch, values) + n * sizeof (GtkCssStaticStyleMatchValue));
+  match->change = change;
+  match->n_values = n;
+
+  n = 0;
+  for (i = 0; i < GTK_CSS_PROPERTY_N_PROPERTIES; i++)
+    {
+      if (lookup.values[i].value)
+        {
+          match->values[n].id = i;
+          match->values[n].value = lookup.values[i];
+          n++;
+        }
+    }
 
   _gtk_css_lookup_destroy (&lookup);
 
-  return GTK_CSS_STYLE (result);
+  return match;
+}
+
+void
+gtk_css_static_style_match_free (GtkCssStaticStyleMatch *match)
+{
+  g_free (match);
+}
+
+/* Like gtk_css_static_style_new_compute(), but uses the result of an
+ * earlier gtk_css_static_style_match() for @node.
+ */
+GtkCssStyle *
+gtk_css_static_style_new_compute_for_match (GtkStyleProvider       *provider,
+                                            GtkCssStaticStyleMatch *match,
+                                            GtkCssNode             *node,
+                                            GtkCssChange            change)
+{
+  GtkCssStyle *result;
+  GtkCssLookup lookup;
+  guint i;
+
+  _gtk_css_lookup_init (&lookup);
+
+  for (i = 0; i < match->n_values; i++)
+    _gtk_css_lookup_set (&lookup,
+                         match->values[i].id,
+                         match->values[i].value.section,
+                         match->values[i].value.value);
+
+  result = gtk_css_static_style_new_for_lookup (provider,
+                                                &lookup,
+                                                node,
+                                                change == 0 ? match->change : change);
+
+  _gtk_css_lookup_destroy (&lookup);
+
+  return result;
 }
 
 G_STATIC_ASSERT (GTK_CSS_PROPERTY_BORDER_TOP_STYLE == GTK_CSS_PROPERTY_BORDER_TOP_WIDTH - 1);
@@ -1088,7 +1196,7 @@ gtk_css_static_style_compute_value (GtkCssStaticStyle *style,
       value = _gtk_css_initial_value_new_compute (id, provider, (GtkCssStyle *)style, parent_style);
     }
 
-  gtk_css_static_style_set_value (style, id, value, section);
+  gtk_css_static_style_set_value (style, id, gtk_css_value_intern (value), section);
 }
 
 GtkCssChange
@@ -34,6 +34,7 @@ G_BEGIN_DECLS
 #define GTK_CSS_STATIC_STYLE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), GTK_TYPE_CSS_STATIC_STYLE, GtkCssStaticStyleClass))
 
 typedef struct _GtkCssStaticStyleClass      GtkCssStaticStyleClass;
+typedef struct _GtkCssStaticStyleMatch      GtkCssStaticStyleMatch;
 
 
 struct _GtkCssStaticStyle
@@ -59,6 +60,15 @@ GtkCssStyle *           gtk_css_static_style_new_compute        (GtkStyleProvide
                                                                  GtkCssChange                    change);
 GtkCssChange            gtk_css_static_style_get_change         (GtkCssStaticStyle              *style);
 
+GtkCssStaticStyleMatch *gtk_css_static_style_match              (GtkStyleProvider               *provider,
+                                                                 const GtkCountingBloomFilter   *filter,
+                                                                 GtkCssNode                     *node);
+void                    gtk_css_static_style_match_free         (GtkCssStaticStyleMatch         *match);
+GtkCssStyle *           gtk_css_static_style_new_compute_for_match (GtkStyleProvider            *provider,
+                                                                 GtkCssStaticStyleMatch         *match,
+                                                                 GtkCssNode                     *node,
+                                                                 GtkCssChange                    change);
+
 G_END_DECLS
 
 #endif /* __GTK_CSS_STATIC_STYLE_PRIVATE_H__ */
@@ -39,6 +39,8 @@
 #include "gtkstylepropertyprivate.h"
 #include "gtkstyleproviderprivate.h"
 
+#include <string.h>
+
 G_DEFINE_ABSTRACT_TYPE (GtkCssStyle, gtk_css_style, G_TYPE_OBJECT)
 
 static GtkCssSection *
@@ -707,12 +709,55 @@ GtkCssValues *gtk_css_values_ref (GtkCssValues *values)
   return values;
 }
 
+/* Groups computed for static styles are interned, too. Their values
+ * have been interned before, so equal groups contain the same value
+ * pointers and can be compared and hashed by pointer. Styles of similar
+ * nodes end up sharing their groups, which also lets style changes be
+ * detected by comparing the group pointers. The table does not hold a
+ * reference.
+ */
+static GHashTable *interned_groups;
+static guint interned_groups_shared;
+static gsize interned_groups_saved;
+
+static guint
+gtk_css_values_hash (gconstpointer data)
+{
+  const GtkCssValues *values = data;
+  GtkCssValue **v = GET_VALUES (values);
+  guint i, hash;
+
+  hash = values->type;
+  for (i = 0; i < N_VALUES (values->type); i++)
+    hash = hash * 31 + GPOINTER_TO_UINT (v[i]);
+
+  return hash;
+}
+
+static gboolean
+gtk_css_values_equal (gconstpointer data1,
+                      gconstpointer data2)
+{
+  const GtkCssValues *values1 = data1;
+  const GtkCssValues *values2 = data2;
+
+  if (values1->type != values2->type)
+    return FALSE;
+
+  return memcmp (GET_VALUES (values1),
+                 GET_VALUES (values2),
+                 N_VALUES (values1->type) * sizeof (GtkCssValue *)) == 0;
+}
+
 static void
 gtk_css_values_free (GtkCssValues *values)
 {
   int i;
   GtkCssValue **v = GET_VALUES (values);
 
+  if (interned_groups && g_hash_table_lookup (interned_groups, values) == values)
+    g_hash_table_remove (interned_groups, values);
+
   for (i = 0; i < N_VALUES (values->type); i++)
     {
       if (v[i])
@@ -754,6 +799,65 @@ gtk_css_values_copy (GtkCssValues *values)
   return copy;
 }
 
+/*
+ * gtk_css_values_intern:
+ * @values: (transfer full): a group of computed values
+ *
+ * Returns an already existing group with the same values instead
+ * of @values if there is one. The returned group must not be
+ * modified anymore.
+ *
+ * Returns: (transfer full): @values or an equal group
+ */
+GtkCssValues *
+gtk_css_values_intern (GtkCssValues *values)
+{
+  GtkCssValues *interned;
+
+  if (G_UNLIKELY (interned_groups == NULL))
+    interned_groups = g_hash_table_new (gtk_css_values_hash, gtk_css_values_equal);
+
+  interned = g_hash_table_lookup (interned_groups, values);
+  if (interned == values)
+    return values;
+
+  if (interned != NULL)
+    {
+      interned_groups_shared++;
+      interned_groups_saved += VALUES_SIZE (values->type);
+      gtk_css_values_ref (interned);
+      gtk_css_values_unref (values);
+      return interned;
+    }
+
+  g_hash_table_add (interned_groups, values);
+
+  return values;
+}
+
+/*
+ * gtk_css_values_take_intern_statistics:
+ * @n_interned: (out): return location for the number of interned groups
+ *     that are alive
+ * @n_shared: (out): return location for the number of computed groups
+ *     that were replaced by an interned one
+ * @saved: (out): return location for the size of the replaced groups
+ *
+ * Gets the statistics of gtk_css_values_intern() and resets the number
+ * and size of shared groups.
+ */
+void
+gtk_css_values_take_intern_statistics (guint *n_interned,
+                                       guint *n_shared,
+                                       gsize *saved)
+{
+  *n_interned = interned_groups ? g_hash_table_size (interned_groups) : 0;
+  *n_shared = interned_groups_shared;
+  *saved = interned_groups_saved;
+  interned_groups_shared = 0;
+  interned_groups_saved = 0;
+}
+
 GtkCssValues *
 gtk_css_values_new (GtkCssValuesType type)
 {
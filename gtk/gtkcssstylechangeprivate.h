@@ -30,9 +30,11 @@ struct _GtkCssStyleChange {
   GtkBitmask    *changes;
 };
 
+GDK_AVAILABLE_IN_ALL
 void            gtk_css_style_change_init               (GtkCssStyleChange      *change,
                                                          GtkCssStyle            *old_style,
                                                          GtkCssStyle            *new_style);
+GDK_AVAILABLE_IN_ALL
 void            gtk_css_style_change_finish             (GtkCssStyleChange      *change);
 
 GtkCssStyle *   gtk_css_style_change_get_old_style      (GtkCssStyleChange      *change);
@@ -41,6 +43,7 @@ GtkCssStyle *   gtk_css_style_change_get_new_style      (GtkCssStyleChange
 gboolean        gtk_css_style_change_has_change         (GtkCssStyleChange      *change);
 gboolean        gtk_css_style_change_affects            (GtkCssStyleChange      *change,
                                                          GtkCssAffects           affects);
+GDK_AVAILABLE_IN_ALL
 gboolean        gtk_css_style_change_changes_property   (GtkCssStyleChange      *change,
                                                          guint                   id);
 void            gtk_css_style_change_print              (GtkCssStyleChange      *change, GString *string);
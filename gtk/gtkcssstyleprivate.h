@@ -249,6 +249,7 @@ struct _GtkCssStyleClass
 
 GType                   gtk_css_style_get_type                  (void) G_GNUC_CONST;
 
+GDK_AVAILABLE_IN_ALL
 GtkCssValue *           gtk_css_style_get_value                 (GtkCssStyle            *style,
                                                                  guint                   id) G_GNUC_PURE;
 GtkCssSection *         gtk_css_style_get_section               (GtkCssStyle            *style,
@@ -266,10 +267,14 @@ PangoFontDescription *  gtk_css_style_get_pango_font            (GtkCssStyle
 GtkCssStaticStyle *     gtk_css_style_get_static_style          (GtkCssStyle            *style);
 
 
-GtkCssValues *gtk_css_values_new   (GtkCssValuesType  type);
-GtkCssValues *gtk_css_values_ref   (GtkCssValues     *values);
-void          gtk_css_values_unref (GtkCssValues     *values);
-GtkCssValues *gtk_css_values_copy  (GtkCssValues     *values);
+GtkCssValues *gtk_css_values_new    (GtkCssValuesType  type);
+GtkCssValues *gtk_css_values_ref    (GtkCssValues     *values);
+void          gtk_css_values_unref  (GtkCssValues     *values);
+GtkCssValues *gtk_css_values_copy   (GtkCssValues     *values);
+GtkCssValues *gtk_css_values_intern (GtkCssValues     *values);
+void          gtk_css_values_take_intern_statistics (guint *n_interned,
+                                                     guint *n_shared,
+                                                     gsize *saved);
 
 void gtk_css_core_values_compute_changes_and_affects (GtkCssStyle *style1,
                                                       GtkCssStyle *style2,
@@ -170,6 +170,39 @@ gtk_css_value_ref (GtkCssValue *value)
   return value;
 }
 
+/* Computed values that can be hashed are interned when they are stored
+ * in a style, so that styles with equal values share a single instance
+ * instead of each holding their own copy. The table does not hold a
+ * reference, values remove themselves when they are freed.
+ */
+static GHashTable *interned_values;
+static guint interned_values_shared;
+
+static guint
+gtk_css_value_intern_hash (gconstpointer data)
+{
+  const GtkCssValue *value = data;
+
+  return GPOINTER_TO_UINT (value->class) ^ value->class->hash (value);
+}
+
+static gboolean
+gtk_css_value_intern_equal (gconstpointer data1,
+                            gconstpointer data2)
+{
+  return _gtk_css_value_equal (data1, data2);
+}
+
+static void
+gtk_css_value_unintern (GtkCssValue *value)
+{
+  if (interned_values == NULL)
+    return;
+
+  if (g_hash_table_lookup (interned_values, value) == value)
+    g_hash_table_remove (interned_values, value);
+}
+
 void
 gtk_css_value_unref (GtkCssValue *value)
 {
@@ -189,6 +222,9 @@ gtk_css_value_unref (GtkCssValue *value)
   }
 #endif
 
+  if (value->class->hash)
+    gtk_css_value_unintern (value);
+
   value->class->free (value);
 }
 
@@ -369,3 +405,92 @@ gtk_css_value_is_computed (const GtkCssValue *value)
 {
   return value->is_computed;
 }
+
+/**
+ * gtk_css_value_hash:
+ * @value: a #GtkCssValue
+ *
+ * Computes a hash for @value that is consistent with
+ * _gtk_css_value_equal(). Values of types that cannot be hashed
+ * all hash to 0.
+ *
+ * Returns: the hash of @value
+ */
+guint
+gtk_css_value_hash (const GtkCssValue *value)
+{
+  gtk_internal_return_val_if_fail (value != NULL, 0);
+
+  if (!value->class->hash)
+    return 0;
+
+  return value->class->hash (value);
+}
+
+/**
+ * gtk_css_value_intern:
+ * @value: (transfer full): a computed #GtkCssValue
+ *
+ * Looks for a value equal to @value that is already in use and returns
+ * it instead of @value, so equal computed values are only kept in memory
+ * once. Values that are not computed or cannot be hashed are returned
+ * unchanged.
+ *
+ * This must only be called from the thread computing styles.
+ *
+ * Returns: (transfer full): @value or an equal value
+ */
+GtkCssValue *
+gtk_css_value_intern (GtkCssValue *value)
+{
+  GtkCssValue *interned;
+
+  gtk_internal_return_val_if_fail (value != NULL, NULL);
+
+  if (!value->is_computed || !value->class->hash)
+    return value;
+
+  if (G_UNLIKELY (interned_values == NULL))
+    interned_values = g_hash_table_new (gtk_css_value_intern_hash, gtk_css_value_intern_equal);
+
+  interned = g_hash_table_lookup (interned_values, value);
+  if (interned == value)
+    return value;
+
+  if (interned != NULL)
+    {
+      interned_values_shared++;
+      gtk_css_value_ref (interned);
+      gtk_css_value_unref (value);
+      return interned;
+    }
+
+  /* Values that are not equal to themselves, like NaN numbers, could
+   * never be found again to remove them */
+  if (!value->class->equal (value, value))
+    return value;
+
+  g_hash_table_add (interned_values, value);
+
+  return value;
+}
+
+/*
+ * gtk_css_value_take_intern_statistics:
+ * @n_interned: (out): return location for the number of interned values
+ *     that are alive
+ * @n_shared: (out): return location for the number of computed values
+ *     that were replaced by an interned one
+ *
+ * Gets the statistics of gtk_css_value_intern() and resets the number
+ * of shared values. Each shared value is a value that would otherwise
+ * be kept in memory.
+ */
+void
+gtk_css_value_take_intern_statistics (guint *n_interned,
+                                      guint *n_shared)
+{
+  *n_interned = interned_values ? g_hash_table_size (interned_values) : 0;
+  *n_shared = interned_values_shared;
+  interned_values_shared = 0;
+}
@@ -60,6 +60,7 @@ struct _GtkCssValueClass {
                                                        gint64                      monotonic_time);
   void          (* print)                             (const GtkCssValue          *value,
                                                        GString                    *string);
+  guint         (* hash)                              (const GtkCssValue          *value);
 };
 
 GType        _gtk_css_value_get_type                  (void) G_GNUC_CONST;
@@ -95,6 +96,11 @@ void         _gtk_css_value_print                     (const GtkCssValue
                                                        GString                    *string);
 gboolean     gtk_css_value_is_computed                (const GtkCssValue          *value) G_GNUC_PURE;
 
+guint           gtk_css_value_hash                    (const GtkCssValue          *value) G_GNUC_PURE;
+GtkCssValue *   gtk_css_value_intern                  (GtkCssValue                *value);
+void            gtk_css_value_take_intern_statistics  (guint                      *n_interned,
+                                                       guint                      *n_shared);
+
 G_END_DECLS
 
 #endif /* __GTK_CSS_VALUE_PRIVATE_H__ */
@@ -52,6 +52,7 @@ typedef enum {
   GTK_DEBUG_LAYOUT          = 1 << 15,
   GTK_DEBUG_SNAPSHOT        = 1 << 16,
   GTK_DEBUG_CONSTRAINTS     = 1 << 17,
+  GTK_DEBUG_CSS             = 1 << 18,
 } GtkDebugFlag;
 
 #ifdef G_ENABLE_DEBUG
@@ -176,6 +176,7 @@ static const GDebugKey gtk_debug_keys[] = {
   { "layout", GTK_DEBUG_LAYOUT },
   { "snapshot", GTK_DEBUG_SNAPSHOT },
   { "constraints", GTK_DEBUG_CONSTRAINTS },
+  { "css", GTK_DEBUG_CSS },
 };
 #endif /* G_ENABLE_DEBUG */
 
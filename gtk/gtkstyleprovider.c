@@ -40,6 +40,7 @@ enum {
 G_DEFINE_INTERFACE (GtkStyleProvider, gtk_style_provider, G_TYPE_OBJECT)
 
 static guint signals[LAST_SIGNAL];
+static guint generation;
 
 static void
 gtk_style_provider_default_init (GtkStyleProviderInterface *iface)
@@ -120,9 +121,20 @@ gtk_style_provider_changed (GtkStyleProvider *provider)
 {
   gtk_internal_return_if_fail (GTK_IS_STYLE_PROVIDER (provider));
 
+  generation++;
+
   g_signal_emit (provider, signals[CHANGED], 0);
 }
 
+/* Increases whenever any provider changes, so caches of computed
+ * styles can tell when they are out of date.
+ */
+guint
+gtk_style_provider_get_generation (void)
+{
+  return generation;
+}
+
 GtkSettings *
 gtk_style_provider_get_settings (GtkStyleProvider *provider)
 {
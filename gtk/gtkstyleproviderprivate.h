@@ -67,6 +67,7 @@ void                    gtk_style_provider_lookup                (GtkStyleProvid
                                                                   GtkCssChange            *out_change);
 
 void                    gtk_style_provider_changed               (GtkStyleProvider        *provider);
+guint                   gtk_style_provider_get_generation        (void);
 
 void                    gtk_style_provider_emit_error            (GtkStyleProvider        *provider,
                                                                   GtkCssSection           *section,
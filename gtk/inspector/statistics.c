@@ -31,6 +31,7 @@
 #include "gtktreeview.h"
 #include "gtkeventcontrollerkey.h"
 #include "gtkmain.h"
+#include "gtkcssnodestylecacheprivate.h"
 
 #include <glib/gi18n-lib.h>
 
@@ -60,6 +61,8 @@ struct _GtkInspectorStatisticsPrivate
   guint update_source_id;
   GtkWidget *search_entry;
   GtkWidget *search_bar;
+  GtkWidget *style_cache;
+  guint style_cache_source_id;
 };
 
 typedef struct {
@@ -148,6 +151,24 @@ update_type_counts (gpointer data)
   return TRUE;
 }
 
+static gboolean
+update_style_cache (gpointer data)
+{
+  GtkInspectorStatistics *sl = data;
+  guint n_styles, hits, misses;
+  char *text;
+
+  gtk_css_node_style_cache_get_statistics (&n_styles, &hits, &misses);
+
+  text = g_strdup_printf (_("Shared style cache: %u styles, %u hits, %u misses (%.1f%% hit rate)"),
+                          n_styles, hits, misses,
+                          hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
+  gtk_label_set_text (GTK_LABEL (sl->priv->style_cache), text);
+  g_free (text);
+
+  return G_SOURCE_CONTINUE;
+}
+
 static void
 toggle_record (GtkToggleButton        *button,
                GtkInspectorStatistics *sl)
@@ -343,13 +364,19 @@ root (GtkWidget *widget)
   gtk_widget_add_controller (toplevel, controller);
 
   gtk_search_bar_set_key_capture_widget (GTK_SEARCH_BAR (sl->priv->search_bar), toplevel);
+
+  sl->priv->style_cache_source_id = g_timeout_add_seconds (1, update_style_cache, sl);
+  update_style_cache (sl);
 }
 
 static void
 unroot (GtkWidget *widget)
 {
+  GtkInspectorStatistics *sl = GTK_INSPECTOR_STATISTICS (widget);
   GtkWidget *toplevel;
 
+  g_clear_handle_id (&sl->priv->style_cache_source_id, g_source_remove);
+
   toplevel = GTK_WIDGET (gtk_widget_get_root (widget));
   g_object_set_data (G_OBJECT (toplevel), "statistics-controller", NULL);
 
@@ -488,6 +515,7 @@ gtk_inspector_statistics_class_init (GtkInspectorStatisticsClass *klass)
   gtk_widget_class_bind_template_child_private (widget_class, GtkInspectorStatistics, search_entry);
   gtk_widget_class_bind_template_child_private (widget_class, GtkInspectorStatistics, search_bar);
   gtk_widget_class_bind_template_child_private (widget_class, GtkInspectorStatistics, excuse);
+  gtk_widget_class_bind_template_child_private (widget_class, GtkInspectorStatistics, style_cache);
 
 }
 
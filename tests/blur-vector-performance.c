@@ -0,0 +1,125 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+/* Compares the vectorized box blur with the scalar one for radii
+ * from 2 to 100, and checks that both give the same pixels.
+ */
+
+#include <gsk/gskcairoblurprivate.h>
+#include <string.h>
+
+static void
+init_surface (cairo_surface_t *surface)
+{
+  int w = cairo_image_surface_get_width (surface);
+  int h = cairo_image_surface_get_height (surface);
+  cairo_t *cr;
+
+  cr = cairo_create (surface);
+
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_rgba (cr, 0, 0, 0, 0);
+  cairo_paint (cr);
+
+  cairo_set_source_rgba (cr, 0, 0, 0, 1);
+  cairo_arc (cr, w / 2, h / 2, w / 3, 0, 2 * G_PI);
+  cairo_fill (cr);
+
+  /* Some odd sizes, so the columns don't line up with the vectors */
+  cairo_set_source_rgba (cr, 0, 0, 0, 0.5);
+  cairo_rectangle (cr, 17, 23, 61, 7);
+  cairo_rectangle (cr, w - 33, 5, 31, h - 10);
+  cairo_fill (cr);
+
+  cairo_destroy (cr);
+}
+
+static double
+blur (cairo_surface_t *surface,
+      int              radius,
+      GskBlurFlags     flags)
+{
+  gint64 start;
+
+  init_surface (surface);
+
+  start = g_get_monotonic_time ();
+  gsk_cairo_blur_surface (surface, radius, flags);
+
+  return (double) (g_get_monotonic_time () - start) / G_TIME_SPAN_MILLISECOND;
+}
+
+static gboolean
+compare (cairo_surface_t *surface1,
+         cairo_surface_t *surface2)
+{
+  int stride = cairo_image_surface_get_stride (surface1);
+  int height = cairo_image_surface_get_height (surface1);
+
+  return memcmp (cairo_image_surface_get_data (surface1),
+                 cairo_image_surface_get_data (surface2),
+                 stride * height) == 0;
+}
+
+static int opt_size = 1999;
+
+static GOptionEntry options[] = {
+  { "size", 's', 0, G_OPTION_ARG_INT, &opt_size, "Size of the surface", "PIXELS" },
+  { NULL }
+};
+
+int
+main (int argc, char **argv)
+{
+  static const int radii[] = { 2, 3, 4, 5, 8, 10, 15, 20, 30, 50, 75, 100 };
+  GOptionContext *option_context;
+  GError *error = NULL;
+  cairo_surface_t *scalar, *vector;
+  gboolean success = TRUE;
+  guint i;
+  int j;
+
+  option_context = g_option_context_new ("");
+  g_option_context_add_main_entries (option_context, options, NULL);
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("Option parsing failed: %s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (option_context);
+
+  scalar = cairo_image_surface_create (CAIRO_FORMAT_A8, opt_size, opt_size);
+  vector = cairo_image_surface_create (CAIRO_FORMAT_A8, opt_size, opt_size);
+
+  for (i = 0; i < G_N_ELEMENTS (radii); i++)
+    {
+      double scalar_msec = G_MAXDOUBLE, vector_msec = G_MAXDOUBLE;
+      gboolean same = TRUE;
+
+      /* Best of three */
+      for (j = 0; j < 3; j++)
+        {
+          scalar_msec = MIN (scalar_msec, blur (scalar, radii[i], GSK_BLUR_X | GSK_BLUR_Y | GSK_BLUR_SCALAR));
+          vector_msec = MIN (vector_msec, blur (vector, radii[i], GSK_BLUR_X | GSK_BLUR_Y));
+          same &= compare (scalar, vector);
+        }
+
+      /* One direction only */
+      blur (scalar, radii[i], GSK_BLUR_X | GSK_BLUR_SCALAR);
+      blur (vector, radii[i], GSK_BLUR_X);
+      same &= compare (scalar, vector);
+      blur (scalar, radii[i], GSK_BLUR_Y | GSK_BLUR_SCALAR);
+      blur (vector, radii[i], GSK_BLUR_Y);
+      same &= compare (scalar, vector);
+
+      g_print ("Radius %3d: scalar %7.2f msec, vector %7.2f msec, %.1fx%s\n",
+               radii[i], scalar_msec, vector_msec, scalar_msec / vector_msec,
+               same ? "" : ", OUTPUT DIFFERS");
+
+      success &= same;
+    }
+
+  cairo_surface_destroy (scalar);
+  cairo_surface_destroy (vector);
+
+  return success ? 0 : 1;
+}
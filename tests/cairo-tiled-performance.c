@@ -0,0 +1,218 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+/* Compares rendering a large frame with the cairo renderer on one
+ * thread and in tiles on worker threads (GSK_CAIRO_THREADS), and
+ * checks that both give the same pixels.
+ */
+
+#include <gtk/gtk.h>
+#include <string.h>
+
+#include "run-stats.h"
+
+#define N_WIDGETS 2000
+
+static GskRenderNode *
+create_widget (int n)
+{
+  GskRenderNode *children[4];
+  GskRenderNode *node, *content;
+  GskColorStop stops[2];
+  GskRoundedRect outline;
+  GskTransform *transform;
+  guint i;
+
+  gsk_rounded_rect_init_from_rect (&outline, &GRAPHENE_RECT_INIT (0, 0, 90, 26), 5);
+
+  stops[0] = (GskColorStop) { 0.0, { 0.95, 0.95, 0.95, 1 } };
+  stops[1] = (GskColorStop) { 1.0, { 0.75, 0.8, 0.9, 1 } };
+
+  children[0] = gsk_outset_shadow_node_new (&outline, &(GdkRGBA) { 0, 0, 0, 0.3 }, 0, 1, 1, 0);
+  content = gsk_linear_gradient_node_new (&outline.bounds,
+                                          &GRAPHENE_POINT_INIT (0, 0),
+                                          &GRAPHENE_POINT_INIT (0, 26),
+                                          stops, G_N_ELEMENTS (stops));
+  children[1] = gsk_rounded_clip_node_new (content, &outline);
+  gsk_render_node_unref (content);
+  children[2] = gsk_border_node_new (&outline,
+                                     (float[4]) { 1, 1, 1, 1 },
+                                     (GdkRGBA[4]) {
+                                       { 0.4, 0.4, 0.4, 1 },
+                                       { 0.4, 0.4, 0.4, 1 },
+                                       { 0.4, 0.4, 0.4, 1 },
+                                       { 0.4, 0.4, 0.4, 1 }
+                                     });
+  children[3] = gsk_inset_shadow_node_new (&outline, &(GdkRGBA) { 1, 1, 1, 0.5 }, 0, 1, 0, 2);
+
+  content = gsk_container_node_new (children, G_N_ELEMENTS (children));
+  for (i = 0; i < G_N_ELEMENTS (children); i++)
+    gsk_render_node_unref (children[i]);
+
+  node = gsk_opacity_node_new (content, n % 3 ? 1.0 : 0.7);
+  gsk_render_node_unref (content);
+
+  transform = gsk_transform_translate (NULL, &GRAPHENE_POINT_INIT (100 * (n % 20) + 5, 30 * (n / 20) + 2));
+  content = gsk_transform_node_new (node, transform);
+  gsk_transform_unref (transform);
+  gsk_render_node_unref (node);
+
+  return content;
+}
+
+static GskRenderNode *
+create_tree (void)
+{
+  GskRenderNode *widgets[N_WIDGETS + 1];
+  GskRenderNode *node;
+  int i;
+
+  widgets[0] = gsk_color_node_new (&(GdkRGBA) { 1, 1, 1, 1 },
+                                   &GRAPHENE_RECT_INIT (0, 0, 2000, 3000));
+  for (i = 0; i < N_WIDGETS; i++)
+    widgets[i + 1] = create_widget (i);
+
+  node = gsk_container_node_new (widgets, N_WIDGETS + 1);
+
+  for (i = 0; i < N_WIDGETS + 1; i++)
+    gsk_render_node_unref (widgets[i]);
+
+  return node;
+}
+
+static GskRenderer *
+create_renderer (GdkSurface *surface,
+                 const char *threads)
+{
+  GskRenderer *renderer;
+  GError *error = NULL;
+
+  if (threads)
+    g_setenv ("GSK_CAIRO_THREADS", threads, TRUE);
+  else
+    g_unsetenv ("GSK_CAIRO_THREADS");
+
+  renderer = gsk_cairo_renderer_new ();
+  if (!gsk_renderer_realize (renderer, surface, &error))
+    g_error ("Failed to realize renderer: %s", error->message);
+
+  return renderer;
+}
+
+static GdkTexture *
+render (GskRenderer   *renderer,
+        GskRenderNode *node)
+{
+  return gsk_renderer_render_texture (renderer, node, &GRAPHENE_RECT_INIT (0, 0, 2000, 3000));
+}
+
+static guint
+count_mismatches (GdkTexture *texture1,
+                  GdkTexture *texture2)
+{
+  int width = gdk_texture_get_width (texture1);
+  int height = gdk_texture_get_height (texture1);
+  guchar *data1, *data2;
+  guint mismatches;
+  int i;
+
+  data1 = g_malloc (width * height * 4);
+  data2 = g_malloc (width * height * 4);
+  gdk_texture_download (texture1, data1, width * 4);
+  gdk_texture_download (texture2, data2, width * 4);
+
+  mismatches = 0;
+  for (i = 0; i < width * height; i++)
+    {
+      if (memcmp (data1 + 4 * i, data2 + 4 * i, 4) != 0)
+        mismatches++;
+    }
+
+  g_free (data1);
+  g_free (data2);
+
+  return mismatches;
+}
+
+static int opt_threads = -1;
+
+static GOptionEntry options[] = {
+  { "threads", 't', 0, G_OPTION_ARG_INT, &opt_threads, "Number of threads (default: one per CPU)", "COUNT" },
+  { NULL }
+};
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *option_context;
+  GError *error = NULL;
+  GskRenderer *serial, *tiled;
+  GskRenderNode *node;
+  GdkSurface *surface;
+  GdkTexture *texture1, *texture2;
+  RunStats serial_stats, tiled_stats;
+  char *threads;
+  guint mismatches;
+  int run;
+
+  option_context = g_option_context_new ("");
+  g_option_context_add_main_entries (option_context, options, NULL);
+  run_stats_add_options (g_option_context_get_main_group (option_context));
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("Option parsing failed: %s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (option_context);
+
+  gtk_init ();
+
+  surface = gdk_surface_new_toplevel (gdk_display_get_default (), 10, 10);
+  threads = g_strdup_printf ("%d", opt_threads);
+  serial = create_renderer (surface, NULL);
+  tiled = create_renderer (surface, threads);
+  g_free (threads);
+
+  node = create_tree ();
+
+  /* Warm up, and compare the results */
+  texture1 = render (serial, node);
+  texture2 = render (tiled, node);
+  mismatches = count_mismatches (texture1, texture2);
+  g_object_unref (texture1);
+  g_object_unref (texture2);
+
+  if (mismatches != 0)
+    {
+      g_printerr ("Rendering in tiles gives a different result: %u pixels differ\n", mismatches);
+      return 1;
+    }
+
+  run_stats_init (&serial_stats, "Serial");
+  run_stats_init (&tiled_stats, "Tiled");
+
+  for (run = 0; run < run_stats_get_runs (); run++)
+    {
+      run_stats_start (&serial_stats);
+      texture1 = render (serial, node);
+      run_stats_stop (&serial_stats);
+
+      run_stats_start (&tiled_stats);
+      texture2 = render (tiled, node);
+      run_stats_stop (&tiled_stats);
+
+      g_object_unref (texture1);
+      g_object_unref (texture2);
+    }
+
+  run_stats_print (&serial_stats);
+  run_stats_print (&tiled_stats);
+
+  gsk_render_node_unref (node);
+  gsk_renderer_unrealize (serial);
+  gsk_renderer_unrealize (tiled);
+  g_object_unref (serial);
+  g_object_unref (tiled);
+  g_object_unref (surface);
+
+  return 0;
+}
@@ -0,0 +1,94 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+/* Compares loading a style sheet by parsing it (GTK_DEBUG=no-css-cache)
+ * with loading it from the compiled style sheet cache, and checks that
+ * both give the same result. This needs a build with debugging enabled,
+ * otherwise both paths use the cache.
+ */
+
+#include <gtk/gtk.h>
+
+#include "run-stats.h"
+
+static void
+load (GFile     *file,
+      guint      flags,
+      RunStats  *stats,
+      char     **result)
+{
+  GtkCssProvider *provider;
+
+  gtk_set_debug_flags (flags);
+
+  if (stats)
+    run_stats_start (stats);
+  provider = gtk_css_provider_new ();
+  gtk_css_provider_load_from_file (provider, file);
+  if (stats)
+    run_stats_stop (stats);
+
+  if (result)
+    *result = gtk_css_provider_to_string (provider);
+
+  g_object_unref (provider);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *option_context;
+  GError *error = NULL;
+  GFile *file;
+  RunStats parse_stats, cache_stats;
+  char *parsed, *cached;
+  guint flags;
+  int run;
+
+  option_context = g_option_context_new ("[FILE]");
+  run_stats_add_options (g_option_context_get_main_group (option_context));
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("Option parsing failed: %s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (option_context);
+
+  gtk_init ();
+
+  if (argc > 1)
+    file = g_file_new_for_commandline_arg (argv[1]);
+  else
+    file = g_file_new_for_uri ("resource:///org/gtk/libgtk/theme/Adwaita/gtk.css");
+
+  flags = gtk_get_debug_flags ();
+
+  /* Make sure the cache exists, and compare the results */
+  load (file, flags | GTK_DEBUG_NO_CSS_CACHE, NULL, &parsed);
+  load (file, flags, NULL, NULL);
+  load (file, flags, NULL, &cached);
+
+  if (!g_str_equal (parsed, cached))
+    {
+      g_printerr ("Loading from the cache gives a different result\n");
+      return 1;
+    }
+  g_free (parsed);
+  g_free (cached);
+
+  run_stats_init (&parse_stats, "Parse");
+  run_stats_init (&cache_stats, "Cache");
+
+  for (run = 0; run < run_stats_get_runs (); run++)
+    {
+      load (file, flags | GTK_DEBUG_NO_CSS_CACHE, &parse_stats, NULL);
+      load (file, flags, &cache_stats, NULL);
+    }
+
+  run_stats_print (&parse_stats);
+  run_stats_print (&cache_stats);
+
+  gtk_set_debug_flags (flags);
+  g_object_unref (file);
+
+  return 0;
+}
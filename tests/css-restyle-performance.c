@@ -0,0 +1,119 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+/* Measures how long it takes to restyle a deep and wide widget tree
+ * when switching between the light and dark variants of the theme.
+ * Run it with and without GTK_CSS_THREADS set to compare matching
+ * styles on one thread and on worker threads.
+ */
+
+#include <gtk/gtk.h>
+
+#include "run-stats.h"
+
+static int opt_depth = 6;
+static int opt_width = 4;
+
+static GOptionEntry options[] = {
+  { "depth", 'd', 0, G_OPTION_ARG_INT, &opt_depth, "Depth of the widget tree", "DEPTH" },
+  { "width", 'w', 0, G_OPTION_ARG_INT, &opt_width, "Children per box", "COUNT" },
+  { NULL }
+};
+
+static GtkWidget *
+create_tree (int depth,
+             int n)
+{
+  GtkWidget *box;
+  int i;
+
+  if (depth == 0)
+    {
+      if (n % 2)
+        return gtk_button_new_with_label ("Button");
+      else
+        return gtk_label_new ("Label");
+    }
+
+  box = gtk_box_new (depth % 2 ? GTK_ORIENTATION_HORIZONTAL : GTK_ORIENTATION_VERTICAL, 2);
+  if (n % 3 == 0)
+    gtk_widget_add_css_class (box, "linked");
+
+  for (i = 0; i < opt_width; i++)
+    gtk_container_add (GTK_CONTAINER (box), create_tree (depth - 1, i));
+
+  return box;
+}
+
+static void
+layout_cb (GdkFrameClock *frame_clock,
+           gpointer       data)
+{
+  RunStats *stats = data;
+
+  if (stats->start != 0)
+    {
+      run_stats_stop (stats);
+      stats->start = 0;
+      g_main_context_wakeup (NULL);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *option_context;
+  GError *error = NULL;
+  GtkSettings *settings;
+  GtkWidget *window, *scrolled_window;
+  GdkFrameClock *frame_clock;
+  RunStats stats;
+  gboolean dark;
+  int run;
+
+  option_context = g_option_context_new ("");
+  g_option_context_add_main_entries (option_context, options, NULL);
+  run_stats_add_options (g_option_context_get_main_group (option_context));
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("Option parsing failed: %s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (option_context);
+
+  gtk_init ();
+
+  settings = gtk_settings_get_default ();
+  g_object_get (settings, "gtk-application-prefer-dark-theme", &dark, NULL);
+
+  window = gtk_window_new ();
+  gtk_window_set_default_size (GTK_WINDOW (window), 800, 600);
+  scrolled_window = gtk_scrolled_window_new (NULL, NULL);
+  gtk_container_add (GTK_CONTAINER (window), scrolled_window);
+  gtk_container_add (GTK_CONTAINER (scrolled_window), create_tree (opt_depth, 0));
+  gtk_widget_show (window);
+
+  while (!gtk_widget_get_mapped (window))
+    g_main_context_iteration (NULL, TRUE);
+
+  /* The window validates styles in its own layout handler, which runs
+   * before this one */
+  run_stats_init (&stats, "Restyle");
+  frame_clock = gtk_widget_get_frame_clock (window);
+  g_signal_connect_after (frame_clock, "layout", G_CALLBACK (layout_cb), &stats);
+
+  for (run = 0; run < run_stats_get_runs (); run++)
+    {
+      dark = !dark;
+      run_stats_start (&stats);
+      g_object_set (settings, "gtk-application-prefer-dark-theme", dark, NULL);
+
+      while (stats.start != 0)
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+  run_stats_print (&stats);
+
+  gtk_widget_destroy (window);
+
+  return 0;
+}
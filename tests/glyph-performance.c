@@ -0,0 +1,124 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+/* Measures how long the first frame of a page of text takes when
+ * none of its glyphs are in the glyph cache yet. Every run uses a
+ * new font size, so all glyphs have to be rasterized and uploaded.
+ */
+
+#include <gtk/gtk.h>
+
+#include "run-stats.h"
+
+/* A page of CJK text: 40 lines of 40 ideographs */
+#define N_LINES 40
+#define N_COLUMNS 40
+
+static char *
+create_text (int first)
+{
+  GString *text = g_string_new ("");
+  int i, j;
+
+  for (i = 0; i < N_LINES; i++)
+    {
+      for (j = 0; j < N_COLUMNS; j++)
+        g_string_append_unichar (text, 0x4E00 + first + i * N_COLUMNS + j);
+      g_string_append_c (text, '\n');
+    }
+
+  return g_string_free (text, FALSE);
+}
+
+static GskRenderNode *
+create_text_node (PangoContext *context,
+                  const char   *font,
+                  int           size,
+                  const char   *text)
+{
+  GtkSnapshot *snapshot;
+  PangoLayout *layout;
+  PangoFontDescription *desc;
+
+  desc = pango_font_description_from_string (font);
+  pango_font_description_set_absolute_size (desc, size * PANGO_SCALE);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_font_description (layout, desc);
+  pango_layout_set_text (layout, text, -1);
+
+  snapshot = gtk_snapshot_new ();
+  gtk_snapshot_append_layout (snapshot, layout, &(GdkRGBA) { 0, 0, 0, 1 });
+
+  g_object_unref (layout);
+  pango_font_description_free (desc);
+
+  return gtk_snapshot_free_to_node (snapshot);
+}
+
+static char *opt_font = "Noto Sans CJK SC";
+
+static GOptionEntry options[] = {
+  { "font", 'f', 0, G_OPTION_ARG_STRING, &opt_font, "Font family to use", "FAMILY" },
+  { NULL }
+};
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *option_context;
+  GError *error = NULL;
+  GdkSurface *surface;
+  GskRenderer *renderer;
+  PangoContext *context;
+  RunStats stats;
+  int run;
+
+  option_context = g_option_context_new ("");
+  g_option_context_add_main_entries (option_context, options, NULL);
+  run_stats_add_options (g_option_context_get_main_group (option_context));
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("Option parsing failed: %s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (option_context);
+
+  gtk_init ();
+
+  surface = gdk_surface_new_toplevel (gdk_display_get_default (), 10, 10);
+  renderer = gsk_renderer_new_for_surface (surface);
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  g_print ("Rendering with %s\n", G_OBJECT_TYPE_NAME (renderer));
+
+  run_stats_init (&stats, "First frame");
+
+  for (run = 0; run < run_stats_get_runs (); run++)
+    {
+      GskRenderNode *node;
+      GdkTexture *texture;
+      char *text;
+
+      /* New glyphs and a new size every time */
+      text = create_text (run * N_LINES * N_COLUMNS);
+      node = create_text_node (context, opt_font, 12 + run, text);
+
+      run_stats_start (&stats);
+      texture = gsk_renderer_render_texture (renderer, node, NULL);
+      run_stats_stop (&stats);
+
+      g_object_unref (texture);
+      gsk_render_node_unref (node);
+      g_free (text);
+    }
+
+  g_print ("%d new glyphs per frame\n", N_LINES * N_COLUMNS);
+  run_stats_print (&stats);
+
+  gsk_renderer_unrealize (renderer);
+  g_object_unref (renderer);
+  g_object_unref (context);
+  g_object_unref (surface);
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+/* Measures how long it takes to download a memory texture of each
+ * format, which converts it to the cairo format. This is what happens
+ * to every video frame and pixbuf that is drawn.
+ */
+
+#include <gtk/gtk.h>
+
+#include "run-stats.h"
+
+static int opt_width = 3840;
+static int opt_height = 2160;
+
+static GOptionEntry options[] = {
+  { "width", 'w', 0, G_OPTION_ARG_INT, &opt_width, "Width of the texture", "PIXELS" },
+  { "height", 'h', 0, G_OPTION_ARG_INT, &opt_height, "Height of the texture", "PIXELS" },
+  { NULL }
+};
+
+static gsize
+bytes_per_pixel (GdkMemoryFormat format)
+{
+  switch (format)
+    {
+    case GDK_MEMORY_R8G8B8:
+    case GDK_MEMORY_B8G8R8:
+      return 3;
+
+    default:
+      return 4;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *option_context;
+  GError *error = NULL;
+  GEnumClass *enum_class;
+  GdkMemoryFormat format;
+  guchar *dest;
+
+  option_context = g_option_context_new ("");
+  g_option_context_add_main_entries (option_context, options, NULL);
+  run_stats_add_options (g_option_context_get_main_group (option_context));
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("Option parsing failed: %s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (option_context);
+
+  enum_class = g_type_class_ref (GDK_TYPE_MEMORY_FORMAT);
+  dest = g_malloc ((gsize) opt_width * opt_height * 4);
+
+  for (format = 0; format < GDK_MEMORY_N_FORMATS; format++)
+    {
+      gsize stride = opt_width * bytes_per_pixel (format);
+      RunStats stats;
+      GdkTexture *texture;
+      GBytes *bytes;
+      guchar *data;
+      gsize i;
+      int run;
+
+      data = g_malloc (stride * opt_height);
+      for (i = 0; i < stride * opt_height; i++)
+        data[i] = g_random_int_range (0, 256);
+      bytes = g_bytes_new_take (data, stride * opt_height);
+      texture = gdk_memory_texture_new (opt_width, opt_height, format, bytes, stride);
+      g_bytes_unref (bytes);
+
+      run_stats_init (&stats, g_enum_get_value (enum_class, format)->value_nick);
+
+      for (run = 0; run < run_stats_get_runs (); run++)
+        {
+          run_stats_start (&stats);
+          gdk_texture_download (texture, dest, opt_width * 4);
+          run_stats_stop (&stats);
+        }
+
+      run_stats_print (&stats);
+
+      g_object_unref (texture);
+    }
+
+  g_free (dest);
+  g_type_class_unref (enum_class);
+
+  return 0;
+}
@@ -0,0 +1,185 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+/* Measures how long it takes to create and free the render nodes of
+ * a busy window: 1000 widgets with 50 nodes each.
+ *
+ * Run with GSK_DEBUG=renderer to also see the allocator statistics
+ * after the last tree has been rendered.
+ */
+
+#include <gtk/gtk.h>
+
+#include "run-stats.h"
+
+#define N_WIDGETS 1000
+
+static GskRenderNode *
+create_label (float x,
+              float y)
+{
+  GskRenderNode *children[3];
+  GskRenderNode *node;
+  guint i;
+
+  /* 3 nodes */
+  for (i = 0; i < 3; i++)
+    children[i] = gsk_color_node_new (&(GdkRGBA) { 0, 0, 0, 1 },
+                                      &GRAPHENE_RECT_INIT (x + 2, y + 4 * i, 20, 3));
+
+  /* 1 node */
+  node = gsk_container_node_new (children, 3);
+
+  for (i = 0; i < 3; i++)
+    gsk_render_node_unref (children[i]);
+
+  return node;
+}
+
+/* A button-like widget: background, shadow, border, a clipped
+ * label and a focus ring. 50 nodes in total. */
+static GskRenderNode *
+create_widget (int n)
+{
+  GskRenderNode *children[13];
+  GskRenderNode *labels[8];
+  GskRenderNode *node, *content;
+  GskRoundedRect outline;
+  GskTransform *transform;
+  float x = 0, y = 0;
+  guint i;
+
+  gsk_rounded_rect_init_from_rect (&outline, &GRAPHENE_RECT_INIT (x, y, 100, 30), 4);
+
+  /* 1 node */
+  children[0] = gsk_outset_shadow_node_new (&outline, &(GdkRGBA) { 0, 0, 0, 0.3 }, 0, 1, 0, 3);
+  /* 1 node */
+  children[1] = gsk_color_node_new (&(GdkRGBA) { 0.9, 0.9, 0.9, 1 }, &outline.bounds);
+  /* 1 node */
+  children[2] = gsk_border_node_new (&outline,
+                                     (float[4]) { 1, 1, 1, 1 },
+                                     (GdkRGBA[4]) {
+                                       { 0.5, 0.5, 0.5, 1 },
+                                       { 0.5, 0.5, 0.5, 1 },
+                                       { 0.5, 0.5, 0.5, 1 },
+                                       { 0.5, 0.5, 0.5, 1 }
+                                     });
+  /* 8 * 4 = 32 nodes */
+  for (i = 0; i < 8; i++)
+    labels[i] = create_label (x + 4 + 12 * i, y + 8);
+  /* 1 node */
+  content = gsk_container_node_new (labels, 8);
+  for (i = 0; i < 8; i++)
+    gsk_render_node_unref (labels[i]);
+  /* 1 node */
+  children[3] = gsk_rounded_clip_node_new (content, &outline);
+  gsk_render_node_unref (content);
+  /* 9 nodes */
+  for (i = 4; i < 13; i++)
+    children[i] = gsk_color_node_new (&(GdkRGBA) { 0.2, 0.4, 0.8, 1 },
+                                      &GRAPHENE_RECT_INIT (x + 12 * (i - 4), y + 28, 10, 2));
+
+  /* 1 node */
+  content = gsk_container_node_new (children, 13);
+  for (i = 0; i < 13; i++)
+    gsk_render_node_unref (children[i]);
+
+  /* 1 node */
+  node = gsk_opacity_node_new (content, n % 2 ? 1.0 : 0.8);
+  gsk_render_node_unref (content);
+
+  /* 1 node */
+  transform = gsk_transform_translate (NULL, &GRAPHENE_POINT_INIT (100 * (n % 10), 30 * (n / 10)));
+  content = gsk_transform_node_new (node, transform);
+  gsk_transform_unref (transform);
+  gsk_render_node_unref (node);
+
+  /* 1 node */
+  node = gsk_debug_node_new (content, g_strdup ("GtkButton"));
+  gsk_render_node_unref (content);
+
+  return node;
+}
+
+static GskRenderNode *
+create_tree (void)
+{
+  GskRenderNode *widgets[N_WIDGETS];
+  GskRenderNode *node;
+  int i;
+
+  for (i = 0; i < N_WIDGETS; i++)
+    widgets[i] = create_widget (i);
+
+  node = gsk_container_node_new (widgets, N_WIDGETS);
+
+  for (i = 0; i < N_WIDGETS; i++)
+    gsk_render_node_unref (widgets[i]);
+
+  return node;
+}
+
+static gboolean opt_render = FALSE;
+
+static GOptionEntry options[] = {
+  { "render", 0, 0, G_OPTION_ARG_NONE, &opt_render, "Render the last tree", NULL },
+  { NULL }
+};
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *option_context;
+  GError *error = NULL;
+  RunStats create_stats, free_stats;
+  int run;
+
+  option_context = g_option_context_new ("");
+  g_option_context_add_main_entries (option_context, options, NULL);
+  run_stats_add_options (g_option_context_get_main_group (option_context));
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("Option parsing failed: %s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (option_context);
+
+  gtk_init ();
+
+  run_stats_init (&create_stats, "Create");
+  run_stats_init (&free_stats, "Free");
+
+  for (run = 0; run < run_stats_get_runs (); run++)
+    {
+      GskRenderNode *node;
+
+      run_stats_start (&create_stats);
+      node = create_tree ();
+      run_stats_stop (&create_stats);
+
+      if (opt_render && run == run_stats_get_runs () - 1)
+        {
+          GdkSurface *surface;
+          GskRenderer *renderer;
+          GdkTexture *texture;
+
+          surface = gdk_surface_new_toplevel (gdk_display_get_default (), 10, 10);
+          renderer = gsk_renderer_new_for_surface (surface);
+          texture = gsk_renderer_render_texture (renderer, node, &GRAPHENE_RECT_INIT (0, 0, 1000, 3000));
+
+          g_object_unref (texture);
+          gsk_renderer_unrealize (renderer);
+          g_object_unref (renderer);
+          g_object_unref (surface);
+        }
+
+      run_stats_start (&free_stats);
+      gsk_render_node_unref (node);
+      run_stats_stop (&free_stats);
+    }
+
+  g_print ("%d nodes per tree\n", N_WIDGETS * 50 + 1);
+  run_stats_print (&create_stats);
+  run_stats_print (&free_stats);
+
+  return 0;
+}
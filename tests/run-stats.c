@@ -0,0 +1,80 @@
+/* -*- mode: C; c-basic-offset: 2; indent-tabs-mode: nil; -*- */
+
+#include <glib.h>
+
+#include "run-stats.h"
+
+static int runs = 10;
+
+static GOptionEntry run_stats_options[] = {
+  { "runs", 'r', 0, G_OPTION_ARG_INT, &runs, "Number of runs", "COUNT" },
+  { NULL }
+};
+
+void
+run_stats_add_options (GOptionGroup *group)
+{
+  g_option_group_add_entries (group, run_stats_options);
+}
+
+int
+run_stats_get_runs (void)
+{
+  return MAX (runs, 0);
+}
+
+void
+run_stats_init (RunStats   *stats,
+                const char *name)
+{
+  stats->name = name;
+  variable_init (&stats->time);
+  stats->min = G_MAXDOUBLE;
+  stats->max = 0;
+  stats->start = 0;
+}
+
+void
+run_stats_start (RunStats *stats)
+{
+  stats->start = g_get_monotonic_time ();
+}
+
+/* Returns the time since run_stats_start() in msec */
+double
+run_stats_stop (RunStats *stats)
+{
+  double msec;
+
+  msec = (double) (g_get_monotonic_time () - stats->start) / G_TIME_SPAN_MILLISECOND;
+  run_stats_add (stats, msec);
+
+  return msec;
+}
+
+void
+run_stats_add (RunStats *stats,
+               double    msec)
+{
+  variable_add (&stats->time, msec);
+  stats->min = MIN (stats->min, msec);
+  stats->max = MAX (stats->max, msec);
+}
+
+void
+run_stats_print (RunStats *stats)
+{
+  if (stats->time.weight == 0)
+    {
+      g_print ("%s: <n/a>\n", stats->name);
+      return;
+    }
+
+  g_print ("%s: %g runs, min %.2f msec, avg %.2f +/- %.2f msec, max %.2f msec\n",
+           stats->name,
+           stats->time.weight,
+           stats->min,
+           variable_mean (&stats->time),
+           variable_standard_deviation (&stats->time),
+           stats->max);
+}
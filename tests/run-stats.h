@@ -0,0 +1,28 @@
+#ifndef __RUN_STATS_H__
+#define __RUN_STATS_H__
+
+#include <glib.h>
+
+#include "variable.h"
+
+typedef struct
+{
+  const char *name;
+  Variable time;
+  double min;
+  double max;
+  gint64 start;
+} RunStats;
+
+void   run_stats_add_options (GOptionGroup *group);
+int    run_stats_get_runs    (void);
+
+void   run_stats_init        (RunStats     *stats,
+                              const char   *name);
+void   run_stats_start       (RunStats     *stats);
+double run_stats_stop        (RunStats     *stats);
+void   run_stats_add         (RunStats     *stats,
+                              double        msec);
+void   run_stats_print       (RunStats     *stats);
+
+#endif /* __RUN_STATS_H__ */
@@ -0,0 +1,124 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+
+/* Loads a file, which parses it and writes the compiled style sheet
+ * cache, then loads it again from the cache, and checks that both
+ * give the same style sheet.
+ */
+
+static char *
+load (GFile *file)
+{
+  GtkCssProvider *provider;
+  char *result;
+
+  provider = gtk_css_provider_new ();
+  gtk_css_provider_load_from_file (provider, file);
+  result = gtk_css_provider_to_string (provider);
+  g_object_unref (provider);
+
+  return result;
+}
+
+static char *
+get_cache_path (GFile *file)
+{
+  char *uri, *checksum, *basename, *path;
+
+  uri = g_file_get_uri (file);
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, uri, -1);
+  basename = g_strconcat (checksum, ".cache", NULL);
+  path = g_build_filename (g_get_user_cache_dir (), "gtk-4.0", "css", basename, NULL);
+
+  g_free (basename);
+  g_free (checksum);
+  g_free (uri);
+
+  return path;
+}
+
+static void
+test_cache (gconstpointer data)
+{
+  GFile *file = G_FILE (data);
+  char *parsed, *cached, *path;
+
+  path = get_cache_path (file);
+  g_remove (path);
+
+  parsed = load (file);
+  g_assert_true (g_file_test (path, G_FILE_TEST_EXISTS));
+
+  cached = load (file);
+  g_assert_cmpstr (parsed, ==, cached);
+
+  g_free (parsed);
+  g_free (cached);
+  g_free (path);
+}
+
+static void
+remove_recursively (const char *path)
+{
+  GDir *dir;
+  const char *name;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)))
+        {
+          char *child = g_build_filename (path, name, NULL);
+          remove_recursively (child);
+          g_free (child);
+        }
+      g_dir_close (dir);
+    }
+
+  g_remove (path);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GFile *file, *theme;
+  char *cache_dir;
+  int result;
+
+  /* Don't touch the real cache */
+  cache_dir = g_dir_make_tmp ("gtk-css-cache-XXXXXX", NULL);
+  g_assert_nonnull (cache_dir);
+  g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+
+  gtk_test_init (&argc, &argv, NULL);
+
+  file = g_file_new_for_path (g_test_get_filename (G_TEST_DIST, "cache.css", NULL));
+  theme = g_file_new_for_uri ("resource:///org/gtk/libgtk/theme/Adwaita/gtk.css");
+
+  g_test_add_data_func ("/css/cache/shared-values", file, test_cache);
+  g_test_add_data_func ("/css/cache/adwaita", theme, test_cache);
+
+  result = g_test_run ();
+
+  g_object_unref (file);
+  g_object_unref (theme);
+  remove_recursively (cache_dir);
+  g_free (cache_dir);
+
+  return result;
+}
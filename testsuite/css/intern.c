@@ -0,0 +1,145 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+#include "gtk/gtkcssnodeprivate.h"
+#include "gtk/gtkcssstylechangeprivate.h"
+#include "gtk/gtkcsstypesprivate.h"
+
+/* The same shadows are declared by different rules, so the
+ * specified values are different objects and only interning
+ * the computed values can make the styles share them.
+ */
+static const char css[] =
+  ".a { box-shadow: 1px 2px 3px 4px red; text-shadow: 1px 1px 2px blue; }\n"
+  ".b { box-shadow: 1px 2px 3px 4px red; text-shadow: 1px 1px 2px blue; }\n"
+  ".c { box-shadow: 1px 2px 3px 4px red; text-shadow: 1px 1px 2px blue; opacity: 0.5; }\n"
+  ".d { box-shadow: 1px 2px 3px 4px green; }\n";
+
+static GtkCssNode *
+create_node (const char *first_class,
+             ...)
+{
+  GtkCssNode *node;
+  const char *class;
+  va_list args;
+
+  node = gtk_css_node_new ();
+
+  va_start (args, first_class);
+  for (class = first_class; class; class = va_arg (args, const char *))
+    gtk_css_node_add_class (node, g_quark_from_string (class));
+  va_end (args);
+
+  return node;
+}
+
+static void
+test_values (void)
+{
+  GtkCssNode *node1, *node2, *node3;
+  GtkCssStyle *style1, *style2, *style3;
+
+  node1 = create_node ("a", NULL);
+  node2 = create_node ("b", NULL);
+  node3 = create_node ("d", NULL);
+
+  style1 = gtk_css_node_get_style (node1);
+  style2 = gtk_css_node_get_style (node2);
+  style3 = gtk_css_node_get_style (node3);
+
+  g_assert_true (gtk_css_style_get_value (style1, GTK_CSS_PROPERTY_BOX_SHADOW) ==
+                 gtk_css_style_get_value (style2, GTK_CSS_PROPERTY_BOX_SHADOW));
+  g_assert_true (gtk_css_style_get_value (style1, GTK_CSS_PROPERTY_TEXT_SHADOW) ==
+                 gtk_css_style_get_value (style2, GTK_CSS_PROPERTY_TEXT_SHADOW));
+  g_assert_false (gtk_css_style_get_value (style1, GTK_CSS_PROPERTY_BOX_SHADOW) ==
+                  gtk_css_style_get_value (style3, GTK_CSS_PROPERTY_BOX_SHADOW));
+
+  g_object_unref (node1);
+  g_object_unref (node2);
+  g_object_unref (node3);
+}
+
+static void
+test_groups (void)
+{
+  GtkCssNode *node1, *node2, *node3;
+  GtkCssStyle *style1, *style2, *style3;
+
+  node1 = create_node ("a", NULL);
+  node2 = create_node ("b", NULL);
+  node3 = create_node ("d", NULL);
+
+  style1 = gtk_css_node_get_style (node1);
+  style2 = gtk_css_node_get_style (node2);
+  style3 = gtk_css_node_get_style (node3);
+
+  /* box-shadow is the only value of the group that is set */
+  g_assert_true (style1->background == style2->background);
+  g_assert_false (style1->background == style3->background);
+
+  g_object_unref (node1);
+  g_object_unref (node2);
+  g_object_unref (node3);
+}
+
+static void
+test_change (void)
+{
+  GtkCssNode *node;
+  GtkCssStyle *old_style;
+  GtkCssStyleChange change;
+
+  node = create_node ("a", NULL);
+  old_style = g_object_ref (gtk_css_node_get_style (node));
+
+  gtk_css_node_add_class (node, g_quark_from_string ("c"));
+
+  gtk_css_style_change_init (&change, old_style, gtk_css_node_get_style (node));
+  g_assert_true (gtk_css_style_change_changes_property (&change, GTK_CSS_PROPERTY_OPACITY));
+  g_assert_false (gtk_css_style_change_changes_property (&change, GTK_CSS_PROPERTY_BOX_SHADOW));
+  g_assert_false (gtk_css_style_change_changes_property (&change, GTK_CSS_PROPERTY_TEXT_SHADOW));
+  gtk_css_style_change_finish (&change);
+
+  gtk_css_node_add_class (node, g_quark_from_string ("d"));
+
+  gtk_css_style_change_init (&change, old_style, gtk_css_node_get_style (node));
+  g_assert_true (gtk_css_style_change_changes_property (&change, GTK_CSS_PROPERTY_BOX_SHADOW));
+  gtk_css_style_change_finish (&change);
+
+  g_object_unref (old_style);
+  g_object_unref (node);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GtkCssProvider *provider;
+
+  gtk_test_init (&argc, &argv);
+
+  provider = gtk_css_provider_new ();
+  gtk_css_provider_load_from_data (provider, css, -1);
+  gtk_style_context_add_provider_for_display (gdk_display_get_default (),
+                                              GTK_STYLE_PROVIDER (provider),
+                                              GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+  g_object_unref (provider);
+
+  g_test_add_func ("/css/intern/values", test_values);
+  g_test_add_func ("/css/intern/groups", test_groups);
+  g_test_add_func ("/css/intern/change", test_change);
+
+  return g_test_run ();
+}
@@ -0,0 +1,110 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+#include "gdk/gdkparalleltaskprivate.h"
+#include "gtk/gtkcssnodeprivate.h"
+#include "gtk/gtkcssnumbervalueprivate.h"
+#include "gtk/gtkcsstypesprivate.h"
+
+/* Validates trees with GTK_CSS_THREADS set. Small trees are matched on
+ * the calling thread, big ones on the worker threads. Either way, the
+ * nodes must keep their references and get the right styles.
+ */
+
+static const char css[] =
+  ".odd { opacity: 0.5; }\n"
+  ".even { opacity: 0.25; }\n";
+
+static void
+validate_tree (guint n_children)
+{
+  GtkCssNode *root;
+  GtkCssNode **children;
+  guint i;
+
+  root = gtk_css_node_new ();
+  children = g_new (GtkCssNode *, n_children);
+
+  for (i = 0; i < n_children; i++)
+    {
+      children[i] = gtk_css_node_new ();
+      gtk_css_node_add_class (children[i], g_quark_from_static_string (i % 2 ? "odd" : "even"));
+      gtk_css_node_set_parent (children[i], root);
+      /* one reference is ours, one is the parent's */
+      g_assert_cmpuint (G_OBJECT (children[i])->ref_count, ==, 2);
+    }
+
+  gtk_css_node_validate (root);
+
+  for (i = 0; i < n_children; i++)
+    {
+      GtkCssStyle *style = gtk_css_node_get_style (children[i]);
+
+      g_assert_cmpuint (G_OBJECT (children[i])->ref_count, ==, 2);
+      g_assert_cmpfloat (_gtk_css_number_value_get (gtk_css_style_get_value (style, GTK_CSS_PROPERTY_OPACITY), 100),
+                         ==,
+                         i % 2 ? 0.5 : 0.25);
+    }
+
+  for (i = 0; i < n_children; i++)
+    {
+      gtk_css_node_set_parent (children[i], NULL);
+      g_object_unref (children[i]);
+    }
+
+  g_free (children);
+  g_object_unref (root);
+}
+
+static void
+test_small (void)
+{
+  validate_tree (10);
+}
+
+static void
+test_big (void)
+{
+  if (gdk_parallel_task_get_max_tasks () < 2)
+    {
+      g_test_skip ("No worker threads on this machine");
+      return;
+    }
+
+  validate_tree (1000);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GtkCssProvider *provider;
+
+  g_setenv ("GTK_CSS_THREADS", "-1", TRUE);
+
+  gtk_test_init (&argc, &argv);
+
+  provider = gtk_css_provider_new ();
+  gtk_css_provider_load_from_data (provider, css, -1);
+  gtk_style_context_add_provider_for_display (gdk_display_get_default (),
+                                              GTK_STYLE_PROVIDER (provider),
+                                              GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+  g_object_unref (provider);
+
+  g_test_add_func ("/css/threads/small", test_small);
+  g_test_add_func ("/css/threads/big", test_big);
+
+  return g_test_run ();
+}
@@ -1,4 +1,5 @@
 #include <locale.h>
+#include <string.h>
 #include <gdk/gdk.h>
 
 /* maximum bytes per pixel */
@@ -172,6 +173,99 @@ test_download_4x4_with_stride (gconstpointer data)
   g_object_unref (test);
 }
 
+/* The order of the channels in each format, for the reference conversion */
+static const char *channel_order[GDK_MEMORY_N_FORMATS] = {
+  "bgra", "argb", "BGRA", "ARGB", "RGBA", "ABGR", "RGB", "BGR"
+};
+
+/* Converts one pixel to GDK_MEMORY_DEFAULT, one byte at a time.
+ * Upper case channels are not premultiplied yet */
+static void
+convert_pixel (guchar          *dest,
+               const guchar    *src,
+               GdkMemoryFormat  format)
+{
+  const char *order = channel_order[format];
+  guint c[4] = { 0, 0, 0, 255 };
+  gboolean premultiply = FALSE;
+  guint i, t;
+
+  for (i = 0; order[i]; i++)
+    {
+      const char *channels = "rgba";
+      const char *channels_upper = "RGBA";
+
+      if (strchr (channels_upper, order[i]))
+        {
+          premultiply = TRUE;
+          c[strchr (channels_upper, order[i]) - channels_upper] = src[i];
+        }
+      else
+        c[strchr (channels, order[i]) - channels] = src[i];
+    }
+
+  if (premultiply && strlen (order) == 4)
+    {
+      for (i = 0; i < 3; i++)
+        {
+          t = c[i] * c[3] + 0x80;
+          c[i] = ((t >> 8) + t) >> 8;
+        }
+    }
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  dest[0] = c[2]; dest[1] = c[1]; dest[2] = c[0]; dest[3] = c[3];
+#else
+  dest[0] = c[3]; dest[1] = c[0]; dest[2] = c[1]; dest[3] = c[2];
+#endif
+}
+
+/* Random data at sizes that don't fill the vectors, and large enough
+ * to be converted by several threads */
+static void
+test_download_random (gconstpointer data)
+{
+  GdkMemoryFormat format = GPOINTER_TO_INT (data);
+  const int sizes[][2] = { { 1, 1 }, { 7, 3 }, { 9, 5 }, { 31, 17 }, { 601, 457 } };
+  gsize bpp = tests[format].bytes_per_pixel;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      int width = sizes[i][0];
+      int height = sizes[i][1];
+      gsize stride = width * bpp + 3;
+      GdkTexture *texture;
+      guchar *src, *expected, *test;
+      GBytes *bytes;
+      gsize j;
+      int x, y;
+
+      src = g_malloc (height * stride);
+      for (j = 0; j < height * stride; j++)
+        src[j] = g_test_rand_int_range (0, 256);
+
+      expected = g_malloc (width * height * 4);
+      for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+          convert_pixel (expected + 4 * (y * width + x), src + y * stride + x * bpp, format);
+
+      bytes = g_bytes_new_take (src, height * stride);
+      texture = gdk_memory_texture_new (width, height, format, bytes, stride);
+      g_bytes_unref (bytes);
+
+      test = g_malloc (width * height * 4);
+      gdk_texture_download (texture, test, width * 4);
+
+      for (x = 0; x < width * height; x++)
+        g_assert_cmpmem (expected + 4 * x, 4, test + 4 * x, 4);
+
+      g_object_unref (texture);
+      g_free (expected);
+      g_free (test);
+    }
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -225,5 +319,13 @@ main (int argc, char *argv[])
         }
     }
 
+  for (format = 0; format < GDK_MEMORY_N_FORMATS; format++)
+    {
+      char *test_name = g_strdup_printf ("/memorytexture/download_random/%s",
+                                         g_enum_get_value (enum_class, format)->value_nick);
+      g_test_add_data_func (test_name, GINT_TO_POINTER (format), test_download_random);
+      g_free (test_name);
+    }
+
   return g_test_run ();
 }
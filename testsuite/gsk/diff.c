@@ -0,0 +1,205 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gtk/gtk.h>
+#include "gsk/gskrendernodeprivate.h"
+
+/* Builds the same tree every time it is called, except for the
+ * color of the one color node given by @changed. The tree contains
+ * nodes that can't be diffed by themselves, like color matrix and
+ * repeat nodes.
+ */
+static GskRenderNode *
+create_tree (int changed)
+{
+  GskRenderNode *children[10];
+  GskRenderNode *node, *child;
+  graphene_matrix_t matrix;
+  GskTransform *transform;
+  int i;
+
+  for (i = 0; i < 10; i++)
+    {
+      child = gsk_color_node_new (&(GdkRGBA) { 1, i == changed ? 1 : 0, 0, 1 },
+                                  &GRAPHENE_RECT_INIT (0, 0, 10, 10));
+
+      transform = gsk_transform_translate (NULL, &GRAPHENE_POINT_INIT (20 * i, 0));
+      node = gsk_transform_node_new (child, transform);
+      gsk_transform_unref (transform);
+      gsk_render_node_unref (child);
+
+      children[i] = node;
+    }
+
+  child = gsk_container_node_new (children, 10);
+  for (i = 0; i < 10; i++)
+    gsk_render_node_unref (children[i]);
+
+  graphene_matrix_init_scale (&matrix, 0.5, 0.5, 0.5);
+  node = gsk_color_matrix_node_new (child, &matrix, graphene_vec4_zero ());
+  gsk_render_node_unref (child);
+
+  child = gsk_repeat_node_new (&GRAPHENE_RECT_INIT (0, 0, 200, 100),
+                               node,
+                               &GRAPHENE_RECT_INIT (0, 0, 200, 10));
+  gsk_render_node_unref (node);
+
+  return child;
+}
+
+static void
+test_hash_equal (void)
+{
+  GskRenderNode *node1, *node2, *node3;
+
+  node1 = create_tree (-1);
+  node2 = create_tree (-1);
+  node3 = create_tree (3);
+
+  g_assert_true (gsk_render_node_get_hash (node1) != 0);
+  g_assert_true (gsk_render_node_get_hash (node1) == gsk_render_node_get_hash (node2));
+  g_assert_true (gsk_render_node_get_hash (node1) != gsk_render_node_get_hash (node3));
+
+  gsk_render_node_unref (node1);
+  gsk_render_node_unref (node2);
+  gsk_render_node_unref (node3);
+}
+
+static void
+test_hash_texture (void)
+{
+  GskRenderNode *node1, *node2, *node3;
+  GdkTexture *texture1, *texture2;
+  GBytes *bytes;
+  guchar data[4] = { 255, 0, 0, 255 };
+
+  bytes = g_bytes_new (data, sizeof (data));
+  texture1 = gdk_memory_texture_new (1, 1, GDK_MEMORY_DEFAULT, bytes, 4);
+  texture2 = gdk_memory_texture_new (1, 1, GDK_MEMORY_DEFAULT, bytes, 4);
+  g_bytes_unref (bytes);
+
+  /* Textures are compared by identity */
+  node1 = gsk_texture_node_new (texture1, &GRAPHENE_RECT_INIT (0, 0, 10, 10));
+  node2 = gsk_texture_node_new (texture1, &GRAPHENE_RECT_INIT (0, 0, 10, 10));
+  node3 = gsk_texture_node_new (texture2, &GRAPHENE_RECT_INIT (0, 0, 10, 10));
+
+  g_assert_true (gsk_render_node_get_hash (node1) == gsk_render_node_get_hash (node2));
+  g_assert_true (gsk_render_node_get_hash (node1) != gsk_render_node_get_hash (node3));
+
+  gsk_render_node_unref (node1);
+  gsk_render_node_unref (node2);
+  gsk_render_node_unref (node3);
+  g_object_unref (texture1);
+  g_object_unref (texture2);
+}
+
+static void
+test_equal (void)
+{
+  GskRenderNode *node1, *node2, *node3;
+
+  node1 = create_tree (-1);
+  node2 = create_tree (-1);
+  node3 = create_tree (3);
+
+  g_assert_true (gsk_render_node_equal (node1, node2));
+  g_assert_false (gsk_render_node_equal (node1, node3));
+
+  gsk_render_node_unref (node1);
+  gsk_render_node_unref (node2);
+  gsk_render_node_unref (node3);
+}
+
+static void
+test_diff_collision (void)
+{
+  GskRenderNode *node1, *node2;
+  cairo_region_t *region;
+
+  node1 = gsk_color_node_new (&(GdkRGBA) { 1, 0, 0, 1 }, &GRAPHENE_RECT_INIT (0, 0, 10, 10));
+  node2 = gsk_color_node_new (&(GdkRGBA) { 0, 1, 0, 1 }, &GRAPHENE_RECT_INIT (0, 0, 10, 10));
+  region = cairo_region_create ();
+
+  /* Pretend the hashes collide, the contents must still be compared */
+  node2->hash = gsk_render_node_get_hash (node1);
+  g_assert_false (gsk_render_node_equal (node1, node2));
+
+  gsk_render_node_diff (node1, node2, region);
+  g_assert_false (cairo_region_is_empty (region));
+
+  cairo_region_destroy (region);
+  gsk_render_node_unref (node1);
+  gsk_render_node_unref (node2);
+}
+
+static void
+test_diff_rebuilt (void)
+{
+  GskRenderNode *node1, *node2;
+  cairo_region_t *region;
+
+  node1 = create_tree (-1);
+  node2 = create_tree (-1);
+  region = cairo_region_create ();
+
+  /* Without hashing, the color matrix node makes this the full area */
+  gsk_render_node_diff (node1, node2, region);
+  g_assert_true (cairo_region_is_empty (region));
+
+  cairo_region_destroy (region);
+  gsk_render_node_unref (node1);
+  gsk_render_node_unref (node2);
+}
+
+static void
+test_diff_changed (void)
+{
+  GskRenderNode *node1, *node2, *node3, *node4;
+  cairo_region_t *region;
+
+  node1 = gsk_color_node_new (&(GdkRGBA) { 1, 0, 0, 1 }, &GRAPHENE_RECT_INIT (0, 0, 10, 10));
+  node2 = gsk_color_node_new (&(GdkRGBA) { 0, 1, 0, 1 }, &GRAPHENE_RECT_INIT (0, 0, 10, 10));
+  node3 = gsk_blur_node_new (node1, 2);
+  node4 = gsk_blur_node_new (node2, 2);
+  region = cairo_region_create ();
+
+  /* Real changes must still be found */
+  gsk_render_node_diff (node3, node4, region);
+  g_assert_false (cairo_region_is_empty (region));
+
+  cairo_region_destroy (region);
+  gsk_render_node_unref (node1);
+  gsk_render_node_unref (node2);
+  gsk_render_node_unref (node3);
+  gsk_render_node_unref (node4);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  gtk_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/diff/hash-equal", test_hash_equal);
+  g_test_add_func ("/diff/hash-texture", test_hash_texture);
+  g_test_add_func ("/diff/equal", test_equal);
+  g_test_add_func ("/diff/collision", test_diff_collision);
+  g_test_add_func ("/diff/rebuilt", test_diff_rebuilt);
+  g_test_add_func ("/diff/changed", test_diff_changed);
+
+  return g_test_run ();
+}
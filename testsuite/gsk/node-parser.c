@@ -21,6 +21,7 @@
 #include "config.h"
 
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
 
 static char *
 test_get_reference_file (const char *node_file)
@@ -149,6 +150,218 @@ deserialize_error_func (const GtkCssSection *section,
   g_string_append_c (errors, '\n');
 }
 
+/* Checks that the binary format loads the same node as the
+ * text format. Cairo nodes are skipped, as they are stored
+ * as images in the binary format.
+ */
+static gboolean
+check_binary_roundtrip (GskRenderNode *node,
+                        GBytes        *text)
+{
+  GskRenderNode *loaded;
+  GMappedFile *mapped;
+  GBytes *bytes, *text2;
+  GError *error = NULL;
+  gboolean result = TRUE;
+  char *filename;
+  int fd;
+
+  if (g_strstr_len (g_bytes_get_data (text, NULL), g_bytes_get_size (text), "cairo {"))
+    return TRUE;
+
+  fd = g_file_open_tmp ("node-parser-XXXXXX.gskb", &filename, &error);
+  g_assert_no_error (error);
+  g_close (fd, NULL);
+
+  gsk_render_node_write_to_file (node, filename, &error);
+  g_assert_no_error (error);
+
+  mapped = g_mapped_file_new (filename, FALSE, &error);
+  g_assert_no_error (error);
+  bytes = g_mapped_file_get_bytes (mapped);
+  g_mapped_file_unref (mapped);
+
+  loaded = gsk_render_node_deserialize (bytes, NULL, NULL);
+  g_assert_nonnull (loaded);
+  g_bytes_unref (bytes);
+
+  text2 = gsk_render_node_serialize (loaded);
+  gsk_render_node_unref (loaded);
+
+  if (!g_bytes_equal (text, text2))
+    {
+      g_print ("Binary format doesn't roundtrip:\n%s\n",
+               (const char *) g_bytes_get_data (text2, NULL));
+      result = FALSE;
+    }
+
+  g_bytes_unref (text2);
+  g_unlink (filename);
+  g_free (filename);
+
+  return result;
+}
+
+/* Builds binary files by hand, following the layout of
+ * gsk/gskrendernodebinary.c, to check that invalid nodes
+ * make loading fail instead of being skipped.
+ */
+enum {
+  RECORD_STRING = 1,
+  RECORD_TEXTURE,
+  RECORD_NODE,
+  RECORD_ROOT
+};
+
+static void
+append_uint32 (GByteArray *array,
+               guint32     value)
+{
+  g_byte_array_append (array, (guint8 *) &value, sizeof (guint32));
+}
+
+static void
+append_floats (GByteArray *array,
+               guint       n_floats,
+               ...)
+{
+  va_list args;
+  guint i;
+
+  va_start (args, n_floats);
+  for (i = 0; i < n_floats; i++)
+    {
+      float f = va_arg (args, double);
+
+      g_byte_array_append (array, (guint8 *) &f, sizeof (float));
+    }
+  va_end (args);
+}
+
+static GByteArray *
+binary_new (void)
+{
+  GByteArray *data = g_byte_array_new ();
+
+  g_byte_array_append (data, (guint8 *) "\x89GSKNODE", 8);
+  append_uint32 (data, 1); /* version */
+  append_uint32 (data, 0x01020304); /* byte order */
+
+  return data;
+}
+
+static void
+binary_add_record (GByteArray *data,
+                   guint32     tag,
+                   GByteArray *payload)
+{
+  append_uint32 (data, tag);
+  append_uint32 (data, payload->len);
+  g_byte_array_append (data, payload->data, payload->len);
+  g_byte_array_unref (payload);
+}
+
+/* Adds a color node, which will have the next node index */
+static void
+binary_add_color_node (GByteArray *data)
+{
+  GByteArray *payload = g_byte_array_new ();
+
+  append_uint32 (payload, GSK_COLOR_NODE);
+  append_floats (payload, 8, 0., 0., 10., 10., 1., 0., 0., 1.);
+  binary_add_record (data, RECORD_NODE, payload);
+}
+
+static void
+binary_add_root (GByteArray *data,
+                 guint32     index)
+{
+  GByteArray *payload = g_byte_array_new ();
+
+  append_uint32 (payload, index);
+  binary_add_record (data, RECORD_ROOT, payload);
+}
+
+static gboolean
+check_binary_error (const char *name,
+                    GByteArray *data)
+{
+  GskRenderNode *node;
+  GString *errors;
+  GBytes *bytes;
+  gboolean result = TRUE;
+
+  errors = g_string_new ("");
+  bytes = g_byte_array_free_to_bytes (data);
+
+  node = gsk_render_node_deserialize (bytes, deserialize_error_func, errors);
+  if (node != NULL)
+    {
+      g_print ("%s: invalid binary file was loaded\n", name);
+      gsk_render_node_unref (node);
+      result = FALSE;
+    }
+  else if (errors->len == 0)
+    {
+      g_print ("%s: loading invalid binary file reported no error\n", name);
+      result = FALSE;
+    }
+
+  g_bytes_unref (bytes);
+  g_string_free (errors, TRUE);
+
+  return result;
+}
+
+static gboolean
+test_binary_errors (void)
+{
+  GByteArray *data, *payload;
+  gboolean result = TRUE;
+
+  data = binary_new ();
+  payload = g_byte_array_new ();
+  append_uint32 (payload, GSK_LINEAR_GRADIENT_NODE);
+  append_floats (payload, 8, 0., 0., 10., 10., 0., 0., 10., 0.);
+  append_uint32 (payload, 1);
+  append_floats (payload, 5, 0., 1., 0., 0., 1.);
+  binary_add_record (data, RECORD_NODE, payload);
+  binary_add_root (data, 0);
+  result &= check_binary_error ("gradient with one stop", data);
+
+  data = binary_new ();
+  payload = g_byte_array_new ();
+  append_uint32 (payload, GSK_LINEAR_GRADIENT_NODE);
+  append_floats (payload, 8, 0., 0., 10., 10., 0., 0., 10., 0.);
+  append_uint32 (payload, 2);
+  append_floats (payload, 10, 0.5, 1., 0., 0., 1., 0.25, 0., 0., 1., 1.);
+  binary_add_record (data, RECORD_NODE, payload);
+  binary_add_root (data, 0);
+  result &= check_binary_error ("gradient with unsorted stops", data);
+
+  data = binary_new ();
+  binary_add_color_node (data);
+  payload = g_byte_array_new ();
+  append_uint32 (payload, GSK_SHADOW_NODE);
+  append_uint32 (payload, 0); /* child */
+  append_uint32 (payload, 0); /* shadows */
+  binary_add_record (data, RECORD_NODE, payload);
+  binary_add_root (data, 1);
+  result &= check_binary_error ("shadow without shadows", data);
+
+  data = binary_new ();
+  binary_add_color_node (data);
+  payload = g_byte_array_new ();
+  append_uint32 (payload, GSK_TRANSFORM_NODE);
+  append_uint32 (payload, 0); /* child */
+  append_uint32 (payload, G_MAXUINT32); /* no string */
+  binary_add_record (data, RECORD_NODE, payload);
+  binary_add_root (data, 0);
+  result &= check_binary_error ("transform without transform", data);
+
+  return result;
+}
+
 static gboolean
 parse_node_file (GFile *file, gboolean generate)
 {
@@ -173,16 +386,19 @@ parse_node_file (GFile *file, gboolean generate)
   node = gsk_render_node_deserialize (bytes, deserialize_error_func, errors);
   g_bytes_unref (bytes);
   bytes = gsk_render_node_serialize (node);
-  gsk_render_node_unref (node);
 
   if (generate)
     {
       g_print ("%s", (char *) g_bytes_get_data (bytes, NULL));
+      gsk_render_node_unref (node);
       g_bytes_unref (bytes);
       g_string_free (errors, TRUE);
       return TRUE;
     }
 
+  result &= check_binary_roundtrip (node, bytes);
+  gsk_render_node_unref (node);
+
   node_file = g_file_get_path (file);
   reference_file = test_get_reference_file (node_file);
 
@@ -318,9 +534,14 @@ main (int argc, char **argv)
       basedir = g_test_get_dir (G_TEST_DIST);
       dir = g_file_new_for_path (basedir);
       success = test_files_in_directory (dir);
+      success &= test_binary_errors ();
 
       g_object_unref (dir);
     }
+  else if (strcmp (argv[1], "--binary-errors") == 0)
+    {
+      success = test_binary_errors ();
+    }
   else if (strcmp (argv[1], "--generate") == 0)
     {
       if (argc >= 3)
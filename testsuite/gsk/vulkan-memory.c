@@ -0,0 +1,246 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gtk/gtk.h>
+#include "gsk/vulkan/gskvulkanmemoryprivate.h"
+
+/* Every test starts with a fresh allocator and releases it at the
+ * end, which also checks that all memory has been given back.
+ */
+
+static GdkVulkanContext *context;
+
+static GskVulkanMemory *
+alloc (VkDeviceSize         size,
+       VkDeviceSize         alignment,
+       GskVulkanMemoryFlags flags)
+{
+  return gsk_vulkan_memory_new (context,
+                                &(VkMemoryRequirements) {
+                                    .size = size,
+                                    .alignment = alignment,
+                                    .memoryTypeBits = ~0u
+                                },
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                flags);
+}
+
+static gboolean
+has_vulkan (void)
+{
+  if (context == NULL)
+    {
+      g_test_skip ("No Vulkan support");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static guint
+get_n_blocks (void)
+{
+  GskVulkanMemoryStats stats;
+
+  gsk_vulkan_memory_get_stats (context, &stats);
+
+  return stats.n_blocks;
+}
+
+static void
+test_suballocate (void)
+{
+  GskVulkanMemory *a, *b;
+
+  if (!has_vulkan ())
+    return;
+
+  a = alloc (1024, 256, 0);
+  b = alloc (1024, 256, 0);
+
+  g_assert_true (gsk_vulkan_memory_get_device_memory (a) == gsk_vulkan_memory_get_device_memory (b));
+  g_assert_cmpuint (gsk_vulkan_memory_get_offset (a), ==, 0);
+  g_assert_cmpuint (gsk_vulkan_memory_get_offset (b), ==, 1024);
+  g_assert_cmpuint (get_n_blocks (), ==, 1);
+
+  gsk_vulkan_memory_free (a);
+  gsk_vulkan_memory_free (b);
+
+  /* The empty block is kept around */
+  g_assert_cmpuint (get_n_blocks (), ==, 1);
+
+  gsk_vulkan_memory_release (context);
+}
+
+static void
+test_reuse (void)
+{
+  GskVulkanMemory *a, *b, *c, *d;
+
+  if (!has_vulkan ())
+    return;
+
+  a = alloc (4096, 1, 0);
+  b = alloc (4096, 1, 0);
+  c = alloc (4096, 1, 0);
+
+  /* The hole left by b gets filled again */
+  gsk_vulkan_memory_free (b);
+  d = alloc (4096, 1, 0);
+  g_assert_cmpuint (gsk_vulkan_memory_get_offset (d), ==, 4096);
+
+  /* Freeing a and d merges their ranges, so twice the size fits */
+  gsk_vulkan_memory_free (a);
+  gsk_vulkan_memory_free (d);
+  a = alloc (8192, 1, 0);
+  g_assert_cmpuint (gsk_vulkan_memory_get_offset (a), ==, 0);
+  g_assert_cmpuint (get_n_blocks (), ==, 1);
+
+  gsk_vulkan_memory_free (a);
+  gsk_vulkan_memory_free (c);
+
+  gsk_vulkan_memory_release (context);
+}
+
+static void
+test_alignment (void)
+{
+  GskVulkanMemory *a, *b, *c;
+
+  if (!has_vulkan ())
+    return;
+
+  a = alloc (100, 1, 0);
+  b = alloc (100, 256, 0);
+  g_assert_cmpuint (gsk_vulkan_memory_get_offset (b), ==, 256);
+
+  /* The padding in front of b is still free */
+  c = alloc (100, 4, 0);
+  g_assert_cmpuint (gsk_vulkan_memory_get_offset (c), ==, 100);
+
+  gsk_vulkan_memory_free (a);
+  gsk_vulkan_memory_free (b);
+  gsk_vulkan_memory_free (c);
+
+  gsk_vulkan_memory_release (context);
+}
+
+static void
+test_transient (void)
+{
+  GskVulkanMemory *a, *b;
+
+  if (!has_vulkan ())
+    return;
+
+  a = alloc (1000, 1, GSK_VULKAN_MEMORY_TRANSIENT);
+  b = alloc (1000, 16, GSK_VULKAN_MEMORY_TRANSIENT);
+  g_assert_cmpuint (gsk_vulkan_memory_get_offset (a), ==, 0);
+  g_assert_cmpuint (gsk_vulkan_memory_get_offset (b), ==, 1008);
+
+  /* Transient blocks only start over once they are empty */
+  gsk_vulkan_memory_free (a);
+  a = alloc (1000, 1, GSK_VULKAN_MEMORY_TRANSIENT);
+  g_assert_cmpuint (gsk_vulkan_memory_get_offset (a), ==, 2008);
+
+  gsk_vulkan_memory_free (a);
+  gsk_vulkan_memory_free (b);
+  a = alloc (1000, 1, GSK_VULKAN_MEMORY_TRANSIENT);
+  g_assert_cmpuint (gsk_vulkan_memory_get_offset (a), ==, 0);
+  g_assert_cmpuint (get_n_blocks (), ==, 1);
+
+  gsk_vulkan_memory_free (a);
+
+  gsk_vulkan_memory_release (context);
+}
+
+static void
+test_dedicated (void)
+{
+  GskVulkanMemory *a, *b;
+
+  if (!has_vulkan ())
+    return;
+
+  a = alloc (1024, 1, 0);
+  b = alloc (8 * 1024 * 1024, 1, 0);
+
+  g_assert_false (gsk_vulkan_memory_get_device_memory (a) == gsk_vulkan_memory_get_device_memory (b));
+  g_assert_cmpuint (gsk_vulkan_memory_get_offset (b), ==, 0);
+  g_assert_cmpuint (get_n_blocks (), ==, 2);
+
+  /* Dedicated blocks go away right away */
+  gsk_vulkan_memory_free (b);
+  g_assert_cmpuint (get_n_blocks (), ==, 1);
+
+  gsk_vulkan_memory_free (a);
+
+  gsk_vulkan_memory_release (context);
+}
+
+static void
+test_optimal (void)
+{
+  GskVulkanMemory *a, *b;
+
+  if (!has_vulkan ())
+    return;
+
+  /* Linear and optimal resources never share a block */
+  a = alloc (1024, 1, 0);
+  b = alloc (1024, 1, GSK_VULKAN_MEMORY_OPTIMAL_TILING);
+
+  g_assert_false (gsk_vulkan_memory_get_device_memory (a) == gsk_vulkan_memory_get_device_memory (b));
+  g_assert_cmpuint (get_n_blocks (), ==, 2);
+
+  gsk_vulkan_memory_free (a);
+  gsk_vulkan_memory_free (b);
+
+  gsk_vulkan_memory_release (context);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GdkSurface *surface;
+  GError *error = NULL;
+  int result;
+
+  gtk_test_init (&argc, &argv);
+
+  surface = gdk_surface_new_toplevel (gdk_display_get_default (), 10, 10);
+  context = gdk_surface_create_vulkan_context (surface, &error);
+  if (context == NULL)
+    {
+      g_test_message ("No Vulkan: %s", error->message);
+      g_clear_error (&error);
+    }
+
+  g_test_add_func ("/vulkan/memory/suballocate", test_suballocate);
+  g_test_add_func ("/vulkan/memory/reuse", test_reuse);
+  g_test_add_func ("/vulkan/memory/alignment", test_alignment);
+  g_test_add_func ("/vulkan/memory/transient", test_transient);
+  g_test_add_func ("/vulkan/memory/dedicated", test_dedicated);
+  g_test_add_func ("/vulkan/memory/optimal", test_optimal);
+
+  result = g_test_run ();
+
+  g_clear_object (&context);
+  gdk_surface_destroy (surface);
+
+  return result;
+}
@@ -0,0 +1,161 @@
+/* Measures the time from realizing a GskGLRenderer to having its first
+ * frame rendered, once with an empty program binary cache and once
+ * with the cache filled by a previous run.
+ *
+ * Every measurement runs in a new process, since programs are shared
+ * by all renderers of a display.
+ */
+
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+
+#include "run-stats.h"
+
+static gboolean opt_child;
+
+static GOptionEntry options[] = {
+  { "child", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &opt_child, NULL, NULL },
+  { NULL }
+};
+
+static int
+run_child (void)
+{
+  GError *error = NULL;
+  GdkSurface *surface;
+  GskRenderer *renderer;
+  GskRenderNode *node;
+  GdkTexture *texture;
+  gint64 start, end;
+
+  gtk_init ();
+
+  surface = gdk_surface_new_toplevel (gdk_display_get_default (), 10, 10);
+  renderer = gsk_gl_renderer_new ();
+  node = gsk_color_node_new (&(GdkRGBA) { 1, 0, 0, 1 },
+                             &GRAPHENE_RECT_INIT (0, 0, 100, 100));
+
+  start = g_get_monotonic_time ();
+
+  if (!gsk_renderer_realize (renderer, surface, &error))
+    {
+      g_printerr ("Failed to realize the GL renderer: %s\n", error->message);
+      return 1;
+    }
+
+  /* Downloading the texture makes sure the GPU is done as well */
+  texture = gsk_renderer_render_texture (renderer, node, NULL);
+
+  end = g_get_monotonic_time ();
+
+  g_print ("%" G_GINT64_FORMAT "\n", end - start);
+
+  g_object_unref (texture);
+  gsk_render_node_unref (node);
+  gsk_renderer_unrealize (renderer);
+  g_object_unref (renderer);
+  g_object_unref (surface);
+
+  return 0;
+}
+
+/* Returns the time of the child in msec */
+static double
+spawn_child (const char *argv0,
+             const char *cache_dir)
+{
+  GSubprocessLauncher *launcher;
+  GSubprocess *subprocess;
+  GError *error = NULL;
+  char *output;
+  double msec;
+
+  launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE);
+  g_subprocess_launcher_setenv (launcher, "XDG_CACHE_HOME", cache_dir, TRUE);
+  /* Otherwise Mesa's own shader cache makes cold runs warm */
+  g_subprocess_launcher_setenv (launcher, "MESA_SHADER_CACHE_DISABLE", "true", TRUE);
+
+  subprocess = g_subprocess_launcher_spawn (launcher, &error, argv0, "--child", NULL);
+  if (subprocess == NULL)
+    g_error ("Launch child: %s", error->message);
+
+  if (!g_subprocess_communicate_utf8 (subprocess, NULL, NULL, &output, NULL, &error))
+    g_error ("Run child: %s", error->message);
+
+  if (!g_subprocess_get_successful (subprocess))
+    g_error ("Child process failed");
+
+  msec = (double) g_ascii_strtoll (output, NULL, 10) / G_TIME_SPAN_MILLISECOND;
+
+  g_free (output);
+  g_object_unref (subprocess);
+  g_object_unref (launcher);
+
+  return msec;
+}
+
+static void
+remove_recursively (const char *path)
+{
+  GDir *dir;
+  const char *name;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)))
+        {
+          char *child = g_build_filename (path, name, NULL);
+          remove_recursively (child);
+          g_free (child);
+        }
+      g_dir_close (dir);
+    }
+
+  g_remove (path);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *option_context;
+  GError *error = NULL;
+  RunStats cold, warm;
+  char *cache_dir;
+  int run;
+
+  option_context = g_option_context_new ("");
+  g_option_context_add_main_entries (option_context, options, NULL);
+  run_stats_add_options (g_option_context_get_main_group (option_context));
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("Option parsing failed: %s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (option_context);
+
+  if (opt_child)
+    return run_child ();
+
+  run_stats_init (&cold, "Cold cache");
+  run_stats_init (&warm, "Warm cache");
+
+  for (run = 0; run < run_stats_get_runs (); run++)
+    {
+      cache_dir = g_dir_make_tmp ("gsk-gl-startup-XXXXXX", &error);
+      if (cache_dir == NULL)
+        g_error ("Creating cache dir: %s", error->message);
+
+      /* The first run fills the cache for the second one */
+      run_stats_add (&cold, spawn_child (argv[0], cache_dir));
+      run_stats_add (&warm, spawn_child (argv[0], cache_dir));
+
+      remove_recursively (cache_dir);
+      g_free (cache_dir);
+    }
+
+  run_stats_print (&cold);
+  run_stats_print (&warm);
+
+  return 0;
+}